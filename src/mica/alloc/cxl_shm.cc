@@ -6,6 +6,8 @@
 #include <cstring>
 #include <algorithm>
 #include <linux/limits.h>
+#include <thread>
+#include <unordered_map>
 #include "mica/util/barrier.h"
 #include "mica/util/lcore.h"
 #include "mica/util/safe_cast.h"
@@ -76,6 +78,7 @@ CXL_SHM::CXL_SHM(const ::mica::util::Config& config) : config_(config) {
   }
 
   clean_files_on_init_ = config.get("clean_files_on_init").get_bool(false);
+  init_threads_per_node_ = config.get("init_threads_per_node").get_uint64(4);
   verbose_ = config.get("verbose").get_bool(false);
 
   state_lock_ = 0;
@@ -106,27 +109,70 @@ void CXL_SHM::initialize() {
     clean_files();
   }
 
-  size_t next_file_id = 0;
-  size_t num_allocated_pages = 0;
+  // Page i goes to CXL node i % num_cxl_nodes_, as before; each node is
+  // filled by its own workers so that faulting in pages runs in parallel.
+  size_t threads_per_node = std::max(init_threads_per_node_, size_t(1));
+  std::vector<std::vector<Page>> worker_pages(num_cxl_nodes_ *
+                                              threads_per_node);
+  std::vector<size_t> worker_reused(worker_pages.size(), 0);
+
+  if (init_threads_per_node_ == 0) {
+    for (size_t cxl_node = 0; cxl_node < num_cxl_nodes_; cxl_node++)
+      init_pages_on_node(cxl_node, 0, 1, &worker_pages[cxl_node],
+                         &worker_reused[cxl_node]);
+  } else {
+    std::vector<std::thread> threads;
+    for (size_t cxl_node = 0; cxl_node < num_cxl_nodes_; cxl_node++)
+      for (size_t i = 0; i < threads_per_node; i++) {
+        size_t worker_id = cxl_node * threads_per_node + i;
+        threads.emplace_back(&CXL_SHM::init_pages_on_node, this, cxl_node, i,
+                             threads_per_node, &worker_pages[worker_id],
+                             &worker_reused[worker_id]);
+      }
+    for (auto& t : threads) t.join();
+  }
 
-  for (size_t page_id = 0; page_id < num_pages_to_init_; page_id++) {
-    if (verbose_ && page_id % 1000 == 0) {
-      printf("allocating CXL page %zu/%zu\n", page_id, num_pages_to_init_);
-      fflush(stdout);
-    }
+  size_t num_reused_pages = 0;
+  for (size_t i = 0; i < worker_pages.size(); i++) {
+    pages_.insert(pages_.end(), worker_pages[i].begin(),
+                  worker_pages[i].end());
+    num_reused_pages += worker_reused[i];
+  }
+  std::sort(pages_.begin(), pages_.end(), [](const Page& a, const Page& b) {
+    return a.file_id < b.file_id;
+  });
+
+  if (verbose_)
+    printf("allocated %zu CXL pages (%zu reused)\n", pages_.size(),
+           num_reused_pages);
+}
 
-    size_t file_id = next_file_id++;
+void CXL_SHM::init_pages_on_node(size_t cxl_node, size_t thread_index,
+                                 size_t thread_count, std::vector<Page>* out,
+                                 size_t* out_reused) {
+  size_t stride = num_cxl_nodes_ * thread_count;
+  for (size_t page_id = cxl_node + num_cxl_nodes_ * thread_index;
+       page_id < num_pages_to_init_; page_id += stride) {
+    size_t file_id = page_id;
     char path[PATH_MAX];
     make_path(file_id, path);
 
-    int fd = open(path, O_CREAT | O_RDWR, 0755);
+    // Reuse fast path: a file left by an earlier run already has its page.
+    bool reused = true;
+    int fd = open(path, O_RDWR);
+    if (fd == -1) {
+      reused = false;
+      fd = open(path, O_CREAT | O_RDWR, 0755);
+    }
     if (fd == -1) {
       perror("");
       fprintf(stderr, "error: could not open CXL file %s\n", path);
       break;
     }
 
-    void* p = mmap(nullptr, kPageSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    // MAP_POPULATE faults in the page within mmap(), replacing a touch.
+    void* p = mmap(nullptr, kPageSize, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd, 0);
     close(fd);
 
     if (p == MAP_FAILED) {
@@ -134,13 +180,9 @@ void CXL_SHM::initialize() {
       break;
     }
 
-    *(size_t*)p = 0;
-
-    pages_.push_back(Page{file_id, p, nullptr, page_id % num_cxl_nodes_, false});
-    num_allocated_pages++;
+    out->push_back(Page{file_id, p, nullptr, cxl_node, false});
+    if (reused) (*out_reused)++;
   }
-
-  if (verbose_) printf("allocated %zu CXL pages\n", num_allocated_pages);
 }
 
 void CXL_SHM::detect_cxl_topology() {
@@ -452,12 +494,16 @@ bool CXL_SHM::unmap(void* ptr) {
 }
 
 void* CXL_SHM::malloc_contiguous(size_t size, size_t lcore) {
-  size = CXL_SHM::roundup(size);
   size_t cxl_node = ::mica::util::lcore.numa_id(lcore);
   if (cxl_node == ::mica::util::lcore.kUnknown) {
     fprintf(stderr, "error: invalid lcore for CXL\n");
     return nullptr;
   }
+  return malloc_contiguous_on_node(size, cxl_node);
+}
+
+void* CXL_SHM::malloc_contiguous_on_node(size_t size, size_t cxl_node) {
+  size = CXL_SHM::roundup(size);
 
   size_t entry_id = alloc(size, cxl_node);
   if (entry_id == kInvalidId) return nullptr;
@@ -484,6 +530,90 @@ void CXL_SHM::free_contiguous(void* ptr) {
   unmap(ptr);
 }
 
+bool CXL_SHM::contiguous_file_ids(const void* ptr, std::vector<size_t>* out) {
+  lock();
+  for (auto& mapping : mappings_) {
+    if (mapping.addr != ptr) continue;
+    auto& entry = entries_[mapping.entry_id];
+    out->clear();
+    for (size_t i = 0; i < mapping.num_pages; i++)
+      out->push_back(pages_[entry.page_ids[mapping.page_offset + i]].file_id);
+    unlock();
+    return true;
+  }
+  unlock();
+  return false;
+}
+
+void* CXL_SHM::attach_contiguous(void* addr,
+                                 const std::vector<size_t>& file_ids) {
+  if (file_ids.empty()) return nullptr;
+  size_t size = file_ids.size() * kPageSize;
+
+  // Keep the range for this region only if nothing else is there.
+  void* p = mmap(addr, size, PROT_NONE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (p == MAP_FAILED) return nullptr;
+  if (p != addr) {
+    munmap(p, size);
+    fprintf(stderr, "error: %p is not free for an attached region\n", addr);
+    return nullptr;
+  }
+
+  lock();
+
+  std::unordered_map<size_t, size_t> page_of_file;
+  for (size_t page_id = 0; page_id < pages_.size(); page_id++)
+    if (pages_[page_id].addr != nullptr && !pages_[page_id].in_use)
+      page_of_file[pages_[page_id].file_id] = page_id;
+
+  size_t entry_id;
+  for (entry_id = 0; entry_id < entries_.size(); entry_id++)
+    if (entries_[entry_id].page_ids.empty()) break;
+  if (entry_id == entries_.size())
+    entries_.push_back(Entry{0, false, 0, 0, std::vector<size_t>()});
+
+  auto& entry = entries_[entry_id];
+  for (auto file_id : file_ids) {
+    auto it = page_of_file.find(file_id);
+    if (it == page_of_file.end()) {
+      fprintf(stderr, "error: missing page file %zu\n", file_id);
+      entry.page_ids.clear();
+      unlock();
+      munmap(addr, size);
+      return nullptr;
+    }
+    entry.page_ids.push_back(it->second);
+    // A file listed twice is not a valid region.
+    page_of_file.erase(it);
+  }
+  entry.length = size;
+  entry.num_pages = file_ids.size();
+  for (auto page_id : entry.page_ids) pages_[page_id].in_use = true;
+
+  unlock();
+
+  // map() replaces the reservation page by page.
+  bool mapped = map(entry_id, addr, 0, size);
+  schedule_release(entry_id);
+  if (!mapped) {
+    munmap(addr, size);
+    return nullptr;
+  }
+  return addr;
+}
+
+std::vector<void*> CXL_SHM::find_pages(const void* prefix, size_t len) {
+  std::vector<void*> out;
+  lock();
+  for (auto& page : pages_)
+    if (page.addr != nullptr && !page.in_use &&
+        memcmp(page.addr, prefix, len) == 0)
+      out.push_back(page.addr);
+  unlock();
+  return out;
+}
+
 void* CXL_SHM::malloc_striped(size_t size) {
   size = CXL_SHM::roundup(size);
   size_t num_pages = size / kPageSize;
@@ -537,7 +667,7 @@ void CXL_SHM::free_striped(void* ptr) {
 
 void* CXL_SHM::malloc_contiguous_any(size_t size) {
   for (size_t cxl_node = 0; cxl_node < num_cxl_nodes_; cxl_node++) {
-    void* p = malloc_contiguous(size, cxl_node);
+    void* p = malloc_contiguous_on_node(size, cxl_node);
     if (p != nullptr) return p;
   }
   return nullptr;
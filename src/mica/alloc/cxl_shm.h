@@ -5,6 +5,7 @@
 #include "mica/common.h"
 #include "mica/util/config.h"
 #include "mica/util/roundup.h"
+#include <limits>
 #include <vector>
 #include <string>
 
@@ -28,12 +29,27 @@ class CXL_SHM {
   bool map(size_t entry_id, void* ptr, size_t offset, size_t length);
   bool unmap(void* ptr);
 
-  void* malloc_contiguous(size_t size, size_t cxl_node);
+  // Allocates on the NUMA node of the given lcore.
+  void* malloc_contiguous(size_t size, size_t lcore);
+  // Allocates on the given CXL node.
+  void* malloc_contiguous_on_node(size_t size, size_t cxl_node);
   void* malloc_contiguous_local(size_t size);
   void free_contiguous(void* ptr);
   void* malloc_striped(size_t size);
   void free_striped(void* ptr);
 
+  // Persistent regions.  A region that must outlive the process is mapped at
+  // the same address again after a restart from the files of its pages.
+  //
+  // Stores the file IDs of the pages of a region from malloc_contiguous*().
+  bool contiguous_file_ids(const void* ptr, std::vector<size_t>* out);
+  // Maps the pages of the given files contiguously at addr, which must be
+  // unused in this process, and marks them in use.  Free with
+  // free_contiguous().
+  void* attach_contiguous(void* addr, const std::vector<size_t>& file_ids);
+  // The initial mappings of the free pages whose content starts with prefix.
+  std::vector<void*> find_pages(const void* prefix, size_t len);
+
   size_t get_memuse() const { return used_memory_; }
   void dump_page_info();
 
@@ -72,6 +88,12 @@ class CXL_SHM {
     size_t num_pages;
   };
 
+  // Creates (or reuses) the pages of cxl_node that belong to the given
+  // worker thread of the node.
+  void init_pages_on_node(size_t cxl_node, size_t thread_index,
+                          size_t thread_count, std::vector<Page>* out,
+                          size_t* out_reused);
+
   ::mica::util::Config config_;
   std::string cxl_device_path_;
   std::string filename_prefix_;
@@ -80,6 +102,7 @@ class CXL_SHM {
   std::vector<size_t> num_pages_to_free_;
   std::vector<size_t> num_pages_to_reserve_;
   bool clean_files_on_init_;
+  size_t init_threads_per_node_;
   bool verbose_;
 
   uint64_t state_lock_;
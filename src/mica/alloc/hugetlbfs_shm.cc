@@ -12,6 +12,11 @@
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <linux/limits.h>
+#include <numa.h>
+#include <numaif.h>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 #include "mica/alloc/hugetlbfs_shm.h"
 #include "mica/util/roundup.h"
@@ -99,6 +104,91 @@ void HugeTLBFS_SHM::dump_page_info() {
   unlock();
 }
 
+void* HugeTLBFS_SHM::map_file(size_t file_id, bool create) {
+  char path[PATH_MAX];
+  make_path(file_id, path);
+
+  int fd = open(path, O_RDWR | (create ? O_CREAT : 0), 0755);
+  if (fd == -1) {
+    perror("");
+    fprintf(stderr, "error: could not open %s\n", path);
+    assert(false);
+    return nullptr;
+  }
+
+  // MAP_POPULATE faults in the page (and allocates it for a new file) within
+  // mmap(), so no separate touch is needed.
+  void* p = mmap(nullptr, kPageSize, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, fd, 0);
+
+  close(fd);
+
+  if (p == MAP_FAILED) {
+    unlink(path);
+    return nullptr;
+  }
+  return p;
+}
+
+void HugeTLBFS_SHM::map_existing_files(const std::vector<size_t>* file_ids,
+                                       size_t begin, size_t end,
+                                       std::vector<Page>* out) {
+  for (size_t i = begin; i < end; i++) {
+    size_t file_id = (*file_ids)[i];
+    void* p = map_file(file_id, false);
+    if (p == nullptr) continue;  // continue examining existing files
+    out->push_back(Page{file_id, p, nullptr, 0, false});
+  }
+}
+
+void HugeTLBFS_SHM::create_pages_on_node(size_t numa_node, size_t max_pages,
+                                         std::vector<Page>* out) {
+  // Zero the new pages with local CPUs if the node has any (CXL memory nodes
+  // do not), and prefer rather than bind so that an exhausted node falls back
+  // instead of failing the fault.
+  numa_run_on_node(static_cast<int>(numa_node));
+  numa_set_preferred(static_cast<int>(numa_node));
+
+  for (size_t i = 0; i < max_pages; i++) {
+    if (!claim_page_to_init()) break;
+
+    size_t file_id = __sync_fetch_and_add(&next_file_id_, size_t(1));
+    void* p = map_file(file_id, true);
+    if (p == nullptr) {
+      __sync_fetch_and_add(&num_pages_left_to_init_, size_t(1));
+      break;
+    }
+    out->push_back(Page{file_id, p, nullptr, numa_node, false});
+  }
+
+  if (verbose_)
+    printf("created %zu pages for numa node %zu\n", out->size(), numa_node);
+}
+
+bool HugeTLBFS_SHM::claim_page_to_init() {
+  while (true) {
+    size_t left = num_pages_left_to_init_;
+    if (left == 0) return false;
+    if (__sync_bool_compare_and_swap(&num_pages_left_to_init_, left, left - 1))
+      return true;
+  }
+}
+
+size_t HugeTLBFS_SHM::free_pages_on_node(size_t numa_node) {
+  char path[PATH_MAX];
+  snprintf(path, PATH_MAX,
+           "/sys/devices/system/node/node%zu/hugepages/hugepages-%zukB/"
+           "free_hugepages",
+           numa_node, kPageSize / 1024);
+  FILE* f = fopen(path, "r");
+  if (f == nullptr) return kInvalidId;  // Unknown; let the workers race.
+
+  size_t count;
+  if (fscanf(f, "%zu", &count) != 1) count = kInvalidId;
+  fclose(f);
+  return count;
+}
+
 HugeTLBFS_SHM::HugeTLBFS_SHM(const ::mica::util::Config& config)
     : config_(config) {
   // Parse the configuration.
@@ -182,6 +272,8 @@ HugeTLBFS_SHM::HugeTLBFS_SHM(const ::mica::util::Config& config)
   clean_other_files_on_init_ =
       config.get("clean_other_files_on_init").get_bool(true);
 
+  init_threads_per_node_ = config.get("init_threads_per_node").get_uint64(4);
+
   verbose_ = config.get("verbose").get_bool(false);
 
   initialize();
@@ -210,7 +302,8 @@ void HugeTLBFS_SHM::initialize() {
   if (verbose_) printf("initializing pages\n");
   size_t num_allocated_pages = 0;
 
-  // reuse all of existing files
+  // collect existing files to reuse
+  std::vector<size_t> existing_file_ids;
   DIR* d = opendir(hugetlbfs_path_.c_str());
 
   long name_max = pathconf(hugetlbfs_path_.c_str(), _PC_NAME_MAX);
@@ -218,8 +311,7 @@ void HugeTLBFS_SHM::initialize() {
   dirent* de = reinterpret_cast<dirent*>(malloc(
       offsetof(dirent, d_name) + static_cast<long unsigned int>(name_max) + 1));
 
-  size_t next_file_id = 0;
-  page_id = 0;
+  next_file_id_ = 0;
   while (true) {
     dirent* rde;
     if (readdir_r(d, de, &rde) != 0) break;
@@ -233,147 +325,108 @@ void HugeTLBFS_SHM::initialize() {
 
     size_t file_id =
         static_cast<size_t>(atoi(rde->d_name + filename_prefix_.size()));
-    char path[PATH_MAX];
-    make_path(file_id, path);
-
-    int fd = open(path, O_RDWR, 0755);
-    if (fd == -1) {
-      perror("");
-      fprintf(stderr, "error: could not open %s\n", path);
-      assert(false);
-      return;
-    }
-
-    void* p =
-        mmap(nullptr, kPageSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-
-    close(fd);
-
-    if (p == MAP_FAILED) {
-      unlink(path);
-      continue;  // continue examining existing files
-    }
-
-    // printf("got page %zu (address %p)\n", page_id, p);
-
-    // this is required to cause a page fault and invoke actual memory
-    // allocation
-    *(size_t*)p = 0;
-
-    assert(pages_.size() == page_id);
-    pages_.push_back(Page{0, nullptr, nullptr, 0, false});
-    pages_[page_id].file_id = file_id;
-    pages_[page_id].addr = p;
-    // printf("initial allocation of %zu on %p\n", kPageSize, p);
-
-    page_id++;
-    if (next_file_id <= file_id) next_file_id = file_id + 1;
+    existing_file_ids.push_back(file_id);
+    if (next_file_id_ <= file_id) next_file_id_ = file_id + 1;
   }
   closedir(d);
 
   free(de);
 
-  // create additional files
-  for (; page_id < num_pages_to_init_; page_id++) {
-    if (verbose_ && (page_id % 128 == 0)) {
-      printf("\r%zu / %zu", page_id + 1, num_pages_to_init_);
-      fflush(stdout);
+  size_t num_workers = numa_count * init_threads_per_node_;
+  std::vector<std::vector<Page>> worker_pages(std::max(num_workers, size_t(1)));
+
+  // Reuse all of existing files.  Their pages are already allocated (and
+  // zeroed) by an earlier run, so this is only mapping work.
+  if (num_workers == 0) {
+    map_existing_files(&existing_file_ids, 0, existing_file_ids.size(),
+                       &worker_pages[0]);
+  } else {
+    std::vector<std::thread> threads;
+    size_t per_worker = (existing_file_ids.size() + num_workers - 1) /
+                        num_workers;
+    for (size_t i = 0; i < num_workers; i++) {
+      size_t begin = std::min(i * per_worker, existing_file_ids.size());
+      size_t end = std::min(begin + per_worker, existing_file_ids.size());
+      threads.emplace_back(&HugeTLBFS_SHM::map_existing_files, this,
+                           &existing_file_ids, begin, end, &worker_pages[i]);
     }
+    for (auto& t : threads) t.join();
+  }
 
-    size_t file_id = next_file_id++;
-    char path[PATH_MAX];
-    make_path(file_id, path);
-
-    int fd = open(path, O_CREAT | O_RDWR, 0755);
-    if (fd == -1) {
-      perror("");
-      fprintf(stderr, "error: could not open %s\n", path);
-      assert(false);
-      return;
-    }
-
-    void* p =
-        mmap(nullptr, kPageSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-
-    close(fd);
-
-    if (p == MAP_FAILED) {
-      unlink(path);
-      break;
+  size_t num_reused_pages = 0;
+  for (auto& v : worker_pages) num_reused_pages += v.size();
+  if (verbose_) printf("reused %zu existing pages\n", num_reused_pages);
+
+  // Create additional files on each NUMA node in parallel.  Faulting in a new
+  // page zeroes 2 MiB, which is what makes a serial initialization slow.
+  num_pages_left_to_init_ = num_pages_to_init_ > num_reused_pages
+                                ? num_pages_to_init_ - num_reused_pages
+                                : 0;
+  if (num_workers != 0 && num_pages_left_to_init_ != 0) {
+    std::vector<std::thread> threads;
+    for (numa_node = 0; numa_node < numa_count; numa_node++) {
+      size_t free_pages = free_pages_on_node(numa_node);
+      for (size_t i = 0; i < init_threads_per_node_; i++) {
+        size_t max_pages = free_pages;
+        if (free_pages != kInvalidId) {
+          max_pages = free_pages / init_threads_per_node_;
+          if (i < free_pages % init_threads_per_node_) max_pages++;
+        }
+        threads.emplace_back(
+            &HugeTLBFS_SHM::create_pages_on_node, this, numa_node, max_pages,
+            &worker_pages[numa_node * init_threads_per_node_ + i]);
+      }
     }
+    for (auto& t : threads) t.join();
+  }
 
-    // printf("got page %zu (address %p)\n", page_id, p);
-
-    // this is required to cause a page fault and invoke actual memory
-    // allocation
-    *(size_t*)p = 0;
+  // Pick up whatever the per-node workers left (e.g., pages freed by other
+  // processes meanwhile, or all pages if parallel initialization is off).
+  while (claim_page_to_init()) {
+    size_t file_id = __sync_fetch_and_add(&next_file_id_, size_t(1));
+    void* p = map_file(file_id, true);
+    if (p == nullptr) break;
+    worker_pages[0].push_back(Page{file_id, p, nullptr, 0, false});
+  }
 
-    assert(pages_.size() == page_id);
-    pages_.push_back(Page{0, nullptr, nullptr, 0, false});
-    pages_[page_id].file_id = file_id;
-    pages_[page_id].addr = p;
-    // printf("initial allocation of %zu on %p\n", kPageSize, p);
+  for (auto& v : worker_pages) {
+    pages_.insert(pages_.end(), v.begin(), v.end());
+    std::vector<Page>().swap(v);
   }
-  num_allocated_pages = page_id;
+  num_allocated_pages = pages_.size();
 
   if (verbose_)
-    printf("\rinitial allocation of %zu pages\n", num_allocated_pages);
-
-  // sort by virtual address
-  if (verbose_) printf("sorting by virtual address\n");
-  std::sort(pages_.begin(), pages_.end(),
-            [](Page& a, Page& b) { return a.addr < b.addr; });
+    printf("initial allocation of %zu pages\n", num_allocated_pages);
 
   // detect numa socket
   if (verbose_) printf("detecting NUMA mapping\n");
-  FILE* f = fopen("/proc/self/numa_maps", "r");
-  if (f == nullptr) {
-    perror("");
-    fprintf(stderr, "error: could not open /proc/self/numa_maps\n");
-    assert(false);
-    return;
-  }
-
-  page_id = 0;
-  char buf[BUFSIZ];
-  while (true) {
-    if (fgets(buf, sizeof(buf), f) == nullptr) break;
-
-    size_t addr = strtoull(buf, nullptr, 16);
-    // for (page_id = 0; page_id < num_allocated_pages; page_id++)
-    if (page_id < num_allocated_pages) {
-      if (pages_[page_id].addr == (void*)addr) {
-        char* p = strstr(buf, " N");
-        if (p == nullptr) {
-          assert(false);
-          fprintf(stderr, "error: could not parse /proc/self/numa_maps\n");
-          return;
-        }
-
-        size_t numa_node;
-        size_t page_count;
-        if (sscanf(p, " N%zu=%zu", &numa_node, &page_count) != 2) {
-          assert(false);
-          return;
-        }
-        if (page_count != 1)
-          fprintf(stderr, "warning: page count for %p is expected to be 1\n",
-                  (void*)addr);
+  {
+    std::vector<void*> addrs(num_allocated_pages);
+    std::vector<int> status(num_allocated_pages, -1);
+    for (page_id = 0; page_id < num_allocated_pages; page_id++)
+      addrs[page_id] = pages_[page_id].addr;
+
+    // With no target nodes, move_pages() only reports where each page is.
+    if (num_allocated_pages != 0 &&
+        move_pages(0, num_allocated_pages, addrs.data(), nullptr,
+                   status.data(), 0) != 0) {
+      perror("");
+      fprintf(stderr, "error: could not query the NUMA node of pages\n");
+      assert(false);
+      return;
+    }
 
-        pages_[page_id].numa_node = numa_node;
-        // printf("%p is on numa node %zu\n", p, numa_node);
-        page_id++;
+    for (page_id = 0; page_id < num_allocated_pages; page_id++) {
+      if (status[page_id] < 0) {
+        fprintf(stderr,
+                "error: unable to get NUMA mapping information for page %p\n",
+                pages_[page_id].addr);
+        assert(false);
+        return;
       }
+      pages_[page_id].numa_node = static_cast<size_t>(status[page_id]);
     }
   }
-  fclose(f);
-  if (page_id != num_allocated_pages) {
-    fprintf(stderr,
-            "error: unable to get NUMA mapping information for all pages "
-            "(/proc/self/numa_maps may be not sorted by virtual address)\n");
-    assert(false);
-    return;
-  }
 
   // get physical address (pagemap.txt)
   if (verbose_) printf("detecting physical address of pages\n");
@@ -390,16 +443,9 @@ void HugeTLBFS_SHM::initialize() {
     size_t pfn = (size_t)pages_[page_id].addr / normal_page_size;
     off_t offset = (off_t)(sizeof(uint64_t) * pfn);
 
-    if (lseek(fd, offset, SEEK_SET) != offset) {
-      perror("");
-      close(fd);
-      fprintf(stderr, "error: could not seek in /proc/self/pagemap\n");
-      assert(false);
-      return;
-    }
-
     uint64_t entry;
-    if (read(fd, &entry, sizeof(uint64_t)) == -1) {
+    if (pread(fd, &entry, sizeof(uint64_t), offset) !=
+        static_cast<ssize_t>(sizeof(uint64_t))) {
       perror("");
       close(fd);
       fprintf(stderr, "error: could not read /proc/self/pagemap\n");
@@ -412,6 +458,7 @@ void HugeTLBFS_SHM::initialize() {
     // printf("virtual addr %p = physical addr %p\n", pages_[page_id].addr,
     // pages_[page_id].paddr);
   }
+  close(fd);
 
   // sort by physical address
   if (verbose_) printf("sorting by physical address\n");
@@ -422,6 +469,7 @@ void HugeTLBFS_SHM::initialize() {
   // (contiguous in physical memory) first so that the freed memory can be used
   // for DMA.
   if (verbose_) printf("releasing unnecessary pages\n");
+  size_t num_freed_pages = 0;
   for (numa_node = 0; numa_node < numa_count; numa_node++) {
     size_t num_pages_to_free = num_pages_to_free_[numa_node];
 
@@ -521,6 +569,7 @@ void HugeTLBFS_SHM::initialize() {
         pages_[page_id].in_use = false;
 
         num_pages_to_free--;
+        num_freed_pages++;
       }
     }
 
@@ -557,9 +606,12 @@ void HugeTLBFS_SHM::initialize() {
     }
   }
 
-  printf("HugeTLBFS_SHM: syncing and sleeping for 1 second\n");
-  sync();
-  sleep(1);
+  // Only freed pages need time to become visible to other applications.
+  if (num_freed_pages != 0) {
+    printf("HugeTLBFS_SHM: syncing and sleeping for 1 second\n");
+    sync();
+    sleep(1);
+  }
 
   // {
   //   FILE* f = fopen("/proc/self/numa_maps", "r");
@@ -895,7 +947,6 @@ bool HugeTLBFS_SHM::unmap(void* ptr) {
 }
 
 void* HugeTLBFS_SHM::malloc_contiguous(size_t size, size_t lcore) {
-  size = HugeTLBFS_SHM::roundup(size);
   // size_t entry_id = mehcached_shm_alloc(size, (size_t)-1);
   // size_t entry_id = mehcached_shm_alloc(size, numa_node);
   size_t numa_node = ::mica::util::lcore.numa_id(lcore);
@@ -903,6 +954,15 @@ void* HugeTLBFS_SHM::malloc_contiguous(size_t size, size_t lcore) {
     fprintf(stderr, "error: invalid lcore\n");
     return nullptr;
   }
+  return malloc_contiguous_on_node(size, numa_node);
+}
+
+void* HugeTLBFS_SHM::malloc_contiguous_on_node(size_t size, size_t numa_node) {
+  size = HugeTLBFS_SHM::roundup(size);
+  if (numa_node >= ::mica::util::lcore.numa_count()) {
+    fprintf(stderr, "error: invalid numa node %zu\n", numa_node);
+    return nullptr;
+  }
 
   size_t entry_id = alloc(size, numa_node);
   // fprintf(stderr, "entry_id=%zu, size=%zu\n", entry_id, size);
@@ -927,54 +987,128 @@ void* HugeTLBFS_SHM::malloc_contiguous_local(size_t size) {
 }
 
 void* HugeTLBFS_SHM::malloc_contiguous_any(size_t size) {
-  // size_t lcore = ::mica::util::lcore.lcore_id();
-  size_t lcore = 0;
-
-  // TODO: Use numa id instead of lcore id.
-  for (size_t trial = 0; trial < ::mica::util::lcore.lcore_count(); trial++) {
-    void* p;
-    p = malloc_contiguous(size, lcore);
-    if (!p) return p;
-    if (++lcore == ::mica::util::lcore.lcore_count()) lcore = 0;
+  for (size_t numa_node = 0; numa_node < ::mica::util::lcore.numa_count();
+       numa_node++) {
+    void* p = malloc_contiguous_on_node(size, numa_node);
+    if (p != nullptr) return p;
   }
   return nullptr;
 }
 
 void HugeTLBFS_SHM::free_contiguous(void* ptr) { unmap(ptr); }
 
+bool HugeTLBFS_SHM::contiguous_file_ids(const void* ptr,
+                                        std::vector<size_t>* out) {
+  lock();
+  for (auto& mapping : mappings_) {
+    if (mapping.addr != ptr) continue;
+    auto& entry = entries_[mapping.entry_id];
+    out->clear();
+    for (size_t i = 0; i < mapping.num_pages; i++)
+      out->push_back(pages_[entry.page_ids[mapping.page_offset + i]].file_id);
+    unlock();
+    return true;
+  }
+  unlock();
+  return false;
+}
+
+void* HugeTLBFS_SHM::attach_contiguous(void* addr,
+                                       const std::vector<size_t>& file_ids) {
+  if (file_ids.empty()) return nullptr;
+  size_t size = file_ids.size() * kPageSize;
+
+  // Keep the range for this region only if nothing else is there.
+  void* p = mmap(addr, size, PROT_NONE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (p == MAP_FAILED) return nullptr;
+  if (p != addr) {
+    munmap(p, size);
+    fprintf(stderr, "error: %p is not free for an attached region\n", addr);
+    return nullptr;
+  }
+
+  lock();
+
+  std::unordered_map<size_t, size_t> page_of_file;
+  for (size_t page_id = 0; page_id < pages_.size(); page_id++)
+    if (pages_[page_id].addr != nullptr && !pages_[page_id].in_use)
+      page_of_file[pages_[page_id].file_id] = page_id;
+
+  size_t entry_id;
+  for (entry_id = 0; entry_id < entries_.size(); entry_id++)
+    if (entries_[entry_id].page_ids.empty()) break;
+  if (entry_id == entries_.size())
+    entries_.push_back(Entry{0, false, 0, 0, std::vector<size_t>()});
+
+  auto& entry = entries_[entry_id];
+  for (auto file_id : file_ids) {
+    auto it = page_of_file.find(file_id);
+    if (it == page_of_file.end()) {
+      fprintf(stderr, "error: missing page file %zu\n", file_id);
+      entry.page_ids.clear();
+      unlock();
+      munmap(addr, size);
+      return nullptr;
+    }
+    entry.page_ids.push_back(it->second);
+    // A file listed twice is not a valid region.
+    page_of_file.erase(it);
+  }
+  entry.length = size;
+  entry.num_pages = file_ids.size();
+  for (auto page_id : entry.page_ids) pages_[page_id].in_use = true;
+
+  unlock();
+
+  // map() replaces the reservation page by page.
+  bool mapped = map(entry_id, addr, 0, size);
+  schedule_release(entry_id);
+  if (!mapped) {
+    munmap(addr, size);
+    return nullptr;
+  }
+  return addr;
+}
+
+std::vector<void*> HugeTLBFS_SHM::find_pages(const void* prefix, size_t len) {
+  std::vector<void*> out;
+  lock();
+  for (auto& page : pages_)
+    if (page.addr != nullptr && !page.in_use &&
+        memcmp(page.addr, prefix, len) == 0)
+      out.push_back(page.addr);
+  unlock();
+  return out;
+}
+
 void* HugeTLBFS_SHM::malloc_striped(size_t size) {
   if (::mica::util::lcore.numa_count() == 1) return malloc_contiguous(size, 0);
 
-  // size_t numa_node = ::mica::util::lcore.numa_id();
-  // if (numa_node == ::mica::util::lcore.kUnknown) {
-  //   fprintf(stderr, "error: unable to detect current lcore\n");
-  //   return nullptr;
-  // }
-  size_t numa_node = 0;
+  size_t numa_count = ::mica::util::lcore.numa_count();
 
   size += 2 * kPageSize;  // need to store metadata
 
-  size_t size_2 = (size + 1) / 2;
-  size_2 = roundup(size_2);
+  // Pages rotate over all NUMA nodes.
+  size_t size_per_node = (size + numa_count - 1) / numa_count;
+  size_per_node = roundup(size_per_node);
 
-  // TODO: allocate 1 fewer page (i.e., only 1 page in total) when the total
-  // number of pages required is an odd numbered
+  // TODO: allocate fewer pages on the last nodes when the total number of
+  // pages required is not a multiple of the node count.
 
-  size_t entry_id[2];
-  entry_id[0] = alloc(size_2, numa_node);
-  if (entry_id[0] == kInvalidId) return nullptr;
-
-  entry_id[1] = alloc(size_2, 1 - numa_node);
-  if (entry_id[1] == kInvalidId) {
-    schedule_release(entry_id[0]);
-    return nullptr;
+  std::vector<size_t> entry_id(numa_count);
+  for (size_t numa_node = 0; numa_node < numa_count; numa_node++) {
+    entry_id[numa_node] = alloc(size_per_node, numa_node);
+    if (entry_id[numa_node] == kInvalidId) {
+      for (size_t i = 0; i < numa_node; i++) schedule_release(entry_id[i]);
+      return nullptr;
+    }
   }
 
   while (true) {
     void* base = find_free_address(size);
     if (base == nullptr) {
-      schedule_release(entry_id[0]);
-      schedule_release(entry_id[1]);
+      for (size_t i = 0; i < numa_count; i++) schedule_release(entry_id[i]);
       return nullptr;
     }
 
@@ -987,7 +1121,7 @@ void* HugeTLBFS_SHM::malloc_striped(size_t size) {
         // error
         break;
       }
-      if (++numa_node == ::mica::util::lcore.numa_count()) numa_node = 0;
+      if (++numa_node == numa_count) numa_node = 0;
       if (numa_node == 0) offset_in_stripe += kPageSize;
       p = (void*)((size_t)p + kPageSize);
     }
@@ -1002,8 +1136,7 @@ void* HugeTLBFS_SHM::malloc_striped(size_t size) {
       }
     } else {
       // success
-      schedule_release(entry_id[0]);
-      schedule_release(entry_id[1]);
+      for (size_t i = 0; i < numa_count; i++) schedule_release(entry_id[i]);
 
       *(uint64_t*)base = size;
       void* ptr = (void*)((size_t)base + 2 * kPageSize);
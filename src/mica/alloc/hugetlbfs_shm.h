@@ -3,6 +3,7 @@
 #define MICA_ALLOC_HUGETLB_SHM_H_
 
 #include <limits>
+#include <string>
 #include <vector>
 #include "mica/common.h"
 #include "mica/util/config.h"
@@ -33,6 +34,11 @@
 //  * clean_other_files_on_init (bool): Similar to clean_files_on_init, but
 //    delete all files whose filename does not starts with filename_prefix.
 //    This is required to make num_pages_to_free work.  Default = true
+//  * init_threads_per_node (integer): The number of threads per NUMA domain
+//    that create and fault in pages in parallel during initialization.  Each
+//    thread runs on (and prefers memory from) its NUMA domain.  Existing files
+//    are mapped by the same threads without being recreated.  0 initializes
+//    all pages on the calling thread.  Default = 4
 //  * verbose (bool): Print verbose messages.  Default = false
 
 namespace mica {
@@ -59,13 +65,28 @@ class HugeTLBFS_SHM {
   size_t get_memuse() const { return used_memory_; }
   void dump_page_info();
 
-  void* malloc_contiguous(size_t size, size_t numa_node);
+  // Allocates on the NUMA node of the given lcore.
+  void* malloc_contiguous(size_t size, size_t lcore);
+  // Allocates on the given NUMA node, which may have no lcore (e.g., CXL).
+  void* malloc_contiguous_on_node(size_t size, size_t numa_node);
   void* malloc_contiguous_local(size_t size);
   void free_contiguous(void* ptr);
 
   void* malloc_striped(size_t size);
   void free_striped(void* ptr);
 
+  // Persistent regions.  A region that must outlive the process is mapped at
+  // the same address again after a restart from the files of its pages.
+  //
+  // Stores the file IDs of the pages of a region from malloc_contiguous*().
+  bool contiguous_file_ids(const void* ptr, std::vector<size_t>* out);
+  // Maps the pages of the given files contiguously at addr, which must be
+  // unused in this process, and marks them in use.  Free with
+  // free_contiguous().
+  void* attach_contiguous(void* addr, const std::vector<size_t>& file_ids);
+  // The initial mappings of the free pages whose content starts with prefix.
+  std::vector<void*> find_pages(const void* prefix, size_t len);
+
  private:
   void initialize();
 
@@ -106,6 +127,16 @@ class HugeTLBFS_SHM {
     size_t num_pages;
   };
 
+  // Parallel initialization.  Each worker appends to its own page list, which
+  // initialize() merges into pages_.
+  void* map_file(size_t file_id, bool create);
+  void map_existing_files(const std::vector<size_t>* file_ids, size_t begin,
+                          size_t end, std::vector<Page>* out);
+  void create_pages_on_node(size_t numa_node, size_t max_pages,
+                            std::vector<Page>* out);
+  bool claim_page_to_init();
+  static size_t free_pages_on_node(size_t numa_node);
+
   ::mica::util::Config config_;
 
   std::string hugetlbfs_path_;
@@ -116,8 +147,12 @@ class HugeTLBFS_SHM {
   std::vector<size_t> num_pages_to_reserve_;
   bool clean_files_on_init_;
   bool clean_other_files_on_init_;
+  size_t init_threads_per_node_;
   bool verbose_;
 
+  volatile size_t next_file_id_;
+  volatile size_t num_pages_left_to_init_;
+
   uint64_t state_lock_;
   std::vector<Page> pages_;
   std::vector<Entry> entries_;
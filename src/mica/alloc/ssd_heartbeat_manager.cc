@@ -1,4 +1,5 @@
 #include "mica/alloc/ssd_heartbeat_manager.h"
+#include "mica/util/lcore.h"
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/stat.h>
@@ -15,12 +16,16 @@ SSDHeartbeatManager::SSDHeartbeatManager(const ::mica::util::Config& config)
     // 从配置中读取参数
     ssd_device_path_ = config.get("ssd_heartbeat").get("device_path").get_str("/dev/nvme0n1");
     heartbeat_file_path_ = config.get("ssd_heartbeat").get("heartbeat_file").get_str("/mnt/cxl_ssd/cicada_heartbeat.dat");
-    heartbeat_timeout_us_ = config.get("ssd_heartbeat").get("timeout_us").get_uint64(200000)// 200ms
+    heartbeat_timeout_us_ = config.get("ssd_heartbeat").get("timeout_us").get_uint64(200000);  // 200ms
     monitoring_interval_us_ = config.get("ssd_heartbeat").get("monitoring_interval_us").get_uint64(100000);  // 100ms
 
+    size_t max_threads = config.get("ssd_heartbeat").get("max_threads").get_uint64(
+        ::mica::util::lcore.lcore_count());
+
     // 初始化心跳记录数组
-    memset(heartbeats_, 0, sizeof(heartbeats_));
-    memset(last_heartbeat_time_, 0, sizeof(last_heartbeat_time_));
+    heartbeats_.resize(max_threads);
+    last_heartbeat_time_.assign(max_threads, 0);
+    memset(heartbeats_.data(), 0, heartbeat_bytes());
 }
 
 SSDHeartbeatManager::~SSDHeartbeatManager() {
@@ -39,7 +44,7 @@ bool SSDHeartbeatManager::initialize() {
     }
 
     // 预分配文件空间
-    size_t file_size = sizeof(HeartbeatRecord) * 64;  // 64个线程的心跳记录
+    size_t file_size = heartbeat_bytes();  // 每个线程一条心跳记录
     if (ftruncate(ssd_fd_, file_size) != 0) {
         perror("Failed to allocate SSD file space");
         close(ssd_fd_);
@@ -75,7 +80,7 @@ void SSDHeartbeatManager::stop_monitoring() {
 
 void SSDHeartbeatManager::update_heartbeat(uint16_t thread_id, uint64_t timestamp,
                                          uint64_t tx_id, uint8_t status) {
-    if (thread_id >= 64) {
+    if (thread_id >= heartbeats_.size()) {
         return;  // 超出支持的线程数量
     }
 
@@ -104,7 +109,7 @@ std::vector<uint16_t> SSDHeartbeatManager::detect_failed_threads() {
     uint64_t current_time = 
         std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count();
 
-    for (uint16_t i = 0; i < 64; i++) {
+    for (uint16_t i = 0; i < heartbeats_.size(); i++) {
         if (last_heartbeat_time_[i] > 0) {  // 线程曾经活跃过
             uint64_t time_diff = current_time - last_heartbeat_time_[i];
 
@@ -126,11 +131,11 @@ bool SSDHeartbeatManager::recover_from_ssd() {
 
     // 从SSD读取心跳数据
     lseek(ssd_fd_, 0, SEEK_SET);
-    ssize_t bytes_read = read(ssd_fd_, heartbeats_, sizeof(heartbeats_));
+    ssize_t bytes_read = read(ssd_fd_, heartbeats_.data(), heartbeat_bytes());
 
-    if (bytes_read != sizeof(heartbeats_)) {
+    if (bytes_read != static_cast<ssize_t>(heartbeat_bytes())) {
         // 文件可能是新创建的，初始化为零
-        memset(heartbeats_, 0, sizeof(heartbeats_));
+        memset(heartbeats_.data(), 0, heartbeat_bytes());
         return true;
     }
 
@@ -139,7 +144,7 @@ bool SSDHeartbeatManager::recover_from_ssd() {
     uint64_t current_time = 
         std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count();
 
-    for (int i = 0; i < 64; i++) {
+    for (size_t i = 0; i < heartbeats_.size(); i++) {
         if (heartbeats_[i].thread_id == i && heartbeats_[i].timestamp > 0) {
             last_heartbeat_time_[i] = current_time;
         }
@@ -170,7 +175,7 @@ void SSDHeartbeatManager::monitoring_thread_func() {
         {
             std::lock_guard<std::mutex> lock(heartbeat_mutex_);
             lseek(ssd_fd_, 0, SEEK_SET);
-            write(ssd_fd_, heartbeats_, sizeof(heartbeats_));
+            write(ssd_fd_, heartbeats_.data(), heartbeat_bytes());
             fsync(ssd_fd_);  // 强制同步到SSD
         }
     
@@ -211,9 +216,9 @@ bool SSDHeartbeatManager::read_heartbeats_from_ssd() {
     }
 
     lseek(ssd_fd_, 0, SEEK_SET);
-    ssize_t bytes_read = read(ssd_fd_, heartbeats_, sizeof(heartbeats_));
+    ssize_t bytes_read = read(ssd_fd_, heartbeats_.data(), heartbeat_bytes());
       
-    return bytes_read == sizeof(heartbeats_);
+    return bytes_read == static_cast<ssize_t>(heartbeat_bytes());
 }  
   
 }  // namespace alloc
@@ -51,8 +51,13 @@ private:
     std::thread monitoring_thread_;
     std::mutex heartbeat_mutex_;
 
-    HeartbeatRecord heartbeats_[64];  // 最大支持64个线程
-    uint64_t last_heartbeat_time_[64];
+    size_t heartbeat_bytes() const {
+        return sizeof(HeartbeatRecord) * heartbeats_.size();
+    }
+
+    // One entry per thread ("max_threads"; default: the lcore count).
+    std::vector<HeartbeatRecord> heartbeats_;
+    std::vector<uint64_t> last_heartbeat_time_;
 };
 
 }
@@ -0,0 +1,289 @@
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include "mica/transaction/db.h"
+#include "mica/util/histogram.h"
+#include "mica/util/lcore.h"
+#include "mica/test/test_tx_conf.h"
+
+// Measures the commit-to-visibility lag: the time between a writer's commit
+// slot reaching kCommitted and the first reader on another thread observing
+// the new version.  Thread 0 updates a single row with an increasing
+// sequence number; the other threads keep reading the row.
+
+typedef DBConfig::Alloc Alloc;
+typedef DBConfig::Logger Logger;
+typedef ::mica::transaction::PagePool<DBConfig> PagePool;
+typedef ::mica::transaction::DB<DBConfig> DB;
+typedef ::mica::transaction::Table<DBConfig> Table;
+typedef ::mica::transaction::RowAccessHandle<DBConfig> RowAccessHandle;
+typedef ::mica::transaction::RowAccessHandlePeekOnly<DBConfig>
+    RowAccessHandlePeekOnly;
+typedef ::mica::transaction::Transaction<DBConfig> Transaction;
+typedef ::mica::transaction::Result Result;
+
+static ::mica::util::Stopwatch sw;
+
+static volatile uint16_t running_threads;
+static volatile bool stopping;
+
+struct Task {
+  DB* db;
+  Table* tbl;
+  uint64_t row_id;
+  uint16_t thread_id;
+  uint16_t num_threads;
+  bool peek_only;
+  uint64_t write_interval_us;
+
+  // Indexed by the sequence number.
+  std::vector<uint64_t>* commit_time;
+  std::vector<uint64_t>* first_seen;
+
+  uint64_t count;  // Committed writes or reads.
+};
+
+static void start(Task* task) {
+  ::mica::util::lcore.pin_thread(task->thread_id);
+
+  __sync_add_and_fetch(&running_threads, 1);
+  while (running_threads < task->num_threads) ::mica::util::pause();
+
+  task->db->activate(task->thread_id);
+  while (task->db->active_thread_count() < task->num_threads) {
+    ::mica::util::pause();
+    task->db->idle(task->thread_id);
+  }
+}
+
+static void writer_proc(Task* task) {
+  start(task);
+
+  auto db = task->db;
+  auto& commit_time = *task->commit_time;
+  Transaction tx(db->context(task->thread_id));
+
+  uint64_t interval = task->write_interval_us * sw.c_1_usec();
+  uint64_t next_time = sw.now();
+  uint64_t seq = 1;
+  while (seq < commit_time.size()) {
+    // Keep the published timestamps moving while waiting, as an idle
+    // application thread would.
+    while (static_cast<int64_t>(sw.now() - next_time) < 0)
+      db->idle(task->thread_id);
+
+    if (!tx.begin()) continue;
+
+    RowAccessHandle rah(&tx);
+    if (!rah.peek_row(task->tbl, 0, task->row_id, false, true, true) ||
+        !rah.read_row() || !rah.write_row(sizeof(uint64_t))) {
+      tx.abort();
+      continue;
+    }
+    *reinterpret_cast<uint64_t*>(rah.data()) = seq;
+
+    // write_func runs right before the commit slot becomes kCommitted, so
+    // the measured lag is slightly conservative.
+    auto write_func = [&commit_time, seq] {
+      commit_time[seq] = sw.now();
+      return true;
+    };
+    Result result;
+    if (!tx.commit(&result, write_func)) continue;
+
+    seq++;
+    next_time += interval;
+  }
+  task->count = seq - 1;
+
+  stopping = true;
+  db->deactivate(task->thread_id);
+}
+
+static void reader_proc(Task* task) {
+  start(task);
+
+  auto db = task->db;
+  auto& first_seen = *task->first_seen;
+  Transaction tx(db->context(task->thread_id));
+
+  uint64_t last_seq = 0;
+  uint64_t count = 0;
+  while (!stopping) {
+    if (!tx.begin(task->peek_only)) continue;
+
+    uint64_t seq;
+    if (task->peek_only) {
+      RowAccessHandlePeekOnly rah(&tx);
+      if (!rah.peek_row(task->tbl, 0, task->row_id, false, false, false)) {
+        tx.abort();
+        continue;
+      }
+      seq = *reinterpret_cast<const uint64_t*>(rah.cdata());
+    } else {
+      RowAccessHandle rah(&tx);
+      if (!rah.peek_row(task->tbl, 0, task->row_id, false, true, false) ||
+          !rah.read_row()) {
+        tx.abort();
+        continue;
+      }
+      seq = *reinterpret_cast<const uint64_t*>(rah.cdata());
+    }
+
+    Result result;
+    if (!tx.commit(&result)) continue;
+    count++;
+
+    if (seq > last_seq) {
+      auto now = sw.now();
+      if (seq < first_seen.size())
+        __sync_bool_compare_and_swap(&first_seen[seq], 0, now);
+      last_seq = seq;
+    }
+  }
+  task->count = count;
+
+  db->deactivate(task->thread_id);
+}
+
+int main(int argc, const char* argv[]) {
+  if (argc != 5) {
+    printf("%s READER-COUNT WRITE-COUNT WRITE-INTERVAL-US PEEK-ONLY\n",
+           argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  auto config = ::mica::util::Config::load_file("test_tx.json");
+
+  uint16_t num_readers = static_cast<uint16_t>(atol(argv[1]));
+  uint64_t write_count = static_cast<uint64_t>(atol(argv[2]));
+  uint64_t write_interval_us = static_cast<uint64_t>(atol(argv[3]));
+  bool peek_only = atoi(argv[4]) != 0;
+  if (num_readers == 0 || write_count == 0) {
+    printf("READER-COUNT and WRITE-COUNT must be positive\n");
+    return EXIT_FAILURE;
+  }
+  uint16_t num_threads = static_cast<uint16_t>(num_readers + 1);
+
+  printf("num_readers = %" PRIu16 "\n", num_readers);
+  printf("write_count = %" PRIu64 "\n", write_count);
+  printf("write_interval_us = %" PRIu64 "\n", write_interval_us);
+  printf("peek_only = %d\n", peek_only ? 1 : 0);
+  printf("\n");
+
+  Alloc alloc(config.get("alloc"));
+  auto page_pool_size = 4 * uint64_t(1073741824);
+  ::mica::transaction::CXLTopology cxl_topology(config.get("cxl"));
+  std::vector<PagePool*> page_pools(::mica::util::lcore.numa_count(), nullptr);
+  for (uint8_t numa_id = 0; numa_id < page_pools.size(); numa_id++) {
+    auto size = cxl_topology.page_pool_size(numa_id, page_pool_size);
+    if (size != 0) page_pools[numa_id] = new PagePool(&alloc, size, numa_id);
+  }
+
+  ::mica::util::lcore.pin_thread(0);
+
+  sw.init_start();
+  sw.init_end();
+
+  Logger logger;
+  DB db(page_pools.data(), &logger, &sw, num_threads, cxl_topology);
+
+  const uint64_t data_sizes[] = {sizeof(uint64_t)};
+  bool ret = db.create_table("main", 1, data_sizes);
+  assert(ret);
+  (void)ret;
+  auto tbl = db.get_table("main");
+
+  uint64_t row_id;
+  db.activate(0);
+  while (true) {
+    Transaction tx(db.context(0));
+    if (!tx.begin()) continue;
+    RowAccessHandle rah(&tx);
+    if (!rah.new_row(tbl, 0, Transaction::kNewRowID, true,
+                     sizeof(uint64_t))) {
+      tx.abort();
+      continue;
+    }
+    *reinterpret_cast<uint64_t*>(rah.data()) = 0;
+    row_id = rah.row_id();
+    Result result;
+    if (tx.commit(&result)) break;
+  }
+  db.deactivate(0);
+
+  db.reset_stats();
+
+  std::vector<uint64_t> commit_time(write_count + 1, 0);
+  std::vector<uint64_t> first_seen(write_count + 1, 0);
+
+  std::vector<Task> tasks(num_threads);
+  for (uint16_t thread_id = 0; thread_id < num_threads; thread_id++) {
+    auto& task = tasks[thread_id];
+    task.db = &db;
+    task.tbl = tbl;
+    task.row_id = row_id;
+    task.thread_id = thread_id;
+    task.num_threads = num_threads;
+    task.peek_only = peek_only;
+    task.write_interval_us = write_interval_us;
+    task.commit_time = &commit_time;
+    task.first_seen = &first_seen;
+    task.count = 0;
+  }
+
+  running_threads = 0;
+  stopping = false;
+  ::mica::util::memory_barrier();
+
+  uint64_t start_time = sw.now();
+  std::vector<std::thread> threads;
+  threads.emplace_back(writer_proc, &tasks[0]);
+  for (uint16_t thread_id = 1; thread_id < num_threads; thread_id++)
+    threads.emplace_back(reader_proc, &tasks[thread_id]);
+  while (threads.size() > 0) {
+    threads.back().join();
+    threads.pop_back();
+  }
+  double elapsed = sw.diff(sw.now(), start_time);
+
+  // Lags are in nanoseconds.
+  ::mica::util::Histogram lag;
+  uint64_t missed = 0;
+  for (uint64_t seq = 1; seq <= tasks[0].count; seq++) {
+    if (first_seen[seq] == 0) {
+      missed++;
+      continue;
+    }
+    if (first_seen[seq] > commit_time[seq])
+      lag.update(sw.diff_in_ns(first_seen[seq], commit_time[seq]));
+    else
+      lag.update(0);
+  }
+
+  uint64_t reads = 0;
+  for (uint16_t thread_id = 1; thread_id < num_threads; thread_id++)
+    reads += tasks[thread_id].count;
+
+  printf("elapsed:                   %10.3lf sec\n", elapsed);
+  printf("committed writes:          %10" PRIu64 "\n", tasks[0].count);
+  printf("committed reads:           %10" PRIu64 " (%7.3lf M/sec)\n", reads,
+         static_cast<double>(reads) / elapsed / 1000000.);
+  // A version replaced before any reader saw it.
+  printf("unobserved writes:         %10" PRIu64 "\n", missed);
+  printf("\n");
+  printf("commit-to-visibility (ns): min=%" PRIu64 ", max=%" PRIu64
+         ", avg=%" PRIu64 "; 50-th=%" PRIu64 ", 95-th=%" PRIu64
+         ", 99-th=%" PRIu64 ", 99.9-th=%" PRIu64 "\n",
+         lag.min(), lag.max(), lag.avg(), lag.perc(0.50), lag.perc(0.95),
+         lag.perc(0.99), lag.perc(0.999));
+
+  auto& visibility_lag = db.visibility_lag();
+  printf("min_wts lag (us):          min=%" PRIu64 ", max=%" PRIu64
+         ", avg=%" PRIu64 "; 50-th=%" PRIu64 ", 99-th=%" PRIu64 "\n",
+         visibility_lag.min(), visibility_lag.max(), visibility_lag.avg(),
+         visibility_lag.perc(0.50), visibility_lag.perc(0.99));
+
+  return EXIT_SUCCESS;
+}
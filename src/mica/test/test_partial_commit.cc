@@ -8,6 +8,7 @@
 #include <cstdlib>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <vector>
 #include "mica/transaction/db.h"
 #include "mica/util/lcore.h"
 #include "mica/util/config.h"
@@ -97,16 +98,18 @@ int main() {
   auto config = ::mica::util::Config::load_file("test_tx.json");
   Alloc alloc(config.get("alloc"));
   auto page_pool_size = 8ul * 1024 * 1024 * 1024;
-  PagePool* page_pools[2] = {
-    new PagePool(&alloc, page_pool_size / 2, 0),
-    new PagePool(&alloc, page_pool_size / 2, 1)
-  };
+  ::mica::transaction::CXLTopology cxl_topology(config.get("cxl"));
+  std::vector<PagePool*> page_pools(::mica::util::lcore.numa_count(), nullptr);
+  for (uint8_t numa_id = 0; numa_id < page_pools.size(); numa_id++) {
+    auto size = cxl_topology.page_pool_size(numa_id, page_pool_size);
+    if (size != 0) page_pools[numa_id] = new PagePool(&alloc, size, numa_id);
+  }
 
   sw.init_start();
   sw.init_end();
 
   Logger logger;
-  DB db(page_pools, &logger, &sw, 2);
+  DB db(page_pools.data(), &logger, &sw, 2, cxl_topology);
   const uint64_t kDataSizes[] = {sizeof(char)};
   db.create_table("test", 1, kDataSizes);
   Table* tbl = db.get_table("test");
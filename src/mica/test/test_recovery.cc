@@ -0,0 +1,298 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "mica/transaction/db.h"
+#include "mica/util/lcore.h"
+#include "mica/test/test_tx_conf.h"
+
+// Checks DB::recover() against the commit slot states that a crash can leave
+// behind.  Each scenario commits one transaction that updates its own row and
+// inserts new rows.  The versions are final before the slot reaches
+// kCommitted, so rewriting the slot state afterwards gives the state of a crash
+// right before the commit point.
+
+struct RecoveryTestConfig : public DBConfig {
+  typedef ::mica::transaction::NullLogger<RecoveryTestConfig> Logger;
+  // Keep GC from reclaiming the versions that recovery falls back to.
+  static constexpr int64_t kMinQuiescenceInterval = 1000000000;
+};
+
+typedef RecoveryTestConfig::Alloc Alloc;
+typedef RecoveryTestConfig::Logger Logger;
+typedef RecoveryTestConfig::Timestamp Timestamp;
+typedef ::mica::transaction::PagePool<RecoveryTestConfig> PagePool;
+typedef ::mica::transaction::DB<RecoveryTestConfig> DB;
+typedef ::mica::transaction::Table<RecoveryTestConfig> Table;
+typedef ::mica::transaction::RowVersion<RecoveryTestConfig> RowVersion;
+typedef ::mica::transaction::CommitSlot<RecoveryTestConfig> CommitSlot;
+typedef ::mica::transaction::CommitSlotState CommitSlotState;
+typedef ::mica::transaction::RowVersionStatus RowVersionStatus;
+typedef ::mica::transaction::RowAccessHandle<RecoveryTestConfig>
+    RowAccessHandle;
+typedef ::mica::transaction::RowAccessHandlePeekOnly<RecoveryTestConfig>
+    RowAccessHandlePeekOnly;
+typedef ::mica::transaction::Transaction<RecoveryTestConfig> Transaction;
+typedef ::mica::transaction::Result Result;
+
+struct Scenario {
+  const char* name;
+  CommitSlotState state;
+  uint64_t insert_count;
+
+  uint64_t row_id;
+  std::vector<uint64_t> inserted_row_ids;
+  RowVersion* rv;
+  CommitSlot* slot;
+};
+
+static uint64_t failures;
+
+static void check(bool cond, const char* what, const Scenario& s) {
+  if (cond) return;
+  fprintf(stderr, "error: %s: %s\n", s.name, what);
+  failures++;
+}
+
+static void insert_rows(DB* db, Table* tbl, std::vector<Scenario>& scenarios) {
+  while (true) {
+    Transaction tx(db->context(0));
+    if (!tx.begin()) continue;
+    bool ok = true;
+    for (auto& s : scenarios) {
+      RowAccessHandle rah(&tx);
+      if (!rah.new_row(tbl, 0, Transaction::kNewRowID, false,
+                       sizeof(uint64_t))) {
+        ok = false;
+        break;
+      }
+      *reinterpret_cast<uint64_t*>(rah.data()) = 0;
+      s.row_id = rah.row_id();
+    }
+    if (!ok) {
+      tx.abort();
+      continue;
+    }
+    Result result;
+    if (tx.commit(&result)) break;
+  }
+}
+
+static void run(DB* db, Table* tbl, Scenario* s) {
+  while (true) {
+    Transaction tx(db->context(0));
+    if (!tx.begin()) continue;
+
+    RowAccessHandle rah(&tx);
+    if (!rah.peek_row(tbl, 0, s->row_id, false, true, true) ||
+        !rah.read_row() || !rah.write_row(sizeof(uint64_t))) {
+      tx.abort();
+      continue;
+    }
+    *reinterpret_cast<uint64_t*>(rah.data()) = 1;
+
+    s->inserted_row_ids.clear();
+    bool ok = true;
+    for (uint64_t i = 0; i < s->insert_count; i++) {
+      RowAccessHandle new_rah(&tx);
+      if (!new_rah.new_row(tbl, 0, Transaction::kNewRowID, false,
+                           sizeof(uint64_t))) {
+        ok = false;
+        break;
+      }
+      *reinterpret_cast<uint64_t*>(new_rah.data()) = 1;
+      s->inserted_row_ids.push_back(new_rah.row_id());
+    }
+    if (!ok) {
+      tx.abort();
+      continue;
+    }
+
+    Result result;
+    if (tx.commit(&result)) break;
+  }
+
+  s->rv = tbl->head(0, s->row_id)->older_rv;
+  check(s->rv != nullptr && s->rv->older_rv != nullptr,
+        "the update is not the newest version", *s);
+  if (s->rv == nullptr) return;
+  s->slot = &db->context(0)->get_slot(s->rv->slot_idx());
+  check(s->slot->state == CommitSlotState::kCommitted &&
+            s->rv->is_writer_seq(s->slot->local_tx_seq),
+        "the slot does not hold the update", *s);
+
+  // allocate_slot() must not hand the slot out again before the crash.
+  s->slot->state = CommitSlotState::kActive;
+}
+
+static uint64_t read_value(DB* db, Table* tbl, uint64_t row_id) {
+  uint64_t value = static_cast<uint64_t>(-1);
+  Transaction tx(db->context(0));
+  while (true) {
+    if (!tx.begin(true)) continue;
+    RowAccessHandlePeekOnly rah(&tx);
+    if (rah.peek_row(tbl, 0, row_id, false, false, false))
+      value = *reinterpret_cast<const uint64_t*>(rah.cdata());
+    Result result;
+    if (tx.commit(&result)) break;
+  }
+  return value;
+}
+
+int main() {
+  auto config = ::mica::util::Config::load_file("test_tx.json");
+
+  Alloc alloc(config.get("alloc"));
+  auto page_pool_size = 1 * uint64_t(1073741824);
+  ::mica::transaction::CXLTopology cxl_topology(config.get("cxl"));
+  std::vector<PagePool*> page_pools(::mica::util::lcore.numa_count(), nullptr);
+  for (uint8_t numa_id = 0; numa_id < page_pools.size(); numa_id++) {
+    auto size = cxl_topology.page_pool_size(numa_id, page_pool_size);
+    if (size != 0) page_pools[numa_id] = new PagePool(&alloc, size, numa_id);
+  }
+
+  ::mica::util::lcore.pin_thread(0);
+
+  ::mica::util::Stopwatch sw;
+  sw.init_start();
+  sw.init_end();
+
+  Logger logger;
+  DB db(page_pools.data(), &logger, &sw, 1, cxl_topology);
+
+  const uint64_t data_sizes[] = {sizeof(uint64_t)};
+  bool ret = db.create_table("main", 1, data_sizes);
+  assert(ret);
+  (void)ret;
+  auto tbl = db.get_table("main");
+
+  // The last one has more writes than the slot's intent array holds (about
+  // 500), so recovery scans the table for it.
+  std::vector<Scenario> scenarios = {
+      {"committed", CommitSlotState::kCommitted, 1, 0, {}, nullptr, nullptr},
+      {"active", CommitSlotState::kActive, 1, 0, {}, nullptr, nullptr},
+      {"committing", CommitSlotState::kCommitting, 1, 0, {}, nullptr,
+       nullptr},
+      {"aborted", CommitSlotState::kAborted, 1, 0, {}, nullptr, nullptr},
+      {"overflow", CommitSlotState::kActive, 1000, 0, {}, nullptr, nullptr},
+  };
+
+  db.activate(0);
+  insert_rows(&db, tbl, scenarios);
+  for (auto& s : scenarios) {
+    run(&db, tbl, &s);
+    if (s.rv == nullptr) return EXIT_FAILURE;
+  }
+  db.deactivate(0);
+
+  // Leave the slots as a crash would.  A committed transaction whose
+  // statuses were not final yet still has them pending.
+  Timestamp max_ts = db.min_wts();
+  uint64_t max_seq = 0;
+  for (auto& s : scenarios) {
+    s.slot->state = s.state;
+    if (s.state == CommitSlotState::kCommitted) {
+      s.rv->status = RowVersionStatus::kPending;
+      if (s.slot->commit_ts > max_ts) max_ts = s.slot->commit_ts;
+    } else {
+      if (s.slot->start_ts > max_ts) max_ts = s.slot->start_ts;
+    }
+    max_seq = std::max(max_seq, s.slot->local_tx_seq);
+  }
+  check(scenarios.back().slot->intent_count == CommitSlot::kIntentOverflow,
+        "the intents did not overflow", scenarios.back());
+
+  db.recover();
+
+  std::vector<uint64_t> freed_row_ids;
+  for (auto& s : scenarios) {
+    bool committed = s.state == CommitSlotState::kCommitted;
+
+    RowVersion* head_rv = tbl->head(0, s.row_id)->older_rv;
+    check(head_rv == s.rv, "the update was unlinked", s);
+    RowVersion* older_rv = s.rv->older_rv;
+    check(older_rv != nullptr &&
+              older_rv->status == RowVersionStatus::kCommitted,
+          "the previous version is gone", s);
+
+    if (committed) {
+      check(s.slot->state == CommitSlotState::kCommitted,
+            "the committed slot changed", s);
+      check(s.rv->status == RowVersionStatus::kCommitted,
+            "the pending status was not finalized", s);
+    } else {
+      check(s.slot->state == CommitSlotState::kAborted,
+            "the slot was not released", s);
+      if (s.state != CommitSlotState::kAborted)
+        check(s.slot->commit_ts == s.slot->start_ts,
+              "the released slot keeps its commit timestamp", s);
+      check(s.rv->status == RowVersionStatus::kAborted,
+            "the update was not rolled back", s);
+    }
+
+    for (auto row_id : s.inserted_row_ids) {
+      RowVersion* inserted_rv = tbl->head(0, row_id)->older_rv;
+      if (committed) {
+        check(inserted_rv != nullptr &&
+                  inserted_rv->status == RowVersionStatus::kCommitted,
+              "the committed insert was lost", s);
+      } else {
+        check(inserted_rv == nullptr, "the insert was not unlinked", s);
+        freed_row_ids.push_back(row_id);
+      }
+    }
+  }
+
+  auto& last = scenarios.back();
+  check(!(db.min_wts() < max_ts), "min_wts is behind a recovered slot", last);
+  check(db.min_rts() < db.min_wts(), "min_rts is not below min_wts", last);
+  for (auto& s : scenarios) {
+    auto ts = s.state == CommitSlotState::kCommitted ? s.slot->commit_ts
+                                                     : s.slot->start_ts;
+    if (ts < max_ts)
+      check(!(db.min_rts() < ts), "min_rts is behind a recovered slot", s);
+  }
+
+  // New timestamps order after everything that survived.
+  db.activate(0);
+  check(max_ts < db.context(0)->wts(), "wts is behind a recovered slot",
+        last);
+
+  for (auto& s : scenarios)
+    check(read_value(&db, tbl, s.row_id) ==
+              (s.state == CommitSlotState::kCommitted ? 1u : 0u),
+          "the row has the wrong value", s);
+
+  // The row IDs of unlinked inserts went back to the context, so they are
+  // handed out first.
+  {
+    Transaction tx(db.context(0));
+    while (!tx.begin()) ::mica::util::pause();
+    std::vector<uint64_t> row_ids;
+    for (size_t i = 0; i < freed_row_ids.size(); i++) {
+      RowAccessHandle rah(&tx);
+      if (!rah.new_row(tbl, 0, Transaction::kNewRowID, false,
+                       sizeof(uint64_t)))
+        break;
+      row_ids.push_back(rah.row_id());
+    }
+    std::sort(freed_row_ids.begin(), freed_row_ids.end());
+    std::sort(row_ids.begin(), row_ids.end());
+    check(row_ids == freed_row_ids, "the inserted row IDs were not freed",
+          last);
+
+    // Writer tags stay unique across the crash.
+    auto& slot = db.context(0)->get_slot(tx.current_slot_index());
+    check(slot.local_tx_seq > max_seq, "local_tx_seq went back", last);
+
+    tx.abort();
+  }
+  db.deactivate(0);
+
+  if (failures != 0) {
+    printf("recovery test failed: %" PRIu64 " errors\n", failures);
+    return EXIT_FAILURE;
+  }
+  printf("recovery test passed\n");
+  return EXIT_SUCCESS;
+}
@@ -10,6 +10,8 @@
 struct VisibilityTestConfig : public ::mica::transaction::BasicDBConfig {
     typedef ::mica::transaction::NullLogger<VisibilityTestConfig> Logger;
     static constexpr bool kEnableSlotCommit = true;
+    // Inspects the slot right after begin().
+    static constexpr bool kLazySlotAllocation = false;
     static constexpr bool kVerbose = true;
 };
 
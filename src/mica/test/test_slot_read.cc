@@ -5,6 +5,8 @@
 struct SimpleSlotTestConfig : public ::mica::transaction::BasicDBConfig {
     typedef ::mica::transaction::NullLogger<SimpleSlotTestConfig> Logger;
     static constexpr bool kEnableSlotCommit = true;
+    // Inspects the slot right after begin().
+    static constexpr bool kLazySlotAllocation = false;
     static constexpr bool kVerbose = true;
 };
 
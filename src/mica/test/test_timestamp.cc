@@ -0,0 +1,220 @@
+#include <numa.h>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include "mica/transaction/timestamp.h"
+#include "mica/util/barrier.h"
+#include "mica/util/lcore.h"
+#include "mica/util/stopwatch.h"
+#include "mica/util/tsc.h"
+
+// Measures how fast threads generate timestamps with each timestamp type.
+// CXLClockTimestamp follows Context: a per-thread clock advanced by the TSC
+// and anchored to the reference, which is placed on REFERENCE-NUMA-ID (e.g.,
+// a CXL node).  With TSC-OFFSET, odd threads add it to their TSC as if they
+// ran on another host; "jumps" counts how often a clock was moved up to the
+// reference.
+
+using ::mica::transaction::CompactTimestamp;
+using ::mica::transaction::CentralizedTimestamp;
+using ::mica::transaction::CXLClockTimestamp;
+
+enum class ClockType {
+  kCompact = 0,
+  kCentralized,
+  kCXLClock,
+  kMax,
+};
+
+static const char* clock_names[] = {"compact (local TSC)",
+                                    "centralized counter",
+                                    "CXL clock (hybrid logical clock)"};
+
+struct Task {
+  uint16_t lcore_id;
+  uint16_t num_threads;
+  uint64_t tsc_offset;
+
+  ClockType clock_type;
+
+  uint64_t c;
+  uint64_t jumps;
+  uint64_t last_t2;
+  struct timeval tv_start;
+  struct timeval tv_end;
+} __attribute__((aligned(128)));
+
+static ::mica::util::Stopwatch sw;
+static volatile uint16_t running_threads;
+static volatile uint8_t stop;
+
+int worker_proc(Task* task) {
+  ::mica::util::lcore.pin_thread(task->lcore_id);
+
+  __sync_add_and_fetch(&running_threads, 1);
+  while (running_threads < task->num_threads) ::mica::util::pause();
+
+  gettimeofday(&task->tv_start, nullptr);
+
+  uint64_t t = sw.now();
+  uint64_t c = 0;
+  uint64_t jumps = 0;
+  uint64_t t2 = 0;
+
+  // As in Context.
+  uint64_t last_tsc = ::mica::util::rdtsc();
+  uint64_t clock = last_tsc + task->tsc_offset;
+  uint64_t adjusted_clock = 0;
+
+  while (!stop) {
+    const int n = 100;
+    for (int i = 0; i < n; i++) {
+      switch (task->clock_type) {
+        case ClockType::kCompact:
+          t2 += CompactTimestamp::make(0, ::mica::util::rdtsc(),
+                                       task->lcore_id)
+                    .t2;
+          break;
+        case ClockType::kCentralized:
+          t2 += CentralizedTimestamp::make(0, 0, task->lcore_id).t2;
+          break;
+        case ClockType::kCXLClock: {
+          uint64_t tsc = ::mica::util::rdtsc();
+          int64_t tsc_diff = static_cast<int64_t>(tsc - last_tsc);
+          clock += tsc_diff > 0 ? static_cast<uint64_t>(tsc_diff) : 1;
+          last_tsc = tsc;
+
+          uint64_t anchored = CXLClockTimestamp::anchor_clock(clock);
+          if (anchored != clock) jumps++;
+          clock = anchored;
+
+          if (static_cast<int64_t>(clock - adjusted_clock) <= 0)
+            adjusted_clock++;
+          else
+            adjusted_clock = clock;
+          t2 += CXLClockTimestamp::make(0, adjusted_clock, task->lcore_id).t2;
+        } break;
+        default:
+          assert(false);
+      }
+    }
+    c += n;
+
+    if (task->lcore_id == 0 &&
+        sw.diff_in_cycles(sw.now(), t) >= 3 * sw.c_1_sec())
+      stop = 1;
+  }
+
+  gettimeofday(&task->tv_end, nullptr);
+
+  task->c = c;
+  task->jumps = jumps;
+  // Keeps the timestamps from being optimized out.
+  task->last_t2 = t2;
+
+  return 0;
+}
+
+int main(int argc, const char* argv[]) {
+  if (argc < 2 || argc > 4) {
+    printf("%s THREAD-COUNT [REFERENCE-NUMA-ID [TSC-OFFSET]]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  ::mica::util::lcore.pin_thread(0);
+
+  sw.init_start();
+  sw.init_end();
+
+  printf("1 seconds: %" PRIu64 " cycles\n", sw.c_1_sec());
+
+  uint16_t num_threads = static_cast<uint16_t>(atoi(argv[1]));
+  assert(num_threads <=
+         static_cast<uint16_t>(::mica::util::lcore.lcore_count()));
+  assert(num_threads <= CXLClockTimestamp::kMaxThreadCount);
+  int reference_numa_id = argc >= 3 ? atoi(argv[2]) : -1;
+  uint64_t tsc_offset =
+      argc >= 4 ? static_cast<uint64_t>(atoll(argv[3])) : uint64_t(0);
+  printf("num_threads: %hu\n", num_threads);
+  printf("reference_numa_id: %d\n", reference_numa_id);
+  printf("tsc_offset: %" PRIu64 "\n", tsc_offset);
+  printf("max_clock_skew: %" PRId64 "\n", CXLClockTimestamp::kMaxClockSkew);
+  printf("\n");
+
+  volatile uint64_t* reference = nullptr;
+  if (reference_numa_id >= 0) {
+    reference = reinterpret_cast<volatile uint64_t*>(
+        numa_alloc_onnode(4096, reference_numa_id));
+    if (reference == nullptr) {
+      fprintf(stderr, "error: failed to allocate the reference on node %d\n",
+              reference_numa_id);
+      return EXIT_FAILURE;
+    }
+    CXLClockTimestamp::set_reference(reference);
+  }
+
+  for (int type = 0; type < static_cast<int>(ClockType::kMax); type++) {
+    std::vector<Task> tasks(num_threads);
+    for (uint16_t lcore_id = 0; lcore_id < num_threads; lcore_id++) {
+      tasks[lcore_id].lcore_id = lcore_id;
+      tasks[lcore_id].num_threads = num_threads;
+      tasks[lcore_id].tsc_offset = lcore_id % 2 == 1 ? tsc_offset : 0;
+      tasks[lcore_id].clock_type = static_cast<ClockType>(type);
+    }
+
+    running_threads = 0;
+    stop = 0;
+    *CXLClockTimestamp::reference() = 0;
+    ::mica::util::memory_barrier();
+
+    std::vector<std::thread> threads;
+    for (size_t thread_id = 1; thread_id < num_threads; thread_id++)
+      threads.emplace_back(worker_proc, &tasks[thread_id]);
+    worker_proc(&tasks[0]);
+
+    while (threads.size() > 0) {
+      threads.back().join();
+      threads.pop_back();
+    }
+
+    double diff;
+    {
+      double min_start = 0.;
+      double max_end = 0.;
+      for (size_t thread_id = 0; thread_id < num_threads; thread_id++) {
+        double start = (double)tasks[thread_id].tv_start.tv_sec * 1. +
+                       (double)tasks[thread_id].tv_start.tv_usec * 0.000001;
+        double end = (double)tasks[thread_id].tv_end.tv_sec * 1. +
+                     (double)tasks[thread_id].tv_end.tv_usec * 0.000001;
+        if (thread_id == 0 || min_start > start) min_start = start;
+        if (thread_id == 0 || max_end < end) max_end = end;
+      }
+
+      diff = max_end - min_start;
+    }
+
+    uint64_t c = 0;
+    uint64_t jumps = 0;
+    for (size_t thread_id = 0; thread_id < num_threads; thread_id++) {
+      c += tasks[thread_id].c;
+      jumps += tasks[thread_id].jumps;
+    }
+
+    printf("clock_type: %s\n", clock_names[type]);
+    printf("elapsed: %lf\n", diff);
+    printf("count: %" PRIu64 " (%.3lf M/sec)\n", c,
+           static_cast<double>(c) / diff / 1000000.);
+    if (static_cast<ClockType>(type) == ClockType::kCXLClock)
+      printf("jumps: %" PRIu64 " (%.3lf%%)\n", jumps,
+             static_cast<double>(jumps) / static_cast<double>(c) * 100.);
+    printf("\n");
+  }
+
+  if (reference != nullptr) {
+    CXLClockTimestamp::reset_reference();
+    numa_free(const_cast<uint64_t*>(reference), 4096);
+  }
+
+  return EXIT_SUCCESS;
+}
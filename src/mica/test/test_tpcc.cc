@@ -0,0 +1,1588 @@
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <random>
+#include "mica/transaction/db.h"
+#include "mica/util/lcore.h"
+#include "mica/util/latency.h"
+#include "mica/util/rand.h"
+
+struct DBConfig : public ::mica::transaction::BasicDBConfig {
+  // Switch this for verification.
+  typedef ::mica::transaction::NullLogger<DBConfig> Logger;
+};
+
+typedef DBConfig::Alloc Alloc;
+typedef DBConfig::Logger Logger;
+typedef DBConfig::Timing Timing;
+typedef ::mica::transaction::PagePool<DBConfig> PagePool;
+typedef ::mica::transaction::DB<DBConfig> DB;
+typedef ::mica::transaction::Table<DBConfig> Table;
+typedef DB::HashIndexUniqueU64 HashIndex;
+typedef DB::BTreeIndexUniqueU64 BTreeIndex;
+typedef ::mica::transaction::RowAccessHandle<DBConfig> RowAccessHandle;
+typedef ::mica::transaction::RowAccessHandlePeekOnly<DBConfig>
+    RowAccessHandlePeekOnly;
+typedef ::mica::transaction::Transaction<DBConfig> Transaction;
+typedef ::mica::transaction::Result Result;
+typedef ::mica::transaction::BTreeRangeType BTreeRangeType;
+
+static ::mica::util::Stopwatch sw;
+
+// Debugging
+static constexpr bool kShowPoolStats = true;
+
+// Index lookups do not validate the index nodes; the rows found by the lookups
+// are validated as usual.
+static constexpr bool kSkipValidationForIndexAccess = true;
+
+// Run OrderStatus and StockLevel as peek-only (snapshot) transactions.
+static constexpr bool kUseSnapshot = true;
+
+// TPC-C constants.  The item and customer counts can be scaled down in
+// test_tpcc.json for quick runs.
+static constexpr uint64_t kDistrictsPerWarehouse = 10;
+static constexpr uint64_t kDefaultItemCount = 100000;
+static constexpr uint64_t kDefaultCustomersPerDistrict = 3000;
+static constexpr uint64_t kMaxOrderLines = 15;
+static constexpr uint64_t kLastNameCount = 1000;
+// The last 30% of the initial orders are undelivered.
+static constexpr double kInitialNewOrderRatio = 0.3;
+
+// Schema.
+
+struct Warehouse {
+  double w_tax;
+  double w_ytd;
+  char w_name[10];
+  char w_street_1[20];
+  char w_street_2[20];
+  char w_city[20];
+  char w_state[2];
+  char w_zip[9];
+};
+
+struct District {
+  double d_tax;
+  double d_ytd;
+  uint64_t d_next_o_id;
+  char d_name[10];
+  char d_street_1[20];
+  char d_street_2[20];
+  char d_city[20];
+  char d_state[2];
+  char d_zip[9];
+};
+
+struct Customer {
+  uint64_t c_id;
+  uint64_t c_since;
+  double c_credit_lim;
+  double c_discount;
+  double c_balance;
+  double c_ytd_payment;
+  uint32_t c_payment_cnt;
+  uint32_t c_delivery_cnt;
+  char c_first[16];
+  char c_middle[2];
+  char c_last[16];
+  char c_street_1[20];
+  char c_street_2[20];
+  char c_city[20];
+  char c_state[2];
+  char c_zip[9];
+  char c_phone[16];
+  char c_credit[2];
+  char c_data[500];
+};
+
+struct History {
+  uint64_t h_c_id;
+  uint64_t h_c_d_id;
+  uint64_t h_c_w_id;
+  uint64_t h_d_id;
+  uint64_t h_w_id;
+  uint64_t h_date;
+  double h_amount;
+  char h_data[24];
+};
+
+struct NewOrder {
+  uint64_t no_o_id;
+  uint64_t no_d_id;
+  uint64_t no_w_id;
+};
+
+struct Order {
+  uint64_t o_id;
+  uint64_t o_c_id;
+  uint64_t o_d_id;
+  uint64_t o_w_id;
+  uint64_t o_entry_d;
+  uint32_t o_carrier_id;
+  uint32_t o_ol_cnt;
+  uint32_t o_all_local;
+};
+
+struct OrderLine {
+  uint64_t ol_o_id;
+  uint64_t ol_d_id;
+  uint64_t ol_w_id;
+  uint64_t ol_number;
+  uint64_t ol_i_id;
+  uint64_t ol_supply_w_id;
+  uint64_t ol_delivery_d;
+  uint32_t ol_quantity;
+  double ol_amount;
+  char ol_dist_info[24];
+};
+
+struct Item {
+  uint64_t i_id;
+  uint64_t i_im_id;
+  double i_price;
+  char i_name[24];
+  char i_data[50];
+};
+
+struct Stock {
+  uint64_t s_i_id;
+  uint64_t s_w_id;
+  int32_t s_quantity;
+  uint32_t s_ytd;
+  uint32_t s_order_cnt;
+  uint32_t s_remote_cnt;
+  char s_dist[kDistrictsPerWarehouse][24];
+  char s_data[50];
+};
+
+enum TableID : int {
+  kWarehouse = 0,
+  kDistrict,
+  kCustomer,
+  kHistory,
+  kNewOrder,
+  kOrder,
+  kOrderLine,
+  kItem,
+  kStock,
+  kTableCount
+};
+static const char* table_names[] = {"warehouse", "district",   "customer",
+                                    "history",   "new_order",  "order",
+                                    "order_line", "item",      "stock"};
+static const uint64_t table_data_sizes[] = {
+    sizeof(Warehouse), sizeof(District),  sizeof(Customer),
+    sizeof(History),   sizeof(NewOrder),  sizeof(Order),
+    sizeof(OrderLine), sizeof(Item),      sizeof(Stock)};
+
+enum TxType : int {
+  kNewOrderTx = 0,
+  kPaymentTx,
+  kOrderStatusTx,
+  kDeliveryTx,
+  kStockLevelTx,
+  kTxTypeCount
+};
+static const char* tx_type_names[] = {"NewOrder", "Payment", "OrderStatus",
+                                      "Delivery", "StockLevel"};
+
+// Index keys.  Warehouse and district IDs are 0-based; customer, order, and
+// item IDs are 1-based as in the specification.
+
+static uint64_t district_key(uint64_t w_id, uint64_t d_id) {
+  return w_id * kDistrictsPerWarehouse + d_id;
+}
+
+struct TPCC {
+  DB* db;
+  Table* tbls[kTableCount];
+
+  HashIndex* warehouse_idx;
+  HashIndex* district_idx;
+  HashIndex* customer_idx;
+  HashIndex* item_idx;
+  HashIndex* stock_idx;
+  // (district, last name, c_id)
+  BTreeIndex* customer_name_idx;
+  // (district, o_id)
+  BTreeIndex* order_idx;
+  // (district, c_id, o_id)
+  BTreeIndex* order_cust_idx;
+  // (district, o_id)
+  BTreeIndex* new_order_idx;
+  // (district, o_id, ol_number)
+  BTreeIndex* order_line_idx;
+
+  uint64_t num_warehouses;
+  uint64_t num_items;
+  uint64_t num_customers;
+
+  // NURand run-time constants.
+  uint64_t c_last;
+  uint64_t c_id;
+  uint64_t ol_i_id;
+
+  uint64_t customer_key(uint64_t w_id, uint64_t d_id, uint64_t c_id) const {
+    return district_key(w_id, d_id) * num_customers + (c_id - 1);
+  }
+  uint64_t stock_key(uint64_t w_id, uint64_t i_id) const {
+    return w_id * num_items + (i_id - 1);
+  }
+};
+
+static uint64_t customer_name_key(uint64_t w_id, uint64_t d_id,
+                                  uint64_t last_idx, uint64_t c_id) {
+  return (district_key(w_id, d_id) << 32) | (last_idx << 16) | c_id;
+}
+static uint64_t order_key(uint64_t w_id, uint64_t d_id, uint64_t o_id) {
+  return (district_key(w_id, d_id) << 32) | o_id;
+}
+static uint64_t order_cust_key(uint64_t w_id, uint64_t d_id, uint64_t c_id,
+                               uint64_t o_id) {
+  return (district_key(w_id, d_id) << 48) | (c_id << 32) | o_id;
+}
+static uint64_t order_line_key(uint64_t w_id, uint64_t d_id, uint64_t o_id,
+                               uint64_t ol_number) {
+  return (district_key(w_id, d_id) << 36) | (o_id << 4) | ol_number;
+}
+
+// Random input generation.
+
+static uint64_t uniform(::mica::util::Rand& rand, uint64_t min, uint64_t max) {
+  return min + rand.next_u32() % (max - min + 1);
+}
+
+static uint64_t nurand(::mica::util::Rand& rand, uint64_t a, uint64_t c,
+                       uint64_t min, uint64_t max) {
+  return (((uniform(rand, 0, a) | uniform(rand, min, max)) + c) %
+          (max - min + 1)) +
+         min;
+}
+
+static void make_string(::mica::util::Rand& rand, char* s, size_t len) {
+  for (size_t i = 0; i < len; i++)
+    s[i] = static_cast<char>('a' + rand.next_u32() % 26);
+}
+
+static void make_last_name(uint64_t last_idx, char* s, size_t len) {
+  static const char* syllables[] = {"BAR", "OUGHT", "ABLE",  "PRI",   "PRES",
+                                    "ESE", "ANTI",  "CALLY", "ATION", "EING"};
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%s%s%s", syllables[last_idx / 100],
+           syllables[last_idx / 10 % 10], syllables[last_idx % 10]);
+  ::mica::util::memset(s, 0, len);
+  ::mica::util::memcpy(s, buf, std::min(len, strlen(buf)));
+}
+
+// Row and index access helpers.  All return false (or nullptr) if the
+// transaction must abort.
+
+template <typename T>
+static const T* get_row(Transaction* tx, Table* tbl, uint64_t row_id) {
+  if (tx->is_peek_only()) {
+    RowAccessHandlePeekOnly rah(tx);
+    if (!rah.peek_row(tbl, 0, row_id, false, false, false)) return nullptr;
+    return reinterpret_cast<const T*>(rah.cdata());
+  }
+  RowAccessHandle rah(tx);
+  if (!rah.peek_row(tbl, 0, row_id, false, true, false) || !rah.read_row())
+    return nullptr;
+  return reinterpret_cast<const T*>(rah.cdata());
+}
+
+template <typename T>
+static T* update_row(Transaction* tx, Table* tbl, uint64_t row_id) {
+  RowAccessHandle rah(tx);
+  if (!rah.peek_row(tbl, 0, row_id, false, true, true) || !rah.read_row() ||
+      !rah.write_row(sizeof(T)))
+    return nullptr;
+  return reinterpret_cast<T*>(rah.data());
+}
+
+template <typename T>
+static T* insert_row(Transaction* tx, Table* tbl, uint64_t& row_id) {
+  RowAccessHandle rah(tx);
+  if (!rah.new_row(tbl, 0, Transaction::kNewRowID, true, sizeof(T)))
+    return nullptr;
+  row_id = rah.row_id();
+  return reinterpret_cast<T*>(rah.data());
+}
+
+static bool delete_row(Transaction* tx, Table* tbl, uint64_t row_id) {
+  RowAccessHandle rah(tx);
+  return rah.peek_row(tbl, 0, row_id, false, true, true) && rah.read_row() &&
+         rah.write_row() && rah.delete_row();
+}
+
+template <class Index>
+static bool index_insert(Transaction* tx, Index* idx, uint64_t key,
+                         uint64_t row_id) {
+  return idx->insert(tx, key, row_id) == 1;
+}
+
+// Returns 1 if found, 0 if not found, and Index::kHaveToAbort on abort.
+template <class Index>
+static uint64_t index_lookup(Transaction* tx, Index* idx, uint64_t key,
+                             uint64_t& row_id) {
+  return idx->lookup(tx, key, kSkipValidationForIndexAccess,
+                     [&row_id](auto& k, auto& v) {
+                       (void)k;
+                       row_id = v;
+                       return false;
+                     });
+}
+
+// Finds the first entry in [min_key, max_key].
+template <bool Reversed>
+static uint64_t index_first(Transaction* tx, BTreeIndex* idx, uint64_t min_key,
+                            uint64_t max_key, uint64_t& key,
+                            uint64_t& row_id) {
+  return idx->lookup<BTreeRangeType::kInclusive, BTreeRangeType::kInclusive,
+                     Reversed>(tx, min_key, max_key,
+                               kSkipValidationForIndexAccess,
+                               [&key, &row_id](auto& k, auto& v) {
+                                 key = k;
+                                 row_id = v;
+                                 return false;
+                               });
+}
+
+// Worker task.
+
+struct TxTypeStats {
+  uint64_t committed;
+  uint64_t aborted;
+  uint64_t rolled_back;
+  // The latency of committed transactions including retries (us).
+  ::mica::util::Latency latency;
+};
+
+struct Task {
+  TPCC* tpcc;
+
+  uint64_t thread_id;
+  uint64_t num_threads;
+
+  // Warehouse-per-thread mode.
+  bool partitioned;
+  uint64_t home_w_id;
+  // Cross-partition mode.
+  uint64_t remote_item_pct;
+  uint64_t remote_payment_pct;
+
+  uint64_t duration_ms;
+
+  // Results.
+  struct timeval tv_start;
+  struct timeval tv_end;
+
+  TxTypeStats stats[kTxTypeCount];
+} __attribute__((aligned(64)));
+
+enum class TxResult {
+  kCommitted = 0,
+  kAborted,
+  // An application-requested rollback (1% of NewOrder).
+  kRolledBack,
+};
+
+static volatile uint16_t running_threads;
+static volatile uint8_t stopping;
+
+static uint64_t other_warehouse(Task* task, ::mica::util::Rand& rand,
+                                uint64_t w_id) {
+  auto n = task->tpcc->num_warehouses;
+  if (n == 1) return w_id;
+  auto other = uniform(rand, 0, n - 2);
+  return other >= w_id ? other + 1 : other;
+}
+
+// Finds a customer by last name (picking the middle one as in the
+// specification, ordered by c_id instead of c_first) or by c_id.  Returns
+// false if the transaction must abort.
+static bool find_customer(Transaction* tx, TPCC* tpcc, uint64_t w_id,
+                          uint64_t d_id, bool by_name, uint64_t last_idx,
+                          uint64_t& c_id, uint64_t& row_id) {
+  if (by_name) {
+    static constexpr size_t kMaxMatches = 256;
+    uint64_t matches[kMaxMatches];
+    size_t match_count = 0;
+
+    auto ret =
+        tpcc->customer_name_idx
+            ->lookup<BTreeRangeType::kInclusive, BTreeRangeType::kInclusive,
+                     false>(tx, customer_name_key(w_id, d_id, last_idx, 0),
+                            customer_name_key(w_id, d_id, last_idx, 0xffff),
+                            kSkipValidationForIndexAccess,
+                            [&](auto& k, auto& v) {
+                              (void)v;
+                              matches[match_count++] = k & 0xffff;
+                              return match_count < kMaxMatches;
+                            });
+    if (ret == BTreeIndex::kHaveToAbort) return false;
+    // Fall back to a c_id lookup if no customer has this name (possible with
+    // a scaled-down customer count).
+    if (match_count == 0)
+      c_id = last_idx % tpcc->num_customers + 1;
+    else
+      c_id = matches[(match_count - 1) / 2];
+  }
+
+  return index_lookup(tx, tpcc->customer_idx,
+                      tpcc->customer_key(w_id, d_id, c_id), row_id) == 1;
+}
+
+// Transactions.
+
+static TxResult new_order_tx(Task* task, Transaction* tx,
+                             ::mica::util::Rand& rand, uint64_t w_id) {
+  auto tpcc = task->tpcc;
+
+  struct Line {
+    uint64_t i_id;
+    uint64_t supply_w_id;
+    uint32_t quantity;
+  };
+
+  uint64_t d_id = uniform(rand, 0, kDistrictsPerWarehouse - 1);
+  uint64_t c_id = nurand(rand, 1023, tpcc->c_id, 1, tpcc->num_customers);
+  uint64_t ol_cnt = uniform(rand, 5, kMaxOrderLines);
+  bool rollback = uniform(rand, 1, 100) == 1;
+  bool all_local = true;
+
+  Line lines[kMaxOrderLines];
+  for (uint64_t i = 0; i < ol_cnt; i++) {
+    while (true) {
+      lines[i].i_id = nurand(rand, 8191, tpcc->ol_i_id, 1, tpcc->num_items);
+      // Avoid duplicate items in a single transaction.
+      uint64_t j;
+      for (j = 0; j < i; j++)
+        if (lines[j].i_id == lines[i].i_id) break;
+      if (j == i) break;
+    }
+    lines[i].supply_w_id = w_id;
+    if (!task->partitioned && uniform(rand, 1, 100) <= task->remote_item_pct) {
+      lines[i].supply_w_id = other_warehouse(task, rand, w_id);
+      if (lines[i].supply_w_id != w_id) all_local = false;
+    }
+    lines[i].quantity = static_cast<uint32_t>(uniform(rand, 1, 10));
+  }
+  // An unused item ID causes a rollback.
+  if (rollback) lines[ol_cnt - 1].i_id = tpcc->num_items + 1;
+
+  uint64_t now = sw.now();
+
+  while (true) {
+    bool ret = tx->begin();
+    assert(ret);
+    (void)ret;
+
+    bool aborted = true;
+    do {
+      uint64_t row_id;
+
+      if (index_lookup(tx, tpcc->warehouse_idx, w_id, row_id) != 1) break;
+      auto w = get_row<Warehouse>(tx, tpcc->tbls[kWarehouse], row_id);
+      if (!w) break;
+
+      if (index_lookup(tx, tpcc->district_idx, district_key(w_id, d_id),
+                       row_id) != 1)
+        break;
+      auto d = update_row<District>(tx, tpcc->tbls[kDistrict], row_id);
+      if (!d) break;
+      uint64_t o_id = d->d_next_o_id++;
+
+      if (index_lookup(tx, tpcc->customer_idx,
+                       tpcc->customer_key(w_id, d_id, c_id), row_id) != 1)
+        break;
+      auto c = get_row<Customer>(tx, tpcc->tbls[kCustomer], row_id);
+      if (!c) break;
+
+      auto o = insert_row<Order>(tx, tpcc->tbls[kOrder], row_id);
+      if (!o) break;
+      o->o_id = o_id;
+      o->o_c_id = c_id;
+      o->o_d_id = d_id;
+      o->o_w_id = w_id;
+      o->o_entry_d = now;
+      o->o_carrier_id = 0;
+      o->o_ol_cnt = static_cast<uint32_t>(ol_cnt);
+      o->o_all_local = all_local ? 1 : 0;
+      if (!index_insert(tx, tpcc->order_idx, order_key(w_id, d_id, o_id),
+                        row_id) ||
+          !index_insert(tx, tpcc->order_cust_idx,
+                        order_cust_key(w_id, d_id, c_id, o_id), row_id))
+        break;
+
+      auto no = insert_row<NewOrder>(tx, tpcc->tbls[kNewOrder], row_id);
+      if (!no) break;
+      no->no_o_id = o_id;
+      no->no_d_id = d_id;
+      no->no_w_id = w_id;
+      if (!index_insert(tx, tpcc->new_order_idx, order_key(w_id, d_id, o_id),
+                        row_id))
+        break;
+
+      double total = 0.;
+      uint64_t i;
+      for (i = 0; i < ol_cnt; i++) {
+        auto& line = lines[i];
+
+        auto found = index_lookup(tx, tpcc->item_idx, line.i_id, row_id);
+        if (found == HashIndex::kHaveToAbort) break;
+        if (found == 0) {
+          tx->abort(true);
+          task->stats[kNewOrderTx].rolled_back++;
+          return TxResult::kRolledBack;
+        }
+        auto item = get_row<Item>(tx, tpcc->tbls[kItem], row_id);
+        if (!item) break;
+
+        if (index_lookup(tx, tpcc->stock_idx,
+                         tpcc->stock_key(line.supply_w_id, line.i_id),
+                         row_id) != 1)
+          break;
+        auto s = update_row<Stock>(tx, tpcc->tbls[kStock], row_id);
+        if (!s) break;
+        if (s->s_quantity >= static_cast<int32_t>(line.quantity) + 10)
+          s->s_quantity -= static_cast<int32_t>(line.quantity);
+        else
+          s->s_quantity += 91 - static_cast<int32_t>(line.quantity);
+        s->s_ytd += line.quantity;
+        s->s_order_cnt++;
+        if (line.supply_w_id != w_id) s->s_remote_cnt++;
+
+        double amount = static_cast<double>(line.quantity) * item->i_price;
+        total += amount;
+
+        auto ol = insert_row<OrderLine>(tx, tpcc->tbls[kOrderLine], row_id);
+        if (!ol) break;
+        ol->ol_o_id = o_id;
+        ol->ol_d_id = d_id;
+        ol->ol_w_id = w_id;
+        ol->ol_number = i + 1;
+        ol->ol_i_id = line.i_id;
+        ol->ol_supply_w_id = line.supply_w_id;
+        ol->ol_delivery_d = 0;
+        ol->ol_quantity = line.quantity;
+        ol->ol_amount = amount;
+        ::mica::util::memcpy(ol->ol_dist_info, s->s_dist[d_id],
+                             sizeof(ol->ol_dist_info));
+        if (!index_insert(tx, tpcc->order_line_idx,
+                          order_line_key(w_id, d_id, o_id, i + 1), row_id))
+          break;
+      }
+      if (i != ol_cnt) break;
+
+      total *= (1. - c->c_discount) * (1. + w->w_tax + d->d_tax);
+      (void)total;
+
+      aborted = false;
+    } while (false);
+
+    if (aborted) {
+      tx->abort();
+      task->stats[kNewOrderTx].aborted++;
+      if (stopping) return TxResult::kAborted;
+      continue;
+    }
+
+    Result result;
+    if (!tx->commit(&result)) {
+      task->stats[kNewOrderTx].aborted++;
+      if (stopping) return TxResult::kAborted;
+      continue;
+    }
+    return TxResult::kCommitted;
+  }
+}
+
+static TxResult payment_tx(Task* task, Transaction* tx,
+                           ::mica::util::Rand& rand, uint64_t w_id) {
+  auto tpcc = task->tpcc;
+
+  uint64_t d_id = uniform(rand, 0, kDistrictsPerWarehouse - 1);
+  uint64_t c_w_id = w_id;
+  uint64_t c_d_id = d_id;
+  if (!task->partitioned && uniform(rand, 1, 100) <= task->remote_payment_pct) {
+    c_w_id = other_warehouse(task, rand, w_id);
+    c_d_id = uniform(rand, 0, kDistrictsPerWarehouse - 1);
+  }
+  bool by_name = uniform(rand, 1, 100) <= 60;
+  uint64_t last_idx = nurand(rand, 255, tpcc->c_last, 0, kLastNameCount - 1);
+  uint64_t c_id = nurand(rand, 1023, tpcc->c_id, 1, tpcc->num_customers);
+  double amount = static_cast<double>(uniform(rand, 100, 500000)) / 100.;
+
+  uint64_t now = sw.now();
+
+  while (true) {
+    bool ret = tx->begin();
+    assert(ret);
+    (void)ret;
+
+    bool aborted = true;
+    do {
+      uint64_t row_id;
+
+      if (index_lookup(tx, tpcc->warehouse_idx, w_id, row_id) != 1) break;
+      auto w = update_row<Warehouse>(tx, tpcc->tbls[kWarehouse], row_id);
+      if (!w) break;
+      w->w_ytd += amount;
+
+      if (index_lookup(tx, tpcc->district_idx, district_key(w_id, d_id),
+                       row_id) != 1)
+        break;
+      auto d = update_row<District>(tx, tpcc->tbls[kDistrict], row_id);
+      if (!d) break;
+      d->d_ytd += amount;
+
+      uint64_t found_c_id = c_id;
+      if (!find_customer(tx, tpcc, c_w_id, c_d_id, by_name, last_idx,
+                         found_c_id, row_id))
+        break;
+      auto c = update_row<Customer>(tx, tpcc->tbls[kCustomer], row_id);
+      if (!c) break;
+      c->c_balance -= amount;
+      c->c_ytd_payment += amount;
+      c->c_payment_cnt++;
+      if (c->c_credit[0] == 'B' && c->c_credit[1] == 'C') {
+        char buf[64];
+        int len = snprintf(buf, sizeof(buf),
+                           "%" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64
+                           " %" PRIu64 " %.2lf|",
+                           found_c_id, c_d_id, c_w_id, d_id, w_id, amount);
+        auto shift = std::min(static_cast<size_t>(len), sizeof(buf) - 1);
+        ::mica::util::memmove(c->c_data + shift, c->c_data,
+                              sizeof(c->c_data) - shift);
+        ::mica::util::memcpy(c->c_data, buf, shift);
+      }
+
+      auto h = insert_row<History>(tx, tpcc->tbls[kHistory], row_id);
+      if (!h) break;
+      h->h_c_id = found_c_id;
+      h->h_c_d_id = c_d_id;
+      h->h_c_w_id = c_w_id;
+      h->h_d_id = d_id;
+      h->h_w_id = w_id;
+      h->h_date = now;
+      h->h_amount = amount;
+      ::mica::util::memset(h->h_data, 0, sizeof(h->h_data));
+      ::mica::util::memcpy(h->h_data, w->w_name, sizeof(w->w_name));
+      ::mica::util::memcpy(h->h_data + 12, d->d_name, sizeof(d->d_name));
+
+      aborted = false;
+    } while (false);
+
+    if (aborted) {
+      tx->abort();
+      task->stats[kPaymentTx].aborted++;
+      if (stopping) return TxResult::kAborted;
+      continue;
+    }
+
+    Result result;
+    if (!tx->commit(&result)) {
+      task->stats[kPaymentTx].aborted++;
+      if (stopping) return TxResult::kAborted;
+      continue;
+    }
+    return TxResult::kCommitted;
+  }
+}
+
+static TxResult order_status_tx(Task* task, Transaction* tx,
+                                ::mica::util::Rand& rand, uint64_t w_id) {
+  auto tpcc = task->tpcc;
+
+  uint64_t d_id = uniform(rand, 0, kDistrictsPerWarehouse - 1);
+  bool by_name = uniform(rand, 1, 100) <= 60;
+  uint64_t last_idx = nurand(rand, 255, tpcc->c_last, 0, kLastNameCount - 1);
+  uint64_t c_id = nurand(rand, 1023, tpcc->c_id, 1, tpcc->num_customers);
+
+  while (true) {
+    bool ret = tx->begin(kUseSnapshot);
+    assert(ret);
+    (void)ret;
+
+    bool aborted = true;
+    do {
+      uint64_t row_id;
+
+      uint64_t found_c_id = c_id;
+      if (!find_customer(tx, tpcc, w_id, d_id, by_name, last_idx, found_c_id,
+                         row_id))
+        break;
+      auto c = get_row<Customer>(tx, tpcc->tbls[kCustomer], row_id);
+      if (!c) break;
+
+      // The most recent order of the customer.
+      uint64_t key;
+      auto found = index_first<true>(
+          tx, tpcc->order_cust_idx, order_cust_key(w_id, d_id, found_c_id, 0),
+          order_cust_key(w_id, d_id, found_c_id, 0xffffffff), key, row_id);
+      if (found == BTreeIndex::kHaveToAbort) break;
+      if (found == 0) {
+        aborted = false;
+        break;
+      }
+      auto o = get_row<Order>(tx, tpcc->tbls[kOrder], row_id);
+      if (!o) break;
+
+      uint64_t o_id = o->o_id;
+      uint64_t quantity = 0;
+      bool failed = false;
+      auto ret2 = tpcc->order_line_idx->lookup<BTreeRangeType::kInclusive,
+                                               BTreeRangeType::kInclusive,
+                                               false>(
+          tx, order_line_key(w_id, d_id, o_id, 1),
+          order_line_key(w_id, d_id, o_id, kMaxOrderLines),
+          kSkipValidationForIndexAccess, [&](auto& k, auto& v) {
+            (void)k;
+            auto ol = get_row<OrderLine>(tx, tpcc->tbls[kOrderLine], v);
+            if (!ol) {
+              failed = true;
+              return false;
+            }
+            quantity += ol->ol_quantity;
+            return true;
+          });
+      if (ret2 == BTreeIndex::kHaveToAbort || failed) break;
+      (void)quantity;
+
+      aborted = false;
+    } while (false);
+
+    if (aborted) {
+      tx->abort();
+      task->stats[kOrderStatusTx].aborted++;
+      if (stopping) return TxResult::kAborted;
+      continue;
+    }
+
+    Result result;
+    if (!tx->commit(&result)) {
+      task->stats[kOrderStatusTx].aborted++;
+      if (stopping) return TxResult::kAborted;
+      continue;
+    }
+    return TxResult::kCommitted;
+  }
+}
+
+static TxResult delivery_tx(Task* task, Transaction* tx,
+                            ::mica::util::Rand& rand, uint64_t w_id) {
+  auto tpcc = task->tpcc;
+
+  uint32_t carrier_id = static_cast<uint32_t>(uniform(rand, 1, 10));
+
+  uint64_t now = sw.now();
+
+  while (true) {
+    bool ret = tx->begin();
+    assert(ret);
+    (void)ret;
+
+    bool aborted = true;
+    uint64_t d_id;
+    for (d_id = 0; d_id < kDistrictsPerWarehouse; d_id++) {
+      uint64_t key;
+      uint64_t row_id;
+
+      // The oldest undelivered order.
+      auto found = index_first<false>(
+          tx, tpcc->new_order_idx, order_key(w_id, d_id, 0),
+          order_key(w_id, d_id, 0xffffffff), key, row_id);
+      if (found == BTreeIndex::kHaveToAbort) break;
+      if (found == 0) continue;
+      uint64_t o_id = key & 0xffffffff;
+
+      if (!delete_row(tx, tpcc->tbls[kNewOrder], row_id) ||
+          tpcc->new_order_idx->remove(tx, key, row_id) != 1)
+        break;
+
+      if (index_lookup(tx, tpcc->order_idx, order_key(w_id, d_id, o_id),
+                       row_id) != 1)
+        break;
+      auto o = update_row<Order>(tx, tpcc->tbls[kOrder], row_id);
+      if (!o) break;
+      o->o_carrier_id = carrier_id;
+      uint64_t c_id = o->o_c_id;
+
+      double total = 0.;
+      bool failed = false;
+      auto ret2 = tpcc->order_line_idx->lookup<BTreeRangeType::kInclusive,
+                                               BTreeRangeType::kInclusive,
+                                               false>(
+          tx, order_line_key(w_id, d_id, o_id, 1),
+          order_line_key(w_id, d_id, o_id, kMaxOrderLines),
+          kSkipValidationForIndexAccess, [&](auto& k, auto& v) {
+            (void)k;
+            auto ol = update_row<OrderLine>(tx, tpcc->tbls[kOrderLine], v);
+            if (!ol) {
+              failed = true;
+              return false;
+            }
+            ol->ol_delivery_d = now;
+            total += ol->ol_amount;
+            return true;
+          });
+      if (ret2 == BTreeIndex::kHaveToAbort || failed) break;
+
+      if (index_lookup(tx, tpcc->customer_idx,
+                       tpcc->customer_key(w_id, d_id, c_id), row_id) != 1)
+        break;
+      auto c = update_row<Customer>(tx, tpcc->tbls[kCustomer], row_id);
+      if (!c) break;
+      c->c_balance += total;
+      c->c_delivery_cnt++;
+    }
+    if (d_id == kDistrictsPerWarehouse) aborted = false;
+
+    if (aborted) {
+      tx->abort();
+      task->stats[kDeliveryTx].aborted++;
+      if (stopping) return TxResult::kAborted;
+      continue;
+    }
+
+    Result result;
+    if (!tx->commit(&result)) {
+      task->stats[kDeliveryTx].aborted++;
+      if (stopping) return TxResult::kAborted;
+      continue;
+    }
+    return TxResult::kCommitted;
+  }
+}
+
+static TxResult stock_level_tx(Task* task, Transaction* tx,
+                               ::mica::util::Rand& rand, uint64_t w_id) {
+  auto tpcc = task->tpcc;
+
+  // Each thread is bound to a district within the warehouse.
+  uint64_t d_id = task->thread_id % kDistrictsPerWarehouse;
+  int32_t threshold = static_cast<int32_t>(uniform(rand, 10, 20));
+
+  while (true) {
+    bool ret = tx->begin(kUseSnapshot);
+    assert(ret);
+    (void)ret;
+
+    bool aborted = true;
+    do {
+      uint64_t row_id;
+
+      if (index_lookup(tx, tpcc->district_idx, district_key(w_id, d_id),
+                       row_id) != 1)
+        break;
+      auto d = get_row<District>(tx, tpcc->tbls[kDistrict], row_id);
+      if (!d) break;
+      uint64_t next_o_id = d->d_next_o_id;
+      uint64_t min_o_id = next_o_id > 20 ? next_o_id - 20 : 1;
+
+      // Items of the last 20 orders.
+      static constexpr size_t kMaxItems = 20 * kMaxOrderLines;
+      uint64_t i_ids[kMaxItems];
+      size_t item_count = 0;
+      bool failed = false;
+      auto ret2 = tpcc->order_line_idx->lookup<BTreeRangeType::kInclusive,
+                                               BTreeRangeType::kExclusive,
+                                               false>(
+          tx, order_line_key(w_id, d_id, min_o_id, 0),
+          order_line_key(w_id, d_id, next_o_id, 0),
+          kSkipValidationForIndexAccess, [&](auto& k, auto& v) {
+            (void)k;
+            auto ol = get_row<OrderLine>(tx, tpcc->tbls[kOrderLine], v);
+            if (!ol) {
+              failed = true;
+              return false;
+            }
+            size_t i;
+            for (i = 0; i < item_count; i++)
+              if (i_ids[i] == ol->ol_i_id) break;
+            if (i == item_count) i_ids[item_count++] = ol->ol_i_id;
+            return item_count < kMaxItems;
+          });
+      if (ret2 == BTreeIndex::kHaveToAbort || failed) break;
+
+      uint64_t low_stock = 0;
+      size_t i;
+      for (i = 0; i < item_count; i++) {
+        if (index_lookup(tx, tpcc->stock_idx,
+                         tpcc->stock_key(w_id, i_ids[i]), row_id) != 1)
+          break;
+        auto s = get_row<Stock>(tx, tpcc->tbls[kStock], row_id);
+        if (!s) break;
+        if (s->s_quantity < threshold) low_stock++;
+      }
+      if (i != item_count) break;
+      (void)low_stock;
+
+      aborted = false;
+    } while (false);
+
+    if (aborted) {
+      tx->abort();
+      task->stats[kStockLevelTx].aborted++;
+      if (stopping) return TxResult::kAborted;
+      continue;
+    }
+
+    Result result;
+    if (!tx->commit(&result)) {
+      task->stats[kStockLevelTx].aborted++;
+      if (stopping) return TxResult::kAborted;
+      continue;
+    }
+    return TxResult::kCommitted;
+  }
+}
+
+void worker_proc(Task* task) {
+  ::mica::util::lcore.pin_thread(static_cast<uint16_t>(task->thread_id));
+
+  auto ctx = task->tpcc->db->context();
+
+  __sync_add_and_fetch(&running_threads, 1);
+  while (running_threads < task->num_threads) ::mica::util::pause();
+
+  Timing t(ctx->timing_stack(), &::mica::transaction::Stats::worker);
+
+  uint64_t seed = 4 * task->thread_id * ::mica::util::rdtsc();
+  uint64_t seed_mask = (uint64_t(1) << 48) - 1;
+  ::mica::util::Rand rand(seed & seed_mask);
+
+  gettimeofday(&task->tv_start, nullptr);
+
+  task->tpcc->db->activate(static_cast<uint16_t>(task->thread_id));
+  while (task->tpcc->db->active_thread_count() < task->num_threads) {
+    ::mica::util::pause();
+    task->tpcc->db->idle(static_cast<uint16_t>(task->thread_id));
+  }
+
+  uint64_t start_t = sw.now();
+  uint64_t end_t = start_t + task->duration_ms * sw.c_1_msec();
+
+  Transaction tx(ctx);
+
+  while (!stopping) {
+    uint64_t w_id = task->partitioned
+                        ? task->home_w_id
+                        : uniform(rand, 0, task->tpcc->num_warehouses - 1);
+
+    // The standard mix: 45% NewOrder, 43% Payment, 4% each of the rest.
+    uint64_t r = uniform(rand, 1, 100);
+    TxType type;
+    if (r <= 45)
+      type = kNewOrderTx;
+    else if (r <= 88)
+      type = kPaymentTx;
+    else if (r <= 92)
+      type = kOrderStatusTx;
+    else if (r <= 96)
+      type = kDeliveryTx;
+    else
+      type = kStockLevelTx;
+
+    uint64_t tx_start_t = sw.now();
+
+    TxResult result;
+    switch (type) {
+      case kNewOrderTx:
+        result = new_order_tx(task, &tx, rand, w_id);
+        break;
+      case kPaymentTx:
+        result = payment_tx(task, &tx, rand, w_id);
+        break;
+      case kOrderStatusTx:
+        result = order_status_tx(task, &tx, rand, w_id);
+        break;
+      case kDeliveryTx:
+        result = delivery_tx(task, &tx, rand, w_id);
+        break;
+      case kStockLevelTx:
+      default:
+        result = stock_level_tx(task, &tx, rand, w_id);
+        break;
+    }
+
+    uint64_t now = sw.now();
+    if (result == TxResult::kCommitted) {
+      task->stats[type].committed++;
+      task->stats[type].latency.update(sw.diff_in_us(now, tx_start_t));
+    }
+
+    if (now >= end_t && !stopping) stopping = 1;
+  }
+
+  task->tpcc->db->deactivate(static_cast<uint16_t>(task->thread_id));
+
+  gettimeofday(&task->tv_end, nullptr);
+}
+
+// Population.
+
+// Runs f(i) for i in [begin, end) in transactions of batch_size calls each.
+template <typename Func>
+static void load_rows(Transaction* tx, uint64_t begin, uint64_t end,
+                      uint64_t batch_size, const Func& f) {
+  for (uint64_t i = begin; i < end; i += batch_size) {
+    auto i_end = std::min(i + batch_size, end);
+    while (true) {
+      bool ret = tx->begin();
+      if (!ret) {
+        printf("failed to start a transaction\n");
+        continue;
+      }
+
+      bool aborted = false;
+      for (uint64_t j = i; j < i_end; j++) {
+        if (!f(j)) {
+          aborted = true;
+          break;
+        }
+      }
+      if (aborted) {
+        tx->abort(true);
+        continue;
+      }
+
+      Result result;
+      if (!tx->commit(&result)) continue;
+      break;
+    }
+  }
+}
+
+static void load_items(TPCC* tpcc, Transaction* tx, uint64_t thread_id,
+                       uint64_t init_num_threads) {
+  ::mica::util::Rand rand((thread_id + 1) * 12345);
+  uint64_t per_thread =
+      (tpcc->num_items + init_num_threads - 1) / init_num_threads;
+  uint64_t begin = 1 + per_thread * thread_id;
+  uint64_t end = std::min(begin + per_thread, tpcc->num_items + 1);
+
+  load_rows(tx, begin, end, 16, [&](uint64_t i_id) {
+    uint64_t row_id;
+    auto item = insert_row<Item>(tx, tpcc->tbls[kItem], row_id);
+    if (!item) return false;
+    item->i_id = i_id;
+    item->i_im_id = uniform(rand, 1, 10000);
+    item->i_price = static_cast<double>(uniform(rand, 100, 10000)) / 100.;
+    make_string(rand, item->i_name, sizeof(item->i_name));
+    make_string(rand, item->i_data, sizeof(item->i_data));
+    return index_insert(tx, tpcc->item_idx, i_id, row_id);
+  });
+}
+
+static void load_warehouse(TPCC* tpcc, Transaction* tx, uint64_t w_id) {
+  ::mica::util::Rand rand((w_id + 1) * 54321);
+
+  load_rows(tx, 0, 1, 1, [&](uint64_t i) {
+    (void)i;
+    uint64_t row_id;
+    auto w = insert_row<Warehouse>(tx, tpcc->tbls[kWarehouse], row_id);
+    if (!w) return false;
+    w->w_tax = static_cast<double>(uniform(rand, 0, 2000)) / 10000.;
+    w->w_ytd = 300000.;
+    make_string(rand, w->w_name, sizeof(w->w_name));
+    make_string(rand, w->w_street_1, sizeof(w->w_street_1));
+    make_string(rand, w->w_street_2, sizeof(w->w_street_2));
+    make_string(rand, w->w_city, sizeof(w->w_city));
+    make_string(rand, w->w_state, sizeof(w->w_state));
+    make_string(rand, w->w_zip, sizeof(w->w_zip));
+    return index_insert(tx, tpcc->warehouse_idx, w_id, row_id);
+  });
+
+  load_rows(tx, 1, tpcc->num_items + 1, 16, [&](uint64_t i_id) {
+    uint64_t row_id;
+    auto s = insert_row<Stock>(tx, tpcc->tbls[kStock], row_id);
+    if (!s) return false;
+    s->s_i_id = i_id;
+    s->s_w_id = w_id;
+    s->s_quantity = static_cast<int32_t>(uniform(rand, 10, 100));
+    s->s_ytd = 0;
+    s->s_order_cnt = 0;
+    s->s_remote_cnt = 0;
+    for (uint64_t d_id = 0; d_id < kDistrictsPerWarehouse; d_id++)
+      make_string(rand, s->s_dist[d_id], sizeof(s->s_dist[d_id]));
+    make_string(rand, s->s_data, sizeof(s->s_data));
+    return index_insert(tx, tpcc->stock_idx, tpcc->stock_key(w_id, i_id),
+                        row_id);
+  });
+
+  uint64_t num_customers = tpcc->num_customers;
+  uint64_t first_new_order = num_customers - static_cast<uint64_t>(
+                                                 static_cast<double>(
+                                                     num_customers) *
+                                                 kInitialNewOrderRatio);
+  uint64_t now = sw.now();
+
+  for (uint64_t d_id = 0; d_id < kDistrictsPerWarehouse; d_id++) {
+    load_rows(tx, 0, 1, 1, [&](uint64_t i) {
+      (void)i;
+      uint64_t row_id;
+      auto d = insert_row<District>(tx, tpcc->tbls[kDistrict], row_id);
+      if (!d) return false;
+      d->d_tax = static_cast<double>(uniform(rand, 0, 2000)) / 10000.;
+      d->d_ytd = 30000.;
+      d->d_next_o_id = num_customers + 1;
+      make_string(rand, d->d_name, sizeof(d->d_name));
+      make_string(rand, d->d_street_1, sizeof(d->d_street_1));
+      make_string(rand, d->d_street_2, sizeof(d->d_street_2));
+      make_string(rand, d->d_city, sizeof(d->d_city));
+      make_string(rand, d->d_state, sizeof(d->d_state));
+      make_string(rand, d->d_zip, sizeof(d->d_zip));
+      return index_insert(tx, tpcc->district_idx, district_key(w_id, d_id),
+                          row_id);
+    });
+
+    load_rows(tx, 1, num_customers + 1, 8, [&](uint64_t c_id) {
+      uint64_t row_id;
+      auto c = insert_row<Customer>(tx, tpcc->tbls[kCustomer], row_id);
+      if (!c) return false;
+      // The first 1000 customers cover all last names.
+      uint64_t last_idx = c_id <= kLastNameCount
+                              ? c_id - 1
+                              : nurand(rand, 255, tpcc->c_last, 0,
+                                       kLastNameCount - 1);
+      c->c_id = c_id;
+      c->c_since = now;
+      c->c_credit_lim = 50000.;
+      c->c_discount = static_cast<double>(uniform(rand, 0, 5000)) / 10000.;
+      c->c_balance = -10.;
+      c->c_ytd_payment = 10.;
+      c->c_payment_cnt = 1;
+      c->c_delivery_cnt = 0;
+      make_string(rand, c->c_first, sizeof(c->c_first));
+      c->c_middle[0] = 'O';
+      c->c_middle[1] = 'E';
+      make_last_name(last_idx, c->c_last, sizeof(c->c_last));
+      make_string(rand, c->c_street_1, sizeof(c->c_street_1));
+      make_string(rand, c->c_street_2, sizeof(c->c_street_2));
+      make_string(rand, c->c_city, sizeof(c->c_city));
+      make_string(rand, c->c_state, sizeof(c->c_state));
+      make_string(rand, c->c_zip, sizeof(c->c_zip));
+      make_string(rand, c->c_phone, sizeof(c->c_phone));
+      bool bad_credit = uniform(rand, 1, 100) <= 10;
+      c->c_credit[0] = bad_credit ? 'B' : 'G';
+      c->c_credit[1] = 'C';
+      make_string(rand, c->c_data, sizeof(c->c_data));
+      if (!index_insert(tx, tpcc->customer_idx,
+                        tpcc->customer_key(w_id, d_id, c_id), row_id) ||
+          !index_insert(tx, tpcc->customer_name_idx,
+                        customer_name_key(w_id, d_id, last_idx, c_id),
+                        row_id))
+        return false;
+
+      auto h = insert_row<History>(tx, tpcc->tbls[kHistory], row_id);
+      if (!h) return false;
+      h->h_c_id = c_id;
+      h->h_c_d_id = d_id;
+      h->h_c_w_id = w_id;
+      h->h_d_id = d_id;
+      h->h_w_id = w_id;
+      h->h_date = now;
+      h->h_amount = 10.;
+      make_string(rand, h->h_data, sizeof(h->h_data));
+      return true;
+    });
+
+    // Orders are assigned to a random permutation of customers.
+    std::vector<uint64_t> c_ids;
+    for (uint64_t c_id = 1; c_id <= num_customers; c_id++)
+      c_ids.push_back(c_id);
+    std::mt19937 g(w_id * kDistrictsPerWarehouse + d_id);
+    std::shuffle(c_ids.begin(), c_ids.end(), g);
+
+    load_rows(tx, 1, num_customers + 1, 2, [&](uint64_t o_id) {
+      bool delivered = o_id <= first_new_order;
+      uint64_t c_id = c_ids[o_id - 1];
+      uint64_t ol_cnt = uniform(rand, 5, kMaxOrderLines);
+
+      uint64_t row_id;
+      auto o = insert_row<Order>(tx, tpcc->tbls[kOrder], row_id);
+      if (!o) return false;
+      o->o_id = o_id;
+      o->o_c_id = c_id;
+      o->o_d_id = d_id;
+      o->o_w_id = w_id;
+      o->o_entry_d = now;
+      o->o_carrier_id =
+          delivered ? static_cast<uint32_t>(uniform(rand, 1, 10)) : 0;
+      o->o_ol_cnt = static_cast<uint32_t>(ol_cnt);
+      o->o_all_local = 1;
+      if (!index_insert(tx, tpcc->order_idx, order_key(w_id, d_id, o_id),
+                        row_id) ||
+          !index_insert(tx, tpcc->order_cust_idx,
+                        order_cust_key(w_id, d_id, c_id, o_id), row_id))
+        return false;
+
+      for (uint64_t ol_number = 1; ol_number <= ol_cnt; ol_number++) {
+        auto ol = insert_row<OrderLine>(tx, tpcc->tbls[kOrderLine], row_id);
+        if (!ol) return false;
+        ol->ol_o_id = o_id;
+        ol->ol_d_id = d_id;
+        ol->ol_w_id = w_id;
+        ol->ol_number = ol_number;
+        ol->ol_i_id = uniform(rand, 1, tpcc->num_items);
+        ol->ol_supply_w_id = w_id;
+        ol->ol_delivery_d = delivered ? now : 0;
+        ol->ol_quantity = 5;
+        ol->ol_amount =
+            delivered ? 0. : static_cast<double>(uniform(rand, 1, 999999)) /
+                                 100.;
+        make_string(rand, ol->ol_dist_info, sizeof(ol->ol_dist_info));
+        if (!index_insert(tx, tpcc->order_line_idx,
+                          order_line_key(w_id, d_id, o_id, ol_number),
+                          row_id))
+          return false;
+      }
+
+      if (!delivered) {
+        auto no = insert_row<NewOrder>(tx, tpcc->tbls[kNewOrder], row_id);
+        if (!no) return false;
+        no->no_o_id = o_id;
+        no->no_d_id = d_id;
+        no->no_w_id = w_id;
+        if (!index_insert(tx, tpcc->new_order_idx,
+                          order_key(w_id, d_id, o_id), row_id))
+          return false;
+      }
+      return true;
+    });
+  }
+}
+
+int main(int argc, const char* argv[]) {
+  if (argc != 4) {
+    printf("%s WAREHOUSE-COUNT THREAD-COUNT DURATION-SEC\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  auto config = ::mica::util::Config::load_file("test_tpcc.json");
+
+  uint64_t num_warehouses = static_cast<uint64_t>(atol(argv[1]));
+  uint64_t num_threads = static_cast<uint64_t>(atol(argv[2]));
+  double duration = atof(argv[3]);
+
+  auto tpcc_config = config.get("tpcc");
+  bool partitioned = tpcc_config.get("partitioned").get_bool(true);
+  uint64_t remote_item_pct = tpcc_config.get("remote_item_pct").get_uint64(1);
+  uint64_t remote_payment_pct =
+      tpcc_config.get("remote_payment_pct").get_uint64(15);
+  uint64_t num_items =
+      tpcc_config.get("item_count").get_uint64(kDefaultItemCount);
+  uint64_t num_customers = tpcc_config.get("customers_per_district")
+                               .get_uint64(kDefaultCustomersPerDistrict);
+  double warmup = tpcc_config.get("warmup").get_double(1.);
+
+  if (num_warehouses == 0 || num_warehouses > 0xffff / kDistrictsPerWarehouse) {
+    printf("invalid warehouse count\n");
+    return EXIT_FAILURE;
+  }
+  if (num_customers == 0 || num_customers > 0xffff || num_items == 0) {
+    printf("invalid item or customer count\n");
+    return EXIT_FAILURE;
+  }
+
+  Alloc alloc(config.get("alloc"));
+  auto page_pool_size = 24 * uint64_t(1073741824);
+  // Each page pool may grow up to this multiple of its initial size.
+  double page_pool_growth = config.get("page_pool_growth").get_double(1.);
+  ::mica::transaction::CXLTopology cxl_topology(config.get("cxl"));
+  std::vector<PagePool*> page_pools(::mica::util::lcore.numa_count(), nullptr);
+  for (uint8_t numa_id = 0; numa_id < page_pools.size(); numa_id++) {
+    auto size = cxl_topology.page_pool_size(numa_id, page_pool_size);
+    if (size != 0)
+      page_pools[numa_id] = new PagePool(
+          &alloc, size, numa_id,
+          static_cast<uint64_t>(static_cast<double>(size) * page_pool_growth));
+  }
+
+  ::mica::util::lcore.pin_thread(0);
+
+  sw.init_start();
+  sw.init_end();
+
+  printf("num_warehouses = %" PRIu64 "\n", num_warehouses);
+  printf("num_threads = %" PRIu64 "\n", num_threads);
+  printf("duration = %lf\n", duration);
+  printf("partitioned = %d\n", partitioned ? 1 : 0);
+  if (!partitioned) {
+    printf("remote_item_pct = %" PRIu64 "\n", remote_item_pct);
+    printf("remote_payment_pct = %" PRIu64 "\n", remote_payment_pct);
+  }
+  printf("item_count = %" PRIu64 "\n", num_items);
+  printf("customers_per_district = %" PRIu64 "\n", num_customers);
+#ifndef NDEBUG
+  printf("!NDEBUG\n");
+#endif
+  printf("\n");
+
+  Logger logger;
+  DB db(page_pools.data(), &logger, &sw, static_cast<uint16_t>(num_threads),
+        cxl_topology);
+
+  TPCC tpcc;
+  tpcc.db = &db;
+  tpcc.num_warehouses = num_warehouses;
+  tpcc.num_items = num_items;
+  tpcc.num_customers = num_customers;
+  {
+    ::mica::util::Rand rand(::mica::util::rdtsc() & ((uint64_t(1) << 48) - 1));
+    tpcc.c_last = uniform(rand, 0, 255);
+    tpcc.c_id = uniform(rand, 0, 1023);
+    tpcc.ol_i_id = uniform(rand, 0, 8191);
+  }
+
+  // Tables listed in "cxl_tables" (and their indexes) are placed on the CXL
+  // NUMA node.
+  bool cxl_resident[kTableCount] = {};
+  {
+    auto cxl_tables = tpcc_config.get("cxl_tables");
+    for (size_t i = 0; cxl_tables.exists() && i < cxl_tables.size(); i++) {
+      auto name = cxl_tables.get(i).get_str();
+      int table_id;
+      for (table_id = 0; table_id < kTableCount; table_id++)
+        if (name == table_names[table_id]) break;
+      if (table_id == kTableCount) {
+        printf("unknown table: %s\n", name.c_str());
+        return EXIT_FAILURE;
+      }
+      cxl_resident[table_id] = true;
+    }
+  }
+
+  for (int table_id = 0; table_id < kTableCount; table_id++) {
+    const uint64_t data_sizes[] = {table_data_sizes[table_id]};
+    bool ret = db.create_table(table_names[table_id], 1, data_sizes);
+    assert(ret);
+    (void)ret;
+
+    tpcc.tbls[table_id] = db.get_table(table_names[table_id]);
+    tpcc.tbls[table_id]->set_cxl_resident(cxl_resident[table_id]);
+    printf("%-12s %4" PRIu64 " bytes  %s\n", table_names[table_id],
+           table_data_sizes[table_id], cxl_resident[table_id] ? "CXL" : "DRAM");
+  }
+  printf("\n");
+
+  db.activate(0);
+  {
+    uint64_t num_districts = num_warehouses * kDistrictsPerWarehouse;
+
+    auto create_hash_index = [&](const char* name, int table_id,
+                                 uint64_t expected_num_rows) {
+      bool ret = db.create_hash_index_unique_u64(name, tpcc.tbls[table_id],
+                                                 expected_num_rows);
+      assert(ret);
+      (void)ret;
+      auto idx = db.get_hash_index_unique_u64(name);
+      idx->index_table()->set_cxl_resident(cxl_resident[table_id]);
+      Transaction tx(db.context(0));
+      idx->init(&tx);
+      return idx;
+    };
+    auto create_btree_index = [&](const char* name, int table_id) {
+      bool ret = db.create_btree_index_unique_u64(name, tpcc.tbls[table_id]);
+      assert(ret);
+      (void)ret;
+      auto idx = db.get_btree_index_unique_u64(name);
+      idx->index_table()->set_cxl_resident(cxl_resident[table_id]);
+      Transaction tx(db.context(0));
+      idx->init(&tx);
+      return idx;
+    };
+
+    tpcc.warehouse_idx =
+        create_hash_index("warehouse_idx", kWarehouse, num_warehouses);
+    tpcc.district_idx =
+        create_hash_index("district_idx", kDistrict, num_districts);
+    tpcc.customer_idx = create_hash_index("customer_idx", kCustomer,
+                                          num_districts * num_customers);
+    tpcc.item_idx = create_hash_index("item_idx", kItem, num_items);
+    tpcc.stock_idx =
+        create_hash_index("stock_idx", kStock, num_warehouses * num_items);
+    tpcc.customer_name_idx =
+        create_btree_index("customer_name_idx", kCustomer);
+    tpcc.order_idx = create_btree_index("order_idx", kOrder);
+    tpcc.order_cust_idx = create_btree_index("order_cust_idx", kOrder);
+    tpcc.new_order_idx = create_btree_index("new_order_idx", kNewOrder);
+    tpcc.order_line_idx = create_btree_index("order_line_idx", kOrderLine);
+  }
+  db.deactivate(0);
+
+  {
+    printf("populating tables\n");
+
+    std::vector<std::thread> threads;
+    uint64_t init_num_threads = std::min(num_warehouses, num_threads);
+    for (uint64_t thread_id = 0; thread_id < init_num_threads; thread_id++) {
+      threads.emplace_back([&, thread_id] {
+        ::mica::util::lcore.pin_thread(thread_id);
+
+        db.activate(static_cast<uint16_t>(thread_id));
+        while (db.active_thread_count() < init_num_threads) {
+          ::mica::util::pause();
+          db.idle(static_cast<uint16_t>(thread_id));
+        }
+
+        Transaction tx(db.context(static_cast<uint16_t>(thread_id)));
+        load_items(&tpcc, &tx, thread_id, init_num_threads);
+        for (uint64_t w_id = thread_id; w_id < num_warehouses;
+             w_id += init_num_threads)
+          load_warehouse(&tpcc, &tx, w_id);
+
+        db.deactivate(static_cast<uint16_t>(thread_id));
+        return 0;
+      });
+    }
+
+    while (threads.size() > 0) {
+      threads.back().join();
+      threads.pop_back();
+    }
+
+    db.activate(0);
+    auto renew = [&](Table* tbl) {
+      uint64_t i = 0;
+      tbl->renew_rows(db.context(0), 0, i, static_cast<uint64_t>(-1), false);
+    };
+    for (int table_id = 0; table_id < kTableCount; table_id++)
+      renew(tpcc.tbls[table_id]);
+    for (auto idx : {tpcc.warehouse_idx, tpcc.district_idx, tpcc.customer_idx,
+                     tpcc.item_idx, tpcc.stock_idx})
+      renew(idx->index_table());
+    for (auto idx : {tpcc.customer_name_idx, tpcc.order_idx,
+                     tpcc.order_cust_idx, tpcc.new_order_idx,
+                     tpcc.order_line_idx})
+      renew(idx->index_table());
+    db.deactivate(0);
+
+    db.reset_stats();
+    db.reset_backoff();
+  }
+
+  std::vector<Task> tasks(num_threads);
+  for (uint64_t thread_id = 0; thread_id < num_threads; thread_id++) {
+    auto& task = tasks[thread_id];
+    task.tpcc = &tpcc;
+    task.thread_id = thread_id;
+    task.num_threads = num_threads;
+    task.partitioned = partitioned;
+    task.home_w_id = thread_id % num_warehouses;
+    task.remote_item_pct = remote_item_pct;
+    task.remote_payment_pct = remote_payment_pct;
+  }
+
+  for (auto phase = 0; phase < 2; phase++) {
+    if (phase == 0) {
+      if (warmup <= 0.) continue;
+      printf("warming up\n");
+    } else {
+      db.reset_stats();
+      printf("executing workload\n");
+    }
+
+    for (auto& task : tasks) {
+      task.duration_ms =
+          static_cast<uint64_t>((phase == 0 ? warmup : duration) * 1000.);
+      for (auto& stats : task.stats) {
+        stats.committed = 0;
+        stats.aborted = 0;
+        stats.rolled_back = 0;
+        stats.latency.reset();
+      }
+    }
+
+    running_threads = 0;
+    stopping = 0;
+
+    ::mica::util::memory_barrier();
+
+    std::vector<std::thread> threads;
+    for (uint64_t thread_id = 1; thread_id < num_threads; thread_id++)
+      threads.emplace_back(worker_proc, &tasks[thread_id]);
+
+    worker_proc(&tasks[0]);
+
+    while (threads.size() > 0) {
+      threads.back().join();
+      threads.pop_back();
+    }
+  }
+  printf("\n");
+
+  {
+    double diff;
+    {
+      double min_start = 0.;
+      double max_end = 0.;
+      for (size_t thread_id = 0; thread_id < num_threads; thread_id++) {
+        double start = (double)tasks[thread_id].tv_start.tv_sec * 1. +
+                       (double)tasks[thread_id].tv_start.tv_usec * 0.000001;
+        double end = (double)tasks[thread_id].tv_end.tv_sec * 1. +
+                     (double)tasks[thread_id].tv_end.tv_usec * 0.000001;
+        if (thread_id == 0 || min_start > start) min_start = start;
+        if (thread_id == 0 || max_end < end) max_end = end;
+      }
+
+      diff = max_end - min_start;
+    }
+    double total_time = diff * static_cast<double>(num_threads);
+
+    TxTypeStats total[kTxTypeCount];
+    uint64_t total_committed = 0;
+    for (int type = 0; type < kTxTypeCount; type++) {
+      total[type].committed = 0;
+      total[type].aborted = 0;
+      total[type].rolled_back = 0;
+      total[type].latency.reset();
+      for (auto& task : tasks) {
+        total[type].committed += task.stats[type].committed;
+        total[type].aborted += task.stats[type].aborted;
+        total[type].rolled_back += task.stats[type].rolled_back;
+        total[type].latency += task.stats[type].latency;
+      }
+      total_committed += total[type].committed;
+    }
+
+    printf("tpmC:                         %10.1lf\n",
+           static_cast<double>(total[kNewOrderTx].committed) / diff * 60.);
+    printf("throughput:                   %7.3lf M/sec\n",
+           static_cast<double>(total_committed) / diff * 0.000001);
+    printf("\n");
+
+    printf("%-12s %10s %10s %7s %9s %6s %6s %6s %6s %6s (us)\n", "type",
+           "committed", "aborted", "abort%", "rollback", "p50", "p90", "p99",
+           "p99.9", "max");
+    for (int type = 0; type < kTxTypeCount; type++) {
+      auto& s = total[type];
+      uint64_t attempts = s.committed + s.aborted;
+      printf("%-12s %10" PRIu64 " %10" PRIu64 " %6.2lf%% %9" PRIu64
+             " %6" PRIu64 " %6" PRIu64 " %6" PRIu64 " %6" PRIu64 " %6" PRIu64
+             "\n",
+             tx_type_names[type], s.committed, s.aborted,
+             attempts == 0 ? 0. : 100. * static_cast<double>(s.aborted) /
+                                      static_cast<double>(attempts),
+             s.rolled_back, s.latency.perc(0.50), s.latency.perc(0.90),
+             s.latency.perc(0.99), s.latency.perc(0.999), s.latency.max());
+    }
+    printf("\n");
+
+    db.print_stats(diff, total_time);
+
+    for (int table_id = 0; table_id < kTableCount; table_id++) {
+      printf("%s:\n", table_names[table_id]);
+      tpcc.tbls[table_id]->print_table_status();
+    }
+
+    if (kShowPoolStats) {
+      db.print_pool_status();
+      db.print_memory_status();
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -2,6 +2,7 @@
 #include <thread>
 #include <random>
 #include "mica/transaction/db.h"
+#include "mica/transaction/stats_sampler.h"
 #include "mica/util/lcore.h"
 #include "mica/util/zipf.h"
 #include "mica/util/rand.h"
@@ -13,6 +14,7 @@ typedef DBConfig::Timestamp Timestamp;
 typedef DBConfig::ConcurrentTimestamp ConcurrentTimestamp;
 typedef DBConfig::Timing Timing;
 typedef ::mica::transaction::PagePool<DBConfig> PagePool;
+typedef ::mica::transaction::Superblock<DBConfig> Superblock;
 typedef ::mica::transaction::DB<DBConfig> DB;
 typedef ::mica::transaction::Table<DBConfig> Table;
 typedef DB::HashIndexUniqueU64 HashIndex;
@@ -37,6 +39,11 @@ struct Task {
   uint64_t thread_id;
   uint64_t num_threads;
 
+  // The number of transactions to interleave (1 = no interleaving).
+  uint64_t interleave_count;
+  // Resolve and prefetch all rows of a transaction before accessing them.
+  bool declare_accesses;
+
   // Workload.
   uint64_t num_rows;
   uint64_t tx_count;
@@ -120,13 +127,285 @@ void setup_logger(VerificationLogger<DBConfig>* logger,
 static volatile uint16_t running_threads;
 static volatile uint8_t stopping;
 
+// Looks up the index for a raw row ID.  Returns false if the transaction must
+// abort.
+static bool lookup_row_id(Task* task, Transaction* tx, uint64_t& row_id) {
+  if (task->hash_idx != nullptr) {
+    auto lookup_result =
+        task->hash_idx->lookup(tx, row_id, kSkipValidationForIndexAccess,
+                               [&row_id](auto& k, auto& v) {
+                                 (void)k;
+                                 row_id = v;
+                                 return false;
+                               }); //hash桶遍历
+    if (lookup_result != 1 || lookup_result == HashIndex::kHaveToAbort) {
+      assert(false);
+      return false;
+    }
+  } else if (task->btree_idx != nullptr) {
+    auto lookup_result =
+        task->btree_idx->lookup(tx, row_id, kSkipValidationForIndexAccess,
+                                [&row_id](auto& k, auto& v) {
+                                  (void)k;
+                                  row_id = v;
+                                  return false;
+                                });// B+tree查找
+    if (lookup_result != 1 || lookup_result == BTreeIndex::kHaveToAbort) {
+      assert(false);
+      return false;
+    }
+  }
+  return true;
+}
+
+// Resolves the row IDs of all requests of a transaction and declares them to
+// the transaction so that their rows are prefetched as a batch.  Returns false
+// if the transaction must abort.
+static bool declare_tx_accesses(
+    Task* task, Transaction* tx, uint64_t tx_i, uint64_t req_i,
+    std::vector<Transaction::DeclaredAccess>& declared) {
+  uint16_t req_count = task->req_counts[tx_i];
+  const uint64_t* raw_row_ids = task->row_ids + req_i;
+
+  if (task->hash_idx != nullptr)
+    task->hash_idx->prefetch(tx, raw_row_ids, req_count);
+
+  declared.resize(req_count);
+  for (uint16_t req_j = 0; req_j < req_count; req_j++) {
+    uint64_t row_id = raw_row_ids[req_j];
+    if (!lookup_row_id(task, tx, row_id)) return false;
+    declared[req_j].tbl = task->tbl;
+    declared[req_j].cf_id = 0;
+    declared[req_j].row_id = row_id;
+    declared[req_j].write_hint = task->op_types[req_i + req_j] != 0;
+  }
+
+  tx->declare_accesses(declared.data(), req_count, true);
+  return true;
+}
+
+// Issues prefetches for the index entry of a raw row ID, or for the row itself
+// if there is no index.
+static void prefetch_request(Task* task, Transaction* tx, uint64_t row_id,
+                             uint8_t column_id) {
+  if (task->hash_idx != nullptr)
+    task->hash_idx->prefetch(tx, row_id);
+  else if (task->btree_idx != nullptr)
+    task->btree_idx->prefetch(tx, row_id);
+  else
+    tx->prefetch_row(task->tbl, 0, row_id,
+                     static_cast<uint64_t>(column_id) * kColumnSize,
+                     kColumnSize);
+}
+
+// Performs a single non-scan request on a row.  Returns false if the
+// transaction must abort.
+static bool access_row(Task* task, Transaction* tx, uint64_t row_id,
+                       uint8_t column_id, uint8_t op_type, bool use_peek_only,
+                       uint64_t& v) {
+  auto tbl = task->tbl;
+  bool is_read = op_type == 0;
+  bool is_rmw = op_type == 1;
+
+  if (!use_peek_only) {
+    RowAccessHandle rah(tx);
+
+    if (is_read) {
+      if (!rah.peek_row(tbl, 0, row_id, false, true, false) ||
+          !rah.read_row())
+        return false;
+
+      const char* data =
+          rah.cdata() + static_cast<uint64_t>(column_id) * kColumnSize;
+      for (uint64_t j = 0; j < kColumnSize; j += 64)
+        v += static_cast<uint64_t>(data[j]);
+      v += static_cast<uint64_t>(data[kColumnSize - 1]);
+    } else {
+      if (is_rmw) {
+        if (!rah.peek_row(tbl, 0, row_id, false, true, true) ||
+            !rah.read_row() || !rah.write_row(kDataSize)) //rah 指向事务的accesses_数组里的一项，描述了当前事务访问的一行的元数据
+          return false;
+      } else {
+        if (!rah.peek_row(tbl, 0, row_id, false, false, true) ||
+            !rah.write_row(kDataSize))
+          return false;
+      }
+
+      char* data =
+          rah.data() + static_cast<uint64_t>(column_id) * kColumnSize;
+      for (uint64_t j = 0; j < kColumnSize; j += 64) {
+        v += static_cast<uint64_t>(data[j]);
+        data[j] = static_cast<char>(v);
+      }
+      v += static_cast<uint64_t>(data[kColumnSize - 1]);
+      data[kColumnSize - 1] = static_cast<char>(v);
+    }
+  } else {
+    RowAccessHandlePeekOnly rah(tx);
+
+    if (!rah.peek_row(tbl, 0, row_id, false, false, false)) return false;
+
+    const char* data =
+        rah.cdata() + static_cast<uint64_t>(column_id) * kColumnSize;
+    for (uint64_t j = 0; j < kColumnSize; j += 64)
+      v += static_cast<uint64_t>(data[j]);
+    v += static_cast<uint64_t>(data[kColumnSize - 1]);
+  }
+  return true;
+}
+
+// Interleaved execution.
+//
+// Each in-flight transaction is a resumable state machine.  It yields to the
+// scheduler right after issuing prefetches for the next index bucket or row so
+// that other transactions of the same thread can run while the memory accesses
+// (possibly to CXL memory) are in flight.
+struct InterleavedTx {
+  enum class Step {
+    kIdle = 0,
+    kBegin,
+    kPrefetch,
+    kLookup,
+    kAccess,
+    kCommit,
+  };
+
+  Transaction* tx;
+  Step step;
+
+  uint64_t tx_i;
+  uint64_t req_i;
+  uint64_t req_j;
+  uint64_t row_id;
+  uint64_t v;
+  bool use_peek_only;
+};
+
+// Runs a transaction until its next yield point.  Returns true when the
+// transaction has committed.
+static bool resume_tx(Task* task, InterleavedTx* itx, uint64_t& commit_i) {
+  auto tx = itx->tx;
+  uint64_t req_count = task->req_counts[itx->tx_i];
+
+  while (true) {
+    switch (itx->step) {
+      case InterleavedTx::Step::kIdle:
+        assert(false);
+        return false;
+
+      case InterleavedTx::Step::kBegin: {
+        itx->use_peek_only = kUseSnapshot && task->read_only_tx[itx->tx_i];
+        bool ret = tx->begin(itx->use_peek_only);
+        assert(ret);
+        (void)ret;
+        itx->req_j = 0;
+        itx->v = 0;
+        itx->step = InterleavedTx::Step::kPrefetch;
+        break;
+      }
+
+      case InterleavedTx::Step::kPrefetch: {
+        if (itx->req_j == req_count) {
+          itx->step = InterleavedTx::Step::kCommit;
+          break;
+        }
+        auto req = itx->req_i + itx->req_j;
+        itx->row_id = task->row_ids[req];
+        prefetch_request(task, tx, itx->row_id, task->column_ids[req]);
+        if (task->hash_idx != nullptr || task->btree_idx != nullptr)
+          itx->step = InterleavedTx::Step::kLookup;
+        else
+          itx->step = InterleavedTx::Step::kAccess;
+        return false;
+      }
+
+      case InterleavedTx::Step::kLookup: {
+        if (!lookup_row_id(task, tx, itx->row_id)) {
+          tx->abort();
+          itx->step = InterleavedTx::Step::kBegin;
+          return false;
+        }
+        auto column_id = task->column_ids[itx->req_i + itx->req_j];
+        tx->prefetch_row(task->tbl, 0, itx->row_id,
+                         static_cast<uint64_t>(column_id) * kColumnSize,
+                         kColumnSize);
+        itx->step = InterleavedTx::Step::kAccess;
+        return false;
+      }
+
+      case InterleavedTx::Step::kAccess: {
+        auto req = itx->req_i + itx->req_j;
+        if (!access_row(task, tx, itx->row_id, task->column_ids[req],
+                        task->op_types[req], itx->use_peek_only, itx->v)) {
+          tx->abort();
+          itx->step = InterleavedTx::Step::kBegin;
+          return false;
+        }
+        itx->req_j++;
+        itx->step = InterleavedTx::Step::kPrefetch;
+        break;
+      }
+
+      case InterleavedTx::Step::kCommit: {
+        // VerificationLogger reads these during commit.
+        task->tx_i = itx->tx_i;
+        task->req_i = itx->req_i;
+        task->commit_i = commit_i;
+
+        Result result;
+        if (!tx->commit(&result)) {
+          itx->step = InterleavedTx::Step::kBegin;
+          return false;
+        }
+        assert(result == Result::kCommitted);
+
+        commit_i++;
+        itx->step = InterleavedTx::Step::kIdle;
+        return true;
+      }
+    }
+  }
+}
+
+static uint64_t run_interleaved(Task* task) {
+  auto ctx = task->db->context();
+
+  std::vector<InterleavedTx> itxs(task->interleave_count);
+  for (auto& itx : itxs) {
+    itx.tx = new Transaction(ctx);
+    itx.step = InterleavedTx::Step::kIdle;
+  }
+
+  uint64_t next_tx_i = 0;
+  uint64_t next_req_i = 0;
+  uint64_t commit_i = 0;
+
+  while (true) {
+    bool in_flight = false;
+    for (auto& itx : itxs) {
+      if (itx.step == InterleavedTx::Step::kIdle) {
+        if (next_tx_i >= task->tx_count || stopping) continue;
+        itx.tx_i = next_tx_i++;
+        itx.req_i = next_req_i;
+        next_req_i += task->req_counts[itx.tx_i];
+        itx.step = InterleavedTx::Step::kBegin;
+      }
+      in_flight = true;
+      resume_tx(task, &itx, commit_i);
+    }
+    if (!in_flight) break;
+  }
+
+  for (auto& itx : itxs) delete itx.tx;
+  return commit_i;
+}
+
 void worker_proc(Task* task) {
   ::mica::util::lcore.pin_thread(static_cast<uint16_t>(task->thread_id));
 
   auto ctx = task->db->context();
   auto tbl = task->tbl;
   auto hash_idx = task->hash_idx;
-  auto btree_idx = task->btree_idx;
 
   __sync_add_and_fetch(&running_threads, 1); //原子操作1
   while (running_threads < task->num_threads) ::mica::util::pause();
@@ -148,6 +427,15 @@ void worker_proc(Task* task) {
 
   if (kVerbose) printf("lcore %" PRIu64 "\n", task->thread_id);
 
+  if (task->interleave_count > 1) {
+    // Scans are not supported in the interleaved mode.
+    assert(!kUseScan);
+    commit_i = run_interleaved(task);
+    next_tx_i = task->tx_count;
+  }
+
+  std::vector<Transaction::DeclaredAccess> declared;
+
   Transaction tx(ctx);
   /*'''
   ctx 是每个线程自己的事务上下文环境，里面保存了：
@@ -184,89 +472,75 @@ void worker_proc(Task* task) {
       assert(ret);
       (void)ret;
 
+      bool use_declared =
+          task->declare_accesses && (!use_peek_only || !kUseScan);
+      if (use_declared &&
+          !declare_tx_accesses(task, &tx, tx_i, req_i, declared)) {
+        tx.abort();
+        continue;
+      }
+
       for (uint64_t req_j = 0; req_j < task->req_counts[tx_i]; req_j++) {
         uint64_t row_id = task->row_ids[req_i + req_j];
         uint8_t column_id = task->column_ids[req_i + req_j];
-        bool is_read = task->op_types[req_i + req_j] == 0;
-        bool is_rmw = task->op_types[req_i + req_j] == 1;
 
-        if (hash_idx != nullptr) {
-          auto lookup_result =
-              hash_idx->lookup(&tx, row_id, kSkipValidationForIndexAccess,
-                               [&row_id](auto& k, auto& v) {
-                                 (void)k;
-                                 row_id = v;
-                                 return false;
-                               }); //hash桶遍历
-          if (lookup_result != 1 || lookup_result == HashIndex::kHaveToAbort) {
-            assert(false);
-            tx.abort();
-            aborted = true;
-            break;
-          }
-        } else if (btree_idx != nullptr) {
-          auto lookup_result =
-              btree_idx->lookup(&tx, row_id, kSkipValidationForIndexAccess,
-                                [&row_id](auto& k, auto& v) {
-                                  (void)k;
-                                  row_id = v;
-                                  return false;
-                                });// B+tree查找
-          if (lookup_result != 1 || lookup_result == BTreeIndex::kHaveToAbort) {
-            assert(false);
+        if (use_declared)
+          row_id = declared[req_j].row_id;
+        else if (!lookup_row_id(task, &tx, row_id)) {
+          tx.abort();
+          aborted = true;
+          break;
+        }
+
+        if (!use_peek_only || !kUseScan) {
+          if (!access_row(task, &tx, row_id, column_id,
+                          task->op_types[req_i + req_j], use_peek_only, v)) {
             tx.abort();
             aborted = true;
             break;
           }
-        }
-
-        if (!use_peek_only) {
-          RowAccessHandle rah(&tx);
-
-          if (is_read) {
-            if (!rah.peek_row(tbl, 0, row_id, false, true, false) ||
-                !rah.read_row()) {
+        } else if (!kUseFullTableScan) {
+          RowAccessHandlePeekOnly rah(&tx);
+
+          uint64_t next_row_id = row_id;
+          uint64_t next_next_raw_row_id = task->row_ids[req_i + req_j] + 1;
+          if (next_next_raw_row_id == task->num_rows) next_next_raw_row_id = 0;
+
+          uint32_t scan_len = task->scan_lens[tx_i];
+          for (uint32_t scan_i = 0; scan_i < scan_len; scan_i++) {
+            uint64_t this_row_id = next_row_id;
+
+            // TODO: Support btree_idx.
+            assert(hash_idx != nullptr);
+
+            // Lookup index for next row.
+            auto lookup_result =
+                hash_idx->lookup(&tx, next_next_raw_row_id, true,
+                                 [&next_row_id](auto& k, auto& v) {
+                                   (void)k;
+                                   next_row_id = v;
+                                   return false;
+                                 });
+            if (lookup_result != 1 ||
+                lookup_result == HashIndex::kHaveToAbort) {
               tx.abort();
               aborted = true;
               break;
             }
 
-            const char* data =
-                rah.cdata() + static_cast<uint64_t>(column_id) * kColumnSize;
-            for (uint64_t j = 0; j < kColumnSize; j += 64)
-              v += static_cast<uint64_t>(data[j]);
-            v += static_cast<uint64_t>(data[kColumnSize - 1]);
-          } else {
-            if (is_rmw) {
-              if (!rah.peek_row(tbl, 0, row_id, false, true, true) ||
-                  !rah.read_row() || !rah.write_row(kDataSize)) { //rah 指向事务的accesses_数组里的一项，描述了当前事务访问的一行的元数据
-                tx.abort();
-                aborted = true;
-                break;
-              }
-            } else {
-              if (!rah.peek_row(tbl, 0, row_id, false, false, true) ||
-                  !rah.write_row(kDataSize)) {
-                tx.abort();
-                aborted = true;
-                break;
-              }
-            }
+            // Prefetch index for next next row.
+            next_next_raw_row_id++;
+            if (next_next_raw_row_id == task->num_rows)
+              next_next_raw_row_id = 0;
+            hash_idx->prefetch(&tx, next_next_raw_row_id);
 
-            char* data =
-                rah.data() + static_cast<uint64_t>(column_id) * kColumnSize;
-            for (uint64_t j = 0; j < kColumnSize; j += 64) {
-              v += static_cast<uint64_t>(data[j]);
-              data[j] = static_cast<char>(v);
-            }
-            v += static_cast<uint64_t>(data[kColumnSize - 1]);
-            data[kColumnSize - 1] = static_cast<char>(v);
-          }
-        } else {
-          if (!kUseScan) {
-            RowAccessHandlePeekOnly rah(&tx);
+            // Prefetch next row.
+            rah.prefetch_row(tbl, 0, next_row_id,
+                             static_cast<uint64_t>(column_id) * kColumnSize,
+                             kColumnSize);
 
-            if (!rah.peek_row(tbl, 0, row_id, false, false, false)) {
+            // Access current row.
+            if (!rah.peek_row(tbl, 0, this_row_id, false, false, false)) {
               tx.abort();
               aborted = true;
               break;
@@ -277,79 +551,24 @@ void worker_proc(Task* task) {
             for (uint64_t j = 0; j < kColumnSize; j += 64)
               v += static_cast<uint64_t>(data[j]);
             v += static_cast<uint64_t>(data[kColumnSize - 1]);
-          } else if (!kUseFullTableScan) {
-            RowAccessHandlePeekOnly rah(&tx);
-
-            uint64_t next_row_id = row_id;
-            uint64_t next_next_raw_row_id = task->row_ids[req_i + req_j] + 1;
-            if (next_next_raw_row_id == task->num_rows)
-              next_next_raw_row_id = 0;
-
-            uint32_t scan_len = task->scan_lens[tx_i];
-            for (uint32_t scan_i = 0; scan_i < scan_len; scan_i++) {
-              uint64_t this_row_id = next_row_id;
-
-              // TODO: Support btree_idx.
-              assert(hash_idx != nullptr);
-
-              // Lookup index for next row.
-              auto lookup_result =
-                  hash_idx->lookup(&tx, next_next_raw_row_id, true,
-                                   [&next_row_id](auto& k, auto& v) {
-                                     (void)k;
-                                     next_row_id = v;
-                                     return false;
-                                   });
-              if (lookup_result != 1 ||
-                  lookup_result == HashIndex::kHaveToAbort) {
-                tx.abort();
-                aborted = true;
-                break;
-              }
-
-              // Prefetch index for next next row.
-              next_next_raw_row_id++;
-              if (next_next_raw_row_id == task->num_rows)
-                next_next_raw_row_id = 0;
-              hash_idx->prefetch(&tx, next_next_raw_row_id);
-
-              // Prefetch next row.
-              rah.prefetch_row(tbl, 0, next_row_id,
-                               static_cast<uint64_t>(column_id) * kColumnSize,
-                               kColumnSize);
-
-              // Access current row.
-              if (!rah.peek_row(tbl, 0, this_row_id, false, false, false)) {
-                tx.abort();
-                aborted = true;
-                break;
-              }
 
-              const char* data =
-                  rah.cdata() + static_cast<uint64_t>(column_id) * kColumnSize;
-              for (uint64_t j = 0; j < kColumnSize; j += 64)
-                v += static_cast<uint64_t>(data[j]);
-              v += static_cast<uint64_t>(data[kColumnSize - 1]);
-
-              rah.reset();
-            }
+            rah.reset();
+          }
 
-            if (aborted) break;
-          } else /*if (kUseFullTableScan)*/ {
-            if (!tbl->scan(&tx, 0,
-                           static_cast<uint64_t>(column_id) * kColumnSize,
-                           kColumnSize, [&v, column_id](auto& rah) {
-                             const char* data =
-                                 rah.cdata() +
-                                 static_cast<uint64_t>(column_id) * kColumnSize;
-                             for (uint64_t j = 0; j < kColumnSize; j += 64)
-                               v += static_cast<uint64_t>(data[j]);
-                             v += static_cast<uint64_t>(data[kColumnSize - 1]);
-                           })) {
-              tx.abort();
-              aborted = true;
-              break;
-            }
+          if (aborted) break;
+        } else /*if (kUseFullTableScan)*/ {
+          if (!tbl->scan(&tx, 0, static_cast<uint64_t>(column_id) * kColumnSize,
+                         kColumnSize, [&v, column_id](auto& rah) {
+                           const char* data =
+                               rah.cdata() +
+                               static_cast<uint64_t>(column_id) * kColumnSize;
+                           for (uint64_t j = 0; j < kColumnSize; j += 64)
+                             v += static_cast<uint64_t>(data[j]);
+                           v += static_cast<uint64_t>(data[kColumnSize - 1]);
+                         })) {
+            tx.abort();
+            aborted = true;
+            break;
           }
         }
       }
@@ -400,16 +619,47 @@ int main(int argc, const char* argv[]) {
   uint64_t tx_count = static_cast<uint64_t>(atol(argv[5]));
   uint64_t num_threads = static_cast<uint64_t>(atol(argv[6]));
 
+  uint64_t interleave_count = config.get("interleave_count").get_uint64(1);
+  if (interleave_count == 0) interleave_count = 1;
+  if (interleave_count > DBConfig::kMaxInterleavedTxCount) {
+    printf("interleave_count is limited by kMaxInterleavedTxCount = %hu\n",
+           DBConfig::kMaxInterleavedTxCount);
+    interleave_count = DBConfig::kMaxInterleavedTxCount;
+  }
+  bool declare_accesses = config.get("declare_accesses").get_bool(false);
+  if (declare_accesses && interleave_count > 1) {
+    printf("declare_accesses is ignored in interleaved execution\n");
+    declare_accesses = false;
+  }
+  if (kUseScan && interleave_count > 1) {
+    printf("interleaved execution does not support scans\n");
+    interleave_count = 1;
+  }
+  uint64_t trace_sample_every = config.get("trace_sample_every").get_uint64(0);
+  std::string trace_file = config.get("trace_file").get_str("test_tx.trace");
+  if (trace_sample_every != 0 && !DBConfig::kEnableTxTrace) {
+    printf("trace_sample_every is ignored without kEnableTxTrace\n");
+    trace_sample_every = 0;
+  }
+
   Alloc alloc(config.get("alloc"));
+  // Keeps the table in CXL across runs when enabled.
+  Superblock superblock(&alloc, config.get("superblock"));
+  bool attached = superblock.attached();
   auto page_pool_size = 24 * uint64_t(1073741824);
-  PagePool* page_pools[2];
-  // if (num_threads == 1) {
-  //   page_pools[0] = new PagePool(&alloc, page_pool_size, 0);
-  //   page_pools[1] = nullptr;
-  // } else {
-  page_pools[0] = new PagePool(&alloc, page_pool_size / 2, 0);
-  page_pools[1] = new PagePool(&alloc, page_pool_size / 2, 1);
-  // }
+  // Each page pool may grow up to this multiple of its initial size.
+  double page_pool_growth = config.get("page_pool_growth").get_double(1.);
+  ::mica::transaction::CXLTopology cxl_topology(config.get("cxl"));
+  std::vector<PagePool*> page_pools(::mica::util::lcore.numa_count(), nullptr);
+  for (uint8_t numa_id = 0; numa_id < page_pools.size(); numa_id++) {
+    page_pools[numa_id] = superblock.page_pool(numa_id);
+    if (page_pools[numa_id] != nullptr) continue;
+    auto size = cxl_topology.page_pool_size(numa_id, page_pool_size);
+    if (size != 0)
+      page_pools[numa_id] = new PagePool(
+          &alloc, size, numa_id,
+          static_cast<uint64_t>(static_cast<double>(size) * page_pool_growth));
+  }
 
   ::mica::util::lcore.pin_thread(0);
 
@@ -435,55 +685,75 @@ int main(int argc, const char* argv[]) {
   printf("zipf_theta = %lf\n", zipf_theta);
   printf("tx_count = %" PRIu64 "\n", tx_count);
   printf("num_threads = %" PRIu64 "\n", num_threads);
+  printf("interleave_count = %" PRIu64 "\n", interleave_count);
+  printf("declare_accesses = %d\n", declare_accesses ? 1 : 0);
 #ifndef NDEBUG
   printf("!NDEBUG\n");
 #endif
   printf("\n");
 
   Logger logger;
-  DB db(page_pools, &logger, &sw, static_cast<uint16_t>(num_threads));
+  DB db(page_pools.data(), &logger, &sw, static_cast<uint16_t>(num_threads),
+        cxl_topology, superblock.enabled() ? &superblock : nullptr);
+  // An attached DB already has the table, the index, and the rows of the last
+  // run, which must have used the same NUM-ROWS.
+  if (attached) printf("resuming from the superblock\n");
+
+  // A shared DB runs only the threads of this process here; the others run
+  // in the other processes.
+  uint64_t thread_begin = db.thread_begin();
+  uint64_t thread_end = db.thread_end();
+  auto main_thread_id = static_cast<uint16_t>(thread_begin);
 
   const bool kVerify =
       typeid(typename DBConfig::Logger) == typeid(VerificationLogger<DBConfig>);
 
   const uint64_t data_sizes[] = {kDataSize};
-  bool ret = db.create_table("main", 1, data_sizes);
-  assert(ret);
-  (void)ret;
+  if (!attached) {
+    bool ret = db.create_table("main", 1, data_sizes);
+    assert(ret);
+    (void)ret;
+  }
 
   auto tbl = db.get_table("main");
 
-  db.activate(0);
+  db.activate(main_thread_id);
 
   HashIndex* hash_idx = nullptr;
-  if (kUseHashIndex) {
+  if (kUseHashIndex && attached) {
+    hash_idx = db.get_hash_index_unique_u64("main_idx");
+  } else if (kUseHashIndex) {
     bool ret = db.create_hash_index_unique_u64("main_idx", tbl, num_rows);
     assert(ret);
     (void)ret;
 
     hash_idx = db.get_hash_index_unique_u64("main_idx");
-    Transaction tx(db.context(0));
+    Transaction tx(db.context(main_thread_id));
     hash_idx->init(&tx);
   }
 
   BTreeIndex* btree_idx = nullptr;
-  if (kUseBTreeIndex) {
+  if (kUseBTreeIndex && attached) {
+    btree_idx = db.get_btree_index_unique_u64("main_idx");
+  } else if (kUseBTreeIndex) {
     bool ret = db.create_btree_index_unique_u64("main_idx", tbl);
     assert(ret);
     (void)ret;
 
     btree_idx = db.get_btree_index_unique_u64("main_idx");
-    Transaction tx(db.context(0));
+    Transaction tx(db.context(main_thread_id));
     btree_idx->init(&tx);
   }
 
-  {
+  if (!attached) {
     printf("initializing table\n");
 
     std::vector<std::thread> threads;
-    uint64_t init_num_threads = std::min(uint64_t(2), num_threads);
-    for (uint64_t thread_id = 0; thread_id < init_num_threads; thread_id++) {
-      threads.emplace_back([&, thread_id] {
+    uint64_t init_num_threads =
+        std::min(uint64_t(2), thread_end - thread_begin);
+    for (uint64_t init_i = 0; init_i < init_num_threads; init_i++) {
+      uint64_t thread_id = thread_begin + init_i;
+      threads.emplace_back([&, init_i, thread_id] {
         ::mica::util::lcore.pin_thread(thread_id);
 
         db.activate(static_cast<uint16_t>(thread_id));
@@ -493,10 +763,10 @@ int main(int argc, const char* argv[]) {
         }
 
         // Randomize the data layout by shuffling row insert order.
-        std::mt19937 g(thread_id);
+        std::mt19937 g(init_i);
         std::vector<uint64_t> row_ids;
         row_ids.reserve((num_rows + init_num_threads - 1) / init_num_threads);
-        for (uint64_t i = thread_id; i < num_rows; i += init_num_threads)
+        for (uint64_t i = init_i; i < num_rows; i += init_num_threads)
           row_ids.push_back(i);
         std::shuffle(row_ids.begin(), row_ids.end(), g);
 
@@ -569,25 +839,28 @@ int main(int argc, const char* argv[]) {
 
     // TODO: Use multiple threads to renew rows for more balanced memory access.
 
-    db.activate(0);
+    db.activate(main_thread_id);
+    auto ctx = db.context(main_thread_id);
     {
       uint64_t i = 0;
-      tbl->renew_rows(db.context(0), 0, i, static_cast<uint64_t>(-1), false);
+      tbl->renew_rows(ctx, 0, i, static_cast<uint64_t>(-1), false);
     }
     if (hash_idx != nullptr) {
       uint64_t i = 0;
-      hash_idx->index_table()->renew_rows(db.context(0), 0, i,
+      hash_idx->index_table()->renew_rows(ctx, 0, i,
                                           static_cast<uint64_t>(-1), false);
     }
     if (btree_idx != nullptr) {
       uint64_t i = 0;
-      btree_idx->index_table()->renew_rows(db.context(0), 0, i,
+      btree_idx->index_table()->renew_rows(ctx, 0, i,
                                            static_cast<uint64_t>(-1), false);
     }
-    db.deactivate(0);
+    db.deactivate(main_thread_id);
 
     db.reset_stats();
     db.reset_backoff();
+  } else {
+    db.deactivate(main_thread_id);
   }
 
   std::vector<Task> tasks(num_threads);
@@ -595,9 +868,12 @@ int main(int argc, const char* argv[]) {
   {
     printf("generating workload\n");
 
-    for (uint64_t thread_id = 0; thread_id < num_threads; thread_id++) {
+    for (uint64_t thread_id = thread_begin; thread_id < thread_end;
+         thread_id++) {
       tasks[thread_id].thread_id = static_cast<uint16_t>(thread_id);
-      tasks[thread_id].num_threads = num_threads;
+      tasks[thread_id].num_threads = thread_end - thread_begin;
+      tasks[thread_id].interleave_count = interleave_count;
+      tasks[thread_id].declare_accesses = declare_accesses;
       tasks[thread_id].db = &db;
       tasks[thread_id].tbl = tbl;
       tasks[thread_id].hash_idx = hash_idx;
@@ -606,7 +882,8 @@ int main(int argc, const char* argv[]) {
 
     if (kUseContendedSet) zipf_theta = 0.;
 
-    for (uint64_t thread_id = 0; thread_id < num_threads; thread_id++) {
+    for (uint64_t thread_id = thread_begin; thread_id < thread_end;
+         thread_id++) {
       auto req_counts = reinterpret_cast<uint16_t*>(
           alloc.malloc_contiguous(sizeof(uint16_t) * tx_count, thread_id));
       auto read_only_tx = reinterpret_cast<uint8_t*>(
@@ -660,7 +937,8 @@ int main(int argc, const char* argv[]) {
     }
 
     std::vector<std::thread> threads;
-    for (uint64_t thread_id = 0; thread_id < num_threads; thread_id++) {
+    for (uint64_t thread_id = thread_begin; thread_id < thread_end;
+         thread_id++) {
       threads.emplace_back([&, thread_id] {
         ::mica::util::lcore.pin_thread(thread_id);
 
@@ -740,6 +1018,16 @@ int main(int argc, const char* argv[]) {
   // For verification.
   std::vector<Timestamp> table_ts;
 
+  // Covers both warmup and execution; reset_stats() is handled as a restart.
+  ::mica::transaction::StatsSampler<DBConfig> sampler(
+      &db, config.get("stats_sampler"));
+  sampler.start();
+
+  // Moves cold rows to the SSD tier while running (see RowEvictor).
+  ::mica::transaction::RowEvictor<DBConfig> evictor(&db,
+                                                    config.get("eviction"));
+  evictor.start();
+
   for (auto phase = 0; phase < 2; phase++) {
     // if (kVerify && phase == 0) {
     //   printf("skipping warming up\n");
@@ -757,6 +1045,8 @@ int main(int argc, const char* argv[]) {
       printf("warming up\n");
     else {
       db.reset_stats();
+      evictor.reset_stats();
+      if (trace_sample_every != 0) db.set_trace_sampling(trace_sample_every);
       printf("executing workload\n");
     }
 
@@ -766,7 +1056,8 @@ int main(int argc, const char* argv[]) {
     ::mica::util::memory_barrier();
 
     std::vector<std::thread> threads;
-    for (uint64_t thread_id = 1; thread_id < num_threads; thread_id++)
+    for (uint64_t thread_id = thread_begin + 1; thread_id < thread_end;
+         thread_id++)
       threads.emplace_back(worker_proc, &tasks[thread_id]);
 
     if (phase != 0 && kRunPerf) {
@@ -775,7 +1066,7 @@ int main(int argc, const char* argv[]) {
       (void)r;
     }
 
-    worker_proc(&tasks[0]);
+    worker_proc(&tasks[thread_begin]);
 
     while (threads.size() > 0) {
       threads.back().join();
@@ -784,27 +1075,31 @@ int main(int argc, const char* argv[]) {
   }
   printf("\n");
 
+  sampler.stop();
+
   {
     double diff;
     {
       double min_start = 0.;
       double max_end = 0.;
-      for (size_t thread_id = 0; thread_id < num_threads; thread_id++) {
+      for (size_t thread_id = thread_begin; thread_id < thread_end;
+           thread_id++) {
         double start = (double)tasks[thread_id].tv_start.tv_sec * 1. +
                        (double)tasks[thread_id].tv_start.tv_usec * 0.000001;
         double end = (double)tasks[thread_id].tv_end.tv_sec * 1. +
                      (double)tasks[thread_id].tv_end.tv_usec * 0.000001;
-        if (thread_id == 0 || min_start > start) min_start = start;
-        if (thread_id == 0 || max_end < end) max_end = end;
+        if (thread_id == thread_begin || min_start > start) min_start = start;
+        if (thread_id == thread_begin || max_end < end) max_end = end;
       }
 
       diff = max_end - min_start;
     }
-    double total_time = diff * static_cast<double>(num_threads);
+    double total_time = diff * static_cast<double>(thread_end - thread_begin);
 
     uint64_t total_committed = 0;
     uint64_t total_scanned = 0;
-    for (size_t thread_id = 0; thread_id < num_threads; thread_id++) {
+    for (size_t thread_id = thread_begin; thread_id < thread_end;
+         thread_id++) {
       total_committed += tasks[thread_id].committed;
       if (kUseScan) total_scanned += tasks[thread_id].scanned;
     }
@@ -816,15 +1111,33 @@ int main(int argc, const char* argv[]) {
 
     db.print_stats(diff, total_time);
 
+    if (config.get("eviction").exists()) {
+      // Not included in the stats above.
+      auto evictor_stats = evictor.stats();
+      printf("evictor: %" PRIu64 " evicted, %" PRIu64 " faulted in, %" PRIu64
+             " of %" PRIu64 " transactions committed\n\n",
+             evictor.evict_count(), evictor.fault_in_count(),
+             evictor_stats.committed_count, evictor_stats.tx_count);
+    }
+
+    if (trace_sample_every != 0 && db.dump_trace(trace_file.c_str()))
+      printf("trace written to %s\n\n", trace_file.c_str());
+
     tbl->print_table_status();
 
     if (hash_idx != nullptr) hash_idx->index_table()->print_table_status();
     if (btree_idx != nullptr) btree_idx->index_table()->print_table_status();
 
-    if (kShowPoolStats) db.print_pool_status();
+    if (kShowPoolStats) {
+      db.print_pool_status();
+      db.print_memory_status();
+    }
   }
 
-  if (kVerify) {
+  if (kVerify && db.shared()) {
+    // The other processes write the same rows.
+    printf("skipping verification of a shared DB\n");
+  } else if (kVerify) {
     printf("verifying\n");
     const bool print_verification = false;
     // const bool print_verification = true;
@@ -937,7 +1250,8 @@ int main(int argc, const char* argv[]) {
 
   {
     printf("cleaning up\n");
-    for (uint64_t thread_id = 0; thread_id < num_threads; thread_id++) {
+    for (uint64_t thread_id = thread_begin; thread_id < thread_end;
+         thread_id++) {
       alloc.free_contiguous(tasks[thread_id].req_counts);
       alloc.free_contiguous(tasks[thread_id].read_only_tx);
       if (kUseScan) alloc.free_contiguous(tasks[thread_id].scan_lens);
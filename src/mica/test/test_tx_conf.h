@@ -89,6 +89,10 @@ struct DBConfig : public ::mica::transaction::BasicDBConfig {
   static constexpr int64_t kMinQuiescenceInterval = MICA_SLOW_GC;
 #endif
 
+  // Uncomment to allow interleaved execution ("interleave_count" in
+  // test_tx.json).
+  // static constexpr uint16_t kMaxInterleavedTxCount = 16;
+
 // typedef ::mica::transaction::WideTimestamp Timestamp;
 // typedef ::mica::transaction::WideConcurrentTimestamp ConcurrentTimestamp;
 #if MICA_NO_TSC
@@ -99,6 +103,8 @@ struct DBConfig : public ::mica::transaction::BasicDBConfig {
 
   // static constexpr bool kCollectCommitStats = false;
   // static constexpr bool kCollectProcessingStats = true;
+  // static constexpr bool kCollectPhaseLatency = true;
+  // static constexpr bool kEnableTxTrace = true;  // "trace_sample_every"
   // typedef ::mica::transaction::ActiveTiming Timing;
 
   // Switch this for verification.
@@ -367,13 +367,11 @@ int main(int argc, const char* argv[]) {
 
   Alloc alloc(config.get("alloc"));
   auto page_pool_size = 8 * uint64_t(1073741824);
-  PagePool* page_pools[2];
-  if (num_threads == 1) {
-    page_pools[0] = new PagePool(&alloc, page_pool_size, 0);
-    page_pools[1] = nullptr;
-  } else {
-    page_pools[0] = new PagePool(&alloc, page_pool_size / 2, 0);
-    page_pools[1] = new PagePool(&alloc, page_pool_size / 2, 1);
+  ::mica::transaction::CXLTopology cxl_topology(config.get("cxl"));
+  std::vector<PagePool*> page_pools(::mica::util::lcore.numa_count(), nullptr);
+  for (uint8_t numa_id = 0; numa_id < page_pools.size(); numa_id++) {
+    auto size = cxl_topology.page_pool_size(numa_id, page_pool_size);
+    if (size != 0) page_pools[numa_id] = new PagePool(&alloc, size, numa_id);
   }
 
   ::mica::util::lcore.pin_thread(0);
@@ -391,7 +389,8 @@ int main(int argc, const char* argv[]) {
   printf("\n");
 
   Logger logger;
-  DB db(page_pools, &logger, &sw, static_cast<uint16_t>(num_threads));
+  DB db(page_pools.data(), &logger, &sw, static_cast<uint16_t>(num_threads),
+        cxl_topology);
 
   const uint64_t kDataSizes[] = {kDataSize};
   bool ret = db.create_table("main", 1, kDataSizes);
@@ -0,0 +1,845 @@
+#include <cstdio>
+#include <thread>
+#include <random>
+#include "mica/transaction/db.h"
+#include "mica/util/lcore.h"
+#include "mica/util/latency.h"
+#include "mica/util/zipf.h"
+#include "mica/util/rand.h"
+
+struct DBConfig : public ::mica::transaction::BasicDBConfig {
+  // Switch this for verification.
+  typedef ::mica::transaction::NullLogger<DBConfig> Logger;
+};
+
+typedef DBConfig::Alloc Alloc;
+typedef DBConfig::Logger Logger;
+typedef DBConfig::Timing Timing;
+typedef ::mica::transaction::PagePool<DBConfig> PagePool;
+typedef ::mica::transaction::DB<DBConfig> DB;
+typedef ::mica::transaction::Table<DBConfig> Table;
+typedef DB::HashIndexUniqueU64 HashIndex;
+typedef DB::BTreeIndexUniqueU64 BTreeIndex;
+typedef ::mica::transaction::RowAccessHandle<DBConfig> RowAccessHandle;
+typedef ::mica::transaction::RowAccessHandlePeekOnly<DBConfig>
+    RowAccessHandlePeekOnly;
+typedef ::mica::transaction::Transaction<DBConfig> Transaction;
+typedef ::mica::transaction::Result Result;
+typedef ::mica::transaction::BTreeRangeType BTreeRangeType;
+
+static ::mica::util::Stopwatch sw;
+
+// Debugging
+static constexpr bool kShowPoolStats = true;
+
+static constexpr bool kSkipValidationForIndexAccess = true;
+
+// Run transactions with only reads and scans as peek-only (snapshot)
+// transactions.
+static constexpr bool kUseSnapshot = true;
+
+// The maximum number of operations per transaction.
+static constexpr uint64_t kMaxOpsPerTx = 64;
+
+enum OpType : int {
+  kRead = 0,
+  kUpdate,
+  kInsert,
+  kScan,
+  kReadModifyWrite,
+  kOpTypeCount
+};
+static const char* op_type_names[] = {"READ", "UPDATE", "INSERT", "SCAN",
+                                      "READ-MODIFY-WRITE"};
+
+enum class Distribution {
+  kUniform = 0,
+  kZipfian,
+  kHotspot,
+  kLatest,
+};
+
+// Workload parameters.  Defaults follow the YCSB core workloads; any of them
+// can be overridden in the "ycsb" section of test_tx.json.
+struct Workload {
+  std::string name;
+
+  uint64_t record_count;
+  uint64_t field_count;
+  uint64_t field_length;
+  bool read_all_fields;
+
+  double proportions[kOpTypeCount];
+  uint64_t ops_per_tx;
+  uint64_t max_scan_length;
+
+  Distribution distribution;
+  double zipf_theta;
+  double hotspot_data_fraction;
+  double hotspot_op_fraction;
+
+  uint64_t data_size() const { return field_count * field_length; }
+  bool has_scan() const { return proportions[kScan] > 0.; }
+};
+
+static bool set_preset(Workload& w, const std::string& name) {
+  for (auto& p : w.proportions) p = 0.;
+  w.distribution = Distribution::kZipfian;
+
+  if (name == "a") {
+    // Update heavy.
+    w.proportions[kRead] = 0.5;
+    w.proportions[kUpdate] = 0.5;
+  } else if (name == "b") {
+    // Read mostly.
+    w.proportions[kRead] = 0.95;
+    w.proportions[kUpdate] = 0.05;
+  } else if (name == "c") {
+    // Read only.
+    w.proportions[kRead] = 1.;
+  } else if (name == "d") {
+    // Read latest.
+    w.proportions[kRead] = 0.95;
+    w.proportions[kInsert] = 0.05;
+    w.distribution = Distribution::kLatest;
+  } else if (name == "e") {
+    // Short ranges.
+    w.proportions[kScan] = 0.95;
+    w.proportions[kInsert] = 0.05;
+  } else if (name == "f") {
+    // Read-modify-write.
+    w.proportions[kRead] = 0.5;
+    w.proportions[kReadModifyWrite] = 0.5;
+  } else {
+    return false;
+  }
+  w.name = name;
+  return true;
+}
+
+static bool parse_distribution(const std::string& s, Distribution& d) {
+  if (s == "uniform")
+    d = Distribution::kUniform;
+  else if (s == "zipfian")
+    d = Distribution::kZipfian;
+  else if (s == "hotspot")
+    d = Distribution::kHotspot;
+  else if (s == "latest")
+    d = Distribution::kLatest;
+  else
+    return false;
+  return true;
+}
+
+static const char* distribution_name(Distribution d) {
+  switch (d) {
+    case Distribution::kUniform:
+      return "uniform";
+    case Distribution::kZipfian:
+      return "zipfian";
+    case Distribution::kHotspot:
+      return "hotspot";
+    case Distribution::kLatest:
+      return "latest";
+  }
+  return "";
+}
+
+// The number of keys inserted so far (including the initial records).  Keys
+// are dense, so a key is valid if it is smaller than this.  Keys that are
+// reserved but not yet committed are reported as not found.
+static volatile uint64_t next_insert_key;
+
+static volatile uint16_t running_threads;
+static volatile uint8_t stopping;
+
+// Worker task.
+
+struct OpStats {
+  uint64_t count;
+  uint64_t not_found;
+  // The latency of committed transactions that contain this operation type,
+  // including retries (us).  With ops_per_tx == 1, this is the per-operation
+  // latency as reported by YCSB.
+  ::mica::util::Latency latency;
+};
+
+struct Task {
+  DB* db;
+  Table* tbl;
+  HashIndex* hash_idx;
+  BTreeIndex* btree_idx;
+  const Workload* workload;
+
+  uint64_t thread_id;
+  uint64_t num_threads;
+
+  uint64_t duration_ms;
+
+  // Results.
+  struct timeval tv_start;
+  struct timeval tv_end;
+
+  uint64_t committed;
+  uint64_t aborted;
+  OpStats stats[kOpTypeCount];
+} __attribute__((aligned(64)));
+
+struct Op {
+  OpType type;
+  uint64_t key;
+  uint64_t field;
+  uint64_t scan_len;
+};
+
+// Key chooser for a single thread.
+class KeyGen {
+ public:
+  KeyGen(const Workload& w, uint64_t seed)
+      : w_(w),
+        rand_(seed),
+        zg_(w.record_count, w.distribution == Distribution::kUniform
+                                ? 0.
+                                : w.zipf_theta,
+            (seed + 1) & ((uint64_t(1) << 48) - 1)),
+        zg_n_(w.record_count) {}
+
+  uint64_t next() {
+    uint64_t n = next_insert_key;
+    switch (w_.distribution) {
+      case Distribution::kUniform:
+        return rand_.next_u32() % n;
+      case Distribution::kZipfian:
+        // Scramble the popular keys over the key space.
+        return (zipf(n) * 0x9ddfea08eb382d69ULL) % n;
+      case Distribution::kHotspot: {
+        auto hot_n = std::max(
+            uint64_t(1), static_cast<uint64_t>(static_cast<double>(n) *
+                                               w_.hotspot_data_fraction));
+        if (rand_.next_f64() < w_.hotspot_op_fraction || hot_n == n)
+          return rand_.next_u32() % hot_n;
+        return hot_n + rand_.next_u32() % (n - hot_n);
+      }
+      case Distribution::kLatest:
+        // The most recently inserted keys are the most popular.
+        return n - 1 - zipf(n);
+    }
+    return 0;
+  }
+
+  uint32_t next_u32() { return rand_.next_u32(); }
+  double next_f64() { return rand_.next_f64(); }
+
+ private:
+  const Workload& w_;
+  ::mica::util::Rand rand_;
+  ::mica::util::ZipfGen zg_;
+  uint64_t zg_n_;
+
+  uint64_t zipf(uint64_t n) {
+    if (zg_n_ != n) {
+      zg_.change_n(n);
+      zg_n_ = n;
+    }
+    return zg_.next();
+  }
+};
+
+static void generate_tx(KeyGen& kg, const Workload& w, Op* ops) {
+  for (uint64_t i = 0; i < w.ops_per_tx; i++) {
+    auto& op = ops[i];
+
+    double r = kg.next_f64();
+    int type;
+    for (type = 0; type < kOpTypeCount - 1; type++) {
+      if (r < w.proportions[type]) break;
+      r -= w.proportions[type];
+    }
+    op.type = static_cast<OpType>(type);
+
+    if (op.type == kInsert) {
+      op.key = __sync_fetch_and_add(&next_insert_key, 1);
+    } else {
+      // Avoid duplicate keys in a single transaction.
+      while (true) {
+        op.key = kg.next();
+        uint64_t j;
+        for (j = 0; j < i; j++)
+          if (ops[j].type != kInsert && ops[j].key == op.key) break;
+        if (j == i) break;
+      }
+    }
+    op.field = kg.next_u32() % w.field_count;
+    op.scan_len = kg.next_u32() % w.max_scan_length + 1;
+  }
+}
+
+// Looks up the row ID of a key.  Returns 1 if found, 0 if not found, and
+// kHaveToAbort if the transaction must abort.
+static uint64_t lookup_row_id(Task* task, Transaction* tx, uint64_t key,
+                              uint64_t& row_id) {
+  auto f = [&row_id](auto& k, auto& v) {
+    (void)k;
+    row_id = v;
+    return false;
+  };
+  if (task->hash_idx != nullptr) {
+    auto ret =
+        task->hash_idx->lookup(tx, key, kSkipValidationForIndexAccess, f);
+    return ret == HashIndex::kHaveToAbort ? BTreeIndex::kHaveToAbort : ret;
+  }
+  return task->btree_idx->lookup(tx, key, kSkipValidationForIndexAccess, f);
+}
+
+static void read_fields(const Workload& w, const char* data, uint64_t field,
+                        uint64_t& v) {
+  uint64_t begin = w.read_all_fields ? 0 : field * w.field_length;
+  uint64_t end = w.read_all_fields ? w.data_size() : begin + w.field_length;
+  for (uint64_t j = begin; j < end; j += 64) v += static_cast<uint64_t>(data[j]);
+  v += static_cast<uint64_t>(data[end - 1]);
+}
+
+static void write_field(const Workload& w, char* data, uint64_t field,
+                        uint64_t& v) {
+  char* p = data + field * w.field_length;
+  for (uint64_t j = 0; j < w.field_length; j++) p[j] = static_cast<char>(v + j);
+  v++;
+}
+
+// Reads a row.  Returns false if the transaction must abort.
+static bool read_row(Task* task, Transaction* tx, uint64_t row_id,
+                     uint64_t field, uint64_t& v) {
+  auto& w = *task->workload;
+  if (tx->is_peek_only()) {
+    RowAccessHandlePeekOnly rah(tx);
+    if (!rah.peek_row(task->tbl, 0, row_id, false, false, false)) return false;
+    read_fields(w, rah.cdata(), field, v);
+  } else {
+    RowAccessHandle rah(tx);
+    if (!rah.peek_row(task->tbl, 0, row_id, false, true, false) ||
+        !rah.read_row())
+      return false;
+    read_fields(w, rah.cdata(), field, v);
+  }
+  return true;
+}
+
+// Executes an operation.  Returns false if the transaction must abort.
+static bool execute_op(Task* task, Transaction* tx, const Op& op,
+                       bool& not_found, uint64_t& v) {
+  auto& w = *task->workload;
+  auto tbl = task->tbl;
+
+  not_found = false;
+
+  if (op.type == kInsert) {
+    RowAccessHandle rah(tx);
+    if (!rah.new_row(tbl, 0, Transaction::kNewRowID, true, w.data_size()))
+      return false;
+    for (uint64_t field = 0; field < w.field_count; field++)
+      write_field(w, rah.data(), field, v);
+    if (task->hash_idx != nullptr)
+      return task->hash_idx->insert(tx, op.key, rah.row_id()) == 1;
+    return task->btree_idx->insert(tx, op.key, rah.row_id()) == 1;
+  }
+
+  if (op.type == kScan) {
+    uint64_t left = op.scan_len;
+    bool failed = false;
+    auto ret = task->btree_idx->lookup<BTreeRangeType::kInclusive,
+                                       BTreeRangeType::kOpen, false>(
+        tx, op.key, 0, kSkipValidationForIndexAccess,
+        [&](auto& k, auto& row_id) {
+          (void)k;
+          if (!read_row(task, tx, row_id, op.field, v)) {
+            failed = true;
+            return false;
+          }
+          return --left > 0;
+        });
+    if (ret == BTreeIndex::kHaveToAbort || failed) return false;
+    not_found = ret == 0;
+    return true;
+  }
+
+  uint64_t row_id;
+  auto found = lookup_row_id(task, tx, op.key, row_id);
+  if (found == BTreeIndex::kHaveToAbort) return false;
+  if (found == 0) {
+    not_found = true;
+    return true;
+  }
+
+  switch (op.type) {
+    case kRead:
+      return read_row(task, tx, row_id, op.field, v);
+    case kUpdate: {
+      // Blind write of a single field.
+      RowAccessHandle rah(tx);
+      if (!rah.peek_row(tbl, 0, row_id, false, false, true) ||
+          !rah.write_row(w.data_size()))
+        return false;
+      write_field(w, rah.data(), op.field, v);
+      return true;
+    }
+    case kReadModifyWrite: {
+      RowAccessHandle rah(tx);
+      if (!rah.peek_row(tbl, 0, row_id, false, true, true) ||
+          !rah.read_row() || !rah.write_row(w.data_size()))
+        return false;
+      read_fields(w, rah.cdata(), op.field, v);
+      write_field(w, rah.data(), op.field, v);
+      return true;
+    }
+    default:
+      assert(false);
+      return false;
+  }
+}
+
+void worker_proc(Task* task) {
+  ::mica::util::lcore.pin_thread(static_cast<uint16_t>(task->thread_id));
+
+  auto ctx = task->db->context();
+  auto& w = *task->workload;
+
+  __sync_add_and_fetch(&running_threads, 1);
+  while (running_threads < task->num_threads) ::mica::util::pause();
+
+  Timing t(ctx->timing_stack(), &::mica::transaction::Stats::worker);
+
+  uint64_t seed = 4 * task->thread_id * ::mica::util::rdtsc();
+  uint64_t seed_mask = (uint64_t(1) << 48) - 1;
+  KeyGen kg(w, seed & seed_mask);
+
+  gettimeofday(&task->tv_start, nullptr);
+
+  task->db->activate(static_cast<uint16_t>(task->thread_id));
+  while (task->db->active_thread_count() < task->num_threads) {
+    ::mica::util::pause();
+    task->db->idle(static_cast<uint16_t>(task->thread_id));
+  }
+
+  uint64_t end_t = sw.now() + task->duration_ms * sw.c_1_msec();
+
+  Transaction tx(ctx);
+  Op ops[kMaxOpsPerTx];
+  bool not_found[kMaxOpsPerTx];
+  uint64_t v = 0;
+
+  while (!stopping) {
+    generate_tx(kg, w, ops);
+
+    bool read_only = true;
+    for (uint64_t i = 0; i < w.ops_per_tx; i++)
+      if (ops[i].type != kRead && ops[i].type != kScan) read_only = false;
+
+    uint64_t tx_start_t = sw.now();
+
+    bool committed = false;
+    while (!committed) {
+      bool ret = tx.begin(kUseSnapshot && read_only);
+      assert(ret);
+      (void)ret;
+
+      bool aborted = false;
+      for (uint64_t i = 0; i < w.ops_per_tx; i++) {
+        if (!execute_op(task, &tx, ops[i], not_found[i], v)) {
+          tx.abort();
+          aborted = true;
+          break;
+        }
+      }
+
+      if (!aborted) {
+        Result result;
+        committed = tx.commit(&result);
+      }
+      if (!committed) {
+        task->aborted++;
+        // Inserted keys are not retried after stopping, so they stay missing
+        // for other threads; this only matters at the end of a phase.
+        if (stopping) break;
+      }
+    }
+
+    uint64_t now = sw.now();
+    if (committed) {
+      task->committed++;
+      uint64_t latency = sw.diff_in_us(now, tx_start_t);
+      for (uint64_t i = 0; i < w.ops_per_tx; i++) {
+        auto& stats = task->stats[ops[i].type];
+        stats.count++;
+        if (not_found[i]) stats.not_found++;
+        stats.latency.update(latency);
+      }
+    }
+
+    if (now >= end_t && !stopping) stopping = 1;
+  }
+
+  task->db->deactivate(static_cast<uint16_t>(task->thread_id));
+
+  gettimeofday(&task->tv_end, nullptr);
+}
+
+int main(int argc, const char* argv[]) {
+  if (argc != 1) {
+    printf("%s (configured by the \"ycsb\" section of test_tx.json)\n",
+           argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  auto config = ::mica::util::Config::load_file("test_tx.json");
+  auto ycsb = config.get("ycsb");
+
+  Workload w;
+  if (!set_preset(w, ycsb.get("workload").get_str("a"))) {
+    printf("unknown workload: %s\n",
+           ycsb.get("workload").get_str("a").c_str());
+    return EXIT_FAILURE;
+  }
+  w.record_count = ycsb.get("record_count").get_uint64(1000000);
+  w.field_count = ycsb.get("field_count").get_uint64(10);
+  w.field_length = ycsb.get("field_length").get_uint64(100);
+  w.read_all_fields = ycsb.get("read_all_fields").get_bool(true);
+  w.proportions[kRead] =
+      ycsb.get("read_proportion").get_double(w.proportions[kRead]);
+  w.proportions[kUpdate] =
+      ycsb.get("update_proportion").get_double(w.proportions[kUpdate]);
+  w.proportions[kInsert] =
+      ycsb.get("insert_proportion").get_double(w.proportions[kInsert]);
+  w.proportions[kScan] =
+      ycsb.get("scan_proportion").get_double(w.proportions[kScan]);
+  w.proportions[kReadModifyWrite] =
+      ycsb.get("read_modify_write_proportion")
+          .get_double(w.proportions[kReadModifyWrite]);
+  w.ops_per_tx = ycsb.get("operations_per_tx").get_uint64(1);
+  w.max_scan_length = ycsb.get("max_scan_length").get_uint64(100);
+  if (ycsb.get("distribution").exists() &&
+      !parse_distribution(ycsb.get("distribution").get_str(),
+                          w.distribution)) {
+    printf("unknown distribution: %s\n",
+           ycsb.get("distribution").get_str().c_str());
+    return EXIT_FAILURE;
+  }
+  w.zipf_theta = ycsb.get("zipf_theta").get_double(0.99);
+  w.hotspot_data_fraction = ycsb.get("hotspot_data_fraction").get_double(0.2);
+  w.hotspot_op_fraction = ycsb.get("hotspot_op_fraction").get_double(0.8);
+
+  uint64_t num_threads = ycsb.get("threads").get_uint64(1);
+  double warmup = ycsb.get("warmup").get_double(1.);
+  double duration = ycsb.get("duration").get_double(10.);
+
+  // Scans require an ordered index.
+  bool use_btree = ycsb.get("btree_index").get_bool(w.has_scan());
+  if (w.has_scan() && !use_btree) {
+    printf("scans require btree_index\n");
+    return EXIT_FAILURE;
+  }
+  if (w.record_count == 0 || w.field_count == 0 || w.field_length == 0 ||
+      w.ops_per_tx == 0 || w.ops_per_tx > kMaxOpsPerTx ||
+      w.max_scan_length == 0 || num_threads == 0) {
+    printf("invalid workload parameters\n");
+    return EXIT_FAILURE;
+  }
+
+  Alloc alloc(config.get("alloc"));
+  auto page_pool_size = 24 * uint64_t(1073741824);
+  // Each page pool may grow up to this multiple of its initial size.
+  double page_pool_growth = config.get("page_pool_growth").get_double(1.);
+  ::mica::transaction::CXLTopology cxl_topology(config.get("cxl"));
+  std::vector<PagePool*> page_pools(::mica::util::lcore.numa_count(), nullptr);
+  for (uint8_t numa_id = 0; numa_id < page_pools.size(); numa_id++) {
+    auto size = cxl_topology.page_pool_size(numa_id, page_pool_size);
+    if (size != 0)
+      page_pools[numa_id] = new PagePool(
+          &alloc, size, numa_id,
+          static_cast<uint64_t>(static_cast<double>(size) * page_pool_growth));
+  }
+
+  ::mica::util::lcore.pin_thread(0);
+
+  sw.init_start();
+  sw.init_end();
+
+  printf("workload = %s\n", w.name.c_str());
+  printf("record_count = %" PRIu64 "\n", w.record_count);
+  printf("field_count = %" PRIu64 "\n", w.field_count);
+  printf("field_length = %" PRIu64 "\n", w.field_length);
+  for (int type = 0; type < kOpTypeCount; type++)
+    printf("%s proportion = %lf\n", op_type_names[type], w.proportions[type]);
+  printf("operations_per_tx = %" PRIu64 "\n", w.ops_per_tx);
+  if (w.has_scan()) printf("max_scan_length = %" PRIu64 "\n", w.max_scan_length);
+  printf("distribution = %s\n", distribution_name(w.distribution));
+  if (w.distribution == Distribution::kZipfian ||
+      w.distribution == Distribution::kLatest)
+    printf("zipf_theta = %lf\n", w.zipf_theta);
+  if (w.distribution == Distribution::kHotspot)
+    printf("hotspot = %lf of data, %lf of operations\n",
+           w.hotspot_data_fraction, w.hotspot_op_fraction);
+  printf("index = %s\n", use_btree ? "btree" : "hash");
+  printf("num_threads = %" PRIu64 "\n", num_threads);
+  printf("warmup = %lf\n", warmup);
+  printf("duration = %lf\n", duration);
+#ifndef NDEBUG
+  printf("!NDEBUG\n");
+#endif
+  printf("\n");
+
+  Logger logger;
+  DB db(page_pools.data(), &logger, &sw, static_cast<uint16_t>(num_threads),
+        cxl_topology);
+
+  const uint64_t data_sizes[] = {w.data_size()};
+  bool ret = db.create_table("usertable", 1, data_sizes);
+  assert(ret);
+  (void)ret;
+
+  auto tbl = db.get_table("usertable");
+
+  db.activate(0);
+
+  HashIndex* hash_idx = nullptr;
+  BTreeIndex* btree_idx = nullptr;
+  if (!use_btree) {
+    // Leave room for inserts.
+    bool ret = db.create_hash_index_unique_u64("usertable_idx", tbl,
+                                               w.record_count * 2);
+    assert(ret);
+    (void)ret;
+
+    hash_idx = db.get_hash_index_unique_u64("usertable_idx");
+    Transaction tx(db.context(0));
+    hash_idx->init(&tx);
+  } else {
+    bool ret = db.create_btree_index_unique_u64("usertable_idx", tbl);
+    assert(ret);
+    (void)ret;
+
+    btree_idx = db.get_btree_index_unique_u64("usertable_idx");
+    Transaction tx(db.context(0));
+    btree_idx->init(&tx);
+  }
+
+  db.deactivate(0);
+
+  std::vector<Task> tasks(num_threads);
+  for (uint64_t thread_id = 0; thread_id < num_threads; thread_id++) {
+    auto& task = tasks[thread_id];
+    task.db = &db;
+    task.tbl = tbl;
+    task.hash_idx = hash_idx;
+    task.btree_idx = btree_idx;
+    task.workload = &w;
+    task.thread_id = thread_id;
+    task.num_threads = num_threads;
+  }
+
+  {
+    printf("loading\n");
+
+    std::vector<std::thread> threads;
+    uint64_t init_num_threads = std::min(uint64_t(2), num_threads);
+    for (uint64_t thread_id = 0; thread_id < init_num_threads; thread_id++) {
+      threads.emplace_back([&, thread_id] {
+        ::mica::util::lcore.pin_thread(thread_id);
+
+        db.activate(static_cast<uint16_t>(thread_id));
+        while (db.active_thread_count() < init_num_threads) {
+          ::mica::util::pause();
+          db.idle(static_cast<uint16_t>(thread_id));
+        }
+
+        // Randomize the data layout by shuffling row insert order.
+        std::mt19937 g(thread_id);
+        std::vector<uint64_t> keys;
+        keys.reserve((w.record_count + init_num_threads - 1) /
+                     init_num_threads);
+        for (uint64_t i = thread_id; i < w.record_count; i += init_num_threads)
+          keys.push_back(i);
+        std::shuffle(keys.begin(), keys.end(), g);
+
+        Transaction tx(db.context(static_cast<uint16_t>(thread_id)));
+        const uint64_t kBatchSize = 16;
+        for (uint64_t i = 0; i < keys.size(); i += kBatchSize) {
+          while (true) {
+            bool ret = tx.begin();
+            if (!ret) {
+              printf("failed to start a transaction\n");
+              continue;
+            }
+
+            bool aborted = false;
+            auto i_end = std::min(i + kBatchSize, keys.size());
+            for (uint64_t j = i; j < i_end; j++) {
+              Op op;
+              op.type = kInsert;
+              op.key = keys[j];
+              bool not_found;
+              uint64_t v = keys[j];
+              if (!execute_op(&tasks[thread_id], &tx, op, not_found, v)) {
+                aborted = true;
+                tx.abort(true);
+                break;
+              }
+            }
+
+            if (aborted) continue;
+
+            Result result;
+            if (!tx.commit(&result)) continue;
+            break;
+          }
+        }
+
+        db.deactivate(static_cast<uint16_t>(thread_id));
+        return 0;
+      });
+    }
+
+    while (threads.size() > 0) {
+      threads.back().join();
+      threads.pop_back();
+    }
+
+    db.activate(0);
+    {
+      uint64_t i = 0;
+      tbl->renew_rows(db.context(0), 0, i, static_cast<uint64_t>(-1), false);
+    }
+    if (hash_idx != nullptr) {
+      uint64_t i = 0;
+      hash_idx->index_table()->renew_rows(db.context(0), 0, i,
+                                          static_cast<uint64_t>(-1), false);
+    }
+    if (btree_idx != nullptr) {
+      uint64_t i = 0;
+      btree_idx->index_table()->renew_rows(db.context(0), 0, i,
+                                           static_cast<uint64_t>(-1), false);
+    }
+    db.deactivate(0);
+
+    db.reset_stats();
+    db.reset_backoff();
+  }
+
+  next_insert_key = w.record_count;
+
+  for (auto phase = 0; phase < 2; phase++) {
+    if (phase == 0) {
+      if (warmup <= 0.) continue;
+      printf("warming up\n");
+    } else {
+      db.reset_stats();
+      printf("executing workload\n");
+    }
+
+    for (auto& task : tasks) {
+      task.duration_ms =
+          static_cast<uint64_t>((phase == 0 ? warmup : duration) * 1000.);
+      task.committed = 0;
+      task.aborted = 0;
+      for (auto& stats : task.stats) {
+        stats.count = 0;
+        stats.not_found = 0;
+        stats.latency.reset();
+      }
+    }
+
+    running_threads = 0;
+    stopping = 0;
+
+    ::mica::util::memory_barrier();
+
+    std::vector<std::thread> threads;
+    for (uint64_t thread_id = 1; thread_id < num_threads; thread_id++)
+      threads.emplace_back(worker_proc, &tasks[thread_id]);
+
+    worker_proc(&tasks[0]);
+
+    while (threads.size() > 0) {
+      threads.back().join();
+      threads.pop_back();
+    }
+  }
+  printf("\n");
+
+  {
+    double diff;
+    {
+      double min_start = 0.;
+      double max_end = 0.;
+      for (size_t thread_id = 0; thread_id < num_threads; thread_id++) {
+        double start = (double)tasks[thread_id].tv_start.tv_sec * 1. +
+                       (double)tasks[thread_id].tv_start.tv_usec * 0.000001;
+        double end = (double)tasks[thread_id].tv_end.tv_sec * 1. +
+                     (double)tasks[thread_id].tv_end.tv_usec * 0.000001;
+        if (thread_id == 0 || min_start > start) min_start = start;
+        if (thread_id == 0 || max_end < end) max_end = end;
+      }
+
+      diff = max_end - min_start;
+    }
+    double total_time = diff * static_cast<double>(num_threads);
+
+    uint64_t total_committed = 0;
+    uint64_t total_aborted = 0;
+    OpStats total[kOpTypeCount];
+    for (int type = 0; type < kOpTypeCount; type++) {
+      total[type].count = 0;
+      total[type].not_found = 0;
+      total[type].latency.reset();
+    }
+    for (auto& task : tasks) {
+      total_committed += task.committed;
+      total_aborted += task.aborted;
+      for (int type = 0; type < kOpTypeCount; type++) {
+        total[type].count += task.stats[type].count;
+        total[type].not_found += task.stats[type].not_found;
+        total[type].latency += task.stats[type].latency;
+      }
+    }
+
+    uint64_t total_ops = 0;
+    for (int type = 0; type < kOpTypeCount; type++)
+      total_ops += total[type].count;
+
+    printf("throughput:                   %7.3lf M tx/sec\n",
+           static_cast<double>(total_committed) / diff * 0.000001);
+    printf("operation throughput:         %7.3lf M ops/sec\n",
+           static_cast<double>(total_ops) / diff * 0.000001);
+    printf("abort rate:                   %7.3lf %%\n",
+           100. * static_cast<double>(total_aborted) /
+               static_cast<double>(
+                   std::max(uint64_t(1), total_committed + total_aborted)));
+    printf("\n");
+
+    printf("%-18s %12s %10s %8s %6s %6s %6s %6s %6s (us)\n", "operation",
+           "count", "not found", "avg", "p50", "p95", "p99", "p99.9", "max");
+    for (int type = 0; type < kOpTypeCount; type++) {
+      auto& s = total[type];
+      if (s.count == 0) continue;
+      printf("%-18s %12" PRIu64 " %10" PRIu64 " %8.1lf %6" PRIu64 " %6" PRIu64
+             " %6" PRIu64 " %6" PRIu64 " %6" PRIu64 "\n",
+             op_type_names[type], s.count, s.not_found, s.latency.avg_f(),
+             s.latency.perc(0.50), s.latency.perc(0.95), s.latency.perc(0.99),
+             s.latency.perc(0.999), s.latency.max());
+    }
+    printf("\n");
+
+    db.print_stats(diff, total_time);
+
+    tbl->print_table_status();
+
+    if (hash_idx != nullptr) hash_idx->index_table()->print_table_status();
+    if (btree_idx != nullptr) btree_idx->index_table()->print_table_status();
+
+    if (kShowPoolStats) {
+      db.print_pool_status();
+      db.print_memory_status();
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
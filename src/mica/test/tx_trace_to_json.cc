@@ -0,0 +1,35 @@
+#include <cstdio>
+#include <cstdlib>
+#include "mica/transaction/trace.h"
+
+int main(int argc, const char* argv[]) {
+  if (argc != 2 && argc != 3) {
+    printf("%s TRACE-FILE [JSON-FILE]\n", argv[0]);
+    printf("Converts a trace written by DB::dump_trace() into the Chrome trace "
+           "event format.\n");
+    return EXIT_FAILURE;
+  }
+
+  FILE* in = fopen(argv[1], "rb");
+  if (in == nullptr) {
+    fprintf(stderr, "error: failed to open %s\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+
+  FILE* out = stdout;
+  if (argc == 3) {
+    out = fopen(argv[2], "w");
+    if (out == nullptr) {
+      fprintf(stderr, "error: failed to open %s\n", argv[2]);
+      fclose(in);
+      return EXIT_FAILURE;
+    }
+  }
+
+  bool ok = ::mica::transaction::tx_trace_to_chrome_json(in, out);
+  if (!ok) fprintf(stderr, "error: invalid trace file %s\n", argv[1]);
+
+  fclose(in);
+  if (out != stdout) fclose(out);
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
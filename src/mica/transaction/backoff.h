@@ -0,0 +1,122 @@
+#pragma once
+#ifndef MICA_TRANSACTION_BACKOFF_H_
+#define MICA_TRANSACTION_BACKOFF_H_
+
+#include "mica/common.h"
+
+namespace mica {
+namespace transaction {
+template <class StaticConfig>
+class Table;
+
+// Per-thread exponential backoff with decay.  Used instead of the global hill
+// climbing in DB::update_backoff() when StaticConfig::kPerThreadBackoff is
+// true.
+//
+// A thread that keeps aborting due to contention grows its own backoff
+// exponentially; each commit decays it.  Threads working on uncontended data
+// therefore stay at (near) zero backoff regardless of what other threads see.
+//
+// With StaticConfig::kPerTableBackoff, a separate state is also kept for each
+// table that caused an abort, so that a hot table does not slow down accesses
+// to other tables from the same thread.
+template <class StaticConfig>
+class LocalBackoff {
+ public:
+  static constexpr size_t kMaxTableCount = StaticConfig::kMaxBackoffTableCount;
+
+  LocalBackoff() : c_1_usec_(0.) { reset(); }
+
+  void set_cycles_per_usec(uint64_t c_1_usec) {
+    c_1_usec_ = static_cast<double>(c_1_usec);
+  }
+
+  void reset() {
+    thread_backoff_ = 0.;
+    for (size_t i = 0; i < kMaxTableCount; i++) {
+      tables_[i].tbl = nullptr;
+      tables_[i].backoff = 0.;
+    }
+    table_count_ = 0;
+  }
+
+  // Grows the backoff after an abort caused by contention.  tbl may be
+  // nullptr if the table that caused the abort is unknown.
+  void on_contention_abort(const Table<StaticConfig>* tbl) {
+    grow(thread_backoff_);
+    if (StaticConfig::kPerTableBackoff && tbl != nullptr) {
+      auto state = find_or_insert(tbl);
+      if (state != nullptr) grow(state->backoff);
+    }
+  }
+
+  // Decays the backoff after a commit.
+  void on_commit() {
+    decay(thread_backoff_);
+    if (StaticConfig::kPerTableBackoff)
+      for (size_t i = 0; i < table_count_; i++) decay(tables_[i].backoff);
+  }
+
+  // Returns the maximum backoff time (cycles) to use after an abort.
+  double get(const Table<StaticConfig>* tbl) const {
+    if (StaticConfig::kPerTableBackoff && tbl != nullptr) {
+      for (size_t i = 0; i < table_count_; i++)
+        if (tables_[i].tbl == tbl) return tables_[i].backoff;
+    }
+    return thread_backoff_;
+  }
+
+  double thread_backoff() const { return thread_backoff_; }
+
+ private:
+  struct TableState {
+    const Table<StaticConfig>* tbl;
+    double backoff;
+  };
+
+  double c_1_usec_;
+  double thread_backoff_;
+  size_t table_count_;
+  TableState tables_[kMaxTableCount];
+
+  TableState* find_or_insert(const Table<StaticConfig>* tbl) {
+    for (size_t i = 0; i < table_count_; i++)
+      if (tables_[i].tbl == tbl) return &tables_[i];
+    // Fall back to the per-thread state if there are too many tables.
+    if (table_count_ == kMaxTableCount) return nullptr;
+    auto state = &tables_[table_count_++];
+    state->tbl = tbl;
+    state->backoff = 0.;
+    return state;
+  }
+
+  void grow(double& backoff) const {
+    double min_backoff = StaticConfig::kBackoffMin * c_1_usec_;
+    double max_backoff = StaticConfig::kBackoffMax * c_1_usec_;
+    double initial = StaticConfig::kPerThreadBackoffInitial * c_1_usec_;
+
+    if (backoff < initial)
+      backoff = initial;
+    else
+      backoff *= StaticConfig::kPerThreadBackoffGrowth;
+
+    if (backoff < min_backoff) backoff = min_backoff;
+    if (backoff > max_backoff) backoff = max_backoff;
+  }
+
+  void decay(double& backoff) const {
+    double min_backoff = StaticConfig::kBackoffMin * c_1_usec_;
+
+    backoff *= StaticConfig::kPerThreadBackoffDecay;
+    // Drop to the minimum once the backoff becomes negligible so that
+    // uncontended threads do not keep spinning for a few cycles.
+    if (backoff < StaticConfig::kPerThreadBackoffInitial * c_1_usec_ *
+                      StaticConfig::kPerThreadBackoffDecay)
+      backoff = 0.;
+    if (backoff < min_backoff) backoff = min_backoff;
+  }
+};
+}
+}
+
+#endif
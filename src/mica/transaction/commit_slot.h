@@ -7,7 +7,6 @@
 
 namespace mica {
 namespace transaction {
-
 enum class CommitSlotState : uint8_t {
   kActive = 0,
   kCommitting,
@@ -23,14 +22,40 @@ struct CommitSlot {
   Timestamp start_ts;
   Timestamp commit_ts;
   volatile CommitSlotState state;
+  // The number of SlotIntent entries recorded by the transaction, or
+  // kIntentOverflow if its writes did not fit.
+  uint32_t intent_count;
+
+  static constexpr uint32_t kIntentOverflow = static_cast<uint32_t>(-1);
 
   CommitSlot()
     : local_tx_seq(0),
       start_ts(Timestamp::make(0, 0, 0)),
       commit_ts(Timestamp::make(0, 0, 0)),
-      state(CommitSlotState::kActive) {}
+      state(CommitSlotState::kAborted),
+      intent_count(0) {}
 } __attribute__((aligned(64)));
 
+enum class SlotIntentKind : uint8_t {
+  kWrite = 0,
+  kDelete,
+  kInsert,
+};
+
+// A row that a transaction links a version into, recorded in its commit slot's
+// intent array before the link so that DB::recover() can find the versions of
+// an interrupted transaction without scanning the tables.  The version itself
+// is found by walking the row's chain for the slot's writer tag.  The table
+// is named by its ID, which stays the same when the region is attached by
+// another process.
+template <class StaticConfig>
+struct SlotIntent {
+  uint64_t row_id;
+  uint32_t table_id;  // Table::id()
+  uint8_t cf_id;
+  uint8_t kind;  // SlotIntentKind
+};
+
 }
 }
 
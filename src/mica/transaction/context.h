@@ -3,15 +3,20 @@
 #define MICA_TRANSACTION_CONTEXT_H_
 
 #include <queue>
+#include <type_traits>
 #include "mica/transaction/stats.h"
+#include "mica/transaction/trace.h"
+#include "mica/transaction/backoff.h"
 #include "mica/transaction/row.h"
 #include "mica/transaction/table.h"
 #include "mica/transaction/commit_slot.h"
 #include "mica/transaction/db.h"
+#include "mica/transaction/page_pool.h"
 #include "mica/transaction/row_version_pool.h"
 #include "mica/util/memcpy.h"
 #include "mica/util/rand.h"
 #include "mica/util/latency.h"
+#include "mica/util/histogram.h"
 //#include "mica/transaction/commit_slot.h"
 // #include "mica/util/queue.h"
 
@@ -38,7 +43,8 @@ class Context {
         thread_id_(thread_id),
         numa_id_(numa_id),
         backoff_rand_(static_cast<uint64_t>(thread_id)),
-        timing_stack_(&stats_, db_->sw()),
+        timing_stack_(&stats_, kPerfTiming ? perf_stats_ : nullptr,
+                      db_->sw()),
         current_slot_idx_(0),  // 新增
         local_seq_(0){  // 新增
     if (StaticConfig::kPairwiseSleeping) {
@@ -56,26 +62,35 @@ class Context {
 
     //新增:初始化所有slot
     allocate_cxl_slots();
-    for (size_t i = 0; i < kMaxSlots; i++) {
-      slots_[i].local_tx_seq = 0;
-      slots_[i].start_ts = Timestamp::make(0, 0, 0);
-      slots_[i].commit_ts = Timestamp::make(0, 0, 0);
-      slots_[i].state = CommitSlotState::kActive;
-    }
     //新增结束
 
     clock_ = 0;
     clock_boost_ = 0;
     adjusted_clock_ = 0;
 
+    for (uint16_t i = 0; i < StaticConfig::kMaxInterleavedTxCount; i++)
+      in_flight_[i].used = false;
+    in_flight_count_ = 0;
+
     next_sync_thread_id_ = 0;
 
+    local_backoff_.set_cycles_per_usec(db_->sw()->c_1_usec());
+
+    gc_backlog_ = 0;
+
+    cxl_rv_numa_id_ = db_->cxl_topology().next_node();
+    cxl_rv_bytes_left_ = PagePool<StaticConfig>::kPageSize;
+
+    trace_ring_ = nullptr;
+    trace_every_ = 0;
+    trace_countdown_ = 0;
+
     last_tsc_ = ::mica::util::rdtsc();
     last_quiescence_ = db_->sw()->now();
     last_clock_sync_ = db_->sw()->now();
   }
 
-  ~Context() {}
+  ~Context() { delete trace_ring_; }
 
   DB<StaticConfig>* db() { return db_; }
 
@@ -90,6 +105,11 @@ class Context {
   const Stats& stats() const { return stats_; }
   Stats& stats() { return stats_; }
 
+  const LocalBackoff<StaticConfig>& local_backoff() const {
+    return local_backoff_;
+  }
+  LocalBackoff<StaticConfig>& local_backoff() { return local_backoff_; }
+
   const ::mica::util::Latency& inter_commit_latency() const {
     return inter_commit_latency_;
   }
@@ -110,10 +130,71 @@ class Context {
   }
   ::mica::util::Latency& ro_tx_staleness() { return ro_tx_staleness_; }
 
+  // Only valid if StaticConfig::kCollectPhaseLatency.
+  const ::mica::util::Histogram& phase_latency(LatencyPhase phase) const {
+    return phase_latency_[static_cast<uint8_t>(phase)];
+  }
+  ::mica::util::Histogram& phase_latency(LatencyPhase phase) {
+    return phase_latency_[static_cast<uint8_t>(phase)];
+  }
+
+  // Returns the start time of a phase for phase_end().
+  uint64_t phase_begin() const {
+    if (!StaticConfig::kCollectPhaseLatency) return 0;
+    return db_->sw()->now();
+  }
+
+  // Records the cycles spent since phase_begin() in the phase histogram.
+  void phase_end(LatencyPhase phase, uint64_t start) {
+    if (!StaticConfig::kCollectPhaseLatency) return;
+    phase_latency(phase).update(db_->sw()->now() - start);
+  }
+
   TimingStack* timing_stack() { return &timing_stack_; }
 
+  // Only valid if StaticConfig::Timing is PerfTiming.
+  const PerfStats& perf_stats() const { return perf_stats_[0]; }
+  PerfStats& perf_stats() { return perf_stats_[0]; }
+
+  // The number of versions waiting for GC.  Safe to read from other threads.
+  uint64_t gc_backlog() const { return gc_backlog_; }
+
+  // The NUMA node that holds this thread's commit slots.
+  uint8_t slots_numa_id() const { return slots_numa_id_; }
+
+  // Traces one in every_n transactions; 0 disables tracing.  May be called
+  // while the owner thread is running.
+  void set_trace_sampling(uint64_t every_n) {
+    if (!StaticConfig::kEnableTxTrace) return;
+    if (every_n != 0 && trace_ring_ == nullptr) {
+      trace_ring_ = new TxTraceRing(StaticConfig::kTxTraceRingSize);
+      ::mica::util::memory_barrier();
+    }
+    trace_countdown_ = every_n;
+    trace_every_ = every_n;
+  }
+
+  const TxTraceRing* trace_ring() const { return trace_ring_; }
+  TxTraceRing* trace_ring() { return trace_ring_; }
+
+  // Returns true if the next transaction should be traced.
+  bool sample_trace() {
+    if (!StaticConfig::kEnableTxTrace) return false;
+    uint64_t every_n = trace_every_;
+    if (every_n == 0) return false;
+    if (trace_countdown_ > 1) {
+      trace_countdown_--;
+      return false;
+    }
+    trace_countdown_ = every_n;
+    return true;
+  }
+
   //新增:Slot管理方法
   uint32_t allocate_slot() {
+    // Without slot memory, transactions that write abort instead.
+    if (slots_ == nullptr) return static_cast<uint32_t>(-1);
+
     // 循环查找可复用的slot
     for (size_t i = 0; i < kMaxSlots; i++) {
       uint32_t idx = (current_slot_idx_ + i) % kMaxSlots;
@@ -143,6 +224,12 @@ class Context {
     return slots_[slot_idx];
   }
 
+  // The SlotIntent array of a slot, which holds kSlotIntentCount entries.
+  SlotIntent<StaticConfig>* get_slot_intents(uint32_t slot_idx) {
+    assert(slot_idx < kMaxSlots);
+    return slot_intents_ + slot_idx * kSlotIntentCount;
+  }
+
   Timestamp current_snapshot_ts() const {
     return wts_.get();
   }
@@ -198,6 +285,9 @@ class Context {
 
     clock_ += static_cast<uint64_t>(tsc_diff);
     last_tsc_ = tsc;
+
+    // Follow the other hosts if the timestamp type has a shared clock.
+    clock_ = Timestamp::anchor_clock(clock_);
   }
 
   Timestamp generate_timestamp(bool for_peek_only_transaction = false) {
@@ -212,14 +302,21 @@ class Context {
     const uint16_t era = 0;
 
     auto wts = Timestamp::make(era, adjusted_clock, thread_id_);
-    wts_.write(wts);
 
     Timestamp rts = db_->min_wts();
     // Make sure rts < wts; we do not need to worry about collisions by
     // subtracting 1 because (1) every thread does it and (2) timestamp
     // collisions are benign for read-only transactions.
     rts.t2--;
-    rts_.write(rts);
+
+    // With interleaved transactions, the published timestamps must stay at
+    // the oldest in-flight transaction; see leave_tx().
+    if (StaticConfig::kMaxInterleavedTxCount == 1 || in_flight_count_ == 0) {
+      wts_.write(wts);
+      rts_.write(rts);
+    }
+    last_wts_ = wts;
+    last_rts_ = rts;
 
     if (for_peek_only_transaction)
       return rts;
@@ -230,16 +327,13 @@ class Context {
   uint64_t allocate_row(Table<StaticConfig>* tbl, bool use_cxl = false) {
     auto& free_row_ids = free_rows_[tbl];
     if (free_row_ids.empty()) {
-      if (!tbl->allocate_rows(this, free_row_ids))
-        return static_cast<uint64_t>(-1);
-    }
-
-    if (use_cxl) {
-      if (!tbl->allocate_cxl_rows(this, free_row_ids))
-        return static_cast<uint64_t>(-1);
-    } else {
-      if (!tbl->allocate_rows(this, free_row_ids))
-        return static_cast<uint64_t>(-1);
+      if (use_cxl || tbl->cxl_resident()) {
+        if (!tbl->allocate_cxl_rows(this, free_row_ids))
+          return static_cast<uint64_t>(-1);
+      } else {
+        if (!tbl->allocate_rows(this, free_row_ids))
+          return static_cast<uint64_t>(-1);
+      }
     }
     auto row_id = free_row_ids.back();
     free_row_ids.pop_back();
@@ -309,14 +403,24 @@ class Context {
     auto pool = db_->row_version_pool(thread_id_);
     auto rv = pool->allocate(size_cls);
     rv->data_size = static_cast<uint32_t>(data_size);*/
-    // 修改：直接从CXL内存分配RowVersion
-    auto cxl_pool = db_->cxl_page_pool();
-    char* p = cxl_pool->allocate();
-    if (!p) return nullptr;
-
-    auto rv = reinterpret_cast<RowVersion<StaticConfig>*>(p);
+    // 修改：从CXL内存分配RowVersion
+    // Versions are carved out of CXL pages by the row version pool so that
+    // each write does not consume a whole page.
+    // With several CXL nodes, move on to the next node after every page worth
+    // of versions so that version pages interleave across the devices.
+    if (db_->cxl_topology().node_count() > 1) {
+      auto rv_size =
+          SharedRowVersionPool<StaticConfig>::class_to_rv_size(size_cls);
+      if (cxl_rv_bytes_left_ < rv_size) {
+        cxl_rv_numa_id_ = db_->cxl_topology().next_node();
+        cxl_rv_bytes_left_ = PagePool<StaticConfig>::kPageSize;
+      }
+      cxl_rv_bytes_left_ -= rv_size;
+    }
+    auto pool = db_->row_version_pool(thread_id_);
+    auto rv = pool->allocate(size_cls, cxl_rv_numa_id_);
+    if (!rv) return nullptr;
     rv->data_size = static_cast<uint32_t>(data_size);
-    rv->numa_id = 1; // 标记为CXL内存
     return rv;
   }
 
@@ -349,27 +453,83 @@ class Context {
   void check_gc();
   void gc(bool forced);
 
+  // Registers a transaction that just obtained its timestamp using
+  // generate_timestamp().  Only used when kMaxInterleavedTxCount > 1.
+  uint16_t enter_tx() {
+    assert(in_flight_count_ < StaticConfig::kMaxInterleavedTxCount);
+    uint16_t i;
+    for (i = 0; i < StaticConfig::kMaxInterleavedTxCount; i++)
+      if (!in_flight_[i].used) break;
+    assert(i != StaticConfig::kMaxInterleavedTxCount);
+    in_flight_[i].used = true;
+    in_flight_[i].wts = last_wts_;
+    in_flight_[i].rts = last_rts_;
+    in_flight_count_++;
+    return i;
+  }
+
+  // Unregisters a finished transaction and advances the published timestamps
+  // to the oldest remaining in-flight transaction.
+  void leave_tx(uint16_t i) {
+    assert(in_flight_[i].used);
+    in_flight_[i].used = false;
+    in_flight_count_--;
+    if (in_flight_count_ == 0) return;
+
+    bool first = true;
+    Timestamp min_wts;
+    Timestamp min_rts;
+    for (uint16_t j = 0; j < StaticConfig::kMaxInterleavedTxCount; j++) {
+      if (!in_flight_[j].used) continue;
+      if (first || min_wts > in_flight_[j].wts) min_wts = in_flight_[j].wts;
+      if (first || min_rts > in_flight_[j].rts) min_rts = in_flight_[j].rts;
+      first = false;
+    }
+    if (wts_.get() < min_wts) wts_.write(min_wts);
+    if (rts_.get() < min_rts) rts_.write(min_rts);
+  }
+
+  uint16_t in_flight_count() const { return in_flight_count_; }
+
   void quiescence() { db_->quiescence(thread_id_); }
   void idle() { db_->idle(thread_id_); }
 
   // 新增：CXL slot分配方法
   void allocate_cxl_slots() {
-      auto cxl_pool = db_->cxl_page_pool();
-      char* p = cxl_pool->allocate();
+      // Threads spread their slot pages over the CXL nodes.
+      // The page may spill to DRAM if every CXL node is exhausted.
+      // An attached DB keeps the slots of the last run for DB::recover().
+      char* p = db_->attached_slot_page(thread_id_, &slots_numa_id_);
+      bool attached = p != nullptr;
+      if (!attached) p = db_->allocate_cxl_page(&slots_numa_id_);
       slots_ = reinterpret_cast<CommitSlot<StaticConfig>*>(p);
+      if (slots_ == nullptr) {
+        fprintf(stderr, "error: failed to allocate commit slots\n");
+        slot_intents_ = nullptr;
+        return;
+      }
+
+      // The intent arrays fill the rest of the page.
+      slot_intents_ = reinterpret_cast<SlotIntent<StaticConfig>*>(
+          p + kMaxSlots * sizeof(CommitSlot<StaticConfig>));
+      if (attached) return;
 
       // 初始化所有slot
+      // A free slot is kAborted with no writes; allocate_slot() only hands
+      // out finished slots.
       for (size_t i = 0; i < kMaxSlots; i++) {
           slots_[i].local_tx_seq = 0;
           slots_[i].start_ts = Timestamp::make(0, 0, 0);
           slots_[i].commit_ts = Timestamp::make(0, 0, 0);
-          slots_[i].state = CommitSlotState::kActive;
+          slots_[i].state = CommitSlotState::kAborted;
+          slots_[i].intent_count = 0;
       }
   }
 
  private:
   friend class Table<StaticConfig>;
   friend class Transaction<StaticConfig>;
+  friend class DB<StaticConfig>;
 
   DB<StaticConfig>* db_;
   uint16_t thread_id_;
@@ -378,6 +538,13 @@ class Context {
   //新增:Slot管理相关字段
   static constexpr size_t kMaxSlots = 256;
   CommitSlot<StaticConfig>* slots_;  // 指向CXL分配的slot数组
+  // Slot intents share the slot page (see SlotIntent).
+  static constexpr size_t kSlotIntentCount =
+      (PagePool<StaticConfig>::kPageSize -
+       kMaxSlots * sizeof(CommitSlot<StaticConfig>)) /
+      kMaxSlots / sizeof(SlotIntent<StaticConfig>);
+  SlotIntent<StaticConfig>* slot_intents_;
+  uint8_t slots_numa_id_;
   uint32_t current_slot_idx_;
   uint64_t local_seq_;
   std::vector<uint64_t> commit_log_;
@@ -393,6 +560,7 @@ class Context {
   uint64_t adjusted_clock_;
 
   ::mica::util::Rand backoff_rand_;
+  LocalBackoff<StaticConfig> local_backoff_;
 
   std::unordered_map<const Table<StaticConfig>*, std::vector<uint64_t>>
       free_rows_;
@@ -408,15 +576,34 @@ class Context {
     RowVersion<StaticConfig>* write_rv;
   };
   std::queue<GCItem> gc_items_;
+  // gc_items_.size() mirrored for other threads.
+  volatile uint64_t gc_backlog_;
+
+  // The CXL node for new row versions and the bytes left before switching to
+  // the next node.
+  uint8_t cxl_rv_numa_id_;
+  uint64_t cxl_rv_bytes_left_;
   // ::mica::util::SingleThreadedQueue<GCItem, StaticConfig::kMaxGCQueueSize>
   //     gc_items_;
 
   Stats stats_;
+  static constexpr bool kPerfTiming =
+      std::is_same<Timing, ::mica::transaction::PerfTiming>::value;
+  PerfStats perf_stats_[kPerfTiming ? 1 : 0];
   TimingStack timing_stack_;
   ::mica::util::Latency inter_commit_latency_;
   ::mica::util::Latency commit_latency_;
   ::mica::util::Latency abort_latency_;
   ::mica::util::Latency ro_tx_staleness_;
+  // About 15 KB per phase, so the histograms exist only when collected.
+  ::mica::util::Histogram
+      phase_latency_[StaticConfig::kCollectPhaseLatency ? kLatencyPhaseCount
+                                                        : 0];
+
+  // For kEnableTxTrace.
+  TxTraceRing* trace_ring_;
+  volatile uint64_t trace_every_;
+  uint64_t trace_countdown_;
 
   // For kPairwiseSleeping.
   uint64_t pair_selector_;
@@ -425,6 +612,18 @@ class Context {
   // other threads.
   ConcurrentTimestamp wts_ __attribute__((aligned(64)));
   ConcurrentTimestamp rts_;
+
+  // The last timestamps created by generate_timestamp(), published or not.
+  Timestamp last_wts_;
+  Timestamp last_rts_;
+
+  struct InFlightTx {
+    Timestamp wts;
+    Timestamp rts;
+    bool used;
+  };
+  InFlightTx in_flight_[StaticConfig::kMaxInterleavedTxCount];
+  uint16_t in_flight_count_;
   volatile uint64_t clock_;
 } __attribute__((aligned(64)));
 }
@@ -14,6 +14,7 @@ void Context<StaticConfig>::schedule_gc(
 
   // gc_items_.push({gc_epoch, wts, tbl, row_id, head, write_rv});
   gc_items_.push({wts, tbl, cf_id, deleted, row_id, head, write_rv});
+  gc_backlog_ = gc_backlog_ + 1;
 
   // if (gc_items_.full()) {
   //   fprintf(stderr, "Error: GC queue is full\n");
@@ -92,11 +93,11 @@ void Context<StaticConfig>::gc(bool forced) {
 
     //新增:基于slot的状态验证
     // 获取write_rv对应的slot
-    auto writer_ctx = db_->context(write_rv->writer_thread_id);
-    auto& slot = writer_ctx->get_slot(write_rv->slot_idx);
+    auto writer_ctx = db_->context(write_rv->writer_thread_id());
+    auto& slot = writer_ctx->get_slot(write_rv->slot_idx());
 
     // 检查slot是否被复用(ABA检测)
-    if (slot.local_tx_seq != write_rv->writer_local_seq) {
+    if (!write_rv->is_writer_seq(slot.local_tx_seq)) {
       // Slot已被复用,这个版本属于旧事务,可以安全回收
       // 继续执行GC
     } else {
@@ -149,6 +150,16 @@ void Context<StaticConfig>::gc(bool forced) {
     // parallel GCing this row.
     __sync_lock_release(&gc_info->gc_lock);
 
+    // After a crash, the chain must not lead into versions reused by then.
+    if (StaticConfig::kPersistentCXL) {
+      if (delete_rv)
+        ::mica::util::write_back(&head->older_rv, sizeof(head->older_rv));
+      else
+        ::mica::util::write_back(&write_rv->older_rv,
+                                 sizeof(write_rv->older_rv));
+      ::mica::util::sfence();
+    }
+
     while (rv != nullptr) {
       // If this test fails, some bad thing is going on (accessing a GC'ed
       // row version).
@@ -158,11 +169,11 @@ void Context<StaticConfig>::gc(bool forced) {
 
       //新增:验证slot状态一致性(debug模式)
       #ifndef NDEBUG
-      auto rv_writer_ctx = db_->context(rv->writer_thread_id);
-      auto& rv_slot = rv_writer_ctx->get_slot(rv->slot_idx);
+      auto rv_writer_ctx = db_->context(rv->writer_thread_id());
+      auto& rv_slot = rv_writer_ctx->get_slot(rv->slot_idx());
 
       // 如果slot未被复用,验证状态一致性
-      if (rv_slot.local_tx_seq == rv->writer_local_seq) {
+      if (rv->is_writer_seq(rv_slot.local_tx_seq)) {
         assert(rv_slot.state == CommitSlotState::kCommitted ||
                rv_slot.state == CommitSlotState::kAborted);
       }
@@ -215,6 +226,7 @@ void Context<StaticConfig>::gc(bool forced) {
                 item.head, item.write_rv))
       break;
     gc_items_.pop();
+    gc_backlog_ = gc_backlog_ - 1;
   }
 
   // while (!gc_items_.empty() && min_rts > gc_items_.head().wts) {
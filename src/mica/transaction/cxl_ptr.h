@@ -0,0 +1,85 @@
+#pragma once
+#ifndef MICA_TRANSACTION_CXL_PTR_H_
+#define MICA_TRANSACTION_CXL_PTR_H_
+
+#include <cstdint>
+
+namespace mica {
+namespace transaction {
+template <class Dummy = void>
+struct CXLBaseHolder {
+  static uintptr_t base;
+};
+
+template <class Dummy>
+uintptr_t CXLBaseHolder<Dummy>::base = 0;
+
+// The per-process base of CXLPtr.  It is 0 unless this process attached an
+// existing CXL region at a different address (see Superblock), and must not
+// change once a CXLPtr is stored.
+static inline uintptr_t cxl_base() { return CXLBaseHolder<>::base; }
+static inline void set_cxl_base(uintptr_t base) { CXLBaseHolder<>::base = base; }
+
+// A pointer stored in CXL memory that stays valid when the region is mapped
+// at another address.  It holds the offset of the target from cxl_base(), so
+// with a zero base it is the address itself; 0 is nullptr, which leaves the
+// address equal to cxl_base() unrepresentable.
+//
+// CXLPtr converts to and from T* implicitly, so chain walks and comparisons
+// read as with raw pointers.  A volatile CXLPtr reads and writes its offset
+// with volatile accesses, as a T* volatile would.
+template <class T>
+class CXLPtr {
+ public:
+  CXLPtr() = default;
+  CXLPtr(T* p) : off_(encode(p)) {}
+  CXLPtr(const CXLPtr& o) = default;
+  CXLPtr(const volatile CXLPtr& o) : off_(o.off_) {}
+
+  CXLPtr& operator=(const CXLPtr& o) = default;
+  CXLPtr& operator=(const volatile CXLPtr& o) {
+    off_ = o.off_;
+    return *this;
+  }
+  CXLPtr& operator=(T* p) {
+    off_ = encode(p);
+    return *this;
+  }
+  void operator=(const CXLPtr& o) volatile { off_ = o.off_; }
+  void operator=(const volatile CXLPtr& o) volatile { off_ = o.off_; }
+  void operator=(T* p) volatile { off_ = encode(p); }
+
+  operator T*() const { return decode(off_); }
+  operator T*() const volatile { return decode(off_); }
+  T* operator->() const { return decode(off_); }
+  T* operator->() const volatile { return decode(off_); }
+  T* get() const { return decode(off_); }
+  T* get() const volatile { return decode(off_); }
+
+  // Atomically replaces expected with desired, as __sync_bool_compare_and_swap
+  // does for a raw pointer.
+  bool compare_and_swap(T* expected, T* desired) volatile {
+    return __sync_bool_compare_and_swap(&off_, encode(expected),
+                                        encode(desired));
+  }
+
+  uint64_t offset() const { return off_; }
+  uint64_t offset() const volatile { return off_; }
+
+  static uint64_t encode(const T* p) {
+    return p == nullptr ? 0 : reinterpret_cast<uintptr_t>(p) - cxl_base();
+  }
+  static T* decode(uint64_t off) {
+    return off == 0 ? nullptr : reinterpret_cast<T*>(off + cxl_base());
+  }
+
+ private:
+  uint64_t off_;
+};
+
+static_assert(sizeof(CXLPtr<char>) == sizeof(char*),
+              "CXLPtr must replace a raw pointer in place");
+}
+}
+
+#endif
@@ -9,20 +9,19 @@ namespace transaction {
 template <class StaticConfig>
 class CXLTable : public Table<StaticConfig> {
  public:
+  // Pages are spread over the CXL nodes of the DB's CXLTopology.
   CXLTable(DB<StaticConfig>* db, uint16_t cf_count,
-           const uint64_t* data_size_hints, uint8_t cxl_numa_node);
+           const uint64_t* data_size_hints,
+           SuperblockTable<StaticConfig>* record = nullptr);
   ~CXLTable();
 
   // 重写内存分配方法，强制使用CXL NUMA节点
   bool allocate_cxl_rows(Context<StaticConfig>* ctx,
                          std::vector<uint64_t>& row_ids);
-
- private:
-  uint8_t cxl_numa_node_;
-
-  // 重写父类的内存分配逻辑
-  char* allocate_cxl_page();
 };
 }
 }
+
+#include "cxl_table_impl.h"
+
 #endif
\ No newline at end of file
@@ -12,15 +12,18 @@ namespace transaction {
 // 构造函数实现
 template <class StaticConfig>
 CXLTable<StaticConfig>::CXLTable(DB<StaticConfig>* db, uint16_t cf_count,
-                                const uint64_t* data_size_hints, uint8_t cxl_numa_node)
-    : Table<StaticConfig>(db, cf_count, data_size_hints), cxl_numa_node_(cxl_numa_node) {
-  printf("CXLTable initialized on NUMA node %u for CXL shared memory\n", cxl_numa_node_);
+                                const uint64_t* data_size_hints,
+                                SuperblockTable<StaticConfig>* record)
+    : Table<StaticConfig>(db, cf_count, data_size_hints, record) {
+  printf("CXLTable initialized on %" PRIu8
+         " CXL node(s) for CXL shared memory\n",
+         db->cxl_topology().node_count());
 }
 
 // 析构函数
 template <class StaticConfig>
 CXLTable<StaticConfig>::~CXLTable() {
-  printf("CXLTable on NUMA node %u destroyed\n", cxl_numa_node_);
+  printf("CXLTable destroyed\n");
 }
 
 // CXL行分配实现
@@ -29,19 +32,17 @@ bool CXLTable<StaticConfig>::allocate_cxl_rows(Context<StaticConfig>* ctx,
                                              std::vector<uint64_t>& row_ids) {
   if (StaticConfig::kCollectProcessingStats) ctx->stats().insert_row_count++;
 
-  // 强制从CXL NUMA节点分配内存
-  char* p = nullptr;
-
-  // 直接使用CXL NUMA节点的PagePool分配
-  p = this->db_->page_pool(cxl_numa_node_)->allocate();
+  // 强制从CXL NUMA节点分配内存; the placement policy picks the node.
+  uint8_t cxl_numa_node = 0;
+  char* p = this->db_->allocate_cxl_page(&cxl_numa_node);
 
   if (p == nullptr) {
-    printf("failed to allocate CXL memory on NUMA node %u\n", cxl_numa_node_);
+    printf("failed to allocate CXL memory\n");
     return false;
   }
 
   printf("allocated CXL memory page on NUMA node %u for %zu rows\n",
-         cxl_numa_node_, this->second_level_width_);
+         cxl_numa_node, this->second_level_width_);
 
   // 初始化页面结构 - 与原Table相同
   for (uint64_t i = 0; i < this->second_level_width_; i++) {
@@ -61,27 +62,30 @@ bool CXLTable<StaticConfig>::allocate_cxl_rows(Context<StaticConfig>* ctx,
     }
   }
 
+  this->persist_page(p);
+
   // 获取表锁
-  while (__sync_lock_test_and_set(&this->lock_, 1) == 1) ::mica::util::pause();
+  SharedLock::lock(&this->rows_->lock);
 
   // 分配行ID
-  uint64_t row_id = this->row_count_;
+  uint64_t row_id = this->rows_->row_count;
   if ((row_id >> this->row_id_shift_) == this->kFirstLevelWidth) {
     printf("maximum CXL table size (%" PRIu64 " rows) reached\n",
            this->kFirstLevelWidth * this->second_level_width_);
-    this->db_->page_pool(cxl_numa_node_)->free(p);
-    __sync_lock_release(&this->lock_);
+    this->db_->page_pool(cxl_numa_node)->free(p);
+    SharedLock::unlock(&this->rows_->lock);
     return false;
   }
 
   // 注册新页面到CXL内存
+  this->page_numa_ids_[row_id >> this->row_id_shift_] = cxl_numa_node;
   this->root_[row_id >> this->row_id_shift_] = p;
-  this->page_numa_ids_[row_id >> this->row_id_shift_] = cxl_numa_node_;
+  this->persist_root(row_id >> this->row_id_shift_);
 
-  this->row_count_ += this->second_level_width_;
+  this->rows_->row_count += this->second_level_width_;
 
   // 释放表锁
-  __sync_lock_release(&this->lock_);
+  SharedLock::unlock(&this->rows_->lock);
 
   // 生成行ID列表
   for (uint64_t i = 0; i < this->second_level_width_; i++) {
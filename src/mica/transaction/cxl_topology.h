@@ -0,0 +1,365 @@
+#pragma once
+#ifndef MICA_TRANSACTION_CXL_TOPOLOGY_H_
+#define MICA_TRANSACTION_CXL_TOPOLOGY_H_
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <numa.h>
+#include <string>
+#include <vector>
+#include "mica/common.h"
+#include "mica/util/config.h"
+#include "mica/util/lcore.h"
+
+namespace mica {
+namespace transaction {
+enum class CXLPlacement : uint8_t {
+  // Everything goes to the first CXL node.
+  kSingle = 0,
+  // Pages rotate over all CXL nodes.
+  kRoundRobin,
+  // Pages rotate over all CXL nodes in proportion to their weights.
+  kWeighted,
+};
+
+// The set of NUMA nodes that back CXL memory and the policy that spreads
+// pages over them.
+//
+// Config keys (all optional):
+//   "nodes":     an array of NUMA node IDs, or "auto" to take the nodes below
+//                the top memory tier in sysfs (falling back to CPU-less
+//                nodes); default: node 1 if it exists, otherwise node 0
+//   "placement": "single", "round_robin", or "weighted" (default:
+//                "round_robin" for several nodes)
+//   "weights":   for "weighted", an array of relative weights (e.g., GB/s per
+//                node), "hmat" to use the firmware-reported read bandwidth,
+//                or "probe" to measure the read bandwidth at startup
+//                (default: "hmat", then equal weights)
+//
+// The first node is the primary node that holds fixed CXL metadata such as
+// the shared minimum timestamps.
+class CXLTopology {
+ public:
+  static constexpr uint8_t kMaxNodeCount = 8;
+  // The length of the weighted rotation.  Weights are scaled down to fit.
+  static constexpr uint16_t kScheduleLength = 64;
+
+  CXLTopology()
+      : node_count_(0), placement_(CXLPlacement::kSingle), next_(0) {
+    add_node(::mica::util::lcore.numa_count() > 1 ? 1 : 0, 1);
+    build_schedule();
+  }
+
+  explicit CXLTopology(const ::mica::util::Config& config)
+      : node_count_(0), placement_(CXLPlacement::kSingle), next_(0) {
+    if (config.exists()) {
+      auto nodes = config.get("nodes");
+      if (nodes.is_array()) {
+        for (size_t i = 0; i < nodes.size(); i++)
+          add_node(static_cast<uint8_t>(nodes.get(i).get_uint64()), 1);
+      } else if (nodes.exists() && nodes.get_str() == "auto") {
+        for (auto numa_id : discover_nodes()) add_node(numa_id, 1);
+        if (node_count_ == 0)
+          printf("CXLTopology: no CXL node found; using the default node\n");
+      }
+    }
+    if (node_count_ == 0)
+      add_node(::mica::util::lcore.numa_count() > 1 ? 1 : 0, 1);
+
+    std::string placement =
+        node_count_ > 1 ? std::string("round_robin") : std::string("single");
+    if (config.exists())
+      placement = config.get("placement").get_str(placement);
+    if (placement == "single")
+      placement_ = CXLPlacement::kSingle;
+    else if (placement == "weighted")
+      placement_ = CXLPlacement::kWeighted;
+    else {
+      if (placement != "round_robin")
+        printf("CXLTopology: unknown placement %s; using round_robin\n",
+               placement.c_str());
+      placement_ = CXLPlacement::kRoundRobin;
+    }
+
+    if (placement_ == CXLPlacement::kWeighted) {
+      auto weights =
+          config.exists() ? config.get("weights") : ::mica::util::Config();
+      if (weights.is_array()) {
+        if (weights.size() != node_count_)
+          printf("CXLTopology: %zu weights for %" PRIu8
+                 " nodes; using equal weights\n",
+                 weights.size(), node_count_);
+        else
+          for (uint8_t i = 0; i < node_count_; i++)
+            weights_[i] = weights.get(i).get_uint64();
+      } else {
+        bool probe = weights.exists() && weights.get_str() == "probe";
+        for (uint8_t i = 0; i < node_count_; i++)
+          weights_[i] = probe ? probe_read_bandwidth(nodes_[i])
+                              : hmat_read_bandwidth(nodes_[i]);
+        // Any node without a number makes the set incomparable.
+        for (uint8_t i = 0; i < node_count_; i++)
+          if (weights_[i] == 0) {
+            printf("CXLTopology: bandwidth unavailable for node %" PRIu8
+                   "; using equal weights\n",
+                   nodes_[i]);
+            for (uint8_t j = 0; j < node_count_; j++) weights_[j] = 1;
+            break;
+          }
+      }
+    }
+
+    build_schedule();
+  }
+
+  uint8_t node_count() const { return node_count_; }
+  uint8_t node(uint8_t i) const { return nodes_[i]; }
+  uint64_t weight(uint8_t i) const { return weights_[i]; }
+  uint8_t primary_node() const { return nodes_[0]; }
+  CXLPlacement placement() const { return placement_; }
+
+  bool contains(uint8_t numa_id) const {
+    for (uint8_t i = 0; i < node_count_; i++)
+      if (nodes_[i] == numa_id) return true;
+    return false;
+  }
+
+  // Returns the node for the next CXL page.  Safe to call from any thread.
+  uint8_t next_node() {
+    if (schedule_length_ == 1) return schedule_[0];
+    auto i = __sync_fetch_and_add(&next_, uint64_t(1));
+    return schedule_[i % schedule_length_];
+  }
+
+  // Returns the share of total_size that a page pool on numa_id should get:
+  // the CXL nodes split one half by weight, and the other nodes with CPUs split
+  // the other half evenly.  Returns 0 if numa_id needs no page pool.
+  uint64_t page_pool_size(uint8_t numa_id, uint64_t total_size) const {
+    uint64_t dram_count = 0;
+    for (size_t i = 0; i < ::mica::util::lcore.numa_count(); i++)
+      if (!contains(static_cast<uint8_t>(i)) &&
+          node_has_cpus(static_cast<uint8_t>(i)))
+        dram_count++;
+
+    uint64_t cxl_size = dram_count == 0 ? total_size : total_size / 2;
+    if (contains(numa_id)) {
+      uint64_t weight_sum = 0;
+      uint64_t weight = 0;
+      for (uint8_t i = 0; i < node_count_; i++) {
+        weight_sum += effective_weight(i);
+        if (nodes_[i] == numa_id) weight = effective_weight(i);
+      }
+      return cxl_size / weight_sum * weight;
+    }
+    if (node_has_cpus(numa_id)) return (total_size - cxl_size) / dram_count;
+    return 0;
+  }
+
+  void print() const {
+    static const char* const kPlacementNames[] = {"single", "round_robin",
+                                                  "weighted"};
+    printf("CXL nodes:");
+    for (uint8_t i = 0; i < node_count_; i++) {
+      printf(" %" PRIu8, nodes_[i]);
+      if (placement_ == CXLPlacement::kWeighted)
+        printf(" (weight %" PRIu64 ")", weights_[i]);
+    }
+    printf("; placement = %s\n",
+           kPlacementNames[static_cast<uint8_t>(placement_)]);
+  }
+
+  // Returns the NUMA nodes in every memory tier other than the fastest one,
+  // or the CPU-less nodes if the kernel does not expose memory tiers.
+  static std::vector<uint8_t> discover_nodes() {
+    static const char* const kTierDir = "/sys/devices/virtual/memory_tiering";
+
+    std::vector<uint8_t> nodes;
+    std::vector<int> tiers;
+    DIR* dir = opendir(kTierDir);
+    if (dir != nullptr) {
+      struct dirent* e;
+      while ((e = readdir(dir)) != nullptr) {
+        int tier;
+        if (sscanf(e->d_name, "memory_tier%d", &tier) == 1)
+          tiers.push_back(tier);
+      }
+      closedir(dir);
+    }
+
+    if (tiers.size() > 1) {
+      // A lower tier ID means a smaller abstract distance (faster memory).
+      int top = tiers[0];
+      for (auto tier : tiers)
+        if (tier < top) top = tier;
+      for (auto tier : tiers) {
+        if (tier == top) continue;
+        std::string path = std::string(kTierDir) + "/memory_tier" +
+                            std::to_string(tier) + "/nodelist";
+        for (auto numa_id : read_node_list(path.c_str()))
+          nodes.push_back(numa_id);
+      }
+    } else {
+      for (size_t i = 0; i < ::mica::util::lcore.numa_count(); i++)
+        if (!node_has_cpus(static_cast<uint8_t>(i)))
+          nodes.push_back(static_cast<uint8_t>(i));
+    }
+
+    std::sort(nodes.begin(), nodes.end());
+    return nodes;
+  }
+
+  static bool node_has_cpus(uint8_t numa_id) {
+    for (size_t i = 0; i < ::mica::util::lcore.lcore_count(); i++)
+      if (::mica::util::lcore.numa_id(i) == numa_id) return true;
+    return false;
+  }
+
+  // Returns the read bandwidth from the nearest initiator in MB/s as reported
+  // by ACPI HMAT, or 0 if unavailable.
+  static uint64_t hmat_read_bandwidth(uint8_t numa_id) {
+    char path[128];
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/node/node%" PRIu8
+             "/access0/initiators/read_bandwidth",
+             numa_id);
+    FILE* fp = fopen(path, "r");
+    if (fp == nullptr) return 0;
+    uint64_t v = 0;
+    if (fscanf(fp, "%" SCNu64, &v) != 1) v = 0;
+    fclose(fp);
+    return v;
+  }
+
+  // Measures the single-thread sequential read bandwidth of numa_id in MB/s,
+  // or returns 0 if the node cannot be allocated from.
+  static uint64_t probe_read_bandwidth(uint8_t numa_id) {
+    static constexpr size_t kProbeSize = 64 * 1048576;
+    static constexpr int kProbeRounds = 4;
+
+    if (numa_available() == -1) return 0;
+    auto p = reinterpret_cast<uint64_t*>(numa_alloc_onnode(kProbeSize, numa_id));
+    if (p == nullptr) return 0;
+    ::memset(p, 1, kProbeSize);
+
+    volatile uint64_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < kProbeRounds; round++) {
+      uint64_t sum = 0;
+      for (size_t i = 0; i < kProbeSize / sizeof(uint64_t); i += 8)
+        sum += p[i] + p[i + 1] + p[i + 2] + p[i + 3] + p[i + 4] + p[i + 5] +
+               p[i + 6] + p[i + 7];
+      sink = sink + sum;
+    }
+    auto elapsed = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+    numa_free(p, kProbeSize);
+    (void)sink;
+
+    if (elapsed <= 0.) return 0;
+    return static_cast<uint64_t>(static_cast<double>(kProbeSize) *
+                                 kProbeRounds / elapsed / 1000000.);
+  }
+
+ private:
+  void add_node(uint8_t numa_id, uint64_t weight) {
+    if (contains(numa_id)) return;
+    if (numa_id >= ::mica::util::lcore.numa_count())
+      printf("CXLTopology: warning: NUMA node %" PRIu8 " does not exist\n",
+             numa_id);
+    if (node_count_ == kMaxNodeCount) {
+      printf("CXLTopology: ignoring NUMA node %" PRIu8 " (too many nodes)\n",
+             numa_id);
+      return;
+    }
+    nodes_[node_count_] = numa_id;
+    weights_[node_count_] = weight;
+    node_count_++;
+  }
+
+  uint64_t effective_weight(uint8_t i) const {
+    switch (placement_) {
+      case CXLPlacement::kSingle:
+        return i == 0 ? 1 : 0;
+      case CXLPlacement::kWeighted:
+        return weights_[i];
+      default:
+        return 1;
+    }
+  }
+
+  // Spreads each node's slots evenly over the rotation (smooth weighted
+  // round-robin) so that consecutive pages rarely land on the same device.
+  void build_schedule() {
+    uint64_t weight_sum = 0;
+    for (uint8_t i = 0; i < node_count_; i++) weight_sum += effective_weight(i);
+    if (weight_sum == 0) {
+      for (uint8_t i = 0; i < node_count_; i++) weights_[i] = 1;
+      weight_sum = node_count_;
+    }
+
+    // Scale the weights to at most kScheduleLength slots, keeping at least one
+    // slot for every node with a nonzero weight.
+    uint64_t slots[kMaxNodeCount];
+    uint64_t length = 0;
+    for (uint8_t i = 0; i < node_count_; i++) {
+      uint64_t w = effective_weight(i);
+      slots[i] = weight_sum <= kScheduleLength
+                     ? w
+                     : (w * kScheduleLength + weight_sum / 2) / weight_sum;
+      if (w != 0 && slots[i] == 0) slots[i] = 1;
+      length += slots[i];
+    }
+    if (length > kScheduleLength) length = kScheduleLength;
+
+    int64_t current[kMaxNodeCount] = {};
+    for (uint64_t j = 0; j < length; j++) {
+      uint8_t best = 0;
+      for (uint8_t i = 0; i < node_count_; i++) {
+        current[i] += static_cast<int64_t>(slots[i]);
+        if (current[i] > current[best]) best = i;
+      }
+      current[best] -= static_cast<int64_t>(length);
+      schedule_[j] = nodes_[best];
+    }
+    schedule_length_ = static_cast<uint16_t>(length);
+  }
+
+  static std::vector<uint8_t> read_node_list(const char* path) {
+    std::vector<uint8_t> nodes;
+    FILE* fp = fopen(path, "r");
+    if (fp == nullptr) return nodes;
+    char buf[256];
+    if (fgets(buf, sizeof(buf), fp) != nullptr) {
+      // The list format is "0-1,3".
+      char* saveptr = nullptr;
+      for (char* tok = strtok_r(buf, ",\n", &saveptr); tok != nullptr;
+           tok = strtok_r(nullptr, ",\n", &saveptr)) {
+        unsigned int first, last;
+        int n = sscanf(tok, "%u-%u", &first, &last);
+        if (n < 1) continue;
+        if (n == 1) last = first;
+        for (unsigned int i = first; i <= last && i < 256; i++)
+          nodes.push_back(static_cast<uint8_t>(i));
+      }
+    }
+    fclose(fp);
+    return nodes;
+  }
+
+  uint8_t nodes_[kMaxNodeCount];
+  uint64_t weights_[kMaxNodeCount];
+  uint8_t node_count_;
+  CXLPlacement placement_;
+
+  uint8_t schedule_[kScheduleLength];
+  uint16_t schedule_length_;
+  volatile uint64_t next_;
+};
+}
+}
+
+#endif
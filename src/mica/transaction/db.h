@@ -4,6 +4,7 @@
 
 #include <unordered_map>
 #include <map>
+#include <type_traits>
 #include "mica/common.h"
 #include "mica/transaction/timestamp.h"
 #include "mica/alloc/hugetlbfs_shm.h"
@@ -16,6 +17,8 @@
 #include "mica/transaction/logging.h"
 #include "mica/util/lcore.h"
 #include "mica/transaction/cxl_table.h"
+#include "mica/transaction/cxl_topology.h"
+#include "mica/transaction/superblock.h"
 
 namespace mica {
 namespace transaction {
@@ -45,12 +48,13 @@ struct BasicDBConfig {
   static constexpr bool kReserveAfterAbort = false;
   // Have an inlined row version within a head.
   static constexpr bool kInlinedRowVersion = true;
-  // The maximum size of the data to inline (bytes).  The overhead is 40 bytes.
-  // static constexpr uint64_t kInlineThreshold = 64 - 40;
-  // static constexpr uint64_t kInlineThreshold = 128 - 40;
-  // static constexpr uint64_t kInlineThreshold = 192 - 40;
-  static constexpr uint64_t kInlineThreshold = 256 - 40;
-  // static constexpr uint64_t kInlineThreshold = 4096 - 40;
+  // The size of a row head with an inlined version (bytes).  The maximum data
+  // size to inline is this minus the header (RowLayout::kInlineThreshold).
+  // static constexpr uint64_t kInlinedRowSize = 64;
+  // static constexpr uint64_t kInlinedRowSize = 128;
+  // static constexpr uint64_t kInlinedRowSize = 192;
+  static constexpr uint64_t kInlinedRowSize = 256;
+  // static constexpr uint64_t kInlinedRowSize = 4096;
   // Use an alternative location for the inlining.
   static constexpr bool kInlineWithAltRow = false;
   // Promote a non-inlined version into an inlined version during read.
@@ -74,6 +78,23 @@ struct BasicDBConfig {
   // Print the current backoff status for debugging the adaptive backoff logic.
   static constexpr bool kPrintBackoff = false;
 
+  // Use per-thread exponential backoff driven by the thread's own aborts
+  // instead of the global hill climbing.  Bounded by kBackoffMin and
+  // kBackoffMax.  Requires kBackoff == true.
+  static constexpr bool kPerThreadBackoff = false;
+  // Keep a separate per-thread backoff state for each table that caused
+  // aborts.  Requires kPerThreadBackoff == true.
+  static constexpr bool kPerTableBackoff = false;
+  // The maximum number of tables to track for kPerTableBackoff.  Aborts on
+  // additional tables use the per-thread state only.
+  static constexpr size_t kMaxBackoffTableCount = 16;
+  // The backoff time after the first contention abort (us).
+  static constexpr double kPerThreadBackoffInitial = 0.5;
+  // The multiplier applied to the backoff time on each contention abort.
+  static constexpr double kPerThreadBackoffGrowth = 2.;
+  // The multiplier applied to the backoff time on each commit.
+  static constexpr double kPerThreadBackoffDecay = 0.5;
+
   // Use usleep() alternatively for backoff if this thread has a pair
   // hyperthread.  It is assumed that there are 2 hyperthreads per core, and the
   // lower half and higher half match with each other.  E.g., for 56 cores, core
@@ -85,11 +106,6 @@ struct BasicDBConfig {
   // The minimum time to sleep using usleep() (us).
   static constexpr uint64_t kPairwiseSleepingMinTime = 2;
 
-  // The maximum number of LCore to support.
-  static constexpr size_t kMaxLCoreCount = 64;
-  // The maximum number of numa nodes to support.
-  static constexpr size_t kMaxNUMACount = 8;
-
   // The maximum number of column families.
   static constexpr uint16_t kMaxColumnFamilyCount = 8;
 
@@ -102,6 +118,10 @@ struct BasicDBConfig {
   // array.
   static constexpr uint16_t kMaxAccessSize = 1024;
 
+  // The maximum number of transactions that a thread can keep in flight at
+  // the same time for interleaved execution.  1 disables interleaving.
+  static constexpr uint16_t kMaxInterleavedTxCount = 1;
+
   // The maximum size of garbage collection queue.  This must be at least 2 *
   // kMaxAccessSize + 1.
   // static constexpr size_t kMaxGCQueueSize = 4096;
@@ -121,6 +141,11 @@ struct BasicDBConfig {
   // The minimum interval to quiescence to increment the GC epoch (us).
   static constexpr int64_t kMinQuiescenceInterval = 10;
 
+  // The interval to refresh min_wts from the threads' published wts without
+  // waiting for a full quiescence round (us).  This bounds how long a commit
+  // stays invisible to peek-only transactions while threads make progress.
+  static constexpr int64_t kMinWTSRefreshInterval = 10;
+
   // The minimum interval to synchronize the local clock with a remote clock
   // (us).
   static constexpr int64_t kMinClockSyncInterval = 100;
@@ -133,6 +158,15 @@ struct BasicDBConfig {
   static constexpr bool kCollectROTXStalenessStats = false;
   // Collect internal processing statistics (a bit slow).
   static constexpr bool kCollectProcessingStats = false;
+  // Collect per-phase cycle histograms (timestamping, slot allocation, locate,
+  // validation, slot commit, GC).  Adds two TSC reads to each phase.
+  static constexpr bool kCollectPhaseLatency = false;
+  // Support sampled per-transaction tracing (see DB::set_trace_sampling()).
+  // Sampling is off until enabled at runtime, but this also makes every
+  // transaction track its abort reason.
+  static constexpr bool kEnableTxTrace = false;
+  // The number of trace records kept per thread (rounded up to a power of 2).
+  static constexpr uint64_t kTxTraceRingSize = 4096;
 
   //新增:Slot机制相关配置
   // 每个线程维护的slot数量上限 暂定256
@@ -140,6 +174,18 @@ struct BasicDBConfig {
 
   // 是否启用slot原子提交机制
   static constexpr bool kEnableSlotCommit = true;
+  // Take a commit slot at the first write instead of at begin().  Peek-only
+  // and read-only transactions then never touch the (CXL) slot array.
+  static constexpr bool kLazySlotAllocation = true;
+
+  // Write back new versions, older_rv links, and commit slot transitions with
+  // clwb/clflushopt and sfence in commit order so that persistent CXL memory
+  // (or a DAX mapping standing in for it) holds a recoverable state after a
+  // crash.  Requires kEnableSlotCommit, whose slot is the commit point.
+  static constexpr bool kPersistentCXL = false;
+  // With kPersistentCXL, fence once per commit step for the whole write set
+  // instead of after every write-back.
+  static constexpr bool kBatchPersistFlush = true;
 
   // 启用CXL主导设计
   static constexpr bool kEnableCXLFirstDesign = true;
@@ -149,8 +195,10 @@ struct BasicDBConfig {
   //新增结束
 
   // Use ActiveTiming for fine-grained tracking (slow) and DummyTiming to omit
-  // it.
+  // it.  PerfTiming additionally attributes hardware counters (cycles,
+  // instructions, LLC misses, remote/CXL loads) to each bucket (very slow).
   // typedef ::mica::transaction::ActiveTiming Timing;
+  // typedef ::mica::transaction::PerfTiming Timing;
   typedef ::mica::transaction::DummyTiming Timing;
 
   // Timestamp type.  Use CompactTimestamp for up to 9 months of consecutive
@@ -165,10 +213,23 @@ struct BasicDBConfig {
   // typedef ::mica::transaction::CentralizedTimestamp Timestamp;
   // typedef ::mica::transaction::CentralizedConcurrentTimestamp
   // ConcurrentTimestamp;
+  // Use CXLClockTimestamp when processes on different hosts share the DB.
+  // typedef ::mica::transaction::CXLClockTimestamp Timestamp;
+  // typedef ::mica::transaction::CXLClockConcurrentTimestamp
+  // ConcurrentTimestamp;
 
   // The low-level memory allocator for PagePool.
   typedef ::mica::alloc::HugeTLBFS_SHM Alloc;
 
+  // The unit in which a PagePool with a max_size above its initial size maps
+  // more memory from Alloc (bytes).
+  static constexpr uint64_t kPagePoolChunkSize = 1073741824;
+  // A PagePool grows when it has fewer free pages than this.
+  static constexpr uint64_t kPagePoolGrowWatermark = 64;
+  // A PagePool returns a fully free chunk while it has more free pages than
+  // this.  Keep it above the grow watermark plus a chunk to avoid thrashing.
+  static constexpr uint64_t kPagePoolShrinkWatermark = 1024;
+
   // Logger.
   // template <class StaticConfig>
   // using Logger = ::mica::transaction::NullLogger<StaticConfig>;
@@ -192,8 +253,17 @@ class DB {
   typedef BTreeIndex<StaticConfig, false, std::pair<uint64_t, uint64_t>>
       BTreeIndexNonuniqueU64;
 
+  // page_pools must have a pool for every CXL node in cxl_topology and for
+  // every NUMA node that runs a thread; other entries may be nullptr.
+  //
+  // With an enabled superblock, the DB is durable: everything it keeps goes
+  // to the CXL page pools and is recorded in the superblock.  If the
+  // superblock was attached, the DB resumes from the recorded tables and
+  // indexes instead, which must not be created again.
   DB(PagePool<StaticConfig>** page_pools, Logger* logger, Stopwatch* sw,
-     uint16_t num_threads);
+     uint16_t num_threads,
+     const CXLTopology& cxl_topology = CXLTopology(),
+     Superblock<StaticConfig>* superblock = nullptr);
   ~DB();
 
   PagePool<StaticConfig>* page_pool(uint8_t numa_id) {
@@ -262,17 +332,102 @@ class DB {
   //新增结束
 
   //新增：获取CXL内存(NUMA节点1)的PagePool
+  // The page pool of the primary CXL node.  Use allocate_cxl_page() for data
+  // that should be spread over all CXL nodes.
   PagePool<StaticConfig>* cxl_page_pool() {
-    return page_pools_[1];  // NUMA节点1作为CXL内存
+    return page_pools_[cxl_topology_.primary_node()];
+  }
+  const PagePool<StaticConfig>* cxl_page_pool() const {
+    return page_pools_[cxl_topology_.primary_node()];
   }
 
   // 检查CXL内存是否可用
   bool is_cxl_available() const {
-    return page_pools_[1] != nullptr &&
-           page_pools_[1]->free_count() > 0;
+    for (uint8_t i = 0; i < cxl_topology_.node_count(); i++) {
+      auto pool = page_pools_[cxl_topology_.node(i)];
+      if (pool != nullptr && pool->free_count() > 0) return true;
+    }
+    return false;
   }
   //新增结束
 
+  CXLTopology& cxl_topology() { return cxl_topology_; }
+  const CXLTopology& cxl_topology() const { return cxl_topology_; }
+
+  // The nodes with a page pool in the order to allocate from when memory on
+  // numa_id is preferred: numa_id, the other nodes of the same tier (DRAM or
+  // CXL), and then the nodes of the other tier.  Has spill_order_count()
+  // entries.
+  const uint8_t* spill_order(uint8_t numa_id) const {
+    return spill_order_ + static_cast<size_t>(numa_id) * num_numa_;
+  }
+  uint8_t spill_order_count() const { return spill_order_count_; }
+
+  // Whether a page or version from numa_id served a request for
+  // preferred_numa_id from the other memory tier.
+  bool is_spill(uint8_t preferred_numa_id, uint8_t numa_id) const {
+    return cxl_topology_.contains(preferred_numa_id) !=
+           cxl_topology_.contains(numa_id);
+  }
+
+  // Allocates a page preferably on numa_id, spilling over to the other nodes
+  // in spill_order(numa_id).  Stores the node of the page in *out_numa_id so
+  // that the page goes back to the right pool.
+  char* allocate_page(uint8_t numa_id, uint8_t* out_numa_id) {
+    auto order = spill_order(numa_id);
+    for (uint8_t i = 0; i < spill_order_count_; i++) {
+      auto node = order[i];
+      char* p = page_pools_[node]->allocate();
+      if (p == nullptr) continue;
+      if (is_spill(numa_id, node)) {
+        if (cxl_topology_.contains(numa_id))
+          __sync_fetch_and_add(&cxl_to_dram_page_spill_count_, uint64_t(1));
+        else
+          __sync_fetch_and_add(&dram_to_cxl_page_spill_count_, uint64_t(1));
+      }
+      *out_numa_id = node;
+      return p;
+    }
+    return nullptr;
+  }
+
+  // Allocates a page on the CXL node chosen by the placement policy, trying
+  // the other CXL nodes and then DRAM if that node is exhausted.  Stores the
+  // node of the page in *numa_id.
+  char* allocate_cxl_page(uint8_t* numa_id) {
+    uint8_t first = cxl_topology_.next_node();
+    auto pool = page_pools_[first];
+    char* p = pool != nullptr ? pool->allocate() : nullptr;
+    if (p != nullptr) {
+      *numa_id = first;
+      return p;
+    }
+    return allocate_page(first, numa_id);
+  }
+
+  // Whether the DB keeps its state in a superblock across restarts.
+  bool durable() const { return superblock_ != nullptr; }
+
+  // Whether other processes may use this durable DB at the same time (see
+  // Superblock).
+  bool shared() const {
+    return superblock_ != nullptr && superblock_->shared();
+  }
+
+  // The thread IDs this process may activate, which are all of them unless
+  // the DB is shared.
+  uint16_t thread_begin() const { return thread_begin_; }
+  uint16_t thread_end() const { return thread_end_; }
+
+  // The number of pages that came from the other tier because the preferred
+  // tier was exhausted.
+  uint64_t cxl_to_dram_page_spill_count() const {
+    return cxl_to_dram_page_spill_count_;
+  }
+  uint64_t dram_to_cxl_page_spill_count() const {
+    return dram_to_cxl_page_spill_count_;
+  }
+
   bool create_table(std::string name, uint16_t cf_count,
                     const uint64_t* data_size_hints);
 
@@ -281,6 +436,11 @@ class DB {
     return tables_[name];
   }
 
+  // Any table, including index tables, by Table::id().
+  Table<StaticConfig>* get_table_by_id(uint32_t id) {
+    return id < tables_by_id_.size() ? tables_by_id_[id] : nullptr;
+  }
+
   //新增：CXL_table
   bool create_cxl_table(std::string name, uint16_t cf_count,
                       const uint64_t* data_size_hints);
@@ -335,24 +495,35 @@ class DB {
   }
 
   void quiescence(uint16_t thread_id);
+  void refresh_min_wts(uint16_t thread_id);
 
   void update_backoff(uint16_t thread_id);
   double backoff() const { return backoff_; }
 
   void reset_backoff();
 
-  Timestamp min_wts() const { return min_rts_.get(); }
+  Timestamp min_wts() const { return min_wts_->get(); }
   Timestamp min_rts() const { return min_rts_.get(); }
 
+  // How far min_wts trailed the clock when it was refreshed (us); this is
+  // the visibility lag of committed writes to peek-only transactions.
+  const ::mica::util::Latency& visibility_lag() const {
+    return visibility_lag_;
+  }
+
   //新增：遍历所有活跃线程,返回最小的活跃事务时间戳
   Timestamp min_active_snapshot_ts() const {
     Timestamp min_ts = Timestamp::make(UINT64_MAX, UINT64_MAX, UINT64_MAX);
+    // The sentinel does not order after every timestamp under wrap-around
+    // comparison (CompactTimestamp), so start from the first active thread.
+    bool found = false;
 
     for (uint16_t i = 0; i < num_threads_; i++) {
       if (is_active(i)) {
         auto ctx_ts = ctxs_[i]->wts();  // 获取该线程当前的写时间戳
-        if (ctx_ts < min_ts) {
+        if (!found || ctx_ts < min_ts) {
           min_ts = ctx_ts;
+          found = true;
         }
       }
     }
@@ -368,6 +539,8 @@ class DB {
     min_wts_ = reinterpret_cast<ConcurrentTimestamp*>(p);
     min_rts_ = *reinterpret_cast<ConcurrentTimestamp*>(p + sizeof(ConcurrentTimestamp));
     ref_clock_ = *reinterpret_cast<volatile uint64_t*>(p + 2 * sizeof(ConcurrentTimestamp));
+    *reinterpret_cast<volatile uint64_t*>(p + kClockReferenceOffset) = 0;
+    attach_clock_reference();
 
     // 初始化
     min_wts_->init(ctxs_[0]->generate_timestamp());
@@ -378,30 +551,112 @@ class DB {
 
   // uint64_t gc_epoch() const { return gc_epoch_; }
 
+  // The RowEvictor that moves cold rows of this DB to the SSD tier, or
+  // nullptr.  Set by RowEvictor::start() and stop().
+  RowEvictor<StaticConfig>* row_evictor() { return row_evictor_; }
+  const RowEvictor<StaticConfig>* row_evictor() const { return row_evictor_; }
+  void set_row_evictor(RowEvictor<StaticConfig>* row_evictor) {
+    row_evictor_ = row_evictor;
+  }
+
   // db_print_stats.h
   void reset_stats();
   void print_stats(double elapsed_time, double total_time) const;
 
   void print_pool_status() const;
+  void print_memory_status() const;
+
+  // db_trace.h
+  void set_trace_sampling(uint64_t every_n);
+  bool dump_trace(const char* path) const;
+
+  // db_recovery.h
+  void recover(uint16_t num_scan_threads = 0);
 
  private:
   friend class Table<StaticConfig>;
+  friend class Context<StaticConfig>;
+
+  // db_recovery.h
+  void unlink_inserted_row(Context<StaticConfig>* ctx, Table<StaticConfig>* tbl,
+                           uint16_t cf_id, uint64_t row_id,
+                           RowVersion<StaticConfig>* rv);
+  std::pair<uint64_t, uint64_t> recover_by_scan(
+      const std::vector<uint64_t>& scan_seq, uint16_t num_scan_threads);
+
+  // Called by Table.  IDs follow the construction order, which
+  // attach_superblock() reproduces, so commit slots can name tables by ID.
+  uint32_t register_table(Table<StaticConfig>* tbl) {
+    tables_by_id_.push_back(tbl);
+    return static_cast<uint32_t>(tables_by_id_.size() - 1);
+  }
+
+  // Allocates a page for the root and page NUMA ID arrays of a table, which
+  // must survive restarts in a durable DB.
+  char* allocate_table_metadata_page(uint8_t* numa_id) {
+    if (!durable()) {
+      *numa_id = 0;
+      return page_pools_[0]->allocate();
+    }
+    return allocate_cxl_page(numa_id);
+  }
+
+  // CXLClockTimestamp keeps its reference in the CXL page of min_wts_, so
+  // every process attached to the DB finds it there.
+  static constexpr size_t kClockReferenceOffset = 128;
+
+  void attach_clock_reference() {
+    if (!std::is_same<Timestamp, CXLClockTimestamp>::value) return;
+    CXLClockTimestamp::set_reference(reinterpret_cast<volatile uint64_t*>(
+        reinterpret_cast<char*>(min_wts_) + kClockReferenceOffset));
+  }
+
+  // The recorded commit slot page of a thread when attaching, or nullptr.
+  char* attached_slot_page(uint16_t thread_id, uint8_t* numa_id) const {
+    if (superblock_ == nullptr || !superblock_->attached()) return nullptr;
+    auto& thread = superblock_->layout()->threads[thread_id];
+    *numa_id = thread.slots_numa_id;
+    return reinterpret_cast<char*>(thread.slots.get());
+  }
+
+  // db_superblock.h
+  void format_superblock();
+  void attach_superblock();
+  void register_threads();
+  bool can_record_table(const std::string& name) const;
+  void record_table(const std::string& name, SuperblockTableKind kind,
+                    Table<StaticConfig>* tbl,
+                    const Table<StaticConfig>* main_tbl,
+                    uint64_t expected_num_rows);
 
   PagePool<StaticConfig>** page_pools_;
+  CXLTopology cxl_topology_;
+  // nullptr unless durable.
+  Superblock<StaticConfig>* superblock_;
   Logger* logger_;
   Stopwatch* sw_;
 
   uint16_t num_threads_;
+  uint16_t thread_begin_;
+  uint16_t thread_end_;
   uint8_t num_numa_;
-  Context<StaticConfig>* ctxs_[StaticConfig::kMaxLCoreCount];
+  // Per-thread and per-NUMA-node arrays sized at construction.
+  Context<StaticConfig>** ctxs_;
 
-  SharedRowVersionPool<StaticConfig>*
-      shared_row_version_pools_[StaticConfig::kMaxNUMACount];
-  RowVersionPool<StaticConfig>*
-      row_version_pools_[StaticConfig::kMaxLCoreCount];
+  SharedRowVersionPool<StaticConfig>** shared_row_version_pools_;
+  RowVersionPool<StaticConfig>** row_version_pools_;
+
+  // num_numa_ rows of spill_order_count_ nodes (see spill_order()).
+  uint8_t* spill_order_;
+  uint8_t spill_order_count_;
+  volatile uint64_t cxl_to_dram_page_spill_count_;
+  volatile uint64_t dram_to_cxl_page_spill_count_;
+
+  RowEvictor<StaticConfig>* volatile row_evictor_;
 
   std::unordered_map<std::string, Table<StaticConfig>*> tables_;
   std::map<std::string, Table<StaticConfig>*> cxl_tables_; //CXL_table
+  std::vector<Table<StaticConfig>*> tables_by_id_;
 
   std::unordered_map<std::string, HashIndexUniqueU64*> hash_idxs_unique_u64_;
   std::unordered_map<std::string, HashIndexNonuniqueU64*>
@@ -414,8 +669,8 @@ class DB {
   // Modified by leader/worker threads very infrequently.
   volatile uint16_t leader_thread_id_;
   volatile uint16_t active_thread_count_;
-  volatile bool thread_active_[StaticConfig::kMaxLCoreCount];
-  bool clock_init_[StaticConfig::kMaxLCoreCount];
+  volatile bool* thread_active_;
+  bool* clock_init_;
 
   // Modified by the leader thread.
   //ConcurrentTimestamp min_wts_ __attribute__((aligned(64)));
@@ -424,6 +679,10 @@ class DB {
   volatile uint64_t ref_clock_;
   // volatile uint64_t gc_epoch_;
 
+  // Modified by the thread that refreshes min_wts.
+  volatile uint64_t last_min_wts_refresh_;
+  ::mica::util::Latency visibility_lag_;
+
   volatile double backoff_;
   uint64_t last_backoff_print_;
   uint64_t last_backoff_update_;
@@ -439,7 +698,7 @@ class DB {
     volatile bool quiescence;
   } __attribute__((aligned(64)));
 
-  ThreadState thread_states_[StaticConfig::kMaxLCoreCount];
+  ThreadState* thread_states_;
 
 } __attribute__((aligned(64)));
 }
@@ -447,5 +706,9 @@ class DB {
 
 #include "db_impl.h"
 #include "db_print_stats.h"
+#include "db_trace.h"
+#include "db_recovery.h"
+#include "db_superblock.h"
+#include "row_evictor.h"
 
 #endif
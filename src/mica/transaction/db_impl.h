@@ -6,23 +6,76 @@ namespace mica {
 namespace transaction {
 template <class StaticConfig>
 DB<StaticConfig>::DB(PagePool<StaticConfig>** page_pools, Logger* logger,
-                     Stopwatch* sw, uint16_t num_threads)
+                     Stopwatch* sw, uint16_t num_threads,
+                     const CXLTopology& cxl_topology,
+                     Superblock<StaticConfig>* superblock)
     : page_pools_(page_pools),
+      cxl_topology_(cxl_topology),
+      superblock_(superblock != nullptr && superblock->enabled() ? superblock
+                                                                 : nullptr),
       logger_(logger),
       sw_(sw),
-      num_threads_(num_threads) {
+      num_threads_(num_threads),
+      thread_begin_(0),
+      thread_end_(num_threads) {
   assert(num_threads_ <=
          static_cast<uint16_t>(::mica::util::lcore.lcore_count()));
-  assert(num_threads_ <= StaticConfig::kMaxLCoreCount);
-
-  num_numa_ = 0;
+  if (num_threads_ > Timestamp::kMaxThreadCount)
+    fprintf(stderr, "error: the timestamp supports only %" PRIu64
+                    " threads\n",
+            static_cast<uint64_t>(Timestamp::kMaxThreadCount));
+  assert(num_threads_ <= Timestamp::kMaxThreadCount);
+  if (superblock_ != nullptr && superblock_->attached() &&
+      superblock_->layout()->num_threads != num_threads_) {
+    fprintf(stderr, "error: the superblock is for %" PRIu16 " threads\n",
+            superblock_->layout()->num_threads);
+    assert(false);
+  }
+  assert(num_threads_ <= SuperblockLayout<StaticConfig>::kMaxThreads);
+
+  // Cover every node in the system, including CPU-less (CXL) nodes.
+  num_numa_ = static_cast<uint8_t>(::mica::util::lcore.numa_count()); //直接使用系统numa数量
+
+  ctxs_ = new Context<StaticConfig>*[num_threads_];
+  row_version_pools_ = new RowVersionPool<StaticConfig>*[num_threads_];
+  shared_row_version_pools_ =
+      new SharedRowVersionPool<StaticConfig>*[num_numa_];
+  thread_active_ = new volatile bool[num_threads_];
+  clock_init_ = new bool[num_threads_];
+  // Keep one cache line per thread for quiescence flags.
+  void* p = nullptr;
+  if (posix_memalign(&p, 64, sizeof(ThreadState) * num_threads_) != 0) {
+    fprintf(stderr, "error: failed to allocate thread states\n");
+    assert(false);
+  }
+  thread_states_ = reinterpret_cast<ThreadState*>(p);
+
+  // Build the spill order before Context allocates its commit slots.
+  spill_order_ = new uint8_t[static_cast<size_t>(num_numa_) * num_numa_];
+  spill_order_count_ = 0;
+  for (uint8_t numa_id = 0; numa_id < num_numa_; numa_id++) {
+    auto row = spill_order_ + static_cast<size_t>(numa_id) * num_numa_;
+    uint8_t count = 0;
+    if (page_pools_[numa_id] != nullptr) row[count++] = numa_id;
+    for (int other_tier = 0; other_tier < 2; other_tier++)
+      for (uint8_t i = 0; i < num_numa_; i++) {
+        uint8_t node = static_cast<uint8_t>((numa_id + i) % num_numa_);
+        if (node == numa_id || page_pools_[node] == nullptr) continue;
+        if (is_spill(numa_id, node) != (other_tier != 0)) continue;
+        // A durable DB must not leave CXL.
+        if (durable() && cxl_topology_.contains(numa_id)) continue;
+        row[count++] = node;
+      }
+    spill_order_count_ = count;
+  }
+  cxl_to_dram_page_spill_count_ = 0;
+  dram_to_cxl_page_spill_count_ = 0;
+  row_evictor_ = nullptr;
 
   for (uint16_t thread_id = 0; thread_id < num_threads_; thread_id++) {
     uint8_t numa_id =
         static_cast<uint8_t>(::mica::util::lcore.numa_id(thread_id));
-    if (num_numa_ <= numa_id) num_numa_ = static_cast<uint8_t>(numa_id + 1);
-
-    num_numa_ = static_cast<uint8_t>(::mica::util::lcore.numa_count()); //直接使用系统numa数量
+    assert(numa_id < num_numa_);
 
     ctxs_[thread_id] = new Context<StaticConfig>(this, thread_id, numa_id);
 
@@ -30,20 +83,31 @@ DB<StaticConfig>::DB(PagePool<StaticConfig>** page_pools, Logger* logger,
     clock_init_[thread_id] = false;
     thread_states_[thread_id].quiescence = false;
   }
-  assert(num_numa_ <= StaticConfig::kMaxNUMACount);
 
+  for (uint8_t i = 0; i < cxl_topology_.node_count(); i++) {
+    auto node = cxl_topology_.node(i);
+    if (node >= num_numa_ || page_pools_[node] == nullptr)
+      printf("warning: no page pool on CXL node %" PRIu8 "\n", node);
+  }
+
+  // Nodes without a page pool (e.g., CXL nodes that are not configured) get
+  // no shared row version pool.
   for (uint8_t numa_id = 0; numa_id < num_numa_; numa_id++)
     shared_row_version_pools_[numa_id] =
-        new SharedRowVersionPool<StaticConfig>(page_pools_[numa_id], numa_id);
+        page_pools_[numa_id] == nullptr
+            ? nullptr
+            : new SharedRowVersionPool<StaticConfig>(page_pools_[numa_id],
+                                                     numa_id);
 
   for (uint16_t thread_id = 0; thread_id < num_threads_; thread_id++) {
-    auto pool = new RowVersionPool<StaticConfig>(ctxs_[thread_id],
-                                                 shared_row_version_pools_);
+    auto pool = RowVersionPool<StaticConfig>::create(ctxs_[thread_id],
+                                                     shared_row_version_pools_);
     row_version_pools_[thread_id] = pool;
   }
 
   printf("thread count = %" PRIu16 "\n", num_threads_);
   printf("NUMA count = %" PRIu8 "\n", num_numa_);
+  cxl_topology_.print();
   printf("\n");
 
   last_backoff_print_ = 0;
@@ -52,16 +116,20 @@ DB<StaticConfig>::DB(PagePool<StaticConfig>** page_pools, Logger* logger,
 
   active_thread_count_ = 0;
   leader_thread_id_ = static_cast<uint16_t>(-1);
+  last_min_wts_refresh_ = 0;
 
-  // 在CXL内存中分配min_wts_ - 添加详细调试
-  printf("DEBUG: Starting CXL memory allocation for min_wts_\n");
-  auto cxl_page_pool = page_pools_[1];  // NUMA节点1作为CXL内存
-  if (cxl_page_pool == nullptr) {
-    printf("ERROR: CXL page pool is null\n");
+  if (superblock_ != nullptr && superblock_->attached()) {
+    // Everything below is in the superblock already.
+    attach_superblock();
     return;
   }
 
-  char* min_wts_memory = cxl_page_pool->allocate();
+  // 在CXL内存中分配min_wts_ - 添加详细调试
+  printf("DEBUG: Starting CXL memory allocation for min_wts_\n");
+  // The primary CXL node first, spilling over to DRAM if CXL is exhausted.
+  uint8_t min_wts_numa_id = 0;
+  char* min_wts_memory =
+      allocate_page(cxl_topology_.primary_node(), &min_wts_numa_id);
   if (min_wts_memory == nullptr) {
     printf("ERROR: Failed to allocate min_wts_ in CXL memory\n");
     return;
@@ -76,7 +144,8 @@ DB<StaticConfig>::DB(PagePool<StaticConfig>** page_pools, Logger* logger,
 
   if (addr & 63) {
     printf("WARNING: CXL memory not 64-byte aligned, attempting reallocation\n");
-    char* aligned_memory = cxl_page_pool->allocate();
+    char* aligned_memory =
+        allocate_page(cxl_topology_.primary_node(), &min_wts_numa_id);
     if (aligned_memory == nullptr) {
         printf("ERROR: Failed to allocate aligned CXL memory\n");
         return;
@@ -98,7 +167,7 @@ DB<StaticConfig>::DB(PagePool<StaticConfig>** page_pools, Logger* logger,
   printf("DEBUG: Generated initial timestamp: t2=%lu\n", initial_ts.t2);
 
   // 使用栈临时对象初始化，然后复制到CXL内存
-  CompactConcurrentTimestamp temp_min_wts;
+  ConcurrentTimestamp temp_min_wts;
   printf("DEBUG: Initializing temporary timestamp object\n");
   temp_min_wts.init(initial_ts);
   printf("DEBUG: Temporary timestamp initialized successfully\n");
@@ -115,6 +184,7 @@ DB<StaticConfig>::DB(PagePool<StaticConfig>** page_pools, Logger* logger,
   ref_clock_ = 0;
   */
   allocate_cxl_metadata();  // 修改：初始化CXL全局元数据
+  if (superblock_ != nullptr) format_superblock();
   // gc_epoch_ = 0;
 }
 
@@ -123,24 +193,40 @@ DB<StaticConfig>::~DB() {
   // TODO: Deallocate all rows that are cached in Context before deleting
   // tables.
 
+  if (shared()) superblock_->unregister_process();
+  if (std::is_same<Timestamp, CXLClockTimestamp>::value)
+    CXLClockTimestamp::reset_reference();
+
   for (auto& e : tables_) delete e.second;
 
   for (auto thread_id = 0; thread_id < num_threads_; thread_id++)
-    delete row_version_pools_[thread_id];
+    RowVersionPool<StaticConfig>::destroy(row_version_pools_[thread_id]);
 
-  for (uint8_t numa_id = 0; numa_id < num_numa_; numa_id++)
-    delete shared_row_version_pools_[numa_id];
+  // The version pages of a durable DB stay allocated for the next attach.
+  if (!durable())
+    for (uint8_t numa_id = 0; numa_id < num_numa_; numa_id++)
+      delete shared_row_version_pools_[numa_id];
 
   for (auto i = 0; i < num_threads_; i++) delete ctxs_[i];
+
+  delete[] ctxs_;
+  delete[] row_version_pools_;
+  delete[] shared_row_version_pools_;
+  delete[] spill_order_;
+  delete[] thread_active_;
+  delete[] clock_init_;
+  free(thread_states_);
 }
 
 template <class StaticConfig>
 bool DB<StaticConfig>::create_table(std::string name, uint16_t cf_count,
                                     const uint64_t* data_size_hints) {
   if (tables_.find(name) != tables_.end()) return false;
+  if (!can_record_table(name)) return false;
 
   auto tbl = new Table<StaticConfig>(this, cf_count, data_size_hints);
   tables_[name] = tbl;
+  record_table(name, SuperblockTableKind::kTable, tbl, nullptr, 0);
   return true;
 }
 
@@ -149,10 +235,12 @@ template <class StaticConfig>
 bool DB<StaticConfig>::create_cxl_table(std::string name, uint16_t cf_count,
                                         const uint64_t* data_size_hints) {
   if (cxl_tables_.find(name) != cxl_tables_.end()) return false;
+  if (!can_record_table(name)) return false;
 
   // 创建CXL专用的Table，强制使用NUMA节点1
-  auto tbl = new CXLTable<StaticConfig>(this, cf_count, data_size_hints, 1);
+  auto tbl = new CXLTable<StaticConfig>(this, cf_count, data_size_hints);
   cxl_tables_[name] = tbl;
+  record_table(name, SuperblockTableKind::kCXLTable, tbl, nullptr, 0);
   return true;
 }
 //新增结束
@@ -163,12 +251,15 @@ bool DB<StaticConfig>::create_hash_index_unique_u64(
     uint64_t expected_row_count) {
   if (hash_idxs_unique_u64_.find(name) != hash_idxs_unique_u64_.end())
     return false;
+  if (!can_record_table(name)) return false;
 
   const uint64_t kDataSizes[] = {HashIndexUniqueU64::kDataSize};
   auto idx = new HashIndexUniqueU64(
       this, main_tbl, new Table<StaticConfig>(this, 1, kDataSizes),
       expected_row_count);
   hash_idxs_unique_u64_[name] = idx;
+  record_table(name, SuperblockTableKind::kHashIndexUniqueU64,
+               idx->index_table(), main_tbl, expected_row_count);
   return true;
 }
 
@@ -178,12 +269,15 @@ bool DB<StaticConfig>::create_hash_index_nonunique_u64(
     uint64_t expected_row_count) {
   if (hash_idxs_nonunique_u64_.find(name) != hash_idxs_nonunique_u64_.end())
     return false;
+  if (!can_record_table(name)) return false;
 
   const uint64_t kDataSizes[] = {HashIndexNonuniqueU64::kDataSize};
   auto idx = new HashIndexNonuniqueU64(
       this, main_tbl, new Table<StaticConfig>(this, 1, kDataSizes),
       expected_row_count);
   hash_idxs_nonunique_u64_[name] = idx;
+  record_table(name, SuperblockTableKind::kHashIndexNonuniqueU64,
+               idx->index_table(), main_tbl, expected_row_count);
   return true;
 }
 
@@ -192,11 +286,14 @@ bool DB<StaticConfig>::create_btree_index_unique_u64(
     std::string name, Table<StaticConfig>* main_tbl) {
   if (btree_idxs_unique_u64_.find(name) != btree_idxs_unique_u64_.end())
     return false;
+  if (!can_record_table(name)) return false;
 
   const uint64_t kDataSizes[] = {BTreeIndexUniqueU64::kDataSize};
   auto idx = new BTreeIndexUniqueU64(
       this, main_tbl, new Table<StaticConfig>(this, 1, kDataSizes));
   btree_idxs_unique_u64_[name] = idx;
+  record_table(name, SuperblockTableKind::kBTreeIndexUniqueU64,
+               idx->index_table(), main_tbl, 0);
   return true;
 }
 
@@ -205,17 +302,21 @@ bool DB<StaticConfig>::create_btree_index_nonunique_u64(
     std::string name, Table<StaticConfig>* main_tbl) {
   if (btree_idxs_nonunique_u64_.find(name) != btree_idxs_nonunique_u64_.end())
     return false;
+  if (!can_record_table(name)) return false;
 
   const uint64_t kDataSizes[] = {BTreeIndexNonuniqueU64::kDataSize};
   auto idx = new BTreeIndexNonuniqueU64(
       this, main_tbl, new Table<StaticConfig>(this, 1, kDataSizes));
   btree_idxs_nonunique_u64_[name] = idx;
+  record_table(name, SuperblockTableKind::kBTreeIndexNonuniqueU64,
+               idx->index_table(), main_tbl, 0);
   return true;
 }
 
 template <class StaticConfig>
 void DB<StaticConfig>::activate(uint16_t thread_id) {
   //printf("DB::activate(): thread_id=%u\n", thread_id);
+  assert(thread_begin_ <= thread_id && thread_id < thread_end_);
   if (thread_active_[thread_id]) return;
 
   if (!clock_init_[thread_id]) {
@@ -237,10 +338,14 @@ void DB<StaticConfig>::activate(uint16_t thread_id) {
   ::mica::util::memory_barrier();
 
   // Keep updating timestamp until it is reflected to min_wts and min_rts.
+  // In a shared DB, it must also be past what this process has published to
+  // the others.
   //printf("Starting sync loop for thread %u\n", thread_id);
   while (/*gc_epoch_ - init_gc_epoch < 2 ||*/ min_wts() >
              ctxs_[thread_id]->wts() ||
-         min_rts() > ctxs_[thread_id]->rts()) {
+         min_rts() > ctxs_[thread_id]->rts() ||
+         (shared() && superblock_->behind_published(ctxs_[thread_id]->wts(),
+                                                    ctxs_[thread_id]->rts()))) {
     ::mica::util::pause();
 
     quiescence(thread_id);
@@ -253,6 +358,14 @@ void DB<StaticConfig>::activate(uint16_t thread_id) {
 
   __sync_fetch_and_add(&active_thread_count_, 1);
   //printf("Sync completed for thread %u\n", thread_id);
+
+  // Hardware counters follow the thread that activated this context.
+  if (std::is_same<typename StaticConfig::Timing, PerfTiming>::value &&
+      !ctxs_[thread_id]->timing_stack()->open_perf())
+    fprintf(stderr,
+            "warning: perf_event_open() failed for thread %" PRIu16
+            "; check /proc/sys/kernel/perf_event_paranoid\n",
+            thread_id);
 }
 
 template <class StaticConfig>
@@ -276,6 +389,9 @@ void DB<StaticConfig>::deactivate(uint16_t thread_id) {
     leader_thread_id_ = static_cast<uint16_t>(-1);
 
   __sync_sub_and_fetch(&active_thread_count_, 1);
+
+  if (std::is_same<typename StaticConfig::Timing, PerfTiming>::value)
+    ctxs_[thread_id]->timing_stack()->close_perf();
 }
 
 template <class StaticConfig>
@@ -298,6 +414,8 @@ void DB<StaticConfig>::quiescence(uint16_t thread_id) { //协调线程静默
 
   thread_states_[thread_id].quiescence = true;
 
+  refresh_min_wts(thread_id);
+
   if (leader_thread_id_ == static_cast<uint16_t>(-1)) {
     if (__sync_bool_compare_and_swap(&leader_thread_id_,
                                      static_cast<uint16_t>(-1), thread_id)) { //CAS竞争成为leader
@@ -352,7 +470,14 @@ void DB<StaticConfig>::quiescence(uint16_t thread_id) { //协调线程静默
     // not strict).
     if (min_wts < min_rts) min_wts = min_rts;
 
-    if (min_wts_->get() < min_wts) min_wts_->write(min_wts);
+    // Garbage and visibility follow the slowest thread of every process.
+    if (shared()) {
+      superblock_->merge_min_ts(&min_wts, &min_rts);
+      if (min_wts < min_rts) min_wts = min_rts;
+    }
+
+    // refresh_min_wts() may advance min_wts concurrently.
+    min_wts_->update(min_wts);
 
     if (min_rts_.get() <= min_rts) {
       min_rts_.write(min_rts);
@@ -363,8 +488,47 @@ void DB<StaticConfig>::quiescence(uint16_t thread_id) { //协调线程静默
   }
 }
 
+template <class StaticConfig>
+void DB<StaticConfig>::refresh_min_wts(uint16_t thread_id) {
+  // A full quiescence round waits for every thread, so a commit would stay
+  // invisible to peek-only transactions until the slowest thread passes
+  // quiescence twice.  The minimum of the published wts is a safe lower
+  // bound at any time: every thread's future wts exceeds its published one.
+  auto now = sw_->now();
+  auto last = last_min_wts_refresh_;
+  if (static_cast<int64_t>(now - last) <
+      StaticConfig::kMinWTSRefreshInterval *
+          static_cast<int64_t>(sw_->c_1_usec()))
+    return;
+  if (!__sync_bool_compare_and_swap(&last_min_wts_refresh_, last, now)) return;
+
+  bool first = true;
+  Timestamp min_wts;
+  for (uint16_t i = 0; i < num_threads_; i++) {
+    if (!thread_active_[i]) continue;
+    auto wts = ctxs_[i]->wts();
+    if (first || min_wts > wts) min_wts = wts;
+    first = false;
+  }
+  if (first) return;
+  if (shared()) superblock_->merge_min_ts(&min_wts, nullptr);
+
+  min_wts_->update(min_wts);
+
+  // min_wts_ may be past this thread's wts if another thread refreshed it
+  // with newer timestamps or this thread is not active; clock_diff() would
+  // underflow then.
+  auto wts = ctxs_[thread_id]->wts();
+  auto cur_min_wts = min_wts_->get();
+  if (wts >= cur_min_wts)
+    visibility_lag_.update(wts.clock_diff(cur_min_wts) / sw_->c_1_usec());
+}
+
 template <class StaticConfig>
 void DB<StaticConfig>::update_backoff(uint16_t thread_id) {
+  // Each thread adjusts its own backoff in per-thread mode.
+  if (StaticConfig::kPerThreadBackoff) return;
+
   if (leader_thread_id_ != thread_id) return;
 
   uint64_t now = sw_->now();
@@ -440,6 +604,9 @@ template <class StaticConfig>
 void DB<StaticConfig>::reset_backoff() {
   // This requires reset_stats() to be effective.
   backoff_ = 0.;
+
+  for (uint16_t i = 0; i < num_threads_; i++)
+    ctxs_[i]->local_backoff().reset();
 }
 }
 }
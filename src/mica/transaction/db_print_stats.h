@@ -12,8 +12,20 @@ void DB<StaticConfig>::reset_stats() {
     ctxs_[thread_id]->commit_latency().reset();
     ctxs_[thread_id]->abort_latency().reset();
     ctxs_[thread_id]->ro_tx_staleness().reset();
+    if (std::is_same<typename StaticConfig::Timing, PerfTiming>::value)
+      ctxs_[thread_id]->perf_stats().reset();
+    if (StaticConfig::kCollectPhaseLatency)
+      for (uint8_t phase = 0; phase < kLatencyPhaseCount; phase++)
+        ctxs_[thread_id]
+            ->phase_latency(static_cast<LatencyPhase>(phase))
+            .reset();
   }
 
+  visibility_lag_.reset();
+
+  cxl_to_dram_page_spill_count_ = 0;
+  dram_to_cxl_page_spill_count_ = 0;
+
   last_committed_count_ = 0;
 
   auto now = sw_->now();
@@ -141,6 +153,15 @@ void DB<StaticConfig>::print_stats(double elapsed_time,
     }
     printf("\n");
 
+    if (StaticConfig::kBackoff && StaticConfig::kPerThreadBackoff) {
+      printf("backoff (us):");
+      for (uint16_t thread_id = 0; thread_id < num_threads_; thread_id++) {
+        printf(" %.3f", context(thread_id)->local_backoff().thread_backoff() /
+                            static_cast<double>(sw_->c_1_usec()));
+      }
+      printf("\n");
+    }
+
     printf("\n");
   }
 
@@ -180,8 +201,42 @@ void DB<StaticConfig>::print_stats(double elapsed_time,
     printf("\n");
   }
 
+  printf("     visibility lag (us): min=%" PRIu64 ", max=%" PRIu64
+         ", avg=%" PRIu64 "; 50-th=%" PRIu64 ", 95-th=%" PRIu64
+         ", 99-th=%" PRIu64 ", 99.9-th=%" PRIu64 "\n",
+         visibility_lag_.min(), visibility_lag_.max(), visibility_lag_.avg(),
+         visibility_lag_.perc(0.50), visibility_lag_.perc(0.95),
+         visibility_lag_.perc(0.99), visibility_lag_.perc(0.999));
+  printf("\n");
+
+  // Merge one phase at a time to keep only one histogram on the stack.
+  if (StaticConfig::kCollectPhaseLatency) {
+    ::mica::util::Histogram phase_latency;
+    double c_1_nsec = static_cast<double>(sw_->c_1_sec()) / 1000000000.;
+    printf("phase latency (ns):\n");
+    for (uint8_t phase = 0; phase < kLatencyPhaseCount; phase++) {
+      phase_latency.reset();
+      for (uint16_t thread_id = 0; thread_id < num_threads_; thread_id++)
+        phase_latency +=
+            ctxs_[thread_id]->phase_latency(static_cast<LatencyPhase>(phase));
+      auto ns = [&](uint64_t cycles) {
+        return static_cast<double>(cycles) / c_1_nsec;
+      };
+      printf("  %-24s count=%10" PRIu64
+             ", avg=%9.1lf; 50-th=%9.1lf, 99-th=%9.1lf, 99.9-th=%9.1lf, "
+             "max=%9.1lf\n",
+             kLatencyPhaseNames[phase], phase_latency.count(),
+             ns(phase_latency.avg()), ns(phase_latency.perc(0.50)),
+             ns(phase_latency.perc(0.99)), ns(phase_latency.perc(0.999)),
+             ns(phase_latency.max()));
+    }
+    printf("\n");
+  }
+
   if (typeid(typename StaticConfig::Timing) ==
-      typeid(::mica::transaction::ActiveTiming)) {
+          typeid(::mica::transaction::ActiveTiming) ||
+      typeid(typename StaticConfig::Timing) ==
+          typeid(::mica::transaction::PerfTiming)) {
     double ms;
     ms = sw_->diff(stats.worker, 0) * 1000.;
     printf("worker:                   %10.3lf ms (%6.2lf%%)\n", ms,
@@ -246,6 +301,89 @@ void DB<StaticConfig>::print_stats(double elapsed_time,
     printf("\n");
   }
 
+  if (typeid(typename StaticConfig::Timing) ==
+      typeid(::mica::transaction::PerfTiming)) {
+    static const char* const bucket_names[kTimingBucketCount] = {
+        "worker",
+        "timestamping",
+        "alloc",
+        "dealloc",
+        "execution_read",
+        "execution_write",
+        "index_read",
+        "index_write",
+        "row_copy",
+        "wait_for_pending",
+        "sort_wset",
+        "pre_validation",
+        "deferred_version_insert",
+        "rts_update",
+        "main_validation",
+        "logging",
+        "write",
+        "rollback",
+        "gc",
+        "backoff",
+    };
+
+    PerfStats perf_stats;
+    for (uint16_t thread_id = 0; thread_id < num_threads_; thread_id++)
+      perf_stats += ctxs_[thread_id]->perf_stats();
+
+    // Per committed transaction so that runs of different lengths compare.
+    double per_tx =
+        1. / static_cast<double>(std::max(uint64_t(1), stats.committed_count));
+    uint64_t total[kPerfCounterCount] = {};
+
+    printf("hardware counters per committed tx:\n");
+    printf("%-24s %12s %12s %6s %12s %12s\n", "", "cycles", "instructions",
+           "IPC", "llc_misses", "remote_loads");
+    for (uint8_t b = 0; b <= kTimingBucketCount; b++) {
+      const uint64_t* v = b < kTimingBucketCount ? perf_stats.perf[b] : total;
+      if (b < kTimingBucketCount)
+        for (uint8_t i = 0; i < kPerfCounterCount; i++) total[i] += v[i];
+      printf("%-24s", b < kTimingBucketCount ? bucket_names[b] : "total");
+      for (uint8_t i = 0; i < kPerfCounterCount; i++) {
+        if (!perf_stats.available[i])
+          printf(" %12s", "n/a");
+        else
+          printf(" %12.1lf", static_cast<double>(v[i]) * per_tx);
+        if (i == static_cast<uint8_t>(PerfCounter::kInstructions))
+          printf(" %6.2lf",
+                 static_cast<double>(v[i]) /
+                     static_cast<double>(std::max(uint64_t(1), v[0])));
+      }
+      printf("\n");
+    }
+    printf("\n");
+  }
+
+  // Only shown once a tier ran out of memory.
+  if (stats.cxl_to_dram_version_spill_count != 0 ||
+      stats.dram_to_cxl_version_spill_count != 0 ||
+      cxl_to_dram_page_spill_count_ != 0 ||
+      dram_to_cxl_page_spill_count_ != 0) {
+    printf("spills (CXL->DRAM, DRAM->CXL)\n");
+    printf("  versions:   %10" PRIu64 " %10" PRIu64 "\n",
+           stats.cxl_to_dram_version_spill_count,
+           stats.dram_to_cxl_version_spill_count);
+    printf("  pages:      %10" PRIu64 " %10" PRIu64 "\n",
+           static_cast<uint64_t>(cxl_to_dram_page_spill_count_),
+           static_cast<uint64_t>(dram_to_cxl_page_spill_count_));
+    printf("\n");
+  }
+
+  if (row_evictor_ != nullptr) {
+    printf("eviction (%s)\n", row_evictor_->path().c_str());
+    printf("  evicted:    %10" PRIu64 " rows\n", row_evictor_->evict_count());
+    printf("  faulted in: %10" PRIu64 " rows (%" PRIu64 " accesses)\n",
+           row_evictor_->fault_in_count(), stats.evicted_row_access_count);
+    printf("  log:        %10.3lf MB (%.3lf MB live)\n",
+           static_cast<double>(row_evictor_->log_bytes()) / 1000000.,
+           static_cast<double>(row_evictor_->live_bytes()) / 1000000.);
+    printf("\n");
+  }
+
   if (StaticConfig::kCollectProcessingStats) {
     printf("insert_row_count:             %10" PRIu64 "\n",
            stats.insert_row_count);
@@ -278,6 +416,143 @@ void DB<StaticConfig>::print_stats(double elapsed_time,
   }
 }
 
+template <class StaticConfig>
+void DB<StaticConfig>::print_memory_status() const {
+  constexpr uint64_t kPageSize = PagePool<StaticConfig>::kPageSize;
+  typedef SharedRowVersionPool<StaticConfig> SRVP;
+
+  // Pages owned by anything below; the rest of each page pool is free.
+  std::vector<uint64_t> accounted(num_numa_, 0);
+
+  auto print_row = [this](const char* name,
+                          const std::vector<uint64_t>& bytes) {
+    printf("  %-30s", name);
+    for (uint8_t numa_id = 0; numa_id < num_numa_; numa_id++)
+      printf(" %12.3lf", static_cast<double>(bytes[numa_id]) / 1000000.);
+    printf("\n");
+  };
+
+  printf("memory usage (MB)               ");
+  for (uint8_t numa_id = 0; numa_id < num_numa_; numa_id++)
+    printf("  numa %" PRIu8 "%-5s", numa_id,
+           cxl_topology_.contains(numa_id) ? " CXL" : "");
+  printf("\n");
+
+  // Tables and index tables.
+  std::map<std::string, const Table<StaticConfig>*> tables;
+  for (auto& e : tables_) tables["table " + e.first] = e.second;
+  for (auto& e : hash_idxs_unique_u64_)
+    tables["hash index " + e.first] = e.second->index_table();
+  for (auto& e : hash_idxs_nonunique_u64_)
+    tables["hash index " + e.first] = e.second->index_table();
+  for (auto& e : btree_idxs_unique_u64_)
+    tables["btree index " + e.first] = e.second->index_table();
+  for (auto& e : btree_idxs_nonunique_u64_)
+    tables["btree index " + e.first] = e.second->index_table();
+
+  for (auto& e : tables) {
+    typename Table<StaticConfig>::MemoryUsage usage;
+    e.second->memory_usage(&usage);
+    printf("%s (%" PRIu64 " rows, %" PRIu64 " in free lists)\n",
+           e.first.c_str(), usage.row_count, usage.free_row_count);
+    print_row("row heads", usage.head_bytes);
+    print_row("inlined versions", usage.inlined_rv_bytes);
+    print_row("gc info", usage.gc_info_bytes);
+    print_row("page slack", usage.slack_bytes);
+    for (uint8_t numa_id = 0; numa_id < num_numa_; numa_id++)
+      accounted[numa_id] += usage.page_count[numa_id] * kPageSize;
+    accounted[0] += usage.metadata_bytes;
+  }
+
+  // Row version pools.
+  for (uint16_t cls = 0; cls < SRVP::kClassCount; cls++) {
+    std::vector<uint64_t> in_use(num_numa_, 0);
+    std::vector<uint64_t> free(num_numa_, 0);
+    std::vector<uint64_t> slack(num_numa_, 0);
+    uint64_t free_groups = 0;
+    uint64_t total_rows = 0;
+
+    uint64_t rv_size = SRVP::class_to_rv_size(cls);
+    uint64_t rows_per_page = kPageSize / rv_size;
+    for (uint8_t numa_id = 0; numa_id < num_numa_; numa_id++) {
+      auto pool = shared_row_version_pools_[numa_id];
+      if (pool == nullptr) continue;
+      uint64_t total = pool->total_count(cls);
+      uint64_t free_rows = pool->free_count(cls);
+      total_rows += total;
+      in_use[numa_id] = (total - free_rows) * rv_size;
+      free[numa_id] = free_rows * rv_size;
+      slack[numa_id] =
+          total / rows_per_page * (kPageSize - rows_per_page * rv_size);
+      free_groups += pool->free_group_count(cls);
+    }
+    if (total_rows == 0) continue;
+
+    // Thread-local pools hold versions from any NUMA node.
+    uint64_t local_free_rows = 0;
+    for (uint16_t thread_id = 0; thread_id < num_threads_; thread_id++)
+      local_free_rows += row_version_pools_[thread_id]->free_count(cls);
+
+    printf("row version class %" PRIu16 " (%" PRIu64 " bytes; %" PRIu64
+           " free groups, %" PRIu64 " rows in thread-local pools)\n",
+           cls, rv_size, free_groups, local_free_rows);
+    print_row("in use (incl. thread-local)", in_use);
+    print_row("free in shared pool", free);
+    print_row("page slack", slack);
+  }
+
+  std::vector<uint64_t> rv_pages(num_numa_, 0);
+  for (uint8_t numa_id = 0; numa_id < num_numa_; numa_id++) {
+    auto pool = shared_row_version_pools_[numa_id];
+    if (pool == nullptr) continue;
+    rv_pages[numa_id] = pool->page_count() * kPageSize;
+    accounted[numa_id] += rv_pages[numa_id];
+  }
+  printf("row version pools\n");
+  print_row("pages", rv_pages);
+
+  // Commit slots are spread over the CXL nodes; the shared timestamps live on
+  // the primary CXL node.
+  auto cxl_pool = cxl_page_pool();
+  if (cxl_pool != nullptr) {
+    std::vector<uint64_t> slots(num_numa_, 0);
+    std::vector<uint64_t> slot_slack(num_numa_, 0);
+    uint64_t used = StaticConfig::kMaxSlots * sizeof(CommitSlot<StaticConfig>);
+    for (uint16_t thread_id = 0; thread_id < num_threads_; thread_id++) {
+      auto numa_id = ctxs_[thread_id]->slots_numa_id();
+      slots[numa_id] += used;
+      slot_slack[numa_id] += kPageSize - used;
+      accounted[numa_id] += kPageSize;
+    }
+    // One page for min_wts.
+    accounted[cxl_pool->numa_id()] += kPageSize;
+
+    printf("commit slots (%" PRIu16 " threads)\n", num_threads_);
+    print_row("slots", slots);
+    print_row("page slack", slot_slack);
+  }
+
+  std::vector<uint64_t> other(num_numa_, 0);
+  std::vector<uint64_t> pool_free(num_numa_, 0);
+  std::vector<uint64_t> pool_total(num_numa_, 0);
+  std::vector<uint64_t> pool_max(num_numa_, 0);
+  for (uint8_t numa_id = 0; numa_id < num_numa_; numa_id++) {
+    auto pool = page_pools_[numa_id];
+    if (pool == nullptr) continue;
+    uint64_t used = (pool->total_count() - pool->free_count()) * kPageSize;
+    other[numa_id] = used > accounted[numa_id] ? used - accounted[numa_id] : 0;
+    pool_free[numa_id] = pool->free_count() * kPageSize;
+    pool_total[numa_id] = pool->total_count() * kPageSize;
+    pool_max[numa_id] = pool->max_count() * kPageSize;
+  }
+  printf("page pools\n");
+  print_row("unattributed", other);
+  print_row("free", pool_free);
+  print_row("total", pool_total);
+  print_row("max", pool_max);
+  printf("\n");
+}
+
 template <class StaticConfig>
 void DB<StaticConfig>::print_pool_status() const {
   for (uint16_t cls = 0; cls < SharedRowVersionPool<StaticConfig>::kClassCount;
@@ -286,6 +561,7 @@ void DB<StaticConfig>::print_pool_status() const {
     uint64_t total_rows = 0;
 
     for (uint8_t numa_id = 0; numa_id < num_numa_; numa_id++) {
+      if (shared_row_version_pools_[numa_id] == nullptr) continue;
       uint64_t free_rows = shared_row_version_pools_[numa_id]->free_count(cls);
       total_free_rows += free_rows;
       total_rows += shared_row_version_pools_[numa_id]->total_count(cls);
@@ -312,6 +588,7 @@ void DB<StaticConfig>::print_pool_status() const {
            static_cast<double>(total_rows * size) / 1000000000.);
 
     for (uint8_t numa_id = 0; numa_id < num_numa_; numa_id++) {
+      if (shared_row_version_pools_[numa_id] == nullptr) continue;
       uint64_t free_rows = shared_row_version_pools_[numa_id]->free_count(cls);
       printf("  shared pool %" PRIu8 ": %10" PRIu64 " rows free\n", numa_id,
              free_rows);
@@ -0,0 +1,281 @@
+#pragma once
+#ifndef MICA_TRANSACTION_DB_RECOVERY_H_
+#define MICA_TRANSACTION_DB_RECOVERY_H_
+
+#include <algorithm>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace mica {
+namespace transaction {
+// Commit-slot-based crash recovery.
+//
+// A transaction links its versions into the chains only after recording the
+// rows in its commit slot's SlotIntent array (Transaction::record_intents()),
+// and finalizes their statuses before the slot reaches kCommitted.  Every slot
+// is therefore in one of these states after a crash:
+//
+//   kCommitted             the versions are final; recovery only repairs
+//                          statuses that are still pending
+//   kActive, kCommitting   the transaction was in flight; its versions are
+//                          marked kAborted as abort() does, and the rows it
+//                          inserted are unlinked and freed
+//   kAborted               abort() ran, possibly only partly; it is redone
+//
+// Only the rows in the intents of each thread's kMaxSlots slots are visited,
+// so the work follows the transactions in flight rather than the table size.
+// A transaction whose writes overflowed its intent array is instead found by
+// scanning every table, one table per scan thread.
+//
+// recover() must run before any thread is activated.  Afterwards, min_wts,
+// min_rts, and the reference clock are past every timestamp in the slots, and
+// each thread's clock restarts from there on its next activate().
+//
+// A process attaching to a shared DB recovers only the slots of its own
+// threads, which the process that used them before left behind.  The other
+// processes keep min_wts and min_rts, so only the reference clock moves.
+template <class StaticConfig>
+void DB<StaticConfig>::recover(uint16_t num_scan_threads) {
+  if (!StaticConfig::kEnableSlotCommit) return;
+
+  for (uint16_t thread_id = thread_begin_; thread_id < thread_end_; thread_id++)
+    assert(!thread_active_[thread_id]);
+
+  const size_t kMaxSlots = Context<StaticConfig>::kMaxSlots;
+  uint64_t in_flight_count = 0;
+  uint64_t rollback_count = 0;
+  uint64_t finalize_count = 0;
+  uint64_t unlink_count = 0;
+
+  Timestamp max_ts = min_wts();
+
+  // Slots whose intents overflowed, indexed by thread_id * kMaxSlots +
+  // slot_idx; nonzero entries hold the local_tx_seq to roll back.
+  std::vector<uint64_t> scan_seq;
+
+  for (uint16_t thread_id = thread_begin_; thread_id < thread_end_;
+       thread_id++) {
+    auto ctx = ctxs_[thread_id];
+    if (ctx->slots_ == nullptr) continue;
+
+    uint64_t max_seq = 0;
+    for (uint32_t slot_idx = 0; slot_idx < kMaxSlots; slot_idx++) {
+      auto& slot = ctx->slots_[slot_idx];
+      // Never used.
+      if (slot.local_tx_seq == 0) continue;
+      max_seq = std::max(max_seq, slot.local_tx_seq);
+
+      bool committed = slot.state == CommitSlotState::kCommitted;
+      if (committed) {
+        if (slot.commit_ts > max_ts) max_ts = slot.commit_ts;
+      } else {
+        // The versions of an uncommitted transaction carry its start_ts.
+        if (slot.start_ts > max_ts) max_ts = slot.start_ts;
+        if (slot.state != CommitSlotState::kAborted) in_flight_count++;
+      }
+
+      auto count = slot.intent_count;
+      if (count == CommitSlot<StaticConfig>::kIntentOverflow) {
+        // Committed statuses are final before the commit point, so only
+        // uncommitted transactions need the scan.
+        if (!committed) {
+          if (scan_seq.empty()) scan_seq.resize(num_threads_ * kMaxSlots, 0);
+          scan_seq[thread_id * kMaxSlots + slot_idx] = slot.local_tx_seq;
+        }
+        count = 0;
+      }
+
+      auto intents = ctx->get_slot_intents(slot_idx);
+      for (uint32_t i = 0; i < count; i++) {
+        auto& intent = intents[i];
+        auto kind = static_cast<SlotIntentKind>(intent.kind);
+        auto tbl = get_table_by_id(intent.table_id);
+        auto cf_id = static_cast<uint16_t>(intent.cf_id);
+        uint64_t row_id = intent.row_id;
+        if (tbl == nullptr || cf_id >= tbl->cf_count() ||
+            row_id >= tbl->row_count())
+          continue;
+        auto head = tbl->head(cf_id, row_id);
+
+        // Find the version; it has the slot's start_ts as its wts.
+        RowVersion<StaticConfig>* rv = head->older_rv;
+        while (rv != nullptr && rv->wts >= slot.start_ts) {
+          if (rv->writer_thread_id() == thread_id &&
+              rv->slot_idx() == slot_idx &&
+              rv->is_writer_seq(slot.local_tx_seq))
+            break;
+          rv = rv->older_rv;
+        }
+        if (rv == nullptr || rv->wts < slot.start_ts) continue;
+
+        if (committed) {
+          if (rv->status != RowVersionStatus::kPending) continue;
+          rv->status = kind == SlotIntentKind::kDelete
+                           ? RowVersionStatus::kDeleted
+                           : RowVersionStatus::kCommitted;
+          finalize_count++;
+        } else if (kind == SlotIntentKind::kInsert) {
+          if (head->older_rv != rv) continue;
+          unlink_inserted_row(ctx, tbl, cf_id, row_id, rv);
+          unlink_count++;
+          continue;
+        } else {
+          if (rv->status == RowVersionStatus::kAborted) continue;
+          rv->status = RowVersionStatus::kAborted;
+          rollback_count++;
+        }
+        if (StaticConfig::kPersistentCXL)
+          ::mica::util::write_back(&rv->status, sizeof(RowVersionStatus));
+      }
+
+      if (!committed && slot.state != CommitSlotState::kAborted) {
+        // Let allocate_slot() reuse the slot.
+        slot.commit_ts = slot.start_ts;
+        slot.state = CommitSlotState::kAborted;
+        if (StaticConfig::kPersistentCXL)
+          ::mica::util::write_back(&slot, sizeof(slot));
+      }
+    }
+
+    // Keep writer tags unique across the crash.
+    ctx->local_seq_ = std::max(ctx->local_seq_, max_seq);
+  }
+
+  if (!scan_seq.empty()) {
+    auto counts = recover_by_scan(scan_seq, num_scan_threads);
+    rollback_count += counts.first;
+    unlink_count += counts.second;
+  }
+
+  if (StaticConfig::kPersistentCXL) ::mica::util::sfence();
+
+  // New timestamps must order after everything that survived.
+  uint64_t clock = max_ts.clock() + 1;
+  if (static_cast<int64_t>(clock - ref_clock_) > 0) ref_clock_ = clock;
+  for (uint16_t thread_id = thread_begin_; thread_id < thread_end_; thread_id++)
+    reset_clock(thread_id);
+  if (!shared()) {
+    if (max_ts > min_wts_->get()) min_wts_->init(max_ts);
+    // As in Context::generate_timestamp(), rts stays below wts.
+    Timestamp rts = max_ts;
+    rts.t2--;
+    if (rts > min_rts_.get()) min_rts_.init(rts);
+  }
+  if (StaticConfig::kPersistentCXL) {
+    ::mica::util::write_back(min_wts_, sizeof(*min_wts_));
+    ::mica::util::sfence();
+  }
+
+  printf("recovery: %" PRIu64 " in-flight transactions, %" PRIu64
+         " versions aborted, %" PRIu64 " finalized, %" PRIu64
+         " inserted rows unlinked%s\n",
+         in_flight_count, rollback_count, finalize_count, unlink_count,
+         scan_seq.empty() ? "" : " (with table scan)");
+}
+
+template <class StaticConfig>
+void DB<StaticConfig>::unlink_inserted_row(Context<StaticConfig>* ctx,
+                                           Table<StaticConfig>* tbl,
+                                           uint16_t cf_id, uint64_t row_id,
+                                           RowVersion<StaticConfig>* rv) {
+  // Same as abort() for a row that was never inserted.
+  auto head = tbl->head(cf_id, row_id);
+  head->older_rv = nullptr;
+  if (StaticConfig::kPersistentCXL)
+    ::mica::util::write_back(&head->older_rv, sizeof(head->older_rv));
+  ctx->deallocate_version(rv);
+  if (cf_id == 0) ctx->deallocate_row(tbl, row_id);
+}
+
+template <class StaticConfig>
+std::pair<uint64_t, uint64_t> DB<StaticConfig>::recover_by_scan(
+    const std::vector<uint64_t>& scan_seq, uint16_t num_scan_threads) {
+  const size_t kMaxSlots = Context<StaticConfig>::kMaxSlots;
+
+  std::vector<Table<StaticConfig>*> tables;
+  for (auto& e : tables_) tables.push_back(e.second);
+  for (auto& e : cxl_tables_) tables.push_back(e.second);
+  for (auto& e : hash_idxs_unique_u64_)
+    tables.push_back(e.second->index_table());
+  for (auto& e : hash_idxs_nonunique_u64_)
+    tables.push_back(e.second->index_table());
+  for (auto& e : btree_idxs_unique_u64_)
+    tables.push_back(e.second->index_table());
+  for (auto& e : btree_idxs_nonunique_u64_)
+    tables.push_back(e.second->index_table());
+
+  struct Unlink {
+    Table<StaticConfig>* tbl;
+    uint16_t cf_id;
+    uint64_t row_id;
+    RowVersion<StaticConfig>* rv;
+  };
+  struct Worker {
+    uint64_t rollback_count;
+    std::vector<Unlink> unlinks;
+  };
+
+  if (num_scan_threads == 0) num_scan_threads = num_threads_;
+  num_scan_threads = static_cast<uint16_t>(
+      std::min(static_cast<size_t>(num_scan_threads), tables.size()));
+  std::vector<Worker> workers(num_scan_threads);
+  volatile size_t next_table = 0;
+
+  auto scan = [&](Worker* w) {
+    w->rollback_count = 0;
+    while (true) {
+      size_t i = __sync_fetch_and_add(&next_table, 1);
+      if (i >= tables.size()) break;
+      auto tbl = tables[i];
+      auto row_count = tbl->row_count();
+      for (uint16_t cf_id = 0; cf_id < tbl->cf_count(); cf_id++) {
+        for (uint64_t row_id = 0; row_id < row_count; row_id++) {
+          auto head = tbl->head(cf_id, row_id);
+          for (auto rv = head->older_rv; rv != nullptr; rv = rv->older_rv) {
+            if (rv->writer_thread_id() >= num_threads_) continue;
+            auto seq =
+                scan_seq[rv->writer_thread_id() * kMaxSlots + rv->slot_idx()];
+            if (seq == 0 || !rv->is_writer_seq(seq)) continue;
+
+            // An update links to the older version, which GC keeps while
+            // this version is uncommitted; only a new row has none.
+            if (head->older_rv == rv && rv->older_rv == nullptr) {
+              w->unlinks.push_back(Unlink{tbl, cf_id, row_id, rv});
+              break;
+            }
+            if (rv->status == RowVersionStatus::kAborted) continue;
+            rv->status = RowVersionStatus::kAborted;
+            if (StaticConfig::kPersistentCXL)
+              ::mica::util::write_back(&rv->status, sizeof(RowVersionStatus));
+            w->rollback_count++;
+          }
+        }
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (uint16_t i = 1; i < num_scan_threads; i++)
+    threads.emplace_back(scan, &workers[i]);
+  if (num_scan_threads != 0) scan(&workers[0]);
+  for (auto& t : threads) t.join();
+
+  // Row IDs and versions go back to the writer's context, which is not
+  // thread-safe.
+  uint64_t rollback_count = 0;
+  uint64_t unlink_count = 0;
+  for (auto& w : workers) {
+    rollback_count += w.rollback_count;
+    for (auto& u : w.unlinks) {
+      unlink_inserted_row(ctxs_[u.rv->writer_thread_id()], u.tbl, u.cf_id,
+                          u.row_id, u.rv);
+      unlink_count++;
+    }
+  }
+  return std::make_pair(rollback_count, unlink_count);
+}
+}
+}
+
+#endif
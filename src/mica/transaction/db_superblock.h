@@ -0,0 +1,233 @@
+#pragma once
+#ifndef MICA_TRANSACTION_DB_SUPERBLOCK_H_
+#define MICA_TRANSACTION_DB_SUPERBLOCK_H_
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace mica {
+namespace transaction {
+// Durable DBs (see Superblock).
+//
+// A new durable DB formats the superblock at the end of its construction,
+// after the commit slots and min_wts are allocated.  From then on, the CXL
+// page pools mirror their free lists into the superblock, and each new table
+// and index is recorded as it is created.  A DB given an attached superblock
+// instead adopts the recorded commit slots and min_wts, recreates the tables
+// and indexes on their recorded pages, and recovers the transactions that
+// were in flight.
+//
+// A shared DB is formatted by the first process, which also creates every
+// table; the others attach while it runs.  Each process registers the thread
+// IDs it uses, and the leaders of all processes merge their minimum
+// timestamps through the superblock.
+template <class StaticConfig>
+void DB<StaticConfig>::format_superblock() {
+  typedef SuperblockLayout<StaticConfig> Layout;
+
+  uint8_t numa_id;
+  char* page = allocate_cxl_page(&numa_id);
+  if (page == nullptr) {
+    fprintf(stderr, "error: failed to allocate the superblock\n");
+    superblock_ = nullptr;
+    return;
+  }
+
+  auto layout = superblock_->begin_format(page);
+  layout->num_threads = num_threads_;
+
+  std::vector<size_t> file_ids;
+  for (uint8_t i = 0; i < cxl_topology_.node_count(); i++) {
+    auto pool = page_pools_[cxl_topology_.node(i)];
+    if (pool == nullptr) continue;
+    if (layout->pool_count == Layout::kMaxPools || !pool->file_ids(&file_ids) ||
+        file_ids.size() > Layout::kMaxFileIDs - layout->file_id_count) {
+      fprintf(stderr, "error: too many pages for the superblock\n");
+      assert(false);
+      break;
+    }
+
+    auto pool_i = layout->pool_count;
+    layout->pool_file_id_offsets[pool_i] = layout->file_id_count;
+    for (auto file_id : file_ids)
+      layout->file_ids()[layout->file_id_count++] =
+          static_cast<uint32_t>(file_id);
+    if (!pool->set_record(&layout->pools[pool_i])) {
+      fprintf(stderr,
+              "error: the page pool on numa node %" PRIu8
+              " has grown before the superblock\n",
+              pool->numa_id());
+      assert(false);
+      break;
+    }
+    layout->pool_count++;
+  }
+
+  layout->min_wts = min_wts_;
+  Superblock<StaticConfig>::persist(min_wts_, sizeof(*min_wts_));
+  layout->min_rts.init(min_rts_.get());
+  for (uint16_t thread_id = 0; thread_id < num_threads_; thread_id++) {
+    auto ctx = ctxs_[thread_id];
+    layout->threads[thread_id].slots = ctx->slots_;
+    layout->threads[thread_id].slots_numa_id = ctx->slots_numa_id_;
+    Superblock<StaticConfig>::persist(
+        ctx->slots_,
+        Context<StaticConfig>::kMaxSlots * sizeof(CommitSlot<StaticConfig>));
+  }
+  layout->table_count = 0;
+
+  superblock_->finish_format();
+  register_threads();
+}
+
+template <class StaticConfig>
+void DB<StaticConfig>::attach_superblock() {
+  auto layout = superblock_->layout();
+
+  min_wts_ = layout->min_wts;
+  attach_clock_reference();
+  // A shared min_rts can be ahead of min_wts until the next quiescence.
+  min_rts_.init(shared() ? layout->min_rts.get() : min_wts_->get());
+  ref_clock_ = 0;
+
+  // Tables come before the indexes that refer to them.
+  for (uint32_t i = 0; i < layout->table_count; i++) {
+    auto& record = layout->tables[i];
+    std::string name(record.name);
+
+    Table<StaticConfig>* main_tbl = nullptr;
+    if (record.kind != SuperblockTableKind::kTable &&
+        record.kind != SuperblockTableKind::kCXLTable) {
+      std::string main_name(record.main_table);
+      if (record.main_kind == SuperblockTableKind::kCXLTable)
+        main_tbl = cxl_tables_[main_name];
+      else
+        main_tbl = tables_[main_name];
+    }
+
+    auto tbl = record.kind == SuperblockTableKind::kCXLTable
+                   ? new CXLTable<StaticConfig>(this, record.cf_count,
+                                                record.data_size_hints, &record)
+                   : new Table<StaticConfig>(this, record.cf_count,
+                                             record.data_size_hints, &record);
+    switch (record.kind) {
+      case SuperblockTableKind::kTable:
+        tables_[name] = tbl;
+        break;
+      case SuperblockTableKind::kCXLTable:
+        cxl_tables_[name] = tbl;
+        break;
+      case SuperblockTableKind::kHashIndexUniqueU64:
+        hash_idxs_unique_u64_[name] = new HashIndexUniqueU64(
+            this, main_tbl, tbl, record.expected_num_rows);
+        break;
+      case SuperblockTableKind::kHashIndexNonuniqueU64:
+        hash_idxs_nonunique_u64_[name] = new HashIndexNonuniqueU64(
+            this, main_tbl, tbl, record.expected_num_rows);
+        break;
+      case SuperblockTableKind::kBTreeIndexUniqueU64:
+        btree_idxs_unique_u64_[name] =
+            new BTreeIndexUniqueU64(this, main_tbl, tbl);
+        break;
+      case SuperblockTableKind::kBTreeIndexNonuniqueU64:
+        btree_idxs_nonunique_u64_[name] =
+            new BTreeIndexNonuniqueU64(this, main_tbl, tbl);
+        break;
+    }
+  }
+  printf("attached %" PRIu32 " tables and indexes\n", layout->table_count);
+
+  register_threads();
+  recover();
+}
+
+template <class StaticConfig>
+void DB<StaticConfig>::register_threads() {
+  if (!shared()) return;
+  // Its counter is private to the process.
+  if (std::is_same<Timestamp, CentralizedTimestamp>::value) {
+    fprintf(stderr, "error: a shared DB cannot use CentralizedTimestamp\n");
+    assert(false);
+    return;
+  }
+  if (!superblock_->register_process(num_threads_, min_wts(), min_rts())) {
+    assert(false);
+    return;
+  }
+  thread_begin_ = superblock_->thread_begin();
+  thread_end_ = superblock_->thread_end();
+  printf("shared DB: threads %" PRIu16 "-%" PRIu16 " of %" PRIu16 "\n",
+         thread_begin_, static_cast<uint16_t>(thread_end_ - 1), num_threads_);
+}
+
+template <class StaticConfig>
+bool DB<StaticConfig>::can_record_table(const std::string& name) const {
+  if (superblock_ == nullptr) return true;
+  if (shared() && superblock_->attached()) {
+    fprintf(stderr,
+            "error: only the process that formats a shared DB creates "
+            "tables: %s\n",
+            name.c_str());
+    return false;
+  }
+  if (name.size() > SuperblockTable<StaticConfig>::kMaxNameLength) {
+    fprintf(stderr, "error: too long name for a durable table: %s\n",
+            name.c_str());
+    return false;
+  }
+  if (superblock_->layout()->table_count ==
+      SuperblockLayout<StaticConfig>::kMaxTables) {
+    fprintf(stderr, "error: too many durable tables\n");
+    return false;
+  }
+  return true;
+}
+
+template <class StaticConfig>
+void DB<StaticConfig>::record_table(const std::string& name,
+                                    SuperblockTableKind kind,
+                                    Table<StaticConfig>* tbl,
+                                    const Table<StaticConfig>* main_tbl,
+                                    uint64_t expected_num_rows) {
+  if (superblock_ == nullptr) return;
+  auto layout = superblock_->layout();
+  auto& record = layout->tables[layout->table_count];
+
+  record = SuperblockTable<StaticConfig>();
+  strcpy(record.name, name.c_str());
+  record.kind = kind;
+  if (main_tbl != nullptr) {
+    record.main_kind = SuperblockTableKind::kTable;
+    for (auto& e : tables_)
+      if (e.second == main_tbl) strcpy(record.main_table, e.first.c_str());
+    for (auto& e : cxl_tables_)
+      if (e.second == main_tbl) {
+        strcpy(record.main_table, e.first.c_str());
+        record.main_kind = SuperblockTableKind::kCXLTable;
+      }
+  }
+  record.cf_count = tbl->cf_count_;
+  for (uint16_t cf_id = 0; cf_id < tbl->cf_count_; cf_id++)
+    record.data_size_hints[cf_id] = tbl->data_size_hint(cf_id);
+  record.expected_num_rows = expected_num_rows;
+  record.base_root = tbl->base_root_;
+  record.root = tbl->root_;
+  record.page_numa_ids = tbl->page_numa_ids_;
+  record.metadata_numa_id = tbl->metadata_numa_id_;
+  record.rows.lock = 0;
+  record.rows.row_count = tbl->row_count();
+  tbl->rows_ = &record.rows;
+
+  // The new root is empty; make it durable with the record.
+  Superblock<StaticConfig>::persist(tbl->base_root_,
+                                    PagePool<StaticConfig>::kPageSize);
+  Superblock<StaticConfig>::persist(&record, sizeof(record));
+  layout->table_count++;
+  Superblock<StaticConfig>::persist(&layout->table_count,
+                                    sizeof(layout->table_count));
+}
+}
+}
+
+#endif
@@ -0,0 +1,63 @@
+#pragma once
+#ifndef MICA_TRANSACTION_DB_TRACE_H_
+#define MICA_TRANSACTION_DB_TRACE_H_
+
+#include <vector>
+
+namespace mica {
+namespace transaction {
+template <class StaticConfig>
+void DB<StaticConfig>::set_trace_sampling(uint64_t every_n) {
+  for (uint16_t thread_id = 0; thread_id < num_threads_; thread_id++)
+    ctxs_[thread_id]->set_trace_sampling(every_n);
+}
+
+template <class StaticConfig>
+bool DB<StaticConfig>::dump_trace(const char* path) const {
+  if (!StaticConfig::kEnableTxTrace) return false;
+
+  std::vector<TxTraceRecord> records;
+  for (uint16_t thread_id = 0; thread_id < num_threads_; thread_id++) {
+    auto ring = ctxs_[thread_id]->trace_ring();
+    if (ring == nullptr) continue;
+    auto offset = records.size();
+    records.resize(offset + ring->capacity());
+    records.resize(offset + ring->snapshot(records.data() + offset,
+                                           ring->capacity()));
+  }
+
+  // Table names let the converter resolve abort_tbl.
+  std::vector<TxTraceFileTable> tables;
+  for (auto& e : tables_) {
+    TxTraceFileTable t;
+    ::memset(&t, 0, sizeof(t));
+    t.id = reinterpret_cast<uint64_t>(e.second);
+    ::strncpy(t.name, e.first.c_str(), sizeof(t.name) - 1);
+    tables.push_back(t);
+  }
+
+  FILE* fp = fopen(path, "wb");
+  if (fp == nullptr) {
+    fprintf(stderr, "error: failed to open %s\n", path);
+    return false;
+  }
+
+  TxTraceFileHeader header;
+  header.magic = TxTraceFileHeader::kMagic;
+  header.c_1_sec = sw_->c_1_sec();
+  header.table_count = tables.size();
+  header.record_count = records.size();
+
+  bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+            fwrite(tables.data(), sizeof(TxTraceFileTable), tables.size(),
+                   fp) == tables.size() &&
+            fwrite(records.data(), sizeof(TxTraceRecord), records.size(),
+                   fp) == records.size();
+  if (fclose(fp) != 0) ok = false;
+  if (!ok) fprintf(stderr, "error: failed to write %s\n", path);
+  return ok;
+}
+}
+}
+
+#endif
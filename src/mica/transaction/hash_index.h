@@ -91,6 +91,7 @@ class HashIndex {
 
   // hash_index_impl/prefetch.h
   void prefetch(Transaction* tx, const Key& key);
+  void prefetch(Transaction* tx, const Key* keys, size_t count);
 
   Table<StaticConfig>* main_table() { return main_tbl_; }
   const Table<StaticConfig>* main_table() const { return main_tbl_; }
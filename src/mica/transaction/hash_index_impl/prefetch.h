@@ -15,6 +15,18 @@ void HashIndex<StaticConfig, UniqueKey, Key, Hash, KeyEqual>::prefetch(
   RowAccessHandlePeekOnly rah(tx);
   rah.prefetch_row(idx_tbl_, 0, bkt_id, 0, sizeof(Bucket));
 }
+
+template <class StaticConfig, bool UniqueKey, class Key, class Hash,
+          class KeyEqual>
+void HashIndex<StaticConfig, UniqueKey, Key, Hash, KeyEqual>::prefetch(
+    Transaction* tx, const Key* keys, size_t count) {
+  Timing t(tx->context()->timing_stack(), &Stats::index_read);
+
+  for (size_t i = 0; i < count; i++) {
+    auto bkt_id = get_bucket_id(keys[i]);
+    tx->prefetch_row(idx_tbl_, 0, bkt_id, 0, sizeof(Bucket));
+  }
+}
 }
 }
 
@@ -2,97 +2,409 @@
 #ifndef MICA_TRANSACTION_PAGE_POOL_H_
 #define MICA_TRANSACTION_PAGE_POOL_H_
 
+#include <algorithm>
+#include <cassert>
 #include <cstdio>
+#include <vector>
+#include "mica/transaction/cxl_ptr.h"
+#include "mica/transaction/shared_lock.h"
+#include "mica/util/barrier.h"
 #include "mica/util/lcore.h"
 
 namespace mica {
 namespace transaction {
+// The durable state of a PagePool whose region outlives the process (see
+// Superblock).  The free list is linked through the free pages themselves,
+// so the head and the count are all that is needed to resume allocation.
+// The processes that share the region allocate from the record itself under
+// its lock.
+struct PagePoolRecord {
+  CXLPtr<char> base;
+  uint64_t page_count;
+  volatile CXLPtr<char> next;
+  volatile uint64_t free_count;
+  uint8_t numa_id;
+  volatile uint32_t lock;  // A SharedLock.
+};
+
+// A pool of 2 MiB pages on one NUMA node.  The pool starts with size bytes
+// and, if max_size is larger, maps more memory from Alloc in chunks of
+// StaticConfig::kPagePoolChunkSize when its free pages fall below the grow
+// watermark.  A chunk that becomes entirely free is returned to Alloc while
+// the pool has more free pages than the shrink watermark.  The initial region
+// is never returned.
+//
+// A pool with a PagePoolRecord (set_record() or adopt_record()) keeps its
+// free list in the record and no longer grows, as only the initial region is
+// recorded.
 template <class StaticConfig>
 class PagePool {
  public:
   typedef typename StaticConfig::Alloc Alloc;
 
   static constexpr uint64_t kPageSize = 2 * 1048576;
+  static constexpr uint64_t kChunkPageCount =
+      StaticConfig::kPagePoolChunkSize / kPageSize;
+
+  static_assert(kChunkPageCount > 0, "Too small kPagePoolChunkSize");
+  static_assert(StaticConfig::kPagePoolShrinkWatermark >
+                    StaticConfig::kPagePoolGrowWatermark,
+                "The shrink watermark must be above the grow watermark");
 
-  PagePool(Alloc* alloc, uint64_t size, uint8_t numa_id)
+  PagePool(Alloc* alloc, uint64_t size, uint8_t numa_id, uint64_t max_size = 0)
       : alloc_(alloc), numa_id_(numa_id) {
     uint64_t page_count = (size + kPageSize - 1) / kPageSize;
     size_ = page_count * kPageSize;
 
     lock_ = 0;
-    total_count_ = page_count;
-    free_count_ = page_count;
+    total_count_ = 0;
+    free_count_ = 0;
+    max_count_ = std::max(page_count, (max_size + kPageSize - 1) / kPageSize);
+    alloc_hint_ = 0;
+    growing_ = false;
+    grow_failed_ = false;
+    grow_count_ = 0;
+    shrink_count_ = 0;
+    record_ = nullptr;
 
-    pages_ =
-        reinterpret_cast<char*>(alloc_->malloc_contiguous(size_, numa_id_));
-    if (!pages_) {
+    auto pages = reinterpret_cast<char*>(
+        alloc_->malloc_contiguous_on_node(size_, numa_id_));
+    if (!pages) {
       printf("failed to initialize PagePool\n");
       return;
     }
-    for (uint64_t i = 0; i < page_count; i++)
-      *reinterpret_cast<char**>(pages_ + i * kPageSize) =
-          pages_ + (i + 1) * kPageSize;
+    link_pages(pages, page_count);
+    add_chunk(pages, page_count);
+
+    if (max_count_ > page_count)
+      printf(
+          "initialized PagePool on numa node %" PRIu8
+          " with %.3lf GB (up to %.3lf GB)\n",
+          numa_id_, static_cast<double>(size) / 1000000000.,
+          static_cast<double>(max_count_ * kPageSize) / 1000000000.);
+    else
+      printf("initialized PagePool on numa node %" PRIu8 " with %.3lf GB\n",
+             numa_id_, static_cast<double>(size) / 1000000000.);
+  }
+
+  // Maps the region of a recorded pool again at record.base, which is where
+  // cxl_base() places it in this process, and resumes from its recorded free
+  // list.  file_ids come from file_ids() of
+  // the original pool.
+  PagePool(Alloc* alloc, const PagePoolRecord& record,
+           const std::vector<size_t>& file_ids)
+      : alloc_(alloc), numa_id_(record.numa_id) {
+    size_ = record.page_count * kPageSize;
 
-    *reinterpret_cast<char**>(pages_ + (page_count - 1) * kPageSize) = nullptr;
-    next_ = pages_;
+    lock_ = 0;
+    total_count_ = 0;
+    free_count_ = 0;
+    max_count_ = record.page_count;
+    alloc_hint_ = 0;
+    growing_ = false;
+    grow_failed_ = false;
+    grow_count_ = 0;
+    shrink_count_ = 0;
+    record_ = nullptr;
+
+    char* base = record.base;
+    if (file_ids.size() != record.page_count ||
+        alloc_->attach_contiguous(base, file_ids) != base) {
+      printf("failed to attach PagePool on numa node %" PRIu8 "\n", numa_id_);
+      return;
+    }
+    chunks_.push_back(
+        Chunk{base, record.page_count, record.free_count, record.next});
+    total_count_ = record.page_count;
+    free_count_ = record.free_count;
 
-    printf("initialized PagePool on numa node %" PRIu8 " with %.3lf GB\n",
-           numa_id_, static_cast<double>(size) / 1000000000.);
+    printf("attached PagePool on numa node %" PRIu8
+           " with %.3lf GB (%.3lf GB free)\n",
+           numa_id_, static_cast<double>(size_) / 1000000000.,
+           static_cast<double>(free_count_ * kPageSize) / 1000000000.);
   }
 
-  ~PagePool() { alloc_->free_striped(pages_); }
+  ~PagePool() {
+    for (auto& chunk : chunks_)
+      if (chunk.base != nullptr) alloc_->free_contiguous(chunk.base);
+  }
 
   char* allocate() {
-    while (__sync_lock_test_and_set(&lock_, 1) == 1) ::mica::util::pause();
+    if (record_ != nullptr) return allocate_recorded();
 
-    auto p = next_;
-    if (next_) {
-      next_ = *reinterpret_cast<char**>(next_);
-      free_count_--;
-    }
+    while (true) {
+      lock();
 
-    __sync_lock_release(&lock_);
+      char* p = nullptr;
+      for (size_t i = alloc_hint_; i < chunks_.size(); i++) {
+        auto& chunk = chunks_[i];
+        if (chunk.next == nullptr) continue;
+        p = chunk.next;
+        chunk.next = *reinterpret_cast<CXLPtr<char>*>(p);
+        chunk.free_count--;
+        free_count_--;
+        alloc_hint_ = i;
+        break;
+      }
+      if (p == nullptr) alloc_hint_ = chunks_.size();
 
-    return p;
+      bool grow = !growing_ && !grow_failed_ &&
+                  free_count_ < StaticConfig::kPagePoolGrowWatermark &&
+                  total_count_ < max_count_;
+      if (grow) growing_ = true;
+      bool wait = p == nullptr && !grow && growing_;
+
+      unlock();
+
+      // Growing maps memory, so it happens outside the lock; other threads
+      // keep allocating from the pages below the watermark meanwhile.
+      if (grow && this->grow() && p == nullptr) continue;
+      if (wait) {
+        while (growing_) ::mica::util::pause();
+        continue;
+      }
+      return p;
+    }
   }
 
   void free(char* p) {
-    while (__sync_lock_test_and_set(&lock_, 1) == 1) ::mica::util::pause();
+    if (record_ != nullptr) {
+      free_recorded(p);
+      return;
+    }
 
-    *reinterpret_cast<char**>(p) = next_;
-    next_ = p;
+    lock();
+
+    size_t i = chunk_of(p);
+    auto& chunk = chunks_[i];
+    *reinterpret_cast<CXLPtr<char>*>(p) = chunk.next;
+    chunk.next = p;
+    chunk.free_count++;
     free_count_++;
+    if (alloc_hint_ > i) alloc_hint_ = i;
 
-    __sync_lock_release(&lock_);
+    // Release the chunk if it is idle and the pool stays above the grow
+    // watermark without it.
+    char* release = nullptr;
+    if (i != 0 && chunk.free_count == chunk.page_count &&
+        free_count_ > StaticConfig::kPagePoolShrinkWatermark &&
+        free_count_ - chunk.page_count >=
+            StaticConfig::kPagePoolGrowWatermark) {
+      release = chunk.base;
+      total_count_ -= chunk.page_count;
+      free_count_ -= chunk.page_count;
+      chunk.base = nullptr;
+      chunk.next = nullptr;
+      chunk.page_count = 0;
+      chunk.free_count = 0;
+      grow_failed_ = false;
+      shrink_count_++;
+    }
+
+    unlock();
+
+    if (release != nullptr) alloc_->free_contiguous(release);
   }
 
   uint8_t numa_id() const { return numa_id_; }
 
+  // The initial region and the IDs of the Alloc files that back it, in
+  // order.
+  char* base() const { return chunks_.empty() ? nullptr : chunks_[0].base; }
+  uint64_t base_page_count() const {
+    return chunks_.empty() ? 0 : chunks_[0].page_count;
+  }
+  bool file_ids(std::vector<size_t>* out) const {
+    return !chunks_.empty() &&
+           alloc_->contiguous_file_ids(chunks_[0].base, out);
+  }
+
+  // Moves the free list into record.  Fails if the pool has already grown.
+  bool set_record(PagePoolRecord* record) {
+    lock();
+    bool ok = chunks_.size() == 1;
+    if (ok) {
+      record->base = chunks_[0].base;
+      record->page_count = chunks_[0].page_count;
+      record->numa_id = numa_id_;
+      record->next = chunks_[0].next;
+      record->free_count = chunks_[0].free_count;
+      record->lock = 0;
+      if (StaticConfig::kPersistentCXL) {
+        ::mica::util::write_back(record, sizeof(*record));
+        ::mica::util::sfence();
+      }
+      record_ = record;
+      max_count_ = total_count_;
+    }
+    unlock();
+    return ok;
+  }
+
+  // Continues from the free list in record, which the pool was attached
+  // from and other processes may be using.
+  void adopt_record(PagePoolRecord* record) {
+    assert(chunks_.size() == 1 && chunks_[0].base == record->base.get());
+    record_ = record;
+  }
+
   uint64_t total_count() const { return total_count_; }
-  uint64_t free_count() const { return free_count_; }
+  uint64_t free_count() const {
+    return record_ != nullptr ? record_->free_count : free_count_;
+  }
+  uint64_t max_count() const { return max_count_; }
+
+  // The number of chunks mapped and returned since the construction.
+  uint64_t grow_count() const { return grow_count_; }
+  uint64_t shrink_count() const { return shrink_count_; }
 
   void print_status() const {
     printf("PagePool on numa node %" PRIu8 "\n", numa_id_);
+    uint64_t free_count = this->free_count();
     printf("  in use: %7.3lf GB\n",
-           static_cast<double>((total_count_ - free_count_) * kPageSize) /
+           static_cast<double>((total_count_ - free_count) * kPageSize) /
                1000000000.);
     printf("  free:   %7.3lf GB\n",
-           static_cast<double>(free_count_ * kPageSize) / 1000000000.);
+           static_cast<double>(free_count * kPageSize) / 1000000000.);
     printf("  total:  %7.3lf GB\n",
            static_cast<double>(total_count_ * kPageSize) / 1000000000.);
+    if (max_count_ > size_ / kPageSize) {
+      printf("  max:    %7.3lf GB\n",
+             static_cast<double>(max_count_ * kPageSize) / 1000000000.);
+      printf("  chunks: %" PRIu64 " grown, %" PRIu64 " released\n",
+             grow_count_, shrink_count_);
+    }
   }
 
  private:
+  struct Chunk {
+    char* base;
+    uint64_t page_count;
+    uint64_t free_count;
+    char* next;
+  };
+
+  void lock() {
+    while (__sync_lock_test_and_set(&lock_, 1) == 1) ::mica::util::pause();
+  }
+
+  void unlock() { __sync_lock_release(&lock_); }
+
+  // The record may be shared by processes (see SharedLock).
+  void lock_record() { SharedLock::lock(&record_->lock); }
+
+  void unlock_record() { SharedLock::unlock(&record_->lock); }
+
+  // Requires the record lock.
+  void persist_record() {
+    if (StaticConfig::kPersistentCXL) {
+      ::mica::util::write_back(record_, sizeof(*record_));
+      ::mica::util::sfence();
+    }
+  }
+
+  char* allocate_recorded() {
+    lock_record();
+    char* p = record_->next;
+    if (p != nullptr) {
+      record_->next = *reinterpret_cast<CXLPtr<char>*>(p);
+      record_->free_count--;
+      persist_record();
+    }
+    unlock_record();
+    return p;
+  }
+
+  void free_recorded(char* p) {
+    assert(chunk_of(p) == 0);
+    lock_record();
+    *reinterpret_cast<CXLPtr<char>*>(p) = record_->next;
+    // The link must be durable before the record points to the page.
+    if (StaticConfig::kPersistentCXL)
+      ::mica::util::write_back(p, sizeof(CXLPtr<char>));
+    record_->next = p;
+    record_->free_count++;
+    persist_record();
+    unlock_record();
+  }
+
+  // The links are relative so that a recorded free list stays valid when the
+  // region is attached elsewhere.
+  static void link_pages(char* base, uint64_t page_count) {
+    for (uint64_t i = 0; i < page_count - 1; i++)
+      *reinterpret_cast<CXLPtr<char>*>(base + i * kPageSize) =
+          base + (i + 1) * kPageSize;
+    *reinterpret_cast<CXLPtr<char>*>(base + (page_count - 1) * kPageSize) =
+        nullptr;
+  }
+
+  // Adds a chunk of linked pages to the pool.  Requires the lock unless
+  // called from the constructor.
+  void add_chunk(char* base, uint64_t page_count) {
+    Chunk chunk{base, page_count, page_count, base};
+    size_t i;
+    for (i = 0; i < chunks_.size(); i++)
+      if (chunks_[i].base == nullptr) break;
+    if (i == chunks_.size())
+      chunks_.push_back(chunk);
+    else
+      chunks_[i] = chunk;
+
+    total_count_ += page_count;
+    free_count_ += page_count;
+    if (alloc_hint_ > i) alloc_hint_ = i;
+  }
+
+  bool grow() {
+    uint64_t page_count = std::min(kChunkPageCount, max_count_ - total_count_);
+    auto base = reinterpret_cast<char*>(
+        alloc_->malloc_contiguous_on_node(page_count * kPageSize, numa_id_));
+    if (base != nullptr) link_pages(base, page_count);
+
+    lock();
+    if (base != nullptr) {
+      add_chunk(base, page_count);
+      grow_count_++;
+    } else {
+      // Stop retrying until a chunk goes back to Alloc.
+      grow_failed_ = true;
+    }
+    growing_ = false;
+    unlock();
+
+    return base != nullptr;
+  }
+
+  size_t chunk_of(const char* p) const {
+    for (size_t i = 0; i < chunks_.size(); i++) {
+      auto& chunk = chunks_[i];
+      if (chunk.base <= p && p < chunk.base + chunk.page_count * kPageSize)
+        return i;
+    }
+    assert(false);
+    return 0;
+  }
+
   Alloc* alloc_;
   uint64_t size_;
   uint8_t numa_id_;
 
   uint64_t total_count_;
-  char* pages_;
+  uint64_t max_count_;
 
   volatile uint32_t lock_;
   uint64_t free_count_;
-  char* next_;
+  // Chunk 0 is the initial region.  Released chunks leave an empty slot.
+  std::vector<Chunk> chunks_;
+  // No chunk below this index has a free page.
+  size_t alloc_hint_;
+
+  volatile bool growing_;
+  bool grow_failed_;
+  uint64_t grow_count_;
+  uint64_t shrink_count_;
+
+  PagePoolRecord* record_;
 } __attribute__((aligned(64)));
 }
 }
@@ -0,0 +1,126 @@
+#pragma once
+#ifndef MICA_TRANSACTION_PERF_COUNTER_H_
+#define MICA_TRANSACTION_PERF_COUNTER_H_
+
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "mica/common.h"
+
+namespace mica {
+namespace transaction {
+enum class PerfCounter : uint8_t {
+  kCycles = 0,
+  kInstructions,
+  kLLCMisses,
+  // Loads served by another NUMA node, including CPU-less (CXL) nodes.
+  kRemoteLoads,
+  kCount,
+};
+
+static constexpr uint8_t kPerfCounterCount =
+    static_cast<uint8_t>(PerfCounter::kCount);
+
+static const char* const kPerfCounterNames[kPerfCounterCount] = {
+    "cycles", "instructions", "llc_misses", "remote_loads",
+};
+
+// A perf_event_open() counter group that counts the user-space events of the
+// thread that opened it.  Events that the PMU does not expose are skipped and
+// read as zero.
+class PerfCounterGroup {
+ public:
+  PerfCounterGroup() : member_count_(0) {
+    for (uint8_t i = 0; i < kPerfCounterCount; i++) {
+      fds_[i] = -1;
+      slot_[i] = -1;
+    }
+  }
+
+  ~PerfCounterGroup() { close(); }
+
+  PerfCounterGroup(const PerfCounterGroup&) = delete;
+  PerfCounterGroup& operator=(const PerfCounterGroup&) = delete;
+
+  // Opens the group for the calling thread.  Returns false if even the cycle
+  // counter is unavailable (e.g., due to perf_event_paranoid).
+  bool open() {
+    close();
+
+    static const uint32_t types[kPerfCounterCount] = {
+        PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+        PERF_TYPE_HW_CACHE,
+    };
+    static const uint64_t configs[kPerfCounterCount] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_CACHE_NODE | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+    };
+
+    for (uint8_t i = 0; i < kPerfCounterCount; i++) {
+      struct perf_event_attr attr;
+      ::memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = types[i];
+      attr.config = configs[i];
+      attr.read_format = PERF_FORMAT_GROUP;
+      attr.disabled = (i == 0) ? 1 : 0;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+
+      int group_fd = (i == 0) ? -1 : fds_[0];
+      int fd = static_cast<int>(
+          ::syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0));
+      if (fd < 0) {
+        if (i == 0) return false;
+        continue;
+      }
+      fds_[i] = fd;
+      slot_[i] = static_cast<int8_t>(member_count_++);
+    }
+
+    ::ioctl(fds_[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ::ioctl(fds_[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    return true;
+  }
+
+  void close() {
+    for (uint8_t i = kPerfCounterCount; i > 0; i--) {
+      if (fds_[i - 1] != -1) ::close(fds_[i - 1]);
+      fds_[i - 1] = -1;
+      slot_[i - 1] = -1;
+    }
+    member_count_ = 0;
+  }
+
+  bool is_open() const { return fds_[0] != -1; }
+
+  bool available(PerfCounter c) const {
+    return fds_[static_cast<uint8_t>(c)] != -1;
+  }
+
+  // Reads the current counter values (one read() for the whole group).
+  void read(uint64_t* values) const {
+    uint64_t buf[1 + kPerfCounterCount];
+    auto expected = sizeof(uint64_t) * (uint64_t(1) + member_count_);
+    if (!is_open() ||
+        ::read(fds_[0], buf, sizeof(buf)) < static_cast<ssize_t>(expected)) {
+      ::memset(values, 0, sizeof(uint64_t) * kPerfCounterCount);
+      return;
+    }
+    for (uint8_t i = 0; i < kPerfCounterCount; i++)
+      values[i] = slot_[i] == -1 ? 0 : buf[1 + slot_[i]];
+  }
+
+ private:
+  int fds_[kPerfCounterCount];
+  int8_t slot_[kPerfCounterCount];  // The position in the group read.
+  uint8_t member_count_;
+};
+}
+}
+
+#endif
@@ -2,7 +2,9 @@
 #ifndef MICA_TRANSACTION_ROW_H_
 #define MICA_TRANSACTION_ROW_H_
 
+#include <cassert>
 #include "mica/common.h"
+#include "mica/transaction/cxl_ptr.h"
 
 namespace mica {
 namespace transaction {
@@ -19,7 +21,8 @@ struct RowVersion;
 
 template <class StaticConfig>
 struct RowCommon {
-  RowVersion<StaticConfig>* volatile older_rv;
+  // Relative so that the chains survive remapping the CXL region.
+  volatile CXLPtr<RowVersion<StaticConfig>> older_rv;
 };
 
 template <class StaticConfig>
@@ -27,20 +30,55 @@ struct RowVersion : public RowCommon<StaticConfig> {
   typename StaticConfig::Timestamp wts;
   typename StaticConfig::ConcurrentTimestamp rts;
 
+  // These four fields share one 8-byte word.  status stays a whole byte
+  // because it is updated with a CAS.
   volatile RowVersionStatus status;
   uint8_t numa_id;     // NUMA node ID (set by Table or SharedRowVersionPool).
   uint16_t size_cls;   // Size class (set by Table or SharedRowVersionPool).
   uint32_t data_size;  // Data size (set by Context).
 
-  //新增:Slot引用字段
-  uint16_t writer_thread_id;
-  uint16_t slot_idx;
-  uint64_t writer_local_seq;
-  //新增结束
+  // The commit slot of the writer, packed as
+  // [thread ID (16 bits) | slot index (8 bits) | local sequence (40 bits)].
+  uint64_t writer_slot;
+
+  static constexpr uint64_t kWriterSeqBits = 40;
+  static constexpr uint64_t kWriterSlotIdxBits = 8;
+  static constexpr uint64_t kWriterSeqMask =
+      (uint64_t(1) << kWriterSeqBits) - 1;
+  static constexpr uint64_t kWriterSlotIdxMask =
+      (uint64_t(1) << kWriterSlotIdxBits) - 1;
+  static_assert(StaticConfig::kMaxSlots <= (uint64_t(1) << kWriterSlotIdxBits),
+                "too many commit slots for RowVersion::writer_slot");
+
+  void set_writer(uint16_t thread_id, uint32_t slot_idx, uint64_t local_seq) {
+    assert(slot_idx <= kWriterSlotIdxMask);
+    writer_slot =
+        (uint64_t(thread_id) << (kWriterSlotIdxBits + kWriterSeqBits)) |
+        (uint64_t(slot_idx) << kWriterSeqBits) | (local_seq & kWriterSeqMask);
+  }
+
+  uint16_t writer_thread_id() const {
+    return static_cast<uint16_t>(writer_slot >>
+                                 (kWriterSlotIdxBits + kWriterSeqBits));
+  }
+  uint16_t slot_idx() const {
+    return static_cast<uint16_t>((writer_slot >> kWriterSeqBits) &
+                                 kWriterSlotIdxMask);
+  }
+  // Returns true if the slot has not been reused since the write.  Only the
+  // low kWriterSeqBits of the sequence are compared.
+  bool is_writer_seq(uint64_t local_tx_seq) const {
+    return ((writer_slot ^ local_tx_seq) & kWriterSeqMask) == 0;
+  }
 
   static constexpr uint8_t kInlinedRowVersionNUMAID = static_cast<uint8_t>(-1);
   bool is_inlined() const { return numa_id == kInlinedRowVersionNUMAID; }
 
+  // The newest version of a row moved to the SSD tier is a stub holding an
+  // EvictedRowStub (see RowEvictor); its data_size carries kEvictedFlag.
+  static constexpr uint32_t kEvictedFlag = uint32_t(1) << 31;
+  bool is_evicted() const { return (data_size & kEvictedFlag) != 0; }
+
   char data[0] __attribute__((aligned(8)));
 };  // Alignment of Rows is handled by the row pool manually.
 
@@ -49,6 +87,18 @@ struct RowHead : public RowCommon<StaticConfig> {
   RowVersion<StaticConfig> inlined_rv[0] __attribute__((aligned(8)));
 };  // Alignment of Rows is handled by the table manually.
 
+// The maximum size of the data to inline in a row head, derived from the
+// actual header sizes so that a head stays within kInlinedRowSize bytes.
+template <class StaticConfig>
+struct RowLayout {
+  static constexpr uint64_t kHeaderSize =
+      sizeof(RowHead<StaticConfig>) + sizeof(RowVersion<StaticConfig>);
+  static_assert(StaticConfig::kInlinedRowSize > kHeaderSize,
+                "kInlinedRowSize is smaller than the row header");
+  static constexpr uint64_t kInlineThreshold =
+      StaticConfig::kInlinedRowSize - kHeaderSize;
+};
+
 template <class StaticConfig>
 struct RowGCInfo {
   typename StaticConfig::ConcurrentTimestamp gc_ts;
@@ -43,6 +43,9 @@ class Transaction;
 template <class StaticConfig>
 struct RowAccessItem;
 
+template <class StaticConfig>
+class RowEvictor;
+
 template <class StaticConfig>
 class RowAccessHandle {
  public:
@@ -154,6 +157,7 @@ class RowAccessHandle {
 
  private:
   friend Transaction<StaticConfig>;
+  friend RowEvictor<StaticConfig>;
 
   Transaction<StaticConfig>* tx_;
 
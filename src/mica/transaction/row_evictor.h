@@ -0,0 +1,585 @@
+#pragma once
+#ifndef MICA_TRANSACTION_ROW_EVICTOR_H_
+#define MICA_TRANSACTION_ROW_EVICTOR_H_
+
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <unistd.h>
+#include <vector>
+#include "mica/transaction/db.h"
+#include "mica/util/config.h"
+
+namespace mica {
+namespace transaction {
+// The data of an evicted row: where its record is in the log.
+struct EvictedRowStub {
+  uint64_t offset;
+  uint32_t data_size;
+  uint32_t record_size;
+};
+
+// The header of a row record in the log.  The row data follows; records are
+// padded to 8 bytes.
+struct EvictedRowRecord {
+  uint64_t row_id;
+  uint16_t cf_id;
+  uint16_t reserved;
+  uint32_t data_size;
+};
+
+// Moves cold rows to an append-only log file, normally on an SSD, as a third
+// storage tier below DRAM and CXL memory.
+//
+// A row is cold if its newest version is its only version and was neither
+// written nor read by a read-write transaction for "cold_age_ms" (rts >= wts,
+// so the rts check covers both).  Eviction appends the row data to the log and
+// overwrites the row with a stub version that records the log offset; GC then
+// frees the data version as usual.  Both steps run as ordinary transactions,
+// so concurrent writers simply win.
+//
+// A transaction that finds a stub requests a fault-in and fails the access
+// like a get_row abort.  An I/O thread reads the record back, and a worker
+// installs it as a new version between transactions; the retried transaction
+// then finds the row in memory.
+//
+// Each worker keeps one Transaction for this.  Its commits and aborts are
+// counted in stats(), not in the Context's stats.
+//
+// Config keys:
+//   "path":             the log file (default: "row_evictor.log"); it is
+//                       truncated by start()
+//   "tables":           the names of the tables to evict rows from
+//   "cold_age_ms":      the age of a cold row (default: 1000)
+//   "scan_interval_us": how often each worker looks for cold rows between
+//                       transactions; 0 leaves eviction to evict()
+//                       (default: 1000)
+//   "scan_rows":        the rows to look at per scan (default: 256)
+//   "max_evictions":    the rows to evict per scan at most (default: 16)
+//   "drop_cache_mb":    drop the log from the page cache after this many
+//                       MB are appended; 0 keeps it cached (default: 64)
+//
+// Only column families without inlining are evicted: an inlined row keeps
+// its head-sized slot anyway.  Dead records are not reclaimed from the log.
+template <class StaticConfig>
+class RowEvictor {
+ public:
+  typedef typename StaticConfig::Timestamp Timestamp;
+
+  RowEvictor(DB<StaticConfig>* db, const ::mica::util::Config& config)
+      : db_(db),
+        config_(config),
+        fd_(-1),
+        running_(false),
+        evict_count_(0),
+        fault_in_count_(0),
+        live_bytes_(0),
+        log_tail_(0),
+        log_dropped_(0),
+        ready_count_(0),
+        scan_target_(0),
+        scan_row_id_(0) {
+    if (!config_.exists()) return;
+    path_ = config_.get("path").get_str("row_evictor.log");
+    auto c_1_usec = db_->sw()->c_1_usec();
+    cold_age_ = config_.get("cold_age_ms").get_uint64(1000) * 1000 * c_1_usec;
+    scan_interval_ =
+        config_.get("scan_interval_us").get_uint64(1000) * c_1_usec;
+    scan_rows_ = config_.get("scan_rows").get_uint64(256);
+    max_evictions_ = config_.get("max_evictions").get_uint64(16);
+    drop_cache_bytes_ = config_.get("drop_cache_mb").get_uint64(64) * 1048576;
+  }
+
+  ~RowEvictor() { stop(); }
+
+  RowEvictor(const RowEvictor&) = delete;
+  RowEvictor& operator=(const RowEvictor&) = delete;
+
+  // Opens the log and registers with the DB.  The tables must exist.
+  bool start() {
+    if (running_) return true;
+    if (!config_.exists()) return false;
+
+    targets_.clear();
+    auto tables = config_.get("tables");
+    for (size_t i = 0; i < tables.size(); i++) {
+      auto name = tables.get(i).get_str();
+      auto tbl = db_->get_table(name);
+      if (tbl == nullptr) {
+        fprintf(stderr, "error: no table to evict rows from: %s\n",
+                name.c_str());
+        return false;
+      }
+      for (uint16_t cf_id = 0; cf_id < tbl->cf_count(); cf_id++) {
+        if (StaticConfig::kInlinedRowVersion && tbl->inlining(cf_id)) {
+          printf("RowEvictor: skipping inlined column family %" PRIu16
+                 " of %s\n",
+                 cf_id, name.c_str());
+          continue;
+        }
+        targets_.push_back(Target{tbl, cf_id});
+      }
+    }
+    if (targets_.empty()) {
+      fprintf(stderr, "error: no column family to evict rows from\n");
+      return false;
+    }
+
+    fd_ = ::open(path_.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd_ == -1) {
+      fprintf(stderr, "error: failed to open %s: %s\n", path_.c_str(),
+              strerror(errno));
+      return false;
+    }
+    log_tail_ = 0;
+    log_dropped_ = 0;
+    live_bytes_ = 0;
+
+    thread_states_.assign(db_->thread_count(), ThreadState());
+
+    running_ = true;
+    io_thread_ = std::thread([this] { run(); });
+    db_->set_row_evictor(this);
+
+    printf("RowEvictor: evicting rows of %zu column families to %s\n",
+           targets_.size(), path_.c_str());
+    return true;
+  }
+
+  // Unregisters from the DB.  Rows still evicted cannot be accessed
+  // afterwards, so stop only after the workers stop.
+  void stop() {
+    if (!running_) return;
+    db_->set_row_evictor(nullptr);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      running_ = false;
+    }
+    cv_.notify_all();
+    io_thread_.join();
+
+    for (auto& ts : thread_states_) {
+      delete ts.tx;
+      ts.tx = nullptr;
+    }
+
+    ::close(fd_);
+    fd_ = -1;
+  }
+
+  // Called by Transaction::maintenance() between transactions; installs
+  // faulted-in rows and periodically evicts cold rows.
+  void maintenance(uint16_t thread_id, uint64_t now) {
+    auto& ts = thread_states_[thread_id];
+    // Our own transactions end up here again.
+    if (ts.busy) return;
+
+    bool scan = scan_interval_ != 0 &&
+                static_cast<int64_t>(now - ts.last_scan) >=
+                    static_cast<int64_t>(scan_interval_);
+    if (ready_count_ == 0 && !scan) return;
+
+    ts.busy = true;
+    if (ready_count_ != 0) install_ready(thread_id);
+    if (scan) {
+      ts.last_scan = now;
+      evict_rows(thread_id, scan_rows_, max_evictions_);
+    }
+    ts.busy = false;
+  }
+
+  // Looks at the next scan_rows rows and evicts up to max_evictions cold
+  // ones.  Must be called by an active thread between its transactions.
+  // Returns the number of evicted rows.
+  uint64_t evict(uint16_t thread_id, uint64_t scan_rows,
+                 uint64_t max_evictions) {
+    auto& ts = thread_states_[thread_id];
+    if (ts.busy) return 0;
+    ts.busy = true;
+    auto count = evict_rows(thread_id, scan_rows, max_evictions);
+    ts.busy = false;
+    return count;
+  }
+
+  // Called by Transaction when it finds a stub.  Duplicate requests for a
+  // row are ignored until the row is installed.
+  void request_fault_in(Table<StaticConfig>* tbl, uint16_t cf_id,
+                        uint64_t row_id,
+                        const RowVersion<StaticConfig>* stub_rv) {
+    auto stub = reinterpret_cast<const EvictedRowStub*>(stub_rv->data);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!running_) return;
+    if (!pending_.insert(RowKey(tbl, cf_id, row_id)).second) return;
+    requests_.push_back(FaultIn{tbl, cf_id, row_id, *stub, {}});
+    cv_.notify_one();
+  }
+
+  const std::string& path() const { return path_; }
+
+  // The number of rows evicted and installed back since start().
+  uint64_t evict_count() const { return evict_count_; }
+  uint64_t fault_in_count() const { return fault_in_count_; }
+
+  // The bytes of the log and of its records that still back a stub.
+  uint64_t log_bytes() const { return log_tail_; }
+  uint64_t live_bytes() const { return live_bytes_; }
+
+  // The stats of the evicting and installing transactions.  They are updated
+  // without synchronization, as with Context::stats().
+  Stats stats() const {
+    Stats stats;
+    for (auto& ts : thread_states_) stats += ts.stats;
+    return stats;
+  }
+
+  void reset_stats() {
+    for (auto& ts : thread_states_) ts.stats.reset();
+  }
+
+ private:
+  struct Target {
+    Table<StaticConfig>* tbl;
+    uint16_t cf_id;
+  };
+
+  struct ThreadState {
+    ThreadState() : busy(false), last_scan(0), tx(nullptr) {}
+    bool busy;
+    uint64_t last_scan;
+    std::vector<char> buf;
+    Transaction<StaticConfig>* tx;
+    Stats stats;
+  } __attribute__((aligned(64)));
+
+  typedef std::tuple<const Table<StaticConfig>*, uint16_t, uint64_t> RowKey;
+
+  struct FaultIn {
+    Table<StaticConfig>* tbl;
+    uint16_t cf_id;
+    uint64_t row_id;
+    EvictedRowStub stub;
+    std::vector<char> record;
+  };
+
+  // The worker's transaction for eviction and fault-in, created on first use.
+  Transaction<StaticConfig>* transaction(uint16_t thread_id) {
+    auto& ts = thread_states_[thread_id];
+    if (ts.tx == nullptr) {
+      ts.tx = new Transaction<StaticConfig>(db_->context(thread_id));
+      // Rows may be evicted between is_cold() and the access.
+      ts.tx->access_evicted_ = true;
+      ts.tx->stats_ = &ts.stats;
+    }
+    return ts.tx;
+  }
+
+  static uint64_t record_size(uint32_t data_size) {
+    return (sizeof(EvictedRowRecord) + data_size + 7) & ~uint64_t(7);
+  }
+
+  bool is_cold(const RowVersion<StaticConfig>* rv,
+               const Timestamp& min_wts) const {
+    if (rv == nullptr || rv->status != RowVersionStatus::kCommitted ||
+        rv->is_inlined() || rv->is_evicted() || rv->older_rv != nullptr)
+      return false;
+    // A stub would not save memory.
+    if (rv->size_cls <= SharedRowVersionPool<StaticConfig>::data_size_to_class(
+                            sizeof(EvictedRowStub)))
+      return false;
+    auto rts = rv->rts.get();
+    return rts < min_wts && min_wts.clock_diff(rts) >= cold_age_;
+  }
+
+  // Claims the next range of rows to scan.
+  bool next_scan_range(uint64_t scan_rows, Target* target,
+                       uint64_t* row_id_begin, uint64_t* row_id_end) {
+    std::lock_guard<std::mutex> lock(scan_mutex_);
+    for (size_t i = 0; i < targets_.size(); i++) {
+      auto& t = targets_[scan_target_];
+      auto row_count = t.tbl->row_count();
+      if (scan_row_id_ < row_count) {
+        *target = t;
+        *row_id_begin = scan_row_id_;
+        *row_id_end = std::min(row_count, scan_row_id_ + scan_rows);
+        scan_row_id_ = *row_id_end;
+        return true;
+      }
+      scan_target_ = (scan_target_ + 1) % targets_.size();
+      scan_row_id_ = 0;
+    }
+    return false;
+  }
+
+  uint64_t evict_rows(uint16_t thread_id, uint64_t scan_rows,
+                      uint64_t max_evictions) {
+    Target target;
+    uint64_t row_id_begin;
+    uint64_t row_id_end;
+    if (!next_scan_range(scan_rows, &target, &row_id_begin, &row_id_end))
+      return 0;
+
+    auto tx = transaction(thread_id);
+    auto& buf = thread_states_[thread_id].buf;
+    auto min_wts = db_->min_wts();
+
+    uint64_t count = 0;
+    for (uint64_t row_id = row_id_begin;
+         row_id < row_id_end && count < max_evictions; row_id++) {
+      auto rv = target.tbl->head(target.cf_id, row_id)->older_rv;
+      if (!is_cold(rv, min_wts)) continue;
+      if (evict_row(tx, target, row_id, rv, &buf)) count++;
+    }
+
+    if (count != 0) drop_cached_log();
+    return count;
+  }
+
+  bool evict_row(Transaction<StaticConfig>* tx, const Target& target,
+                 uint64_t row_id, const RowVersion<StaticConfig>* rv,
+                 std::vector<char>* buf) {
+    if (!tx->begin()) return false;
+
+    RowAccessHandle<StaticConfig> rah(tx);
+    // Give up if the row changed since is_cold().
+    if (!rah.peek_row(target.tbl, target.cf_id, row_id, false, true, true) ||
+        !rah.read_row() || rah.access_item_->read_rv != rv) {
+      tx->abort(true);
+      return false;
+    }
+
+    EvictedRowStub stub;
+    stub.data_size = rv->data_size;
+    stub.record_size = static_cast<uint32_t>(record_size(stub.data_size));
+    stub.offset = __sync_fetch_and_add(&log_tail_, stub.record_size);
+
+    buf->assign(stub.record_size, 0);
+    auto record = reinterpret_cast<EvictedRowRecord*>(buf->data());
+    record->row_id = row_id;
+    record->cf_id = target.cf_id;
+    record->reserved = 0;
+    record->data_size = stub.data_size;
+    ::mica::util::memcpy(buf->data() + sizeof(EvictedRowRecord), rv->data,
+                         stub.data_size);
+
+    if (!write_log(buf->data(), stub.record_size, stub.offset)) {
+      tx->abort(true);
+      return false;
+    }
+
+    auto stub_copier = [&stub](uint16_t cf_id, RowVersion<StaticConfig>* dest,
+                               const RowVersion<StaticConfig>* src) {
+      (void)cf_id;
+      (void)src;
+      dest->data_size |= RowVersion<StaticConfig>::kEvictedFlag;
+      ::mica::util::memcpy(dest->data, &stub, sizeof(stub));
+      return true;
+    };
+    if (!rah.write_row(sizeof(EvictedRowStub), stub_copier)) {
+      tx->abort(true);
+      return false;
+    }
+
+    Result result;
+    if (!tx->commit(&result)) return false;
+
+    __sync_fetch_and_add(&evict_count_, uint64_t(1));
+    __sync_fetch_and_add(&live_bytes_, uint64_t(stub.record_size));
+    return true;
+  }
+
+  void install_ready(uint16_t thread_id) {
+    std::vector<FaultIn> ready;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ready.swap(ready_);
+      ready_count_ = 0;
+    }
+
+    auto tx = transaction(thread_id);
+
+    std::vector<FaultIn> retry;
+    std::vector<RowKey> done;
+    for (auto& f : ready) {
+      auto ret = install_row(tx, f);
+      if (ret == 0)
+        retry.push_back(std::move(f));
+      else
+        done.push_back(RowKey(f.tbl, f.cf_id, f.row_id));
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& key : done) pending_.erase(key);
+    for (auto& f : retry) ready_.push_back(std::move(f));
+    ready_count_ = ready_.size();
+  }
+
+  // Returns 1 if installed, 0 to retry later, and -1 if the stub is gone.
+  int install_row(Transaction<StaticConfig>* tx, const FaultIn& f) {
+    if (!tx->begin()) return 0;
+
+    RowAccessHandle<StaticConfig> rah(tx);
+    if (!rah.peek_row(f.tbl, f.cf_id, f.row_id, false, true, true) ||
+        !rah.read_row()) {
+      tx->abort(true);
+      return 0;
+    }
+    auto rv = rah.access_item_->read_rv;
+    if (!rv->is_evicted() ||
+        reinterpret_cast<const EvictedRowStub*>(rv->data)->offset !=
+            f.stub.offset) {
+      tx->abort(true);
+      return -1;
+    }
+
+    auto data = f.record.data() + sizeof(EvictedRowRecord);
+    auto data_copier = [&f, data](uint16_t cf_id,
+                                  RowVersion<StaticConfig>* dest,
+                                  const RowVersion<StaticConfig>* src) {
+      (void)cf_id;
+      (void)src;
+      ::mica::util::memcpy(dest->data, data, f.stub.data_size);
+      return true;
+    };
+    if (!rah.write_row(f.stub.data_size, data_copier)) {
+      tx->abort(true);
+      return 0;
+    }
+
+    Result result;
+    if (!tx->commit(&result)) return 0;
+
+    __sync_fetch_and_add(&fault_in_count_, uint64_t(1));
+    __sync_fetch_and_sub(&live_bytes_, uint64_t(f.stub.record_size));
+    return 1;
+  }
+
+  // The I/O thread: reads the requested records.
+  void run() {
+    while (true) {
+      FaultIn f;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return !running_ || !requests_.empty(); });
+        if (!running_) break;
+        f = std::move(requests_.front());
+        requests_.pop_front();
+      }
+
+      f.record.resize(f.stub.record_size);
+      bool ok = read_log(f.record.data(), f.stub.record_size, f.stub.offset);
+      auto record = reinterpret_cast<const EvictedRowRecord*>(f.record.data());
+      if (ok && (record->row_id != f.row_id || record->cf_id != f.cf_id ||
+                 record->data_size != f.stub.data_size)) {
+        fprintf(stderr, "error: corrupt row record at offset %" PRIu64 "\n",
+                f.stub.offset);
+        ok = false;
+      }
+
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (ok) {
+        ready_.push_back(std::move(f));
+        ready_count_ = ready_.size();
+      } else {
+        // Let a later access try again.
+        pending_.erase(RowKey(f.tbl, f.cf_id, f.row_id));
+      }
+    }
+  }
+
+  bool write_log(const char* buf, uint64_t len, uint64_t offset) {
+    uint64_t off = 0;
+    while (off < len) {
+      auto ret = ::pwrite(fd_, buf + off, len - off,
+                          static_cast<off_t>(offset + off));
+      if (ret < 0 && errno == EINTR) continue;
+      if (ret <= 0) {
+        fprintf(stderr, "error: failed to write %s: %s\n", path_.c_str(),
+                strerror(errno));
+        return false;
+      }
+      off += static_cast<uint64_t>(ret);
+    }
+    return true;
+  }
+
+  bool read_log(char* buf, uint64_t len, uint64_t offset) {
+    uint64_t off = 0;
+    while (off < len) {
+      auto ret = ::pread(fd_, buf + off, len - off,
+                         static_cast<off_t>(offset + off));
+      if (ret < 0 && errno == EINTR) continue;
+      if (ret <= 0) {
+        fprintf(stderr, "error: failed to read %s: %s\n", path_.c_str(),
+                ret == 0 ? "short read" : strerror(errno));
+        return false;
+      }
+      off += static_cast<uint64_t>(ret);
+    }
+    return true;
+  }
+
+  // Keeps evicted rows from staying in DRAM as page cache.  Only written-back
+  // pages can be dropped, hence the sync.
+  void drop_cached_log() {
+    if (drop_cache_bytes_ == 0) return;
+    uint64_t tail = log_tail_;
+    if (tail - log_dropped_ < drop_cache_bytes_) return;
+
+    std::unique_lock<std::mutex> lock(drop_mutex_, std::try_to_lock);
+    if (!lock.owns_lock()) return;
+    if (tail - log_dropped_ < drop_cache_bytes_) return;
+
+    ::fdatasync(fd_);
+    ::posix_fadvise(fd_, 0, 0, POSIX_FADV_DONTNEED);
+    log_dropped_ = tail;
+  }
+
+  DB<StaticConfig>* db_;
+  ::mica::util::Config config_;
+
+  std::string path_;
+  uint64_t cold_age_;       // In clock ticks.
+  uint64_t scan_interval_;  // In clock ticks.
+  uint64_t scan_rows_;
+  uint64_t max_evictions_;
+  uint64_t drop_cache_bytes_;
+
+  std::vector<Target> targets_;
+  std::vector<ThreadState> thread_states_;
+
+  int fd_;
+  bool running_;
+  std::thread io_thread_;
+
+  volatile uint64_t evict_count_;
+  volatile uint64_t fault_in_count_;
+  volatile uint64_t live_bytes_;
+  volatile uint64_t log_tail_;
+  uint64_t log_dropped_;
+  std::mutex drop_mutex_;
+
+  // Protects the fault-in state below.
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::set<RowKey> pending_;
+  std::deque<FaultIn> requests_;
+  std::vector<FaultIn> ready_;
+  // ready_.size(), for a lock-free check in maintenance().
+  volatile size_t ready_count_;
+
+  std::mutex scan_mutex_;
+  size_t scan_target_;
+  uint64_t scan_row_id_;
+};
+}
+}
+
+#endif
@@ -3,6 +3,8 @@
 #define MICA_TRANSACTION_ROW_VERSION_POOL_H_
 
 #include <cstdio>
+#include <cstdlib>
+#include <new>
 #include <vector>
 #include "mica/transaction/page_pool.h"
 #include "mica/transaction/row.h"
@@ -118,6 +120,12 @@ class SharedRowVersionPool {
 
   uint64_t total_count(uint16_t cls) const { return classes_[cls].total_count; }
   uint64_t free_count(uint16_t cls) const { return classes_[cls].free_count; }
+  // The number of free row version groups (approximate while running).
+  uint64_t free_group_count(uint16_t cls) const {
+    return classes_[cls].groups.size();
+  }
+  uint64_t page_count() const { return pages_.size(); }
+  uint8_t numa_id() const { return page_pool_->numa_id(); }
 
  private:
   void allocate(uint16_t cls) {
@@ -199,6 +207,26 @@ class RowVersionPool {
   static constexpr uint16_t kClassCount =
       SharedRowVersionPool<StaticConfig>::kClassCount;
 
+  // Allocates a pool whose per-NUMA-node state for the DB's node count
+  // directly follows the object, so that the state stays at a fixed offset
+  // from this instead of behind another pointer.
+  static RowVersionPool* create(
+      Context<StaticConfig>* ctx,
+      SharedRowVersionPool<StaticConfig>** shared_pools) {
+    size_t size = sizeof(RowVersionPool) +
+                  sizeof(State) * ctx->db()->numa_count() * kClassCount;
+    void* p = nullptr;
+    if (posix_memalign(&p, 64, size) != 0) return nullptr;
+    return new (p) RowVersionPool(ctx, shared_pools);
+  }
+
+  static void destroy(RowVersionPool* pool) {
+    if (pool == nullptr) return;
+    pool->~RowVersionPool();
+    free(pool);
+  }
+
+ private:
   RowVersionPool(Context<StaticConfig>* ctx,
                  SharedRowVersionPool<StaticConfig>** shared_pool)
       : ctx_(ctx), shared_pools_(shared_pool) {
@@ -206,7 +234,7 @@ class RowVersionPool {
 
     for (uint8_t numa_id = 0; numa_id < ctx_->db()->numa_count(); numa_id++) {
       for (uint16_t cls = 0; cls < kClassCount; cls++) {
-        auto state = &states_[numa_id * kClassCount + cls];
+        auto state = &states()[numa_id * kClassCount + cls];
         state->total_count = 0;
         // state->free_count = 0;
         state->current_free_count = 0;
@@ -219,7 +247,7 @@ class RowVersionPool {
   ~RowVersionPool() {
     for (uint8_t numa_id = 0; numa_id < ctx_->db()->numa_count(); numa_id++) {
       for (uint16_t cls = 0; cls < kClassCount; cls++) {
-        auto state = &states_[numa_id * kClassCount + cls];
+        auto state = &states()[numa_id * kClassCount + cls];
 
         if (state->current_free_count != 0) {
           assert(state->group_count <
@@ -234,17 +262,31 @@ class RowVersionPool {
     }
   }
 
+  RowVersionPool(const RowVersionPool&) = delete;
+  RowVersionPool& operator=(const RowVersionPool&) = delete;
+
+ public:
   RowVersion<StaticConfig>* allocate(uint16_t cls) {
+    return allocate(cls, ctx_->numa_id());
+  }
+
+  // Allocates a version preferably on the given NUMA node, falling back to
+  // the same tier and then the other tier (DB::spill_order()) if it is
+  // exhausted.
+  RowVersion<StaticConfig>* allocate(uint16_t cls, uint8_t preferred_numa_id) {
     Timing t(ctx_->timing_stack(), &Stats::alloc);
 
     if (StaticConfig::kVerbose) printf("allocate\n");
 
-    uint8_t numa_id = ctx_->numa_id();
+    auto db = ctx_->db();
+    auto order = db->spill_order(preferred_numa_id);
+    uint8_t numa_id = preferred_numa_id;
     State* state = nullptr;
 
     // printf("1\n");
-    for (auto trial = 0; trial < ctx_->db()->numa_count(); trial++) {
-      state = &states_[numa_id * kClassCount + cls];
+    for (uint8_t trial = 0; trial < db->spill_order_count(); trial++) {
+      numa_id = order[trial];
+      state = &states()[numa_id * kClassCount + cls];
 
       if (state->current_free_count != 0) break;
 
@@ -260,13 +302,10 @@ class RowVersionPool {
         state->rv = state->groups[state->group_count].rv;
         break;
       }
-
-      if (++numa_id == ctx_->db()->numa_count()) numa_id = 0;
     }
 
     // printf("5\n");
-    assert(state != nullptr);
-    if (state->current_free_count == 0) {
+    if (state == nullptr || state->current_free_count == 0) {
       // assert(false);
       return nullptr;
     }
@@ -281,6 +320,14 @@ class RowVersionPool {
 
     __builtin_prefetch(state->rv, 1, 3);
 
+    if (numa_id != preferred_numa_id &&
+        db->is_spill(preferred_numa_id, numa_id)) {
+      if (db->cxl_topology().contains(preferred_numa_id))
+        ctx_->stats().cxl_to_dram_version_spill_count++;
+      else
+        ctx_->stats().dram_to_cxl_version_spill_count++;
+    }
+
     assert(rv->status == RowVersionStatus::kInvalid);
     assert(rv->numa_id == numa_id);
     assert(rv->size_cls == cls);
@@ -301,7 +348,7 @@ class RowVersionPool {
     auto cls = rv->size_cls;
 
     uint8_t numa_id = rv->numa_id;
-    auto state = &states_[numa_id * kClassCount + cls];
+    auto state = &states()[numa_id * kClassCount + cls];
 
     rv->status = RowVersionStatus::kInvalid;
     rv->older_rv = state->rv;
@@ -332,7 +379,7 @@ class RowVersionPool {
   uint64_t total_count(uint16_t cls) const {
     uint64_t c = 0;
     for (uint8_t numa_id = 0; numa_id < ctx_->db()->numa_count(); numa_id++) {
-      auto state = &states_[numa_id * kClassCount + cls];
+      auto state = &states()[numa_id * kClassCount + cls];
       c += state->total_count;
     }
     return c;
@@ -341,7 +388,7 @@ class RowVersionPool {
   uint64_t free_count(uint16_t cls) const {
     uint64_t c = 0;
     for (uint8_t numa_id = 0; numa_id < ctx_->db()->numa_count(); numa_id++) {
-      auto state = &states_[numa_id * kClassCount + cls];
+      auto state = &states()[numa_id * kClassCount + cls];
       c += state->current_free_count;
       // c += state->free_count;
       for (uint64_t group_i = 0; group_i < state->group_count; group_i++)
@@ -367,7 +414,11 @@ class RowVersionPool {
     uint64_t group_count;
   };
 
-  State states_[StaticConfig::kMaxNUMACount * kClassCount];
+  // numa_count() * kClassCount entries allocated by create().
+  State* states() { return reinterpret_cast<State*>(this + 1); }
+  const State* states() const {
+    return reinterpret_cast<const State*>(this + 1);
+  }
 
   void refill_rows(uint8_t numa_id, uint16_t cls) {
     if (StaticConfig::kVerbose) printf("refill_rows\n");
@@ -375,10 +426,13 @@ class RowVersionPool {
     if (StaticConfig::kCollectProcessingStats)
       ctx_->stats().refill_rows_count++;
 
-    auto state = &states_[numa_id * kClassCount + cls];
+    auto state = &states()[numa_id * kClassCount + cls];
 
     assert(state->group_count == 0);
 
+    // The node has no page pool.
+    if (shared_pools_[numa_id] == nullptr) return;
+
     uint64_t new_group_count = StaticConfig::kRowVersionPoolGroupMaxCount / 2;
     shared_pools_[numa_id]->acquire(cls, state->groups, new_group_count);
 
@@ -419,7 +473,8 @@ class RowVersionPool {
     if (StaticConfig::kCollectProcessingStats)
       ctx_->stats().return_rows_count++;
 
-    auto state = &states_[numa_id * kClassCount + cls];
+    auto state = &states()[numa_id * kClassCount + cls];
+    if (shared_pools_[numa_id] == nullptr) return;
 
     // Return half of unused groups.  Leaving the half reduces threshing for
     // frequent allocation/deallocation cycles.
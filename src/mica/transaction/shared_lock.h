@@ -0,0 +1,55 @@
+#pragma once
+#ifndef MICA_TRANSACTION_SHARED_LOCK_H_
+#define MICA_TRANSACTION_SHARED_LOCK_H_
+
+#include <signal.h>
+#include <unistd.h>
+#include <cerrno>
+#include "mica/common.h"
+#include "mica/util/barrier.h"
+
+namespace mica {
+namespace transaction {
+// A spinlock in memory that several processes may share (the page pool
+// records, the row allocation of durable tables, and the process table of a
+// shared superblock).  The lock word holds the PID of its holder instead of 1,
+// so a waiter takes over a lock whose holder exited without releasing it.
+// Exits are detected by PID, which assumes one host, as in
+// Superblock::register_process().
+//
+// Taking over does not repair what the holder was changing.  The sections
+// under these locks are a few stores that pop or push a free page, or register
+// a page and bump a row count, so a crash inside one can at worst leak a page
+// or leave a free page count off by one.
+class SharedLock {
+ public:
+  static void lock(volatile uint32_t* word) {
+    uint32_t self = static_cast<uint32_t>(getpid());
+    uint64_t spins = 0;
+    while (true) {
+      uint32_t holder = *word;
+      if (holder == 0) {
+        if (__sync_bool_compare_and_swap(word, 0, self)) return;
+      } else if (++spins % kAliveCheckInterval == 0 && holder != self &&
+                 !alive(holder)) {
+        // Take over only from the holder we found dead.
+        if (__sync_bool_compare_and_swap(word, holder, self)) return;
+      }
+      ::mica::util::pause();
+    }
+  }
+
+  static void unlock(volatile uint32_t* word) { __sync_lock_release(word); }
+
+  static bool alive(uint32_t pid) {
+    return kill(static_cast<pid_t>(pid), 0) == 0 || errno == EPERM;
+  }
+
+ private:
+  // The spins between liveness checks, which are system calls.
+  static constexpr uint64_t kAliveCheckInterval = uint64_t(1) << 16;
+};
+}
+}
+
+#endif
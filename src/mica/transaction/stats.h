@@ -3,11 +3,17 @@
 #define MICA_TRANSACTION_STATS_H_
 
 #include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include "mica/transaction/perf_counter.h"
 #include "mica/util/stopwatch.h"
 #include "mica/util/memcpy.h"
 
 namespace mica {
 namespace transaction {
+// The number of ActiveTiming buckets (Stats::worker ... Stats::backoff).
+static constexpr uint8_t kTimingBucketCount = 20;
+
 struct Stats {
   // kCollectCommitStats
   uint64_t tx_count;
@@ -59,6 +65,15 @@ struct Stats {
   uint64_t gc_inc_count;
   uint64_t gc_forced_count;
 
+  // Row versions taken from the other memory tier because the preferred one
+  // was exhausted (always collected).
+  uint64_t cxl_to_dram_version_spill_count;
+  uint64_t dram_to_cxl_version_spill_count;
+
+  // Row accesses that found an evicted row and requested a fault-in (always
+  // collected).
+  uint64_t evicted_row_access_count;
+
   // kCollectProcessingStats
   uint64_t max_read_chain_len;
   uint64_t max_write_chain_len;
@@ -70,6 +85,11 @@ struct Stats {
 
   Stats() { reset(); }
 
+  // Returns the index of an ActiveTiming bucket.
+  uint8_t timing_bucket(const uint64_t* target) const {
+    return static_cast<uint8_t>(target - &worker);
+  }
+
   void reset() { ::mica::util::memset(this, 0, sizeof(Stats)); }
 
   Stats& operator+=(const Stats& o) {
@@ -121,6 +141,11 @@ struct Stats {
     gc_inc_count += o.gc_inc_count;
     gc_forced_count += o.gc_forced_count;
 
+    cxl_to_dram_version_spill_count += o.cxl_to_dram_version_spill_count;
+    dram_to_cxl_version_spill_count += o.dram_to_cxl_version_spill_count;
+
+    evicted_row_access_count += o.evicted_row_access_count;
+
     max_read_chain_len = std::max(max_read_chain_len, o.max_read_chain_len);
     max_write_chain_len = std::max(max_write_chain_len, o.max_write_chain_len);
     max_write_trials = std::max(max_write_trials, o.max_write_trials);
@@ -136,38 +161,112 @@ struct Stats {
   }
 } __attribute__((aligned(64)));
 
+static_assert(offsetof(Stats, backoff) - offsetof(Stats, worker) ==
+                  sizeof(uint64_t) * (kTimingBucketCount - 1),
+              "kTimingBucketCount does not match the timing fields in Stats");
+
+// PerfTiming only; kept out of Stats so that other timing modes do not carry
+// it.
+struct PerfStats {
+  // Indexed by the timing bucket (see Stats::timing_bucket()).
+  uint64_t perf[kTimingBucketCount][kPerfCounterCount];
+  // Set when the counters are opened; survives reset() and close_perf().
+  bool available[kPerfCounterCount];
+
+  PerfStats() {
+    reset();
+    for (uint8_t i = 0; i < kPerfCounterCount; i++) available[i] = false;
+  }
+
+  void reset() { ::mica::util::memset(perf, 0, sizeof(perf)); }
+
+  PerfStats& operator+=(const PerfStats& o) {
+    for (uint8_t i = 0; i < kTimingBucketCount; i++)
+      for (uint8_t j = 0; j < kPerfCounterCount; j++)
+        perf[i][j] += o.perf[i][j];
+    for (uint8_t i = 0; i < kPerfCounterCount; i++)
+      available[i] = available[i] || o.available[i];
+    return *this;
+  }
+} __attribute__((aligned(64)));
+
+// Transaction phases whose per-call cycle counts are recorded in
+// ::mica::util::Histogram when kCollectPhaseLatency == true.
+enum class LatencyPhase : uint8_t {
+  kTimestamping = 0,
+  kSlotAllocation,
+  kLocate,
+  kPreValidation,
+  kDeferredVersionInsert,
+  kMainValidation,
+  kSlotCommit,
+  kGC,
+  kPersist,
+  kCount,
+};
+
+static constexpr uint8_t kLatencyPhaseCount =
+    static_cast<uint8_t>(LatencyPhase::kCount);
+
+static const char* const kLatencyPhaseNames[kLatencyPhaseCount] = {
+    "timestamping",    "slot_allocation",         "locate",
+    "pre_validation",  "deferred_version_insert", "main_validation",
+    "slot_commit",     "gc",                      "persist",
+};
+
 class TimingStack {
  public:
   typedef ::mica::util::Stopwatch Stopwatch;
 
   static constexpr uint16_t kMaxDepth = 16;
 
-  TimingStack(Stats* stats, const Stopwatch* sw)
-      : stats_(stats), sw_(sw), depth_(0) {
+  // perf_stats may be nullptr if PerfTiming is not used.
+  TimingStack(Stats* stats, PerfStats* perf_stats, const Stopwatch* sw)
+      : stats_(stats), perf_stats_(perf_stats), sw_(sw), depth_(0) {
     start_ = sw_->now();
+    ::mica::util::memset(perf_start_, 0, sizeof(perf_start_));
+  }
+
+  // Opens hardware counters for the calling thread (used by PerfTiming).
+  bool open_perf() {
+    assert(perf_stats_ != nullptr);
+    if (!perf_.open()) return false;
+    for (uint8_t i = 0; i < kPerfCounterCount; i++)
+      perf_stats_->available[i] = perf_.available(static_cast<PerfCounter>(i));
+    perf_.read(perf_start_);
+    return true;
   }
+  void close_perf() { perf_.close(); }
 
  private:
-  friend class ActiveTiming;
+  template <bool Perf>
+  friend class BasicActiveTiming;
 
   Stats* stats_;
+  PerfStats* perf_stats_;
   const Stopwatch* sw_;
 
   uint64_t start_;
   uint64_t* targets_[kMaxDepth];
   uint16_t depth_;
+
+  PerfCounterGroup perf_;
+  uint64_t perf_start_[kPerfCounterCount];
 };
 
-class ActiveTiming {
+// Attributes elapsed time (and hardware counter deltas if Perf == true) to the
+// Stats bucket at the top of the timing stack.
+template <bool Perf>
+class BasicActiveTiming {
  public:
-  ActiveTiming(TimingStack* ts, uint64_t Stats::*target) : ts_(ts) {
+  BasicActiveTiming(TimingStack* ts, uint64_t Stats::*target) : ts_(ts) {
     update();
 
     assert(ts_->depth_ < TimingStack::kMaxDepth);
     ts_->targets_[ts_->depth_++] = &(ts_->stats_->*target);
   }
 
-  ~ActiveTiming() {
+  ~BasicActiveTiming() {
     update();
     ts_->depth_--;
   }
@@ -185,9 +284,27 @@ class ActiveTiming {
     uint64_t now = ts_->sw_->now();
     if (ts_->depth_ != 0) *ts_->targets_[ts_->depth_ - 1] += now - ts_->start_;
     ts_->start_ = now;
+
+    if (Perf && ts_->perf_.is_open()) {
+      uint64_t values[kPerfCounterCount];
+      ts_->perf_.read(values);
+      if (ts_->depth_ != 0) {
+        auto& perf = ts_->perf_stats_->perf[ts_->stats_->timing_bucket(
+            ts_->targets_[ts_->depth_ - 1])];
+        for (uint8_t i = 0; i < kPerfCounterCount; i++)
+          perf[i] += values[i] - ts_->perf_start_[i];
+      }
+      for (uint8_t i = 0; i < kPerfCounterCount; i++)
+        ts_->perf_start_[i] = values[i];
+    }
   }
 };
 
+typedef BasicActiveTiming<false> ActiveTiming;
+// ActiveTiming plus per-bucket hardware counters (much slower: one read()
+// system call per timing switch).
+typedef BasicActiveTiming<true> PerfTiming;
+
 class DummyTiming {
  public:
   DummyTiming(TimingStack*, uint64_t Stats::*) {}
@@ -0,0 +1,353 @@
+#pragma once
+#ifndef MICA_TRANSACTION_STATS_SAMPLER_H_
+#define MICA_TRANSACTION_STATS_SAMPLER_H_
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "mica/transaction/db.h"
+#include "mica/util/config.h"
+
+namespace mica {
+namespace transaction {
+// Periodically snapshots the per-thread Stats of a DB without stopping the
+// workers and writes the per-interval deltas as CSV or JSON lines.
+//
+// Config keys:
+//   "interval_ms": the sampling interval (default: 1000)
+//   "format":      "csv" or "json" (default: "csv")
+//   "path":        the output file
+//   "socket":      the path of a Unix-domain stream socket to connect to
+//                  instead of "path"
+//
+// The per-reason abort rates (aborted_*_per_sec) are emitted only with
+// StaticConfig::kCollectExtraCommitStats; without it, every abort counts as a
+// main validation abort.
+//
+// Counters are read without synchronization, so a sample may be off by a few
+// in-flight transactions.  DB::reset_stats() between samples is detected and
+// handled as a restart from zero.
+template <class StaticConfig>
+class StatsSampler {
+ public:
+  StatsSampler(const DB<StaticConfig>* db, const ::mica::util::Config& config)
+      : db_(db),
+        config_(config),
+        interval_ms_(1000),
+        json_(false),
+        fd_(-1),
+        is_socket_(false),
+        running_(false) {
+    if (config_.exists()) {
+      interval_ms_ = config_.get("interval_ms").get_uint64(1000);
+      if (interval_ms_ == 0) interval_ms_ = 1;
+      json_ = config_.get("format").get_str("csv") == "json";
+    }
+  }
+
+  ~StatsSampler() { stop(); }
+
+  StatsSampler(const StatsSampler&) = delete;
+  StatsSampler& operator=(const StatsSampler&) = delete;
+
+  bool start() {
+    if (running_) return true;
+    if (!config_.exists() || !open_output()) return false;
+
+    start_time_ = db_->sw()->now();
+    last_time_ = start_time_;
+    collect(&last_);
+
+    if (!json_) write_csv_header();
+
+    running_ = true;
+    thread_ = std::thread([this] { run(); });
+    return true;
+  }
+
+  void stop() {
+    if (!running_) return;
+    running_ = false;
+    thread_.join();
+
+    // Flush the partial interval.
+    sample();
+
+    ::close(fd_);
+    fd_ = -1;
+  }
+
+ private:
+  void run() {
+    auto next = std::chrono::steady_clock::now();
+    while (running_) {
+      next += std::chrono::milliseconds(interval_ms_);
+      // Sleep in short steps to keep stop() responsive.
+      while (running_ && std::chrono::steady_clock::now() < next)
+        std::this_thread::sleep_for(std::min(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                next - std::chrono::steady_clock::now()),
+            std::chrono::nanoseconds(10000000)));
+      if (!running_) break;
+      sample();
+    }
+  }
+
+  bool open_output() {
+    if (config_.get("socket").exists()) {
+      auto path = config_.get("socket").get_str();
+      struct sockaddr_un addr;
+      if (path.size() >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "error: socket path too long: %s\n", path.c_str());
+        return false;
+      }
+      ::memset(&addr, 0, sizeof(addr));
+      addr.sun_family = AF_UNIX;
+      ::strcpy(addr.sun_path, path.c_str());
+
+      fd_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+      if (fd_ == -1 ||
+          ::connect(fd_, reinterpret_cast<struct sockaddr*>(&addr),
+                    sizeof(addr)) != 0) {
+        fprintf(stderr, "error: failed to connect to %s: %s\n", path.c_str(),
+                strerror(errno));
+        if (fd_ != -1) ::close(fd_);
+        fd_ = -1;
+        return false;
+      }
+      is_socket_ = true;
+    } else {
+      auto path = config_.get("path").get_str("stats_sampler.out");
+      fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if (fd_ == -1) {
+        fprintf(stderr, "error: failed to open %s: %s\n", path.c_str(),
+                strerror(errno));
+        return false;
+      }
+      is_socket_ = false;
+    }
+    return true;
+  }
+
+  void write_line(const std::string& line) {
+    if (fd_ == -1) return;
+    size_t off = 0;
+    while (off < line.size()) {
+      ssize_t ret;
+      if (is_socket_)
+        ret = ::send(fd_, line.data() + off, line.size() - off, MSG_NOSIGNAL);
+      else
+        ret = ::write(fd_, line.data() + off, line.size() - off);
+      if (ret < 0 && errno == EINTR) continue;
+      if (ret <= 0) {
+        // The reader went away; keep the workers running regardless.
+        fprintf(stderr, "warning: StatsSampler output closed: %s\n",
+                strerror(errno));
+        ::close(fd_);
+        fd_ = -1;
+        return;
+      }
+      off += static_cast<size_t>(ret);
+    }
+  }
+
+  struct Snapshot {
+    Stats stats;
+    uint64_t gc_backlog;
+    std::vector<uint64_t> page_pool_used;  // One entry per NUMA node.
+    uint64_t row_version_free_bytes;
+    double backoff_us;
+    double thread_backoff_us;
+  };
+
+  void collect(Snapshot* s) const {
+    s->stats.reset();
+    s->gc_backlog = 0;
+    double thread_backoff = 0.;
+    auto num_threads = db_->thread_count();
+    for (uint16_t thread_id = 0; thread_id < num_threads; thread_id++) {
+      auto ctx = db_->context(thread_id);
+      Stats stats = ctx->stats();
+      s->stats += stats;
+      s->gc_backlog += ctx->gc_backlog();
+      if (StaticConfig::kBackoff && StaticConfig::kPerThreadBackoff)
+        thread_backoff += ctx->local_backoff().thread_backoff();
+    }
+
+    auto c_1_usec = static_cast<double>(db_->sw()->c_1_usec());
+    s->backoff_us = db_->backoff() / c_1_usec;
+    s->thread_backoff_us =
+        thread_backoff / c_1_usec / static_cast<double>(num_threads);
+
+    s->row_version_free_bytes = 0;
+    s->page_pool_used.assign(db_->numa_count(), 0);
+    for (uint8_t numa_id = 0; numa_id < db_->numa_count(); numa_id++) {
+      auto page_pool = db_->page_pool(numa_id);
+      s->page_pool_used[numa_id] =
+          page_pool == nullptr
+              ? 0
+              : page_pool->total_count() - page_pool->free_count();
+
+      auto rv_pool = db_->shared_row_version_pool(numa_id);
+      if (rv_pool == nullptr) continue;
+      for (uint16_t cls = 0;
+           cls < SharedRowVersionPool<StaticConfig>::kClassCount; cls++) {
+        auto free_count = rv_pool->free_count(cls);
+        if (free_count != 0)
+          s->row_version_free_bytes +=
+              free_count *
+              SharedRowVersionPool<StaticConfig>::class_to_rv_size(cls);
+      }
+    }
+  }
+
+  // The rates in sample(); the per-reason abort rates come last.
+  static constexpr size_t kRateCount =
+      StaticConfig::kCollectExtraCommitStats ? 9 : 3;
+
+  static const char* rate_name(size_t i) {
+    static const char* const names[] = {
+        "committed_per_sec",
+        "tx_per_sec",
+        "abort_pct",
+        "aborted_get_row_per_sec",
+        "aborted_pre_validation_per_sec",
+        "aborted_deferred_version_insert_per_sec",
+        "aborted_main_validation_per_sec",
+        "aborted_logging_per_sec",
+        "aborted_application_per_sec",
+    };
+    return names[i];
+  }
+
+  void write_csv_header() {
+    std::string line = "time";
+    for (size_t i = 0; i < kRateCount; i++)
+      line += std::string(",") + rate_name(i);
+    line += ",gc_backlog";
+    for (uint8_t numa_id = 0; numa_id < db_->numa_count(); numa_id++)
+      line += ",page_pool_" + std::to_string(numa_id) + "_used_pages";
+    line += ",row_version_free_bytes,backoff_us,thread_backoff_us\n";
+    write_line(line);
+  }
+
+  // A reset between two samples makes the counters go backwards.
+  static uint64_t delta(uint64_t cur, uint64_t last) {
+    return cur >= last ? cur - last : cur;
+  }
+
+  void sample() {
+    Snapshot cur;
+    collect(&cur);
+    uint64_t now = db_->sw()->now();
+
+    double elapsed = db_->sw()->diff(now, last_time_);
+    if (elapsed <= 0.) elapsed = 1e-9;
+    double time = db_->sw()->diff(now, start_time_);
+
+    auto& c = cur.stats;
+    auto& l = last_.stats;
+    uint64_t tx = delta(c.tx_count, l.tx_count);
+    uint64_t committed = delta(c.committed_count, l.committed_count);
+    double rates[] = {
+        static_cast<double>(committed) / elapsed,
+        static_cast<double>(tx) / elapsed,
+        tx == 0 ? 0.
+                : 100. * static_cast<double>(tx - std::min(tx, committed)) /
+                      static_cast<double>(tx),
+        static_cast<double>(delta(c.aborted_by_get_row_count,
+                                  l.aborted_by_get_row_count)) /
+            elapsed,
+        static_cast<double>(delta(c.aborted_by_pre_validation_count,
+                                  l.aborted_by_pre_validation_count)) /
+            elapsed,
+        static_cast<double>(
+            delta(c.aborted_by_deferred_row_version_insert_count,
+                  l.aborted_by_deferred_row_version_insert_count)) /
+            elapsed,
+        static_cast<double>(delta(c.aborted_by_main_validation_count,
+                                  l.aborted_by_main_validation_count)) /
+            elapsed,
+        static_cast<double>(delta(c.aborted_by_logging_count,
+                                  l.aborted_by_logging_count)) /
+            elapsed,
+        static_cast<double>(delta(c.aborted_by_application_count,
+                                  l.aborted_by_application_count)) /
+            elapsed,
+    };
+
+    char buf[128];
+    std::string line;
+    if (json_) {
+      snprintf(buf, sizeof(buf), "{\"time\": %.3lf", time);
+      line += buf;
+      for (size_t i = 0; i < kRateCount; i++) {
+        snprintf(buf, sizeof(buf), ", \"%s\": %.1lf", rate_name(i), rates[i]);
+        line += buf;
+      }
+      snprintf(buf, sizeof(buf), ", \"gc_backlog\": %" PRIu64
+                                 ", \"page_pool_used_pages\": [",
+               cur.gc_backlog);
+      line += buf;
+      for (uint8_t numa_id = 0; numa_id < db_->numa_count(); numa_id++) {
+        snprintf(buf, sizeof(buf), "%s%" PRIu64, numa_id == 0 ? "" : ", ",
+                 cur.page_pool_used[numa_id]);
+        line += buf;
+      }
+      snprintf(buf, sizeof(buf),
+               "], \"row_version_free_bytes\": %" PRIu64
+               ", \"backoff_us\": %.3lf, \"thread_backoff_us\": %.3lf}\n",
+               cur.row_version_free_bytes, cur.backoff_us,
+               cur.thread_backoff_us);
+      line += buf;
+    } else {
+      snprintf(buf, sizeof(buf), "%.3lf", time);
+      line += buf;
+      for (size_t i = 0; i < kRateCount; i++) {
+        snprintf(buf, sizeof(buf), ",%.1lf", rates[i]);
+        line += buf;
+      }
+      snprintf(buf, sizeof(buf), ",%" PRIu64, cur.gc_backlog);
+      line += buf;
+      for (uint8_t numa_id = 0; numa_id < db_->numa_count(); numa_id++) {
+        snprintf(buf, sizeof(buf), ",%" PRIu64, cur.page_pool_used[numa_id]);
+        line += buf;
+      }
+      snprintf(buf, sizeof(buf), ",%" PRIu64 ",%.3lf,%.3lf\n",
+               cur.row_version_free_bytes, cur.backoff_us,
+               cur.thread_backoff_us);
+      line += buf;
+    }
+    write_line(line);
+
+    last_ = cur;
+    last_time_ = now;
+  }
+
+  const DB<StaticConfig>* db_;
+  ::mica::util::Config config_;
+
+  uint64_t interval_ms_;
+  bool json_;
+
+  int fd_;
+  bool is_socket_;
+
+  volatile bool running_;
+  std::thread thread_;
+
+  uint64_t start_time_;
+  uint64_t last_time_;
+  Snapshot last_;
+};
+}
+}
+
+#endif
@@ -0,0 +1,513 @@
+#pragma once
+#ifndef MICA_TRANSACTION_SUPERBLOCK_H_
+#define MICA_TRANSACTION_SUPERBLOCK_H_
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include "mica/common.h"
+#include "mica/transaction/commit_slot.h"
+#include "mica/transaction/cxl_ptr.h"
+#include "mica/transaction/page_pool.h"
+#include "mica/transaction/shared_lock.h"
+#include "mica/util/barrier.h"
+#include "mica/util/config.h"
+
+namespace mica {
+namespace transaction {
+enum class SuperblockTableKind : uint8_t {
+  kTable = 0,
+  kCXLTable,
+  kHashIndexUniqueU64,
+  kHashIndexNonuniqueU64,
+  kBTreeIndexUniqueU64,
+  kBTreeIndexNonuniqueU64,
+};
+
+// The row allocation state of a table.  A durable table keeps it in its
+// record so that every process sharing the DB allocates rows from it.
+struct TableRowState {
+  volatile uint32_t lock;  // A SharedLock.
+  volatile uint64_t row_count;
+};
+
+// A table or index of a durable DB.  For an index, the pages are those of its
+// index table, and main_table/main_kind name its main table.
+template <class StaticConfig>
+struct SuperblockTable {
+  static constexpr size_t kMaxNameLength = 63;
+
+  char name[kMaxNameLength + 1];
+  char main_table[kMaxNameLength + 1];
+  SuperblockTableKind kind;
+  SuperblockTableKind main_kind;
+  uint16_t cf_count;
+  uint64_t data_size_hints[StaticConfig::kMaxColumnFamilyCount];
+  uint64_t expected_num_rows;
+
+  CXLPtr<char> base_root;
+  CXLPtr<CXLPtr<char>> root;
+  CXLPtr<uint8_t> page_numa_ids;
+  uint8_t metadata_numa_id;
+
+  TableRowState rows;
+};
+
+template <class StaticConfig>
+struct SuperblockThread {
+  CXLPtr<CommitSlot<StaticConfig>> slots;
+  uint8_t slots_numa_id;
+};
+
+// A process sharing the DB and its range of thread IDs.  min_wts and min_rts
+// are the minimums over the process's active threads as of its last
+// quiescence round.
+template <class StaticConfig>
+struct SuperblockProcess {
+  typedef typename StaticConfig::ConcurrentTimestamp ConcurrentTimestamp;
+
+  volatile uint32_t pid;  // 0 if the entry is free.
+  uint16_t thread_begin;
+  uint16_t thread_count;
+  ConcurrentTimestamp min_wts;
+  ConcurrentTimestamp min_rts;
+};
+
+// The content of the superblock page.  The IDs of the Alloc files backing
+// each pool follow the structure up to the end of the page.  Pointers are
+// CXLPtr, so they hold offsets in the region rather than addresses.
+template <class StaticConfig>
+struct SuperblockLayout {
+  typedef typename StaticConfig::ConcurrentTimestamp ConcurrentTimestamp;
+
+  static constexpr size_t kMaxPools = 16;
+  static constexpr size_t kMaxThreads = 1024;
+  static constexpr size_t kMaxTables = 128;
+  static constexpr size_t kMaxProcesses = 16;
+
+  char magic[8];
+  uint64_t version;
+  uint64_t generation;
+  // This page in the region, as opposed to its initial mapping in Alloc.
+  CXLPtr<SuperblockLayout> self;
+
+  uint16_t num_threads;
+  uint8_t pool_count;
+  PagePoolRecord pools[kMaxPools];
+  // The first entry of each pool in file_ids(); a pool has page_count
+  // entries.
+  uint32_t pool_file_id_offsets[kMaxPools];
+  uint32_t file_id_count;
+
+  CXLPtr<ConcurrentTimestamp> min_wts;
+  SuperblockThread<StaticConfig> threads[kMaxThreads];
+
+  // Used by shared DBs only.  min_rts is the minimum over the processes.
+  ConcurrentTimestamp min_rts;
+  volatile uint32_t process_lock;  // A SharedLock.
+  SuperblockProcess<StaticConfig> processes[kMaxProcesses];
+
+  volatile uint32_t table_count;
+  SuperblockTable<StaticConfig> tables[kMaxTables];
+
+  uint32_t* file_ids() { return reinterpret_cast<uint32_t*>(this + 1); }
+  const uint32_t* file_ids() const {
+    return reinterpret_cast<const uint32_t*>(this + 1);
+  }
+  static constexpr size_t kMaxFileIDs =
+      (PagePool<StaticConfig>::kPageSize - sizeof(SuperblockLayout)) /
+      sizeof(uint32_t);
+};
+
+// The root of a DB that survives process restarts.  The superblock is a page
+// in a CXL page pool that records the layout of the CXL page pools, the commit
+// slot page of each thread, min_wts, and the pages of every table and index.
+// Everything a durable DB keeps is in those pools, so a restarted process
+// maps the pools again, adopts the recorded pages, and runs DB::recover()
+// without loading any row.
+//
+// Pointers in the region are CXLPtr.  Attaching maps the pools with the
+// relative layout they had when the superblock was formatted, at their
+// original addresses if that range is free and anywhere else otherwise, and
+// sets cxl_base() to the distance moved.  Only the initial region of a pool is
+// recorded, so durable pools do not grow.  Per-thread caches of free rows and
+// row versions, and the GC queues, are not recorded; their memory is lost on a
+// restart.
+//
+// A shared superblock lets several processes use the DB at once.  The first
+// one formats the superblock and creates every table and index; the others
+// attach to it while it runs.  Each process registers a disjoint range of the
+// DB's thread IDs and activates only those threads.  The page pools and the
+// row allocation of tables are locked in the region, and each process
+// publishes the minimum timestamps of its threads so that min_wts, min_rts,
+// and thus GC account for every process.  Commit slots are already per
+// thread.  Timestamps stay ordered across processes because they come from
+// the same TSC, or, with CXLClockTimestamp, from clocks anchored to a shared
+// reference.  A process that exits without unregistering holds min_rts back
+// until another process registers an overlapping thread range, which
+// recovers the transactions it left; exits are detected by PID, which
+// assumes one host.  The locks in the region are SharedLock, which the other
+// processes take over if such a process held one.
+//
+// A secondary process must give this superblock an Alloc that only maps the
+// files of the first one (the same "filename_prefix", "num_pages_to_init" 0,
+// and "clean_other_files_on_init" false), and use another Alloc with its own
+// prefix for everything else.
+//
+// Config keys:
+//   "enable":       make DBs given this superblock durable (default: false)
+//   "reset":        ignore an existing superblock and format a new one
+//                   (default: false)
+//   "shared":       share the DB with other processes (default: false); see
+//                   SharedLock for what a crash inside a locked section
+//                   leaves behind
+//   "thread_begin": the first thread ID of this process when shared (default:
+//                   0)
+//   "thread_count": the number of thread IDs of this process when shared
+//                   (default: up to the last thread of the DB)
+//
+// Construct the Superblock after Alloc but before the page pools.  If
+// attached(), use page_pool() for the recorded nodes instead of creating new
+// pools, and skip creating and loading the tables.
+template <class StaticConfig>
+class Superblock {
+ public:
+  typedef typename StaticConfig::Alloc Alloc;
+  typedef SuperblockLayout<StaticConfig> Layout;
+  typedef typename StaticConfig::Timestamp Timestamp;
+
+  static constexpr uint64_t kVersion = 3;
+
+  Superblock(Alloc* alloc, const ::mica::util::Config& config)
+      : alloc_(alloc),
+        enabled_(false),
+        shared_(false),
+        layout_(nullptr),
+        next_generation_(1),
+        region_(nullptr),
+        region_len_(0),
+        guard_(nullptr),
+        thread_begin_(0),
+        thread_count_(0),
+        process_idx_(-1) {
+    if (!config.exists() || !config.get("enable").get_bool(false)) return;
+    enabled_ = true;
+    shared_ = config.get("shared").get_bool(false);
+    thread_begin_ =
+        static_cast<uint16_t>(config.get("thread_begin").get_uint64(0));
+    thread_count_ =
+        static_cast<uint16_t>(config.get("thread_count").get_uint64(0));
+
+    // Pick the newest superblock among the free pages.
+    const Layout* found = nullptr;
+    for (auto p : alloc_->find_pages(kMagic, sizeof(kMagic))) {
+      auto candidate = reinterpret_cast<const Layout*>(p);
+      if (candidate->version != kVersion) continue;
+      if (candidate->generation >= next_generation_)
+        next_generation_ = candidate->generation + 1;
+      if (found == nullptr || candidate->generation > found->generation)
+        found = candidate;
+    }
+    if (found == nullptr || config.get("reset").get_bool(false)) return;
+
+    if (!attach(found)) {
+      fprintf(stderr, "error: failed to attach the superblock\n");
+      assert(false);
+      release();
+      set_cxl_base(0);
+      enabled_ = false;
+      return;
+    }
+    printf("attached superblock generation %" PRIu64 " at %p (base %p)\n",
+           layout_->generation, layout_,
+           reinterpret_cast<void*>(cxl_base()));
+  }
+
+  ~Superblock() {
+    unregister_process();
+    release();
+  }
+
+  Superblock(const Superblock&) = delete;
+  Superblock& operator=(const Superblock&) = delete;
+
+  bool enabled() const { return enabled_; }
+  bool attached() const { return enabled_ && !pools_.empty(); }
+  bool shared() const { return enabled_ && shared_; }
+
+  // The thread IDs of this process, set by register_process().
+  uint16_t thread_begin() const { return thread_begin_; }
+  uint16_t thread_end() const {
+    return static_cast<uint16_t>(thread_begin_ + thread_count_);
+  }
+
+  // The attached pool on numa_id, or nullptr.
+  PagePool<StaticConfig>* page_pool(uint8_t numa_id) const {
+    for (auto pool : pools_)
+      if (pool->numa_id() == numa_id) return pool;
+    return nullptr;
+  }
+
+  Layout* layout() { return layout_; }
+  const Layout* layout() const { return layout_; }
+
+  // Used by DB to write a new superblock into page.  The superblock is
+  // found by attach only after finish_format().
+  Layout* begin_format(char* page) {
+    assert(enabled_ && !attached());
+    memset(page, 0, PagePool<StaticConfig>::kPageSize);
+    layout_ = reinterpret_cast<Layout*>(page);
+    layout_->version = kVersion;
+    layout_->generation = next_generation_;
+    layout_->self = layout_;
+    return layout_;
+  }
+
+  void finish_format() {
+    persist(layout_, sizeof(Layout) +
+                         layout_->file_id_count * sizeof(uint32_t));
+    // The magic goes last so that a partly formatted superblock is never
+    // attached.
+    memcpy(layout_->magic, kMagic, sizeof(kMagic));
+    persist(layout_->magic, sizeof(kMagic));
+    printf("formatted superblock generation %" PRIu64 " at %p\n",
+           layout_->generation, layout_);
+  }
+
+  // Used by a shared DB to register the thread range of this process.  Fails
+  // if the range is not within [0, num_threads) or overlaps the range of a
+  // live process; the entry of a process that is gone is taken over.  The
+  // published minimums start at min_wts and min_rts.
+  bool register_process(uint16_t num_threads, const Timestamp& min_wts,
+                        const Timestamp& min_rts) {
+    assert(shared() && layout_ != nullptr && process_idx_ == -1);
+    if (thread_count_ == 0 && thread_begin_ < num_threads)
+      thread_count_ = static_cast<uint16_t>(num_threads - thread_begin_);
+    if (thread_count_ == 0 || thread_end() > num_threads) {
+      fprintf(stderr,
+              "error: invalid thread range %" PRIu16 "+%" PRIu16
+              " for %" PRIu16 " threads\n",
+              thread_begin_, thread_count_, num_threads);
+      return false;
+    }
+
+    lock_processes();
+    int free_idx = -1;
+    bool ok = true;
+    for (int i = 0; i < static_cast<int>(Layout::kMaxProcesses); i++) {
+      auto& p = layout_->processes[i];
+      if (p.pid != 0 && p.thread_begin < thread_end() &&
+          thread_begin_ < p.thread_begin + p.thread_count) {
+        if (SharedLock::alive(p.pid)) {
+          fprintf(stderr,
+                  "error: threads %" PRIu16 "+%" PRIu16
+                  " are used by process %" PRIu32 "\n",
+                  p.thread_begin, p.thread_count, p.pid);
+          ok = false;
+          break;
+        }
+        p.pid = 0;
+      }
+      if (p.pid == 0 && free_idx == -1) free_idx = i;
+    }
+    if (ok && free_idx == -1) {
+      fprintf(stderr, "error: too many processes share the superblock\n");
+      ok = false;
+    }
+    if (ok) {
+      auto& p = layout_->processes[free_idx];
+      p.thread_begin = thread_begin_;
+      p.thread_count = thread_count_;
+      p.min_wts.init(min_wts);
+      p.min_rts.init(min_rts);
+      ::mica::util::memory_barrier();
+      p.pid = static_cast<uint32_t>(getpid());
+      persist(&p, sizeof(p));
+      process_idx_ = free_idx;
+    }
+    unlock_processes();
+    return ok;
+  }
+
+  void unregister_process() {
+    if (process_idx_ == -1) return;
+    lock_processes();
+    layout_->processes[process_idx_].pid = 0;
+    persist(&layout_->processes[process_idx_].pid, sizeof(uint32_t));
+    unlock_processes();
+    process_idx_ = -1;
+  }
+
+  // Publishes the minimum wts and, unless min_rts is nullptr, rts of the
+  // active threads of this process, and replaces them with the minimums over
+  // every registered process.  The returned min_rts is the shared one, which
+  // never decreases.
+  void merge_min_ts(Timestamp* min_wts, Timestamp* min_rts) {
+    auto& self = layout_->processes[process_idx_];
+    self.min_wts.update(*min_wts);
+    if (min_rts != nullptr) self.min_rts.update(*min_rts);
+
+    for (auto& p : layout_->processes) {
+      if (p.pid == 0) continue;
+      auto wts = p.min_wts.get();
+      if (*min_wts > wts) *min_wts = wts;
+      if (min_rts == nullptr) continue;
+      auto rts = p.min_rts.get();
+      if (*min_rts > rts) *min_rts = rts;
+    }
+
+    if (min_rts == nullptr) return;
+    layout_->min_rts.update(*min_rts);
+    *min_rts = layout_->min_rts.get();
+  }
+
+  // Returns true if a thread of this process with wts and rts is behind the
+  // minimums this process has published, which other processes may already
+  // use.  DB::activate() waits until it is not.
+  bool behind_published(const Timestamp& wts, const Timestamp& rts) const {
+    auto& self = layout_->processes[process_idx_];
+    return self.min_wts.get() > wts || self.min_rts.get() > rts;
+  }
+
+  // Makes a change to the superblock durable.
+  static void persist(const volatile void* p, size_t len) {
+    if (!StaticConfig::kPersistentCXL) return;
+    ::mica::util::write_back(p, len);
+    ::mica::util::sfence();
+  }
+
+ private:
+  static constexpr char kMagic[8] = {'C', 'I', 'C', 'A', 'D', 'A', 'S', 'B'};
+
+  // found is the initial mapping of the superblock page in Alloc.
+  bool attach(const Layout* found) {
+    if (found->pool_count == 0) return false;
+
+    // The span of the pools in the offsets of the formatting process.
+    uint64_t start = static_cast<uint64_t>(-1);
+    uint64_t end = 0;
+    for (uint8_t i = 0; i < found->pool_count; i++) {
+      auto& record = found->pools[i];
+      uint64_t off = record.base.offset();
+      start = std::min(start, off);
+      end = std::max(end, off + record.page_count * kPageSize);
+    }
+    if (!reserve(start, end - start)) return false;
+
+    // Each pool replaces its part of the reservation.
+    std::vector<size_t> file_ids;
+    for (uint8_t i = 0; i < found->pool_count; i++) {
+      auto& record = found->pools[i];
+      char* base = record.base;
+      munmap(base, record.page_count * kPageSize);
+      auto ids = found->file_ids() + found->pool_file_id_offsets[i];
+      file_ids.assign(ids, ids + record.page_count);
+      auto pool = new PagePool<StaticConfig>(alloc_, record, file_ids);
+      pools_.push_back(pool);
+      if (pool->base() != base) return false;
+    }
+
+    // The superblock is now also mapped where its pointers expect it.
+    layout_ = found->self;
+    if (layout_->generation != found->generation) return false;
+
+    if (!shared_) {
+      // This process is the only user, so locks left by a crash are stale.
+      for (uint8_t i = 0; i < layout_->pool_count; i++)
+        layout_->pools[i].lock = 0;
+      for (uint32_t i = 0; i < layout_->table_count; i++)
+        layout_->tables[i].rows.lock = 0;
+      layout_->process_lock = 0;
+      for (auto& p : layout_->processes) p.pid = 0;
+    }
+
+    for (uint8_t i = 0; i < layout_->pool_count; i++)
+      pools_[i]->adopt_record(&layout_->pools[i]);
+    return true;
+  }
+
+  void lock_processes() { SharedLock::lock(&layout_->process_lock); }
+
+  void unlock_processes() { SharedLock::unlock(&layout_->process_lock); }
+
+  // Reserves len bytes for the region that starts at offset start and sets
+  // cxl_base() so that the offset maps to the reservation.
+  bool reserve(uint64_t start, uint64_t len) {
+    const int kFlags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+
+    // The original range keeps the base at 0.
+    region_len_ = len;
+    region_ = mmap(reinterpret_cast<void*>(start), region_len_, PROT_NONE,
+                   kFlags, -1, 0);
+    if (region_ != MAP_FAILED &&
+        reinterpret_cast<uintptr_t>(region_) != start) {
+      munmap(region_, region_len_);
+      // Leave room to align the pools for huge pages.
+      region_len_ = len + kPageSize;
+      region_ = mmap(nullptr, region_len_, PROT_NONE, kFlags, -1, 0);
+    }
+    if (region_ == MAP_FAILED) {
+      region_ = nullptr;
+      return false;
+    }
+
+    uintptr_t region_start =
+        (reinterpret_cast<uintptr_t>(region_) + kPageSize - 1) &
+        ~(kPageSize - 1);
+    uintptr_t base = region_start - start;
+    set_cxl_base(base);
+    if (base == 0) return true;
+
+    // A CXLPtr cannot point at the base itself, so keep other mappings off
+    // it.  The pools are above it, and a base past the user address space
+    // needs no guard.
+    if (base >= kUserAddressLimit) return true;
+    guard_ = mmap(reinterpret_cast<void*>(base), kGuardSize, PROT_NONE, kFlags,
+                  -1, 0);
+    if (guard_ != MAP_FAILED && reinterpret_cast<uintptr_t>(guard_) == base)
+      return true;
+    if (guard_ != MAP_FAILED) munmap(guard_, kGuardSize);
+    guard_ = nullptr;
+    fprintf(stderr, "error: %p is in use as the CXL base\n",
+            reinterpret_cast<void*>(base));
+    return false;
+  }
+
+  void release() {
+    for (auto pool : pools_) delete pool;
+    pools_.clear();
+    // The gaps between the pools are still reserved.
+    if (region_ != nullptr) munmap(region_, region_len_);
+    region_ = nullptr;
+    if (guard_ != nullptr) munmap(guard_, kGuardSize);
+    guard_ = nullptr;
+  }
+
+  static constexpr uint64_t kPageSize = PagePool<StaticConfig>::kPageSize;
+  static constexpr size_t kGuardSize = 4096;
+  static constexpr uintptr_t kUserAddressLimit = uintptr_t(1) << 47;
+
+  Alloc* alloc_;
+  bool enabled_;
+  bool shared_;
+  Layout* layout_;
+  uint64_t next_generation_;
+  std::vector<PagePool<StaticConfig>*> pools_;
+
+  void* region_;
+  size_t region_len_;
+  void* guard_;
+
+  uint16_t thread_begin_;
+  uint16_t thread_count_;
+  int process_idx_;
+};
+
+template <class StaticConfig>
+constexpr char Superblock<StaticConfig>::kMagic[8];
+}
+}
+
+#endif
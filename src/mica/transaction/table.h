@@ -2,12 +2,16 @@
 #ifndef MICA_TRANSACTION_TABLE_H_
 #define MICA_TRANSACTION_TABLE_H_
 
+#include <cstdlib>
+#include <new>
 #include <vector>
 #include "mica/common.h"
+#include "mica/transaction/cxl_ptr.h"
 #include "mica/transaction/db.h"
 #include "mica/transaction/row.h"
 #include "mica/transaction/context.h"
 #include "mica/transaction/transaction.h"
+#include "mica/transaction/superblock.h"
 #include "mica/util/memcpy.h"
 
 namespace mica {
@@ -15,25 +19,41 @@ namespace transaction {
 template <class StaticConfig>
 class DB;
 
+template <class StaticConfig>
+class CXLTable;
+
 template <class StaticConfig>
 class Table {
  public:
   typedef typename StaticConfig::Timestamp Timestamp;
 
+  // With record, adopts the pages of a table of an attached superblock.
   Table(DB<StaticConfig>* db, uint16_t cf_count,
-        const uint64_t* data_size_hints);
+        const uint64_t* data_size_hints,
+        SuperblockTable<StaticConfig>* record = nullptr);
   ~Table();
 
+  // Table is cache line-aligned, which plain new does not honor in C++14.
+  static void* operator new(size_t size) {
+    void* p = nullptr;
+    if (posix_memalign(&p, 64, size) != 0) throw std::bad_alloc();
+    return p;
+  }
+  static void operator delete(void* p) { free(p); }
+
   DB<StaticConfig>* db() { return db_; }
   const DB<StaticConfig>* db() const { return db_; }
 
+  // See DB::get_table_by_id().
+  uint32_t id() const { return id_; }
+
   uint16_t cf_count() const { return cf_count_; }
 
   uint64_t data_size_hint(uint16_t cf_id) const {
     return cf_[cf_id].data_size_hint;
   }
 
-  uint64_t row_count() const { return row_count_; }
+  uint64_t row_count() const { return rows_->row_count; }
 
   uint8_t inlining(uint16_t cf_id) const { return cf_[cf_id].inlining; }
 
@@ -41,6 +61,11 @@ class Table {
     return cf_[cf_id].inlined_rv_size_cls;
   }
 
+  // Places new rows of this table on the CXL NUMA node instead of the NUMA
+  // node of the inserting thread.
+  bool cxl_resident() const { return cxl_resident_; }
+  void set_cxl_resident(bool cxl_resident) { cxl_resident_ = cxl_resident; }
+
   bool is_valid(uint16_t cf_id, uint64_t row_id) const;
 
   RowHead<StaticConfig>* head(uint16_t cf_id, uint64_t row_id);
@@ -69,8 +94,38 @@ class Table {
 
   void print_table_status() const;
 
+  // Memory held by this table, split by the NUMA node of its pages.  Only
+  // covers the row head pages; non-inlined versions belong to
+  // SharedRowVersionPool.
+  // The vectors have one entry per NUMA node.
+  struct MemoryUsage {
+    std::vector<uint64_t> page_count;
+    std::vector<uint64_t> head_bytes;
+    std::vector<uint64_t> inlined_rv_bytes;
+    std::vector<uint64_t> gc_info_bytes;
+    // Page space that cannot hold a row.
+    std::vector<uint64_t> slack_bytes;
+    // The root and page NUMA ID arrays (on NUMA node 0, or on CXL in a
+    // durable DB).
+    uint64_t metadata_bytes;
+    uint64_t row_count;
+    // Rows allocated but sitting in per-thread free lists.
+    uint64_t free_row_count;
+  };
+
+  void memory_usage(MemoryUsage* usage) const;
+
  private:
+  friend class DB<StaticConfig>;
+  friend class CXLTable<StaticConfig>;
+
+  // With kPersistentCXL, a new row page is made durable before it is
+  // registered in root_, and the registration after.
+  void persist_page(const char* p) const;
+  void persist_root(uint64_t i) const;
+
   DB<StaticConfig>* db_;
+  uint32_t id_;
   uint16_t cf_count_;
 
   struct ColumnFamilyInfo {
@@ -85,7 +140,7 @@ class Table {
 
   // We use only the half the first level because of shuffling.
   static constexpr uint64_t kFirstLevelWidth =
-      PagePool<StaticConfig>::kPageSize / sizeof(char*) / 2;
+      PagePool<StaticConfig>::kPageSize / sizeof(CXLPtr<char>) / 2;
 
   uint64_t total_rh_size_;
   uint64_t second_level_width_;
@@ -94,14 +149,19 @@ class Table {
 
   ColumnFamilyInfo cf_[StaticConfig::kMaxColumnFamilyCount];
 
-  uint8_t* cxl_page_numa_ids_;  // CXL页面的NUMA ID映射
-
   char* base_root_;
-  char** root_;
+  // In base_root_; relative as it is in CXL memory.
+  CXLPtr<char>* root_;
   uint8_t* page_numa_ids_;
+  // The node of base_root_ and page_numa_ids_.
+  uint8_t metadata_numa_id_;
+
+  bool cxl_resident_;
 
-  volatile uint32_t lock_ __attribute__((aligned(64)));
-  uint64_t row_count_;
+  TableRowState local_rows_ __attribute__((aligned(64)));
+  // local_rows_, or the state in the table's superblock record, which the
+  // processes sharing the DB allocate rows from.
+  TableRowState* rows_;
 } __attribute__((aligned(64)));
 }
 }
@@ -6,8 +6,9 @@ namespace mica {
 namespace transaction {
 template <class StaticConfig>
 Table<StaticConfig>::Table(DB<StaticConfig>* db, uint16_t cf_count,
-                           const uint64_t* data_size_hints)
-    : db_(db), cf_count_(cf_count) {
+                           const uint64_t* data_size_hints,
+                           SuperblockTable<StaticConfig>* record)
+    : db_(db), id_(db->register_table(this)), cf_count_(cf_count) {
   assert(cf_count <= StaticConfig::kMaxColumnFamilyCount);
 
   constexpr size_t kAlignment = 64;
@@ -17,6 +18,8 @@ Table<StaticConfig>::Table(DB<StaticConfig>* db, uint16_t cf_count,
   printf("RowHead size: %" PRIu64 " bytes\n", sizeof(RowHead<StaticConfig>));
   printf("RowVersion size: %" PRIu64 " bytes\n",
          sizeof(RowVersion<StaticConfig>));
+  printf("Inline threshold: %" PRIu64 " bytes\n",
+         RowLayout<StaticConfig>::kInlineThreshold);
 
   uint64_t rh_offset = 0;
   for (uint16_t cf_id = 0; cf_id < cf_count_; cf_id++) {
@@ -24,7 +27,7 @@ Table<StaticConfig>::Table(DB<StaticConfig>* db, uint16_t cf_count,
     cf.data_size_hint = data_size_hints[cf_id];
 
     if (StaticConfig::kInlinedRowVersion) {
-      if (cf.data_size_hint <= StaticConfig::kInlineThreshold) {
+      if (cf.data_size_hint <= RowLayout<StaticConfig>::kInlineThreshold) {
         cf.rh_size = ::mica::util::roundup<kAlignment>(
             sizeof(RowHead<StaticConfig>) + sizeof(RowVersion<StaticConfig>) +
             cf.data_size_hint);
@@ -80,7 +83,32 @@ Table<StaticConfig>::Table(DB<StaticConfig>* db, uint16_t cf_count,
          second_level_width_);
   printf("\n");
 
-  base_root_ = db_->page_pool(0)->allocate();
+  // A durable DB keeps every row in CXL.
+  cxl_resident_ = db_->durable();
+  local_rows_.lock = 0;
+  local_rows_.row_count = 0;
+  rows_ = &local_rows_;
+
+  if (record != nullptr) {
+    base_root_ = record->base_root;
+    root_ = record->root;
+    page_numa_ids_ = record->page_numa_ids;
+    metadata_numa_id_ = record->metadata_numa_id;
+    rows_ = &record->rows;
+    // Other processes are using the row state as it is.
+    if (db_->shared()) return;
+
+    // Row IDs are handed out a page at a time from 0.
+    uint64_t row_count = 0;
+    while ((row_count >> row_id_shift_) < kFirstLevelWidth &&
+           root_[row_count >> row_id_shift_] != nullptr)
+      row_count += second_level_width_;
+    rows_->row_count = row_count;
+    rows_->lock = 0;
+    return;
+  }
+
+  base_root_ = db_->allocate_table_metadata_page(&metadata_numa_id_);
   if (base_root_ == nullptr) {
     printf("failed to allocate memory\n");
     return;
@@ -94,28 +122,30 @@ Table<StaticConfig>::Table(DB<StaticConfig>* db, uint16_t cf_count,
   assert(off % 64 == 0);
   assert(off + PagePool<StaticConfig>::kPageSize / 2 <=
          PagePool<StaticConfig>::kPageSize);
-  root_ = reinterpret_cast<char**>(base_root_ + off);
-
-  page_numa_ids_ = reinterpret_cast<uint8_t*>(db_->page_pool(0)->allocate());
+  root_ = reinterpret_cast<CXLPtr<char>*>(base_root_ + off);
 
-  lock_ = 0;
-  row_count_ = 0;
+  page_numa_ids_ = reinterpret_cast<uint8_t*>(
+      db_->page_pool(metadata_numa_id_)->allocate());
 }
 
 template <class StaticConfig>
 Table<StaticConfig>::~Table() {
+  // The pages of a durable DB stay allocated for the next attach.
+  if (db_->durable()) return;
+
   for (uint64_t i = 0; i < kFirstLevelWidth; i++)
     if (root_[i] != nullptr) db_->page_pool(page_numa_ids_[i])->free(root_[i]);
 
-  db_->page_pool(0)->free(base_root_);
+  db_->page_pool(metadata_numa_id_)->free(base_root_);
   // root_ is part of base_root_.
-  db_->page_pool(0)->free(reinterpret_cast<char*>(page_numa_ids_));
+  db_->page_pool(metadata_numa_id_)->free(
+      reinterpret_cast<char*>(page_numa_ids_));
 }
 
 template <class StaticConfig>
 bool Table<StaticConfig>::is_valid(uint16_t cf_id, uint64_t row_id) const {
-  if (row_id >= row_count_) return true;
-  auto p = root_[row_id >> row_id_shift_];
+  if (row_id >= rows_->row_count) return true;
+  char* p = root_[row_id >> row_id_shift_];
   return (p == nullptr || head(cf_id, row_id)->older_rv != nullptr);
 }
 
@@ -123,23 +153,20 @@ template <class StaticConfig>
 RowHead<StaticConfig>* Table<StaticConfig>::head(uint16_t cf_id,
                                                  uint64_t row_id) {
   auto& cf = cf_[cf_id];
-  auto p = root_[row_id >> row_id_shift_];
+  char* p = root_[row_id >> row_id_shift_];
   auto h = p + (row_id & row_id_mask_) * total_rh_size_ + cf.rh_offset;
 
   // __builtin_prefetch(h, 0, 3);
   // if (StaticConfig::kInlinedRowVersion &&
-  //     (sizeof(RowHead<StaticConfig>) + sizeof(RowVersion<StaticConfig>) +
-  //      StaticConfig::kInlineThreshold) > 64 &&
+  //     StaticConfig::kInlinedRowSize > 64 &&
   //     cf.inlining && cf.rh_size > 64)
   //   __builtin_prefetch(h + 64, 0, 3);
   // if (StaticConfig::kInlinedRowVersion &&
-  //     (sizeof(RowHead<StaticConfig>) + sizeof(RowVersion<StaticConfig>) +
-  //      StaticConfig::kInlineThreshold) > 128 &&
+  //     StaticConfig::kInlinedRowSize > 128 &&
   //     cf.inlining && cf.rh_size > 128)
   //   __builtin_prefetch(h + 128, 0, 3);
   // if (StaticConfig::kInlinedRowVersion &&
-  //     (sizeof(RowHead<StaticConfig>) + sizeof(RowVersion<StaticConfig>) +
-  //      StaticConfig::kInlineThreshold) > 192 &&
+  //     StaticConfig::kInlinedRowSize > 192 &&
   //     cf.inlining && cf.rh_size > 192)
   //   __builtin_prefetch(h + 192, 0, 3);
 
@@ -150,23 +177,20 @@ template <class StaticConfig>
 const RowHead<StaticConfig>* Table<StaticConfig>::head(uint16_t cf_id,
                                                        uint64_t row_id) const {
   auto& cf = cf_[cf_id];
-  auto p = root_[row_id >> row_id_shift_];
+  char* p = root_[row_id >> row_id_shift_];
   auto h = p + (row_id & row_id_mask_) * total_rh_size_ + cf.rh_offset;
 
   // __builtin_prefetch(h, 0, 3);
   // if (StaticConfig::kInlinedRowVersion &&
-  //     (sizeof(RowHead<StaticConfig>) + sizeof(RowVersion<StaticConfig>) +
-  //      StaticConfig::kInlineThreshold) > 64 &&
+  //     StaticConfig::kInlinedRowSize > 64 &&
   //     cf.inlining && cf.rh_size > 64)
   //   __builtin_prefetch(h + 64, 0, 3);
   // if (StaticConfig::kInlinedRowVersion &&
-  //     (sizeof(RowHead<StaticConfig>) + sizeof(RowVersion<StaticConfig>) +
-  //      StaticConfig::kInlineThreshold) > 128 &&
+  //     StaticConfig::kInlinedRowSize > 128 &&
   //     cf.inlining && cf.rh_size > 128)
   //   __builtin_prefetch(h + 128, 0, 3);
   // if (StaticConfig::kInlinedRowVersion &&
-  //     (sizeof(RowHead<StaticConfig>) + sizeof(RowVersion<StaticConfig>) +
-  //      StaticConfig::kInlineThreshold) > 192 &&
+  //     StaticConfig::kInlinedRowSize > 192 &&
   //     cf.inlining && cf.rh_size > 192)
   //   __builtin_prefetch(h + 192, 0, 3);
 
@@ -181,23 +205,20 @@ RowHead<StaticConfig>* Table<StaticConfig>::alt_head(uint16_t cf_id,
   auto alt_row_id = (row_id + 1) * 0x9ddfea08eb382d69ULL;
 
   auto& cf = cf_[cf_id];
-  auto p = root_[row_id >> row_id_shift_];
+  char* p = root_[row_id >> row_id_shift_];
   auto h = p + (alt_row_id & row_id_mask_) * total_rh_size_ + cf.rh_offset;
 
   // __builtin_prefetch(h, 0, 3);
   if (StaticConfig::kInlinedRowVersion &&
-      (sizeof(RowHead<StaticConfig>) + sizeof(RowVersion<StaticConfig>) +
-       StaticConfig::kInlineThreshold) > 64 &&
+      StaticConfig::kInlinedRowSize > 64 &&
       cf.inlining && cf.rh_size > 64)
     __builtin_prefetch(h + 64, 0, 3);
   // if (StaticConfig::kInlinedRowVersion &&
-  //     (sizeof(RowHead<StaticConfig>) + sizeof(RowVersion<StaticConfig>) +
-  //      StaticConfig::kInlineThreshold) > 128 &&
+  //     StaticConfig::kInlinedRowSize > 128 &&
   //     cf.inlining && cf.rh_size > 128)
   //   __builtin_prefetch(h + 128, 0, 3);
   // if (StaticConfig::kInlinedRowVersion &&
-  //     (sizeof(RowHead<StaticConfig>) + sizeof(RowVersion<StaticConfig>) +
-  //      StaticConfig::kInlineThreshold) > 192 &&
+  //     StaticConfig::kInlinedRowSize > 192 &&
   //     cf.inlining && cf.rh_size > 192)
   //   __builtin_prefetch(h + 192, 0, 3);
 
@@ -207,7 +228,7 @@ RowHead<StaticConfig>* Table<StaticConfig>::alt_head(uint16_t cf_id,
 template <class StaticConfig>
 RowGCInfo<StaticConfig>* Table<StaticConfig>::gc_info(uint16_t cf_id,
                                                       uint64_t row_id) {
-  auto p = root_[row_id >> row_id_shift_];
+  char* p = root_[row_id >> row_id_shift_];
   auto g = reinterpret_cast<RowGCInfo<StaticConfig>*>(
       p + second_level_width_ * total_rh_size_ +
       ((row_id & row_id_mask_) * cf_count_ + cf_id) *
@@ -231,18 +252,13 @@ bool Table<StaticConfig>::allocate_rows(Context<StaticConfig>* ctx,
                                         std::vector<uint64_t>& row_ids) {
   if (StaticConfig::kCollectProcessingStats) ctx->stats().insert_row_count++;
 
-  // Allocate a new page and initialize it.
-  uint8_t numa_id = ctx->numa_id_;
-  char* p = nullptr;
-  for (auto trial = 0; trial < db_->numa_count(); trial++) {
-    p = db_->page_pool(numa_id)->allocate();
-    if (p != nullptr) break;
-    if (++numa_id == db_->numa_count()) numa_id = 0;
-  }
+  // Allocate a new page and initialize it.  The page spills over to other
+  // nodes (eventually CXL) if the local node is exhausted.
+  uint8_t numa_id = 0;
+  char* p = db_->allocate_page(ctx->numa_id_, &numa_id);
 
   if (p == nullptr) {
     printf("failed to allocate memory\n");
-    __sync_lock_release(&lock_);
     return false;
   }
   // printf("allocated %" PRIu64 " rows\n", second_level_width_);
@@ -270,27 +286,30 @@ bool Table<StaticConfig>::allocate_rows(Context<StaticConfig>* ctx,
     }
   }
 
+  persist_page(p);
+
   // Acquire the table lock.
-  while (__sync_lock_test_and_set(&lock_, 1) == 1) ::mica::util::pause();
+  SharedLock::lock(&rows_->lock);
 
   // Assign row IDs.
-  uint64_t row_id = row_count_;
+  uint64_t row_id = rows_->row_count;
   if ((row_id >> row_id_shift_) == kFirstLevelWidth) {
     printf("maximum table size (%" PRIu64 " rows) reached\n",
            kFirstLevelWidth * second_level_width_);
     db_->page_pool(numa_id)->free(p);
-    __sync_lock_release(&lock_);
+    SharedLock::unlock(&rows_->lock);
     return false;
   }
 
   // Register the new page.
-  root_[row_id >> row_id_shift_] = p;
   page_numa_ids_[row_id >> row_id_shift_] = numa_id;
+  root_[row_id >> row_id_shift_] = p;
+  persist_root(row_id >> row_id_shift_);
 
-  row_count_ += second_level_width_;
+  rows_->row_count += second_level_width_;
 
   // Release the table lock.
-  __sync_lock_release(&lock_);
+  SharedLock::unlock(&rows_->lock);
 
   for (uint64_t i = 0; i < second_level_width_; i++) {
     // Ensure that the the last entry in the row_ids is 0. Some components such
@@ -306,12 +325,9 @@ bool Table<StaticConfig>::allocate_cxl_rows(Context<StaticConfig>* ctx,
                                            std::vector<uint64_t>& row_ids) {
   if (StaticConfig::kCollectProcessingStats) ctx->stats().insert_row_count++;
 
-  // 强制从NUMA节点1(CXL内存)分配
-  uint8_t cxl_numa_id = 1;
-  char* p = nullptr;
-
-  // 直接使用CXL内存池分配
-  p = db_->cxl_page_pool()->allocate();
+  // 强制从CXL内存分配; the placement policy picks the CXL node per page.
+  uint8_t cxl_numa_id = 0;
+  char* p = db_->allocate_cxl_page(&cxl_numa_id);
   if (p == nullptr) {
     printf("failed to allocate CXL memory\n");
     return false;
@@ -328,30 +344,34 @@ bool Table<StaticConfig>::allocate_cxl_rows(Context<StaticConfig>* ctx,
       if (StaticConfig::kInlinedRowVersion && cf.inlining) {
         auto inlined_rv = h->inlined_rv;
         inlined_rv->status = RowVersionStatus::kInvalid;
-        inlined_rv->numa_id = cxl_numa_id;  // 标记为CXL内存
+        inlined_rv->numa_id =
+            RowVersion<StaticConfig>::kInlinedRowVersionNUMAID;
         inlined_rv->size_cls = cf.inlined_rv_size_cls;
       }
     }
   }
 
+  persist_page(p);
+
   // 获取表锁并分配行ID
-  while (__sync_lock_test_and_set(&lock_, 1) == 1) ::mica::util::pause();
+  SharedLock::lock(&rows_->lock);
 
-  uint64_t row_id = row_count_;
+  uint64_t row_id = rows_->row_count;
   if ((row_id >> row_id_shift_) == kFirstLevelWidth) {
     printf("maximum CXL table size (%" PRIu64 " rows) reached\n",
            kFirstLevelWidth * second_level_width_);
-    db_->cxl_page_pool()->free(p);
-    __sync_lock_release(&lock_);
+    db_->page_pool(cxl_numa_id)->free(p);
+    SharedLock::unlock(&rows_->lock);
     return false;
   }
 
   // 注册CXL页面
+  page_numa_ids_[row_id >> row_id_shift_] = cxl_numa_id;
   root_[row_id >> row_id_shift_] = p;
-  cxl_page_numa_ids_[row_id >> row_id_shift_] = cxl_numa_id;
+  persist_root(row_id >> row_id_shift_);
 
-  row_count_ += second_level_width_;
-  __sync_lock_release(&lock_);
+  rows_->row_count += second_level_width_;
+  SharedLock::unlock(&rows_->lock);
 
   // 生成行ID列表
   for (uint64_t i = 0; i < second_level_width_; i++) {
@@ -361,6 +381,22 @@ bool Table<StaticConfig>::allocate_cxl_rows(Context<StaticConfig>* ctx,
   return true;
 }
 
+template <class StaticConfig>
+void Table<StaticConfig>::persist_page(const char* p) const {
+  if (!StaticConfig::kPersistentCXL) return;
+  // The initialized heads must be durable before the root points to them.
+  ::mica::util::write_back(p, PagePool<StaticConfig>::kPageSize);
+  ::mica::util::sfence();
+}
+
+template <class StaticConfig>
+void Table<StaticConfig>::persist_root(uint64_t i) const {
+  if (!StaticConfig::kPersistentCXL) return;
+  ::mica::util::write_back(&page_numa_ids_[i], sizeof(uint8_t));
+  ::mica::util::write_back(&root_[i], sizeof(CXLPtr<char>));
+  ::mica::util::sfence();
+}
+
 // template <class StaticConfig>
 // void Table<StaticConfig>::delete_row(Context<StaticConfig>* ctx,
 //                                      uint64_t row_id) {
@@ -383,7 +419,7 @@ bool Table<StaticConfig>::renew_rows(Context<StaticConfig>* ctx, uint16_t cf_id,
                                      uint64_t row_id_end, bool expiring_only) {
   auto& cf = cf_[cf_id];
 
-  if (row_id_end > row_count_) row_id_end = row_count_;
+  if (row_id_end > rows_->row_count) row_id_end = rows_->row_count;
 
   auto min_wts = db_->min_wts();
 
@@ -452,11 +488,11 @@ bool Table<StaticConfig>::scan(Transaction<StaticConfig>* tx, uint16_t cf_id,
                                uint64_t off, uint64_t len, const Func& f) {
   RowAccessHandlePeekOnly<StaticConfig> rah(tx);
 
-  uint64_t row_count = row_count_;
+  uint64_t row_count = rows_->row_count;
   for (uint64_t row_id = 0; row_id < row_count; row_id++) {
     if (head(cf_id, row_id)->older_rv == nullptr) continue;
 
-    if (row_id + 16 < row_count_)
+    if (row_id + 16 < rows_->row_count)
       rah.prefetch_row(this, cf_id, row_id + 16, off, len);
 
     if (!rah.peek_row(this, cf_id, row_id, false, false, false)) return false;
@@ -468,13 +504,59 @@ bool Table<StaticConfig>::scan(Transaction<StaticConfig>* tx, uint16_t cf_id,
   return true;
 }
 
+template <class StaticConfig>
+void Table<StaticConfig>::memory_usage(MemoryUsage* usage) const {
+  auto numa_count = db_->numa_count();
+  usage->page_count.assign(numa_count, 0);
+  usage->head_bytes.assign(numa_count, 0);
+  usage->inlined_rv_bytes.assign(numa_count, 0);
+  usage->gc_info_bytes.assign(numa_count, 0);
+  usage->slack_bytes.assign(numa_count, 0);
+  usage->free_row_count = 0;
+
+  uint64_t head_size = 0;
+  uint64_t inlined_rv_size = 0;
+  for (uint16_t cf_id = 0; cf_id < cf_count_; cf_id++) {
+    auto& cf = cf_[cf_id];
+    if (StaticConfig::kInlinedRowVersion && cf.inlining) {
+      head_size += sizeof(RowHead<StaticConfig>);
+      inlined_rv_size += cf.rh_size - sizeof(RowHead<StaticConfig>);
+    } else
+      head_size += cf.rh_size;
+  }
+  uint64_t gc_info_size = sizeof(RowGCInfo<StaticConfig>) * cf_count_;
+  uint64_t slack_size =
+      PagePool<StaticConfig>::kPageSize -
+      second_level_width_ * (total_rh_size_ + gc_info_size);
+
+  uint64_t row_count = rows_->row_count;
+  uint64_t page_count = row_count >> row_id_shift_;
+  for (uint64_t i = 0; i < page_count; i++) {
+    auto numa_id = page_numa_ids_[i];
+    usage->page_count[numa_id]++;
+    usage->head_bytes[numa_id] += second_level_width_ * head_size;
+    usage->inlined_rv_bytes[numa_id] += second_level_width_ * inlined_rv_size;
+    usage->gc_info_bytes[numa_id] += second_level_width_ * gc_info_size;
+    usage->slack_bytes[numa_id] += slack_size;
+  }
+
+  usage->metadata_bytes = 2 * PagePool<StaticConfig>::kPageSize;
+  usage->row_count = row_count;
+
+  for (uint16_t i = 0; i < db_->thread_count(); i++) {
+    auto& free_rows = db_->context(i)->free_rows_;
+    auto it = free_rows.find(this);
+    if (it != free_rows.end()) usage->free_row_count += it->second.size();
+  }
+}
+
 template <class StaticConfig>
 void Table<StaticConfig>::print_table_status() const {
-  uint64_t net_row_count = row_count_;
+  uint64_t net_row_count = rows_->row_count;
   for (uint16_t i = 0; i < db_->thread_count(); i++)
     net_row_count -= db_->context(i)->free_rows_[this].size();
 
-  printf("total row count: %10" PRIu64 "\n", row_count_);
+  printf("total row count: %10" PRIu64 "\n", rows_->row_count);
   printf("net row count:   %10" PRIu64 "\n", net_row_count);
 
   for (uint16_t cf_id = 0; cf_id < cf_count_; cf_id++) {
@@ -496,7 +578,7 @@ void Table<StaticConfig>::print_table_status() const {
     uint64_t total_size = 0;
     uint64_t total_net_data_size = 0;
 
-    for (uint64_t i = 0; i < row_count_; i++) {
+    for (uint64_t i = 0; i < rows_->row_count; i++) {
       uint64_t net_data_size = 0;
 
       auto h = head(cf_id, i);
@@ -505,7 +587,9 @@ void Table<StaticConfig>::print_table_status() const {
         auto rv_size =
             SharedRowVersionPool<StaticConfig>::class_to_rv_size(rv->size_cls);
 
-        if (net_data_size < rv->data_size) net_data_size = rv->data_size;
+        auto data_size =
+            rv->data_size & ~RowVersion<StaticConfig>::kEvictedFlag;
+        if (net_data_size < data_size) net_data_size = data_size;
 
         if (StaticConfig::kInlinedRowVersion && cf.inlining &&
             rv->is_inlined()) {
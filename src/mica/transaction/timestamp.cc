@@ -5,5 +5,9 @@ namespace transaction {
 
 volatile uint64_t CentralizedTimestamp::next_t2 = 0;
 
+volatile uint64_t CXLClockTimestamp::local_reference_ = 0;
+volatile uint64_t* CXLClockTimestamp::reference_ =
+    &CXLClockTimestamp::local_reference_;
+
 }
 }
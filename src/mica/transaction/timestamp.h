@@ -8,71 +8,88 @@
 
 namespace mica {
 namespace transaction {
-struct CompactTimestamp {
+// The 64-bit timestamp layout shared by CompactTimestamp and
+// CXLClockTimestamp, which differ only in how a thread's clock is derived.
+// Derived is the timestamp type itself, so that make() and the comparisons
+// take and return it.
+template <class Derived>
+struct BasicCompactTimestamp {
+  // Logical order: tsc (54 bits) | thread id (10 bits)
+  static constexpr uint64_t kThreadIDBits = 10;
+  static constexpr uint64_t kThreadIDMask = (uint64_t(1) << kThreadIDBits) - 1;
+  static constexpr uint64_t kMaxThreadCount = uint64_t(1) << kThreadIDBits;
+
   uint64_t t2;
 
-  static CompactTimestamp make(uint32_t era, uint64_t tsc, uint32_t thread_id) {
-    CompactTimestamp ts;
+  static Derived make(uint32_t era, uint64_t tsc, uint32_t thread_id) {
+    Derived ts;
     assert(era == 0);
     (void)era;
-    assert(thread_id < 256);
-    ts.t2 = (tsc << 8) | static_cast<uint64_t>(thread_id);
+    assert(thread_id < kMaxThreadCount);
+    ts.t2 = (tsc << kThreadIDBits) | static_cast<uint64_t>(thread_id);
     return ts;
   }
 
-  bool operator==(const CompactTimestamp& b) const { return t2 == b.t2; }
+  bool operator==(const Derived& b) const { return t2 == b.t2; }
 
-  bool operator!=(const CompactTimestamp& b) const { return t2 != b.t2; }
+  bool operator!=(const Derived& b) const { return t2 != b.t2; }
 
-  bool operator<(const CompactTimestamp& b) const {
+  bool operator<(const Derived& b) const {
     return static_cast<int64_t>(t2 - b.t2) < 0;
   }
 
-  bool operator<=(const CompactTimestamp& b) const {
+  bool operator<=(const Derived& b) const {
     return static_cast<int64_t>(t2 - b.t2) <= 0;
   }
 
-  bool operator>(const CompactTimestamp& b) const {
+  bool operator>(const Derived& b) const {
     return static_cast<int64_t>(t2 - b.t2) > 0;
   }
 
-  bool operator>=(const CompactTimestamp& b) const {
+  bool operator>=(const Derived& b) const {
     return static_cast<int64_t>(t2 - b.t2) >= 0;
   }
 
-  bool about_to_expire(const CompactTimestamp& unstable_ts) const {
-    return (*this < unstable_ts) &&
-           (*this >
-            CompactTimestamp{unstable_ts.t2 + (uint64_t(1) << (64 - 4))});
+  bool about_to_expire(const Derived& unstable_ts) const {
+    Derived expiry;
+    expiry.t2 = unstable_ts.t2 + (uint64_t(1) << (64 - 4));
+    return (*this < unstable_ts) && (*this > expiry);
   }
 
-  uint64_t clock_diff(const CompactTimestamp& b) const {
-    // We OR the lower 8 bits to avoid thread IDs from causing an underflow
+  // The tsc given to make().
+  uint64_t clock() const { return t2 >> kThreadIDBits; }
+
+  // The clock of a thread is derived from the local TSC only.
+  static uint64_t anchor_clock(uint64_t clock) { return clock; }
+
+  uint64_t clock_diff(const Derived& b) const {
+    // We OR the thread ID bits to avoid thread IDs from causing an underflow
     // during the subtraction.
-    return ((t2 | 0xff) - (b.t2 | 0xff)) >> 8;
+    return ((t2 | kThreadIDMask) - (b.t2 | kThreadIDMask)) >> kThreadIDBits;
   }
 };
 
-struct CompactConcurrentTimestamp {
+template <class Timestamp>
+struct BasicCompactConcurrentTimestamp {
   volatile uint64_t t2;
 
-  CompactTimestamp get() const {
-    CompactTimestamp ts;
+  Timestamp get() const {
+    Timestamp ts;
     ts.t2 = t2;
     return ts;
   }
 
-  void init(const CompactTimestamp& b) {
+  void init(const Timestamp& b) {
     // Initialize a concurrent ts (a) with b.  a is not being read by others.
     t2 = b.t2;
   }
 
-  void write(const CompactTimestamp& b) {
+  void write(const Timestamp& b) {
     // Initialize a concurrent ts (a) with b.  a may be being read by others.
     t2 = b.t2;
   };
 
-  void update(const CompactTimestamp& b) {
+  void update(const Timestamp& b) {
     // Make a concurrent ts (a) at least as large as b.
     uint64_t cts_t2 = t2;
     while (static_cast<int64_t>(cts_t2 - b.t2) < 0) {
@@ -87,9 +104,16 @@ struct CompactConcurrentTimestamp {
   }
 };
 
+struct CompactTimestamp : public BasicCompactTimestamp<CompactTimestamp> {};
+
+typedef BasicCompactConcurrentTimestamp<CompactTimestamp>
+    CompactConcurrentTimestamp;
+
 struct WideTimestamp {
   // Logical order: era (32 bits) | tsc (64 bits) | thread id (32 bits)
   //                         t1 (64 bits) | t2 (64 bits)
+  static constexpr uint64_t kMaxThreadCount = uint64_t(1) << 32;
+
   uint64_t t1;
   uint64_t t2;
 
@@ -100,6 +124,12 @@ struct WideTimestamp {
     return ts;
   }
 
+  // The tsc given to make().
+  uint64_t clock() const { return (t1 << 32) | (t2 >> 32); }
+
+  // The clock of a thread is derived from the local TSC only.
+  static uint64_t anchor_clock(uint64_t clock) { return clock; }
+
   bool operator==(const WideTimestamp& b) const {
     return t2 == b.t2 && t1 == b.t1;
   }
@@ -223,6 +253,9 @@ struct WideConcurrentTimestamp {
 };
 
 struct CentralizedTimestamp {
+  // Thread IDs are not part of the timestamp.
+  static constexpr uint64_t kMaxThreadCount = static_cast<uint64_t>(-1);
+
   uint64_t t2;
 
   static CentralizedTimestamp make(uint32_t era, uint64_t tsc,
@@ -235,6 +268,11 @@ struct CentralizedTimestamp {
     return ts;
   }
 
+  // There is no clock; the counter value stands in for it.
+  uint64_t clock() const { return t2; }
+
+  static uint64_t anchor_clock(uint64_t clock) { return clock; }
+
   bool operator==(const CentralizedTimestamp& b) const { return t2 == b.t2; }
 
   bool operator!=(const CentralizedTimestamp& b) const { return t2 != b.t2; }
@@ -301,6 +339,51 @@ struct CentralizedConcurrentTimestamp {
     }
   }
 };
+
+// A hybrid logical clock for hosts that share CXL memory but not a TSC.  The
+// layout is that of CompactTimestamp, but each thread's clock is anchored to
+// a reference counter in CXL memory (see anchor_clock()), so timestamps of
+// different hosts order within kMaxClockSkew of real time.  A DB places the
+// reference next to its min_wts with set_reference(); until then it is a
+// process-local counter.
+struct CXLClockTimestamp : public BasicCompactTimestamp<CXLClockTimestamp> {
+  // How far a clock may run ahead of the reference before it advances the
+  // reference (about 40 us @ 2.5 GHz).  A larger bound writes the shared
+  // cache line less often but lets hosts drift further apart.
+  static constexpr int64_t kMaxClockSkew = 100000;
+
+  // Returns a thread's clock anchored to the reference.  A clock behind the
+  // reference jumps to it, and one ahead of it by more than kMaxClockSkew
+  // moves it forward, so every clock stays within kMaxClockSkew of the
+  // fastest one plus the CXL access latency.  The accesses are relaxed; a
+  // stale reference only delays the jump.
+  static uint64_t anchor_clock(uint64_t clock) {
+    uint64_t ref = __atomic_load_n(reference_, __ATOMIC_RELAXED);
+    int64_t diff = static_cast<int64_t>(clock - ref);
+    if (diff < 0) return ref;
+    while (diff > kMaxClockSkew) {
+      if (__atomic_compare_exchange_n(reference_, &ref, clock, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        break;
+      // ref is now the value that another thread stored.
+      diff = static_cast<int64_t>(clock - ref);
+    }
+    return diff < 0 ? ref : clock;
+  }
+
+  static volatile uint64_t* reference() { return reference_; }
+  static void set_reference(volatile uint64_t* reference) {
+    reference_ = reference;
+  }
+  static void reset_reference() { reference_ = &local_reference_; }
+
+ private:
+  static volatile uint64_t local_reference_;
+  static volatile uint64_t* reference_;
+};
+
+typedef BasicCompactConcurrentTimestamp<CXLClockTimestamp>
+    CXLClockConcurrentTimestamp;
 }
 }
 
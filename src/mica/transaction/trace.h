@@ -0,0 +1,210 @@
+#pragma once
+#ifndef MICA_TRANSACTION_TRACE_H_
+#define MICA_TRANSACTION_TRACE_H_
+
+#include <cstdio>
+#include <cstring>
+#include "mica/common.h"
+#include "mica/util/barrier.h"
+
+namespace mica {
+namespace transaction {
+enum class TxTraceResult : uint8_t {
+  kCommitted = 0,
+  kAbortedByGetRow,
+  kAbortedByPreValidation,
+  kAbortedByDeferredRowVersionInsert,
+  kAbortedByMainValidation,
+  kAbortedByLogging,
+  kAbortedByApplication,
+  kCount,
+};
+
+static const char* const kTxTraceResultNames[] = {
+    "committed",
+    "aborted_by_get_row",
+    "aborted_by_pre_validation",
+    "aborted_by_deferred_row_version_insert",
+    "aborted_by_main_validation",
+    "aborted_by_logging",
+    "aborted_by_application",
+};
+
+// One sampled transaction attempt.  Times are raw TSC values; timestamps are
+// the low 64 bits (t2) of the transaction timestamp.
+struct TxTraceRecord {
+  uint64_t begin_time;
+  uint64_t end_time;
+  uint64_t begin_ts;
+  uint64_t commit_ts;  // 0 if aborted.
+  // The table that caused the abort, if known (an opaque ID; see
+  // TxTraceFileTable).
+  uint64_t abort_tbl;
+  uint32_t slot_idx;
+  uint16_t thread_id;
+  uint16_t access_size;
+  uint16_t rset_size;
+  uint16_t wset_size;
+  uint16_t iset_size;
+  // Version chain lengths observed by locate().
+  uint16_t locate_count;
+  uint32_t locate_chain_total;
+  uint16_t locate_chain_max;
+  uint8_t result;  // TxTraceResult
+  uint8_t peek_only;
+};
+static_assert(sizeof(TxTraceRecord) == 64, "unexpected TxTraceRecord size");
+
+// A fixed-size ring of trace records with a single writer (the owner thread).
+// Other threads may take a snapshot at any time without locking; records that
+// the writer overwrites during the snapshot are discarded.
+class TxTraceRing {
+ public:
+  TxTraceRing(uint64_t capacity) : head_(0) {
+    capacity_ = 1;
+    while (capacity_ < capacity) capacity_ <<= 1;
+    mask_ = capacity_ - 1;
+    records_ = new TxTraceRecord[capacity_];
+    ::memset(records_, 0, sizeof(TxTraceRecord) * capacity_);
+  }
+
+  ~TxTraceRing() { delete[] records_; }
+
+  uint64_t capacity() const { return capacity_; }
+
+  // The total number of records written so far.
+  uint64_t written() const { return head_; }
+
+  // Returns the record to fill for the next publish() (owner thread only).
+  TxTraceRecord* next() { return &records_[head_ & mask_]; }
+
+  void publish() {
+    ::mica::util::memory_barrier();
+    head_ = head_ + 1;
+  }
+
+  // Copies up to max_count most recent records in the written order and
+  // returns the number of records copied.
+  uint64_t snapshot(TxTraceRecord* out, uint64_t max_count) const {
+    uint64_t head = head_;
+    ::mica::util::memory_barrier();
+
+    uint64_t count = head < capacity_ ? head : capacity_;
+    if (count > max_count) count = max_count;
+    uint64_t first = head - count;
+    for (uint64_t i = 0; i < count; i++)
+      out[i] = records_[(first + i) & mask_];
+
+    // Drop the records that may have been overwritten while copying.  The
+    // writer may be filling one record past the new head.
+    ::mica::util::memory_barrier();
+    uint64_t new_head = head_;
+    if (new_head + 1 > first + capacity_) {
+      uint64_t overwritten = new_head + 1 - capacity_ - first;
+      if (overwritten >= count) return 0;
+      ::memmove(out, out + overwritten,
+                sizeof(TxTraceRecord) * (count - overwritten));
+      count -= overwritten;
+    }
+    return count;
+  }
+
+ private:
+  TxTraceRecord* records_;
+  uint64_t capacity_;
+  uint64_t mask_;
+  volatile uint64_t head_;
+};
+
+// Binary trace file layout:
+//   TxTraceFileHeader
+//   TxTraceFileTable[table_count]
+//   TxTraceRecord[record_count]
+struct TxTraceFileHeader {
+  static constexpr uint64_t kMagic = 0x3143525458414349ULL;  // "ICAXTRC1"
+
+  uint64_t magic;
+  uint64_t c_1_sec;  // TSC frequency.
+  uint64_t table_count;
+  uint64_t record_count;
+};
+
+struct TxTraceFileTable {
+  uint64_t id;
+  char name[56];
+};
+
+// Converts a binary trace file into the Chrome trace event format
+// (chrome://tracing, Perfetto).  Returns false on an I/O or format error.
+static bool tx_trace_to_chrome_json(FILE* in, FILE* out) {
+  TxTraceFileHeader header;
+  if (fread(&header, sizeof(header), 1, in) != 1 ||
+      header.magic != TxTraceFileHeader::kMagic || header.c_1_sec == 0)
+    return false;
+
+  TxTraceFileTable* tables = new TxTraceFileTable[header.table_count + 1];
+  if (fread(tables, sizeof(TxTraceFileTable), header.table_count, in) !=
+      header.table_count) {
+    delete[] tables;
+    return false;
+  }
+
+  // Use the earliest begin time as the origin to keep the numbers small.
+  long records_pos = ftell(in);
+  uint64_t origin = static_cast<uint64_t>(-1);
+  TxTraceRecord r;
+  for (uint64_t i = 0; i < header.record_count; i++) {
+    if (fread(&r, sizeof(r), 1, in) != 1) {
+      delete[] tables;
+      return false;
+    }
+    if (r.begin_time < origin) origin = r.begin_time;
+  }
+  fseek(in, records_pos, SEEK_SET);
+
+  double c_1_usec = static_cast<double>(header.c_1_sec) / 1000000.;
+
+  fprintf(out, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+  for (uint64_t i = 0; i < header.record_count; i++) {
+    if (fread(&r, sizeof(r), 1, in) != 1) {
+      delete[] tables;
+      return false;
+    }
+
+    const char* result =
+        r.result < static_cast<uint8_t>(TxTraceResult::kCount)
+            ? kTxTraceResultNames[r.result]
+            : "unknown";
+    const char* abort_tbl = "";
+    for (uint64_t j = 0; j < header.table_count; j++)
+      if (r.abort_tbl != 0 && tables[j].id == r.abort_tbl) {
+        abort_tbl = tables[j].name;
+        break;
+      }
+
+    fprintf(out,
+            "%s{\"name\": \"%s\", \"cat\": \"tx\", \"ph\": \"X\", "
+            "\"pid\": 0, \"tid\": %" PRIu16 ", \"ts\": %.3lf, \"dur\": %.3lf, "
+            "\"args\": {\"begin_ts\": %" PRIu64 ", \"commit_ts\": %" PRIu64
+            ", \"slot_idx\": %" PRIu32 ", \"peek_only\": %" PRIu8
+            ", \"access_size\": %" PRIu16 ", \"rset_size\": %" PRIu16
+            ", \"wset_size\": %" PRIu16 ", \"iset_size\": %" PRIu16
+            ", \"locate_count\": %" PRIu16 ", \"locate_chain_total\": %" PRIu32
+            ", \"locate_chain_max\": %" PRIu16
+            ", \"result\": \"%s\", \"abort_table\": \"%s\"}}",
+            i == 0 ? "" : ",\n", result, r.thread_id,
+            static_cast<double>(r.begin_time - origin) / c_1_usec,
+            static_cast<double>(r.end_time - r.begin_time) / c_1_usec,
+            r.begin_ts, r.commit_ts, r.slot_idx, r.peek_only, r.access_size,
+            r.rset_size, r.wset_size, r.iset_size, r.locate_count,
+            r.locate_chain_total, r.locate_chain_max, result, abort_tbl);
+  }
+  fprintf(out, "\n]}\n");
+
+  delete[] tables;
+  return true;
+}
+}
+}
+
+#endif
@@ -24,8 +24,14 @@ enum class Result {
   kInvalid,
 };
 
+template <class StaticConfig>
+class RowEvictor;
+
 template <class StaticConfig>
 class Transaction {
+  static_assert(!StaticConfig::kPersistentCXL || StaticConfig::kEnableSlotCommit,
+                "kPersistentCXL requires kEnableSlotCommit");
+
  public:
   typedef typename StaticConfig::Timing Timing;
   typedef typename StaticConfig::Timestamp Timestamp;
@@ -65,12 +71,22 @@ class Transaction {
     };
   };
 
+  // A row access known before execution; see declare_accesses().
+  struct DeclaredAccess {
+    Table<StaticConfig>* tbl;
+    uint16_t cf_id;
+    uint64_t row_id;
+    bool write_hint;
+  };
+
   template <class DataCopier>
   bool new_row(RAH& rah, Table<StaticConfig>* tbl, uint16_t cf_id,
                uint64_t row_id, bool check_dup_access,
                uint64_t data_size, const DataCopier& data_copier);
   void prefetch_row(Table<StaticConfig>* tbl, uint16_t cf_id, uint64_t row_id,
                     uint64_t off, uint64_t len);
+  void declare_accesses(const DeclaredAccess* accesses, uint16_t count,
+                        bool warm_gc_info = false);
   bool peek_row(RAH& rah, Table<StaticConfig>* tbl, uint16_t cf_id,
                 uint64_t row_id, bool check_dup_access, bool read_hint,
                 bool write_hint);
@@ -120,9 +136,13 @@ class Transaction {
   template <bool ForRead, bool ForWrite, bool ForValidation>
   void locate(RowCommon<StaticConfig>*& newer_rv,
               RowVersion<StaticConfig>*& rv);
+  bool locate_insert_point(RowAccessItem<StaticConfig>* item,
+                           RowVersion<StaticConfig>*& rv);
   bool insert_version_deferred();
   RowVersionStatus wait_for_pending(RowVersion<StaticConfig>* rv);
   void insert_row_deferred();
+  void request_fault_in(Table<StaticConfig>* tbl, uint16_t cf_id,
+                        uint64_t row_id, const RowVersion<StaticConfig>* stub);
 
   void reserve(Table<StaticConfig>* tbl, uint16_t cf_id, uint64_t row_id,
                bool read_hint, bool write_hint);
@@ -134,11 +154,20 @@ class Transaction {
   void update_rts();
   void write();
   void write_with_slot();
+  void persist(const volatile void* p, size_t len);
+  void persist_version(const RowVersion<StaticConfig>* rv);
+  void persist_write_set();
+  void record_intents();
 
   void maintenance();
   void backoff();
+  bool is_contention_abort() const;
+  bool acquire_slot();
+  void record_trace(bool committed);
 
  private:
+  friend RowEvictor<StaticConfig>;
+
   // transaction_impl/commit.h
   Context<StaticConfig>* ctx_;
 
@@ -159,9 +188,35 @@ class Transaction {
 
   uint8_t peek_only_;
 
+  // Lets peek_row() return eviction stubs instead of requesting a fault-in.
+  // Set only on RowEvictor's own transactions.
+  bool access_evicted_;
+
+  // Where commit and abort stats go; ctx_->stats() except for RowEvictor's
+  // transactions, which keep theirs apart from the application's.
+  Stats* stats_;
+
+  // The index of this transaction in the context's in-flight transactions.
+  uint16_t in_flight_idx_;
+
   uint64_t begin_time_;
   uint64_t* abort_reason_target_count_;
   uint64_t* abort_reason_target_time_;
+  // The table whose row caused the last abort, if known.
+  const Table<StaticConfig>* abort_tbl_;
+
+  // Per-thread backoff and tracing need abort reasons even without extra
+  // commit stats.
+  static constexpr bool kTrackAbortReason =
+      StaticConfig::kCollectExtraCommitStats ||
+      (StaticConfig::kBackoff && StaticConfig::kPerThreadBackoff) ||
+      StaticConfig::kEnableTxTrace;
+
+  // For kEnableTxTrace.  Chain lengths are collected only while traced.
+  bool traced_;
+  uint16_t trace_locate_count_;
+  uint32_t trace_locate_chain_total_;
+  uint16_t trace_locate_chain_max_;
 
   uint64_t last_commit_time_;
 
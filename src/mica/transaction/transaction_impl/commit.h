@@ -30,25 +30,23 @@ bool Transaction<StaticConfig>::begin(bool peek_only,
 
   peek_only_ = peek_only;
 
-  if (StaticConfig::kCollectExtraCommitStats) {
-    abort_reason_target_count_ = &ctx_->stats().aborted_by_application_count;
-    abort_reason_target_time_ = &ctx_->stats().aborted_by_application_time;
+  if (StaticConfig::kEnableTxTrace) {
+    traced_ = ctx_->sample_trace();
+    trace_locate_count_ = 0;
+    trace_locate_chain_total_ = 0;
+    trace_locate_chain_max_ = 0;
+  }
+
+  if (kTrackAbortReason) {
+    abort_tbl_ = nullptr;
+    abort_reason_target_count_ = &stats_->aborted_by_application_count;
+    abort_reason_target_time_ = &stats_->aborted_by_application_time;
   }
 
   while (true) {
+    auto phase_start = ctx_->phase_begin();
     ts_ = ctx_->generate_timestamp(peek_only); //分配逻辑时间戳
-
-    //新增:slot分配和初始化
-    current_slot_idx_ = ctx_->allocate_slot();
-    if (current_slot_idx_ != static_cast<uint32_t>(-1)) {
-      auto& slot = ctx_->get_slot(current_slot_idx_);
-      slot.local_tx_seq = ++ctx_->local_seq_;
-      slot.start_ts = ts_;  // 使用已生成的ts_
-      slot.commit_ts = Timestamp::make(0, 0, 0);
-      slot.state = CommitSlotState::kActive;
-      current_local_seq_ = slot.local_tx_seq;
-    }
-    //新增结束
+    ctx_->phase_end(LatencyPhase::kTimestamping, phase_start);
 
     // TODO: We should bump the clock instead of waiting for a high timestamp.
     if (causally_after_ts != nullptr) {
@@ -75,6 +73,14 @@ bool Transaction<StaticConfig>::begin(bool peek_only,
     if (!retry) break;
   }
 
+  // Peek-only transactions never write and need no commit slot; others get
+  // one here or at their first write (see acquire_slot()).
+  current_slot_idx_ = static_cast<uint32_t>(-1);
+  if (!StaticConfig::kLazySlotAllocation && !peek_only) acquire_slot();
+
+  if (StaticConfig::kMaxInterleavedTxCount > 1)
+    in_flight_idx_ = ctx_->enter_tx();
+
   if (StaticConfig::kCollectROTXStalenessStats && peek_only) { //只读事务，统计它看到的数据相对于最新版本数据的滞后时间
     auto clock_diff = ctx_->wts_.get().clock_diff(ctx_->rts_.get());
     auto diff_us = clock_diff / ctx_->db_->sw()->c_1_usec();
@@ -95,6 +101,26 @@ bool Transaction<StaticConfig>::begin(bool peek_only,
   return true;
 }
 
+template <class StaticConfig>
+bool Transaction<StaticConfig>::acquire_slot() {
+  if (current_slot_idx_ != static_cast<uint32_t>(-1)) return true;
+
+  auto phase_start = ctx_->phase_begin();
+  current_slot_idx_ = ctx_->allocate_slot();
+  if (current_slot_idx_ != static_cast<uint32_t>(-1)) {
+    auto& slot = ctx_->get_slot(current_slot_idx_);
+    slot.local_tx_seq = ++ctx_->local_seq_;
+    slot.start_ts = ts_;
+    slot.commit_ts = Timestamp::make(0, 0, 0);
+    slot.state = CommitSlotState::kActive;
+    slot.intent_count = 0;
+    current_local_seq_ = slot.local_tx_seq;
+  }
+  ctx_->phase_end(LatencyPhase::kSlotAllocation, phase_start);
+
+  return current_slot_idx_ != static_cast<uint32_t>(-1);
+}
+
 template <class StaticConfig>
 void Transaction<StaticConfig>::sort_wset() {
   // Sort the write set's rows by contention level in descending order (high
@@ -154,7 +180,7 @@ bool Transaction<StaticConfig>::check_version() {
         item->state == RowAccessState::kPeek)
       continue;
 
-    auto rv = item->newer_rv->older_rv;
+    RowVersion<StaticConfig>* rv = item->newer_rv->older_rv;
     if (item->write_rv == nullptr)
       locate<true, false, true>(item->newer_rv, rv);
     else
@@ -169,6 +195,7 @@ bool Transaction<StaticConfig>::check_version() {
                     item->state == RowAccessState::kReadWrite ||
                     item->state == RowAccessState::kDelete ||
                     item->state == RowAccessState::kReadDelete);
+      if (kTrackAbortReason) abort_tbl_ = item->tbl;
       return false;
     }
 
@@ -181,6 +208,7 @@ bool Transaction<StaticConfig>::check_version() {
                     item->state == RowAccessState::kReadWrite ||
                     item->state == RowAccessState::kDelete ||
                     item->state == RowAccessState::kReadDelete);
+      if (kTrackAbortReason) abort_tbl_ = item->tbl;
       return false;
     }
   }
@@ -228,13 +256,119 @@ void Transaction<StaticConfig>::write() {
   }
 }
 
+template <class StaticConfig>
+void Transaction<StaticConfig>::persist(const volatile void* p, size_t len) {
+  ::mica::util::write_back(p, len);
+  if (!StaticConfig::kBatchPersistFlush) ::mica::util::sfence();
+}
+
+template <class StaticConfig>
+void Transaction<StaticConfig>::persist_version(
+    const RowVersion<StaticConfig>* rv) {
+  persist(rv, sizeof(RowVersion<StaticConfig>) +
+                  (rv->data_size & ~RowVersion<StaticConfig>::kEvictedFlag));
+}
+
+template <class StaticConfig>
+void Transaction<StaticConfig>::persist_write_set() {
+  // New versions must be durable before any link to them.
+  for (auto j = 0; j < wset_size_; j++)
+    persist_version(accesses_[wset_idx_[j]].write_rv);
+  for (auto j = 0; j < iset_size_; j++) {
+    auto item = &accesses_[iset_idx_[j]];
+    if (item->state != RowAccessState::kInvalid)
+      persist_version(item->write_rv);
+  }
+  ::mica::util::sfence();
+}
+
+template <class StaticConfig>
+void Transaction<StaticConfig>::record_intents() {
+  if (wset_size_ == 0 && iset_size_ == 0) return;
+
+  auto& slot = ctx_->get_slot(current_slot_idx_);
+  auto intents = ctx_->get_slot_intents(current_slot_idx_);
+  const uint32_t capacity =
+      static_cast<uint32_t>(Context<StaticConfig>::kSlotIntentCount);
+
+  uint32_t count = 0;
+  auto add = [&](const RowAccessItem<StaticConfig>* item,
+                 SlotIntentKind kind) {
+    if (count < capacity) {
+      auto& intent = intents[count];
+      assert(item->cf_id < 256);
+      intent.row_id = item->row_id;
+      intent.table_id = item->tbl->id();
+      intent.cf_id = static_cast<uint8_t>(item->cf_id);
+      intent.kind = static_cast<uint8_t>(kind);
+    }
+    count++;
+  };
+
+  for (auto j = 0; j < wset_size_; j++) {
+    auto item = &accesses_[wset_idx_[j]];
+    add(item, item->state == RowAccessState::kDelete ||
+                      item->state == RowAccessState::kReadDelete
+                  ? SlotIntentKind::kDelete
+                  : SlotIntentKind::kWrite);
+  }
+  for (auto j = 0; j < iset_size_; j++) {
+    auto item = &accesses_[iset_idx_[j]];
+    if (item->state != RowAccessState::kInvalid)
+      add(item, SlotIntentKind::kInsert);
+  }
+
+  // Recovery falls back to a table scan for this transaction.
+  if (count > capacity) count = CommitSlot<StaticConfig>::kIntentOverflow;
+  slot.intent_count = count;
+
+  // persist_write_set() fences these before any link is written.
+  if (StaticConfig::kPersistentCXL) {
+    if (count != CommitSlot<StaticConfig>::kIntentOverflow)
+      ::mica::util::write_back(intents,
+                               count * sizeof(SlotIntent<StaticConfig>));
+    ::mica::util::write_back(&slot, sizeof(slot));
+  }
+}
+
 template <class StaticConfig>
 void Transaction<StaticConfig>::write_with_slot() {
   // 1. 获取当前事务的slot
   auto& slot = ctx_->get_slot(current_slot_idx_);
 
-  // 2. 分配commit_ts并设置为COMMITTING状态
-  slot.commit_ts = ctx_->generate_timestamp();
+  // Readers that pass the slot check wait for pending versions, and GC
+  // expects final statuses.  The slot hides the versions until the commit
+  // point, so the statuses are final before it, as insert_row_deferred() does
+  // for new rows; a crash in between leaves nothing for DB::recover() to
+  // finalize.  Once the slot is reused, the status is the only record of this
+  // commit, so it is written back as well.
+  for (auto j = 0; j < wset_size_; j++) {
+    auto item = &accesses_[wset_idx_[j]];
+    if (item->state == RowAccessState::kDelete ||
+        item->state == RowAccessState::kReadDelete)
+      item->write_rv->status = RowVersionStatus::kDeleted;
+    else
+      item->write_rv->status = RowVersionStatus::kCommitted;
+    if (StaticConfig::kPersistentCXL)
+      persist(&item->write_rv->status, sizeof(RowVersionStatus));
+  }
+  if (StaticConfig::kPersistentCXL) {
+    for (auto j = 0; j < iset_size_; j++) {
+      auto item = &accesses_[iset_idx_[j]];
+      if (item->state != RowAccessState::kInvalid)
+        persist(&item->write_rv->status, sizeof(RowVersionStatus));
+    }
+  }
+
+  // The statuses and the older_rv links written by insert_version_deferred()
+  // and insert_row_deferred() must be durable before the commit point.
+  if (StaticConfig::kPersistentCXL) ::mica::util::sfence();
+
+  // 2. 设置commit_ts并设置为COMMITTING状态
+  // The transaction is serialized at ts_, which is also the wts of its
+  // versions.  A fresh timestamp here would hide the writes from readers
+  // whose ts lies between the two even after the commit.
+  slot.commit_ts = ts_;
   slot.state = CommitSlotState::kCommitting;
 
   // 3. 使用单次CAS完成原子提交
@@ -257,6 +391,15 @@ void Transaction<StaticConfig>::write_with_slot() {
   // 4. 内存屏障确保可见性
   ::mica::util::memory_barrier();
 
+  if (StaticConfig::kPersistentCXL) {
+    ::mica::util::write_back(&slot, sizeof(slot));
+    ::mica::util::sfence();
+  }
+
+  // Publish a wts past ts_ so that min_wts (and thus peek-only readers) can
+  // cover this commit without waiting for this thread's next begin().
+  ctx_->generate_timestamp();
+
   // 5. 更新commit log
   //ctx_->commit_log_.push_back(slot.commit_ts);
 
@@ -314,10 +457,12 @@ bool Transaction<StaticConfig>::commit(Result* detail,
       // printf("ts=%" PRIu64 " max_write_rts=%" PRIu64 "\n", ts_.t2,
       //        max_write_rts.t2);
       // XXX: Hack to increment the timestamp and clock.
-      auto c = (max_write_rts.t2 >> 8) + 1;
-      ts_.t2 = (c << 8) | (ts_.t2 & 0xff);
+      constexpr uint64_t kBits = CompactTimestamp::kThreadIDBits;
+      auto c = (max_write_rts.t2 >> kBits) + 1;
+      ts_.t2 = (c << kBits) | (ts_.t2 & CompactTimestamp::kThreadIDMask);
       // printf("old clock=%" PRIu64 "\n", ctx_->adjusted_clock_);
-      ctx_->adjusted_clock_ += c - ((ctx_->adjusted_clock_ << 8) >> 8);
+      ctx_->adjusted_clock_ +=
+          c - ((ctx_->adjusted_clock_ << kBits) >> kBits);
       // printf("new clock=%" PRIu64 "\n", ctx_->adjusted_clock_);
 
       for (auto i = 0; i < access_size_; i++) {
@@ -345,12 +490,15 @@ bool Transaction<StaticConfig>::commit(Result* detail,
       t.switch_to(&Stats::pre_validation);
       if (StaticConfig::kVerbose)
         printf("pre_validation: ts=%" PRIu64 "\n", ts_.t2);
-      if (!check_version()) {
-        if (StaticConfig::kCollectExtraCommitStats) {
+      auto phase_start = ctx_->phase_begin();
+      bool valid = check_version();
+      ctx_->phase_end(LatencyPhase::kPreValidation, phase_start);
+      if (!valid) {
+        if (kTrackAbortReason) {
           abort_reason_target_count_ =
-              &ctx_->stats().aborted_by_pre_validation_count;
+              &stats_->aborted_by_pre_validation_count;
           abort_reason_target_time_ =
-              &ctx_->stats().aborted_by_pre_validation_time;
+              &stats_->aborted_by_pre_validation_time;
         }
         abort();
         if (detail != nullptr) *detail = Result::kAbortedByPreValidation;
@@ -363,12 +511,21 @@ bool Transaction<StaticConfig>::commit(Result* detail,
     t.switch_to(&Stats::deferred_row_insert);
     if (StaticConfig::kVerbose)
       printf("deferred_version_insert: ts=%" PRIu64 "\n", ts_.t2);
-    if (!insert_version_deferred()) {
-      if (StaticConfig::kCollectExtraCommitStats) {
+    if (StaticConfig::kEnableSlotCommit) record_intents();
+    if (StaticConfig::kPersistentCXL) {
+      auto persist_start = ctx_->phase_begin();
+      persist_write_set();
+      ctx_->phase_end(LatencyPhase::kPersist, persist_start);
+    }
+    auto phase_start = ctx_->phase_begin();
+    bool inserted = insert_version_deferred();
+    ctx_->phase_end(LatencyPhase::kDeferredVersionInsert, phase_start);
+    if (!inserted) {
+      if (kTrackAbortReason) {
         abort_reason_target_count_ =
-            &ctx_->stats().aborted_by_deferred_row_version_insert_count;
+            &stats_->aborted_by_deferred_row_version_insert_count;
         abort_reason_target_time_ =
-            &ctx_->stats().aborted_by_deferred_row_version_insert_time;
+            &stats_->aborted_by_deferred_row_version_insert_time;
       }
       abort();
       if (detail != nullptr)
@@ -387,12 +544,15 @@ bool Transaction<StaticConfig>::commit(Result* detail,
     t.switch_to(&Stats::main_validation);
     if (StaticConfig::kVerbose)
       printf("main_validation: ts=%" PRIu64 "\n", ts_.t2);
-    if (!check_version()) {
-      if (StaticConfig::kCollectExtraCommitStats) {
+    auto phase_start = ctx_->phase_begin();
+    bool valid = check_version();
+    ctx_->phase_end(LatencyPhase::kMainValidation, phase_start);
+    if (!valid) {
+      if (kTrackAbortReason) {
         abort_reason_target_count_ =
-            &ctx_->stats().aborted_by_main_validation_count;
+            &stats_->aborted_by_main_validation_count;
         abort_reason_target_time_ =
-            &ctx_->stats().aborted_by_main_validation_time;
+            &stats_->aborted_by_main_validation_time;
       }
       abort();
       if (detail != nullptr) *detail = Result::kAbortedByMainValidation;
@@ -404,9 +564,9 @@ bool Transaction<StaticConfig>::commit(Result* detail,
     t.switch_to(&Stats::logging);
     if (StaticConfig::kVerbose) printf("logging: ts=%" PRIu64 "\n", ts_.t2);
     if (!ctx_->db_->logger()->log(this)) {
-      if (StaticConfig::kCollectExtraCommitStats) {
-        abort_reason_target_count_ = &ctx_->stats().aborted_by_logging_count;
-        abort_reason_target_time_ = &ctx_->stats().aborted_by_logging_time;
+      if (kTrackAbortReason) {
+        abort_reason_target_count_ = &stats_->aborted_by_logging_count;
+        abort_reason_target_time_ = &stats_->aborted_by_logging_time;
       }
       abort();
       if (detail != nullptr) *detail = Result::kAbortedByLogging;
@@ -426,7 +586,16 @@ bool Transaction<StaticConfig>::commit(Result* detail,
 
     //修改:根据配置选择使用哪个write函数
     if (StaticConfig::kEnableSlotCommit) {
-      write_with_slot();  // 使用新的slot原子提交
+      if (wset_size_ != 0 || iset_size_ != 0) {
+        auto phase_start = ctx_->phase_begin();
+        write_with_slot();  // 使用新的slot原子提交
+        ctx_->phase_end(LatencyPhase::kSlotCommit, phase_start);
+      } else if (current_slot_idx_ != static_cast<uint32_t>(-1)) {
+        // Nothing was written; release the slot without a commit timestamp.
+        auto& slot = ctx_->get_slot(current_slot_idx_);
+        slot.commit_ts = ts_;
+        slot.state = CommitSlotState::kCommitted;
+      }
     } else {
       write();  // 使用原有的per-version提交
     }
@@ -444,19 +613,27 @@ bool Transaction<StaticConfig>::commit(Result* detail,
   if (StaticConfig::kCollectCommitStats) {
     auto now = ctx_->db_->sw()->now();
     auto diff = now - begin_time_;
-    ctx_->stats().tx_count++;
-    ctx_->stats().tx_time += diff;
-    ctx_->stats().committed_count++;
-    ctx_->stats().committed_time += diff;
-    if (StaticConfig::kCollectExtraCommitStats)
+    stats_->tx_count++;
+    stats_->tx_time += diff;
+    stats_->committed_count++;
+    stats_->committed_time += diff;
+    // RowEvictor's transactions stay out of the latency histograms, too.
+    if (StaticConfig::kCollectExtraCommitStats && !access_evicted_)
       ctx_->commit_latency_.update(diff / ctx_->db_->sw()->c_1_usec());
 
-    if (last_commit_time_ != 0)
+    if (last_commit_time_ != 0 && !access_evicted_)
       ctx_->inter_commit_latency_.update((now - last_commit_time_) /
                                          ctx_->db_->sw()->c_1_usec());
     last_commit_time_ = now;
   }
 
+  if (StaticConfig::kMaxInterleavedTxCount > 1) ctx_->leave_tx(in_flight_idx_);
+
+  if (StaticConfig::kEnableTxTrace && traced_) record_trace(true);
+
+  if (StaticConfig::kBackoff && StaticConfig::kPerThreadBackoff)
+    ctx_->local_backoff_.on_commit();
+
   maintenance();
 
   if (detail != nullptr) *detail = Result::kCommitted;
@@ -535,6 +712,8 @@ bool Transaction<StaticConfig>::abort(bool skip_backoff) {
 
   began_ = false;
 
+  if (StaticConfig::kMaxInterleavedTxCount > 1) ctx_->leave_tx(in_flight_idx_);
+
   if (StaticConfig::kStragglerAvoidance)
     ctx_->clock_boost_ =
         static_cast<uint64_t>(StaticConfig::kStragglerAvoidanceIncrement);
@@ -542,19 +721,25 @@ bool Transaction<StaticConfig>::abort(bool skip_backoff) {
 
   if (StaticConfig::kCollectCommitStats) {
     auto diff = ctx_->db_->sw()->now() - begin_time_;
-    ctx_->stats().tx_count++;
-    ctx_->stats().tx_time += diff;
+    stats_->tx_count++;
+    stats_->tx_time += diff;
     if (StaticConfig::kCollectExtraCommitStats) {
       (*abort_reason_target_count_)++;
       (*abort_reason_target_time_) += diff;
     } else {
-      ctx_->stats().aborted_by_main_validation_count++;
-      ctx_->stats().aborted_by_main_validation_time += diff;
+      stats_->aborted_by_main_validation_count++;
+      stats_->aborted_by_main_validation_time += diff;
     }
-    if (StaticConfig::kCollectExtraCommitStats)
+    if (StaticConfig::kCollectExtraCommitStats && !access_evicted_)
       ctx_->abort_latency_.update(diff / ctx_->db_->sw()->c_1_usec());
   }
 
+  if (StaticConfig::kEnableTxTrace && traced_) record_trace(false);
+
+  if (StaticConfig::kBackoff && StaticConfig::kPerThreadBackoff &&
+      is_contention_abort())
+    ctx_->local_backoff_.on_contention_abort(abort_tbl_);
+
   maintenance();
 
   if (StaticConfig::kBackoff && !skip_backoff) {
@@ -567,7 +752,11 @@ bool Transaction<StaticConfig>::abort(bool skip_backoff) {
 
 template <class StaticConfig>
 void Transaction<StaticConfig>::backoff() {
-  auto max_backoff_time = ctx_->db_->backoff();
+  double max_backoff_time;
+  if (StaticConfig::kPerThreadBackoff)
+    max_backoff_time = ctx_->local_backoff_.get(abort_tbl_);
+  else
+    max_backoff_time = ctx_->db_->backoff();
 
   // Ignore very small backoff time (10 cycles).
   if (max_backoff_time <= 10.) return;
@@ -602,6 +791,69 @@ void Transaction<StaticConfig>::backoff() {
   }
 }
 
+template <class StaticConfig>
+bool Transaction<StaticConfig>::is_contention_abort() const {
+  // Application and logging aborts are not caused by other transactions, so
+  // backing off would not help them.
+  auto& stats = *stats_;
+  return abort_reason_target_count_ != &stats.aborted_by_application_count &&
+         abort_reason_target_count_ != &stats.aborted_by_logging_count;
+}
+
+template <class StaticConfig>
+void Transaction<StaticConfig>::record_trace(bool committed) {
+  traced_ = false;
+
+  auto ring = ctx_->trace_ring();
+  if (ring == nullptr) return;
+
+  auto r = ring->next();
+  r->begin_time = begin_time_;
+  r->end_time = ctx_->db_->sw()->now();
+  r->begin_ts = ts_.t2;
+  r->slot_idx = current_slot_idx_;
+  r->thread_id = ctx_->thread_id_;
+  r->access_size = access_size_;
+  r->rset_size = rset_size_;
+  r->wset_size = wset_size_;
+  r->iset_size = iset_size_;
+  r->locate_count = trace_locate_count_;
+  r->locate_chain_total = trace_locate_chain_total_;
+  r->locate_chain_max = trace_locate_chain_max_;
+  r->peek_only = peek_only_;
+
+  if (committed) {
+    if (StaticConfig::kEnableSlotCommit &&
+        current_slot_idx_ != static_cast<uint32_t>(-1))
+      r->commit_ts = ctx_->get_slot(current_slot_idx_).commit_ts.t2;
+    else
+      r->commit_ts = ts_.t2;
+    r->abort_tbl = 0;
+    r->result = static_cast<uint8_t>(TxTraceResult::kCommitted);
+  } else {
+    auto& stats = *stats_;
+    auto target = abort_reason_target_count_;
+    TxTraceResult result;
+    if (target == &stats.aborted_by_get_row_count)
+      result = TxTraceResult::kAbortedByGetRow;
+    else if (target == &stats.aborted_by_pre_validation_count)
+      result = TxTraceResult::kAbortedByPreValidation;
+    else if (target == &stats.aborted_by_deferred_row_version_insert_count)
+      result = TxTraceResult::kAbortedByDeferredRowVersionInsert;
+    else if (target == &stats.aborted_by_main_validation_count)
+      result = TxTraceResult::kAbortedByMainValidation;
+    else if (target == &stats.aborted_by_logging_count)
+      result = TxTraceResult::kAbortedByLogging;
+    else
+      result = TxTraceResult::kAbortedByApplication;
+    r->commit_ts = 0;
+    r->abort_tbl = reinterpret_cast<uint64_t>(abort_tbl_);
+    r->result = static_cast<uint8_t>(result);
+  }
+
+  ring->publish();
+}
+
 template <class StaticConfig>
 void Transaction<StaticConfig>::maintenance() {
   assert(!began_);
@@ -618,7 +870,9 @@ void Transaction<StaticConfig>::maintenance() {
 
     ctx_->quiescence();
 
+    auto phase_start = ctx_->phase_begin();
     ctx_->gc(false);
+    ctx_->phase_end(LatencyPhase::kGC, phase_start);
   }
 
   if (static_cast<int64_t>(now - ctx_->last_clock_sync_) >
@@ -628,6 +882,9 @@ void Transaction<StaticConfig>::maintenance() {
 
     ctx_->synchronize_clock();
   }
+
+  auto evictor = ctx_->db_->row_evictor();
+  if (evictor != nullptr) evictor->maintenance(ctx_->thread_id_, now);
 }
 }
 }
@@ -12,6 +12,18 @@ Transaction<StaticConfig>::Transaction(Context<StaticConfig>* ctx)
   access_buckets_.resize(StaticConfig::kAccessBucketRootCount);
 
   consecutive_commits_ = 0;
+
+  access_evicted_ = false;
+  stats_ = &ctx_->stats();
+
+  abort_reason_target_count_ = nullptr;
+  abort_reason_target_time_ = nullptr;
+  abort_tbl_ = nullptr;
+
+  traced_ = false;
+
+  current_slot_idx_ = static_cast<uint32_t>(-1);
+  current_local_seq_ = 0;
 }
 
 template <class StaticConfig>
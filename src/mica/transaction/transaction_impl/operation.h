@@ -29,9 +29,9 @@ bool Transaction<StaticConfig>::new_row(RAH& rah, Table<StaticConfig>* tbl,
     row_id = ctx_->allocate_row(tbl);
     if (row_id == static_cast<uint64_t>(-1)) {
       // TODO: Use different stats counter.
-      if (StaticConfig::kCollectExtraCommitStats) {
-        abort_reason_target_count_ = &ctx_->stats().aborted_by_get_row_count;
-        abort_reason_target_time_ = &ctx_->stats().aborted_by_get_row_time;
+      if (kTrackAbortReason) {
+        abort_reason_target_count_ = &stats_->aborted_by_get_row_count;
+        abort_reason_target_time_ = &stats_->aborted_by_get_row_time;
       }
       return false;
     }
@@ -40,6 +40,11 @@ bool Transaction<StaticConfig>::new_row(RAH& rah, Table<StaticConfig>* tbl,
     if (row_id == kNewRowID) return false;
   }
 
+  if (!acquire_slot()) {
+    if (cf_id == 0) ctx_->deallocate_row(tbl, row_id);
+    return false;
+  }
+
   auto head = tbl->head(cf_id, row_id);
 
   auto write_rv =
@@ -51,9 +56,7 @@ bool Transaction<StaticConfig>::new_row(RAH& rah, Table<StaticConfig>* tbl,
   }
 
   //新增:设置slot引用
-  write_rv->writer_thread_id = ctx_->thread_id_;
-  write_rv->slot_idx = static_cast<uint16_t>(current_slot_idx_);
-  write_rv->writer_local_seq = current_local_seq_;
+  write_rv->set_writer(ctx_->thread_id_, current_slot_idx_, current_local_seq_);
   //新增结束
 
   write_rv->older_rv = nullptr;
@@ -157,6 +160,56 @@ void Transaction<StaticConfig>::prefetch_row(Table<StaticConfig>* tbl,
   }
 }
 
+template <class StaticConfig>
+void Transaction<StaticConfig>::declare_accesses(
+    const DeclaredAccess* accesses, uint16_t count, bool warm_gc_info) {
+  assert(began_);
+
+  Timing t(ctx_->timing_stack(), &Stats::execution_read);
+
+  // Each stage dereferences what the previous stage prefetched, so we issue
+  // the whole batch for one stage before moving to the next one to overlap the
+  // cache misses of all declared rows.
+
+  // Stage 1: row heads (with inlined versions) and GC info for writes.
+  for (uint16_t i = 0; i < count; i++) {
+    auto& a = accesses[i];
+    assert(a.row_id < a.tbl->row_count());
+
+    auto head = a.tbl->head(a.cf_id, a.row_id);
+    __builtin_prefetch(head, 0, 0);
+    if (StaticConfig::kInlinedRowVersion && a.tbl->inlining(a.cf_id))
+      __builtin_prefetch(head->inlined_rv->data, 0, 0);
+
+    if (warm_gc_info && a.write_hint)
+      __builtin_prefetch(a.tbl->gc_info(a.cf_id, a.row_id), 1, 0);
+  }
+
+  // Stage 2: the newest versions.
+  for (uint16_t i = 0; i < count; i++) {
+    auto& a = accesses[i];
+    auto head = a.tbl->head(a.cf_id, a.row_id);
+    auto rv = head->older_rv;
+    // Inlined versions were prefetched with the head.
+    if (rv == nullptr || rv == head->inlined_rv) continue;
+    __builtin_prefetch(rv, 0, 0);
+    __builtin_prefetch(rv->data, 0, 0);
+  }
+
+  // Stage 3: the commit slots of the writers of the newest versions.
+  auto db = ctx_->db_;
+  for (uint16_t i = 0; i < count; i++) {
+    auto& a = accesses[i];
+    auto rv = a.tbl->head(a.cf_id, a.row_id)->older_rv;
+    if (rv == nullptr) continue;
+    if (rv->writer_thread_id() >= db->thread_count() ||
+        rv->slot_idx() >= StaticConfig::kMaxSlots)
+      continue;
+    __builtin_prefetch(
+        &db->context(rv->writer_thread_id())->get_slot(rv->slot_idx()), 0, 0);
+  }
+}
+
 template <class StaticConfig>
 bool Transaction<StaticConfig>::peek_row(RAH& rah, Table<StaticConfig>* tbl,
                                          uint16_t cf_id, uint64_t row_id,
@@ -206,7 +259,7 @@ bool Transaction<StaticConfig>::peek_row(RAH& rah, Table<StaticConfig>* tbl,
     (void)alt_head;
   }
   RowCommon<StaticConfig>* newer_rv = head;
-  auto rv = head->older_rv;
+  RowVersion<StaticConfig>* rv = head->older_rv;
   // auto head_older = rv;
   // auto latest_wts = rv->wts;
 
@@ -242,9 +295,21 @@ bool Transaction<StaticConfig>::peek_row(RAH& rah, Table<StaticConfig>* tbl,
     if (StaticConfig::kReserveAfterAbort)
       reserve(tbl, cf_id, row_id, read_hint, write_hint);
 
-    if (StaticConfig::kCollectExtraCommitStats) {
-      abort_reason_target_count_ = &ctx_->stats().aborted_by_get_row_count;
-      abort_reason_target_time_ = &ctx_->stats().aborted_by_get_row_time;
+    if (kTrackAbortReason) {
+      abort_reason_target_count_ = &stats_->aborted_by_get_row_count;
+      abort_reason_target_time_ = &stats_->aborted_by_get_row_time;
+      abort_tbl_ = tbl;
+    }
+    return false;
+  }
+
+  if (rv->is_evicted() && !access_evicted_) {
+    request_fault_in(tbl, cf_id, row_id, rv);
+
+    if (kTrackAbortReason) {
+      abort_reason_target_count_ = &stats_->aborted_by_get_row_count;
+      abort_reason_target_time_ = &stats_->aborted_by_get_row_time;
+      abort_tbl_ = tbl;
     }
     return false;
   }
@@ -342,7 +407,7 @@ bool Transaction<StaticConfig>::peek_row(RAHPO& rah, Table<StaticConfig>* tbl,
     (void)alt_head;
   }
   RowCommon<StaticConfig>* newer_rv = head;
-  auto rv = head->older_rv;
+  RowVersion<StaticConfig>* rv = head->older_rv;
   // auto head_older = rv;
   // auto latest_wts = rv->wts;
 
@@ -350,6 +415,11 @@ bool Transaction<StaticConfig>::peek_row(RAHPO& rah, Table<StaticConfig>* tbl,
 
   if (rv == nullptr) return false;
 
+  if (rv->is_evicted()) {
+    request_fault_in(tbl, cf_id, row_id, rv);
+    return false;
+  }
+
   rah.tbl_ = tbl;
   rah.cf_id_ = cf_id;
   rah.row_id_ = row_id;
@@ -358,6 +428,18 @@ bool Transaction<StaticConfig>::peek_row(RAHPO& rah, Table<StaticConfig>* tbl,
   return true;
 }
 
+template <class StaticConfig>
+void Transaction<StaticConfig>::request_fault_in(
+    Table<StaticConfig>* tbl, uint16_t cf_id, uint64_t row_id,
+    const RowVersion<StaticConfig>* stub) {
+  // The row's data is on the SSD tier.  Ask RowEvictor to read it back; the
+  // caller aborts and retries once a worker has installed the row.
+  stats_->evicted_row_access_count++;
+
+  auto evictor = ctx_->db_->row_evictor();
+  if (evictor != nullptr) evictor->request_fault_in(tbl, cf_id, row_id, stub);
+}
+
 template <class StaticConfig>
 template <class DataCopier>
 bool Transaction<StaticConfig>::read_row(RAH& rah,
@@ -425,24 +507,26 @@ bool Transaction<StaticConfig>::write_row(RAH& rah, uint64_t data_size,
       item->state != RowAccessState::kRead)
     return false;
 
+  if (!acquire_slot()) return false;
+
   if (data_size == kDefaultWriteDataSize) data_size = item->read_rv->data_size;
 
   item->write_rv = ctx_->allocate_version_for_existing_row(
       item->tbl, item->cf_id, item->row_id, item->head, data_size);
 
   if (item->write_rv == nullptr) {
-    if (StaticConfig::kCollectExtraCommitStats) {
-      abort_reason_target_count_ = &ctx_->stats().aborted_by_get_row_count;
-      abort_reason_target_time_ = &ctx_->stats().aborted_by_get_row_time;
+    if (kTrackAbortReason) {
+      abort_reason_target_count_ = &stats_->aborted_by_get_row_count;
+      abort_reason_target_time_ = &stats_->aborted_by_get_row_time;
+      abort_tbl_ = item->tbl;
     }
     return false;
   }
 
   //初始化版本信息
   //新增:设置slot引用
-  item->write_rv->writer_thread_id = ctx_->thread_id_;
-  item->write_rv->slot_idx = static_cast<uint16_t>(current_slot_idx_);
-  item->write_rv->writer_local_seq = current_local_seq_;
+  item->write_rv->set_writer(ctx_->thread_id_, current_slot_idx_,
+                             current_local_seq_);
   //新增结束
 
   item->write_rv->wts = ts_;
@@ -510,8 +594,13 @@ void Transaction<StaticConfig>::locate(RowCommon<StaticConfig>*& newer_rv,
                                        RowVersion<StaticConfig>*& rv) {
   Timing t(ctx_->timing_stack(), &Stats::execution_read);
 
-  uint64_t chain_len;
-  if (StaticConfig::kCollectProcessingStats) chain_len = 0;
+  auto phase_start = ctx_->phase_begin();
+
+  // Traced transactions are sampled, so the others skip the counting.
+  bool count_chain_len = StaticConfig::kCollectProcessingStats ||
+                         (StaticConfig::kEnableTxTrace && traced_);
+
+  uint64_t chain_len = 0;
 
   while (true) { //遍历版本链，获取可见的最新版本
     // This usually should not happen because (1) a new row that can have no new
@@ -521,34 +610,33 @@ void Transaction<StaticConfig>::locate(RowCommon<StaticConfig>*& newer_rv,
     if (rv == nullptr) {
 #ifndef NDEBUG
       printf("Transaction:locate(): newer_rv=%p newer_rv->older_rv=%p rv=%p\n",
-             newer_rv, newer_rv->older_rv, rv);
+             newer_rv, newer_rv->older_rv.get(), rv);
 #endif
+      ctx_->phase_end(LatencyPhase::kLocate, phase_start);
       return;
     }
 
-    if (StaticConfig::kCollectProcessingStats) chain_len++;
+    if (count_chain_len) chain_len++;
 
 
     //新增:slot可见性检查(优先级更高)
-    auto writer_ctx = ctx_->db_->context(rv->writer_thread_id);
-    auto& slot = writer_ctx->get_slot(rv->slot_idx);
-
-    if (slot.local_tx_seq != rv->writer_local_seq) {
-      newer_rv = rv;
-      rv = rv->older_rv;
-      continue;
-    }
-
-    if (slot.state != CommitSlotState::kCommitted) {
-      newer_rv = rv;
-      rv = rv->older_rv;
-      continue;
-    }
+    auto writer_ctx = ctx_->db_->context(rv->writer_thread_id());
+    auto& slot = writer_ctx->get_slot(rv->slot_idx());
+
+    // A reused slot (seq mismatch) finished before every active snapshot
+    // (see Context::allocate_slot()), so the version's own status is final.
+    if (rv->is_writer_seq(slot.local_tx_seq)) {
+      if (slot.state != CommitSlotState::kCommitted) {
+        newer_rv = rv;
+        rv = rv->older_rv;
+        continue;
+      }
 
-    if (slot.commit_ts >= ts_) {
-      newer_rv = rv;
-      rv = rv->older_rv;
-      continue;
+      if (slot.commit_ts >= ts_) {
+        newer_rv = rv;
+        rv = rv->older_rv;
+        continue;
+      }
     }
 
   //保留原有的可见性判断
@@ -594,8 +682,9 @@ void Transaction<StaticConfig>::locate(RowCommon<StaticConfig>*& newer_rv,
       printf(
           "Transaction:locate(): newer_rv=%p newer_rv->older_rv=%p rv=%p "
           "rv->older_rv=%p\n",
-          newer_rv, newer_rv->older_rv, rv, rv->older_rv);
+          newer_rv, newer_rv->older_rv.get(), rv, rv->older_rv.get());
       rv = nullptr;
+      ctx_->phase_end(LatencyPhase::kLocate, phase_start);
       return;
     }
 #endif
@@ -608,9 +697,18 @@ void Transaction<StaticConfig>::locate(RowCommon<StaticConfig>*& newer_rv,
     if (rv != nullptr && rv->rts.get() > ts_) rv = nullptr;
   }
 
+  ctx_->phase_end(LatencyPhase::kLocate, phase_start);
+
   if (StaticConfig::kCollectProcessingStats) {
-    if (ctx_->stats().max_read_chain_len < chain_len)
-      ctx_->stats().max_read_chain_len = chain_len;
+    if (stats_->max_read_chain_len < chain_len)
+      stats_->max_read_chain_len = chain_len;
+  }
+
+  if (StaticConfig::kEnableTxTrace && traced_) {
+    trace_locate_count_++;
+    trace_locate_chain_total_ += static_cast<uint32_t>(chain_len);
+    if (trace_locate_chain_max_ < chain_len)
+      trace_locate_chain_max_ = static_cast<uint16_t>(chain_len);
   }
 }
 
@@ -630,63 +728,114 @@ RowVersionStatus Transaction<StaticConfig>::wait_for_pending(
   return status;
 }
 
+template <class StaticConfig>
+bool Transaction<StaticConfig>::locate_insert_point(
+    RowAccessItem<StaticConfig>* item, RowVersion<StaticConfig>*& rv) {
+  rv = item->newer_rv->older_rv; //从newer_rv->older_rv出发，开始遍历目标行的版本链，查找插入点
+  if (item->state == RowAccessState::kReadWrite ||
+      item->state == RowAccessState::kReadDelete) { //如果是 ReadWrite，需要确认 read_rv 没被并发修改
+    locate<true, true, false>(item->newer_rv, rv);
+    // Read version changed; abort here without going to validation.
+    if (rv != item->read_rv) {
+      if (StaticConfig::kReserveAfterAbort)
+        reserve(item->tbl, item->cf_id, item->row_id, true, true);
+      if (kTrackAbortReason) abort_tbl_ = item->tbl;
+      return false; //读集检测不通过
+    }
+  } else { //没读过直接写
+    assert(item->state == RowAccessState::kWrite ||
+           item->state == RowAccessState::kDelete);
+    locate<false, true, false>(item->newer_rv, rv);
+    /*'''
+    找到版本时间戳 ≤ 当前事务时间戳（rv->wts < ts_） 的最近版本；
+
+    如果版本 status == kCommitted，就接受；
+
+    如果版本 status == kPending：
+
+    如果配置允许等待，会挂起；
+
+    否则返回 nullptr（表示 abort）；
+    '''*/
+  }
+  if (rv == nullptr) {  //没找到符合要求的版本
+    if (StaticConfig::kReserveAfterAbort)
+      reserve(item->tbl, item->cf_id, item->row_id, false, true);
+    if (kTrackAbortReason) abort_tbl_ = item->tbl;
+    return false;
+  }
+  return true;
+}
+
 template <class StaticConfig>
 bool Transaction<StaticConfig>::insert_version_deferred() {
+  // With kPersistentCXL, a new version must lead to older versions before the
+  // row links to it, because a crash may leave that link durable.
+  // kBatchPersistFlush writes back the older_rv of every new version first
+  // and fences once; a row that got another version in the meantime is
+  // linked again with a fence of its own.
+  constexpr bool kBatchLinks =
+      StaticConfig::kPersistentCXL && StaticConfig::kBatchPersistFlush;
+  RowVersion<StaticConfig>* located_rvs[kBatchLinks
+                                            ? StaticConfig::kMaxAccessSize
+                                            : 1];
+  if (kBatchLinks) {
+    for (auto j = 0; j < wset_size_; j++) {
+      auto item = &accesses_[wset_idx_[j]];
+      if (!locate_insert_point(item, located_rvs[j])) return false;
+      item->write_rv->older_rv = item->newer_rv->older_rv;
+      ::mica::util::write_back(&item->write_rv->older_rv,
+                               sizeof(item->write_rv->older_rv));
+    }
+    ::mica::util::sfence();
+  }
+
   for (auto j = 0; j < wset_size_; j++) { //遍历写集
     auto i = wset_idx_[j];
     auto item = &accesses_[i];
     assert(item->write_rv != nullptr);
 
+    bool located = kBatchLinks;
     while (true) {
-      auto rv = item->newer_rv->older_rv; //从newer_rv->older_rv出发，开始遍历目标行的版本链，查找插入点
-      if (item->state == RowAccessState::kReadWrite ||
-          item->state == RowAccessState::kReadDelete) { //如果是 ReadWrite，需要确认 read_rv 没被并发修改
-        locate<true, true, false>(item->newer_rv, rv);
-        // Read version changed; abort here without going to validation.
-        if (rv != item->read_rv) {
-          if (StaticConfig::kReserveAfterAbort)
-            reserve(item->tbl, item->cf_id, item->row_id, true, true);
-          return false; //读集检测不通过
-        }
-      } else { //没读过直接写
-        assert(item->state == RowAccessState::kWrite ||
-               item->state == RowAccessState::kDelete);
-        locate<false, true, false>(item->newer_rv, rv);
-        /*'''
-        找到版本时间戳 ≤ 当前事务时间戳（rv->wts < ts_） 的最近版本；
-
-        如果版本 status == kCommitted，就接受；
-
-        如果版本 status == kPending：
-
-        如果配置允许等待，会挂起；
-
-        否则返回 nullptr（表示 abort）；
-        '''*/
-      }
-      if (rv == nullptr) {  //没找到符合要求的版本
-        if (StaticConfig::kReserveAfterAbort)
-          reserve(item->tbl, item->cf_id, item->row_id, false, true);
+      RowVersion<StaticConfig>* rv;
+      if (located)
+        rv = located_rvs[j];
+      else if (!locate_insert_point(item, rv))
         return false;
-      }
 
       auto older_rv = item->newer_rv->older_rv;
 
       // It seems that newer_rv got a new older_rv node.  We need to find
       // the new value for rv.
-      if (older_rv->wts > ts_) continue;
+      if (older_rv->wts > ts_) {
+        located = false;
+        continue;
+      }
 
-      item->write_rv->older_rv = older_rv;
+      if (!located || item->write_rv->older_rv != older_rv) {
+        item->write_rv->older_rv = older_rv;
+        // A crash may leave the link below durable; the version must lead to
+        // older versions by then.
+        if (StaticConfig::kPersistentCXL) {
+          ::mica::util::write_back(&item->write_rv->older_rv,
+                                   sizeof(item->write_rv->older_rv));
+          ::mica::util::sfence();
+        }
+      }
+      located = false;
 
       // auto actual_older_rv = __sync_val_compare_and_swap(
       //     &item->newer_rv->older_rv, older_rv, item->write_rv);
       //
       // // Found a newly inserted version that could be used as a read version.
       // if (older_rv != actual_older_rv) continue;
-      if (!__sync_bool_compare_and_swap(&item->newer_rv->older_rv, older_rv,
-                                        item->write_rv)) //CAS尝试把 RowHead 从 rv 替换为 write_rv
+      if (!item->newer_rv->older_rv.compare_and_swap(older_rv,
+                                                     item->write_rv)) //CAS尝试把 RowHead 从 rv 替换为 write_rv
         continue;
 
+      if (StaticConfig::kPersistentCXL)
+        persist(&item->newer_rv->older_rv, sizeof(item->newer_rv->older_rv));
+
       // Mark the write set item that this row version is visible.
       item->inserted = 1;
 
@@ -719,6 +868,8 @@ void Transaction<StaticConfig>::insert_row_deferred() {
     assert(item->write_rv != nullptr);
     item->head->older_rv = item->write_rv;
     item->write_rv->status = RowVersionStatus::kCommitted; //将新版本标记为committed
+    if (StaticConfig::kPersistentCXL)
+      persist(&item->head->older_rv, sizeof(item->head->older_rv));
 
     item->inserted = 1;
   }
@@ -18,12 +18,64 @@ static void pause() { asm volatile("pause"); }
 
 static void clflush(volatile void* p) { asm volatile("clflush (%0)" ::"r"(p)); }
 
+// Encoded by hand for assemblers without the mnemonics.
+static void clflushopt(volatile void* p) {
+  asm volatile(".byte 0x66; clflush (%0)" ::"r"(p) : "memory");
+}
+
+static void clwb(volatile void* p) {
+  asm volatile(".byte 0x66; xsaveopt (%0)" ::"r"(p) : "memory");
+}
+
 static void cpuid(unsigned int* eax, unsigned int* ebx, unsigned int* ecx,
                   unsigned int* edx) {
   asm volatile("cpuid"
                : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
                : "0"(*eax), "2"(*ecx));
 }
+
+enum class WriteBackInsn : uint8_t {
+  kClflush = 0,
+  kClflushopt,
+  kClwb,
+};
+
+static WriteBackInsn detect_write_back_insn() {
+  unsigned int eax = 0, ebx, ecx = 0, edx;
+  cpuid(&eax, &ebx, &ecx, &edx);
+  if (eax < 7) return WriteBackInsn::kClflush;
+
+  eax = 7;
+  ecx = 0;
+  cpuid(&eax, &ebx, &ecx, &edx);
+  if (ebx & (1u << 24)) return WriteBackInsn::kClwb;
+  if (ebx & (1u << 23)) return WriteBackInsn::kClflushopt;
+  return WriteBackInsn::kClflush;
+}
+
+// Writes back the cache lines covering [p, p + len) to memory with the best
+// instruction the CPU has.  clwb and clflushopt are weakly ordered; issue
+// sfence() before depending on the write-back.
+static void write_back(const volatile void* p, size_t len) {
+  static const WriteBackInsn insn = detect_write_back_insn();
+
+  auto addr = reinterpret_cast<uintptr_t>(p) & ~uintptr_t(63);
+  auto end = reinterpret_cast<uintptr_t>(p) + len;
+  for (; addr < end; addr += 64) {
+    auto line = reinterpret_cast<volatile void*>(addr);
+    switch (insn) {
+      case WriteBackInsn::kClwb:
+        clwb(line);
+        break;
+      case WriteBackInsn::kClflushopt:
+        clflushopt(line);
+        break;
+      default:
+        clflush(line);
+        break;
+    }
+  }
+}
 }
 }
 
@@ -0,0 +1,109 @@
+#pragma once
+#ifndef MICA_UTIL_HISTOGRAM_H_
+#define MICA_UTIL_HISTOGRAM_H_
+
+#include <cstdio>
+#include <algorithm>
+#include "mica/common.h"
+#include "mica/util/memcpy.h"
+
+namespace mica {
+namespace util {
+// A log-linear (HDR-style) histogram for raw TSC cycle counts.
+//
+// Values below kSubBucketCount are recorded exactly.  Larger values are
+// grouped by their most significant bit and then split into kSubBucketCount
+// linear sub-buckets, which keeps the relative error below
+// 1 / kSubBucketCount (about 3%) over the whole 64-bit range.  Unlike Latency,
+// sub-microsecond values remain distinguishable and there is no overflow bin.
+//
+// Each thread should own its instance; use operator+= to merge them.
+class Histogram {
+ public:
+  static constexpr uint64_t kSubBucketBits = 5;
+  static constexpr uint64_t kSubBucketCount = uint64_t(1) << kSubBucketBits;
+  static constexpr uint64_t kBucketCount =
+      (65 - kSubBucketBits) * kSubBucketCount;
+
+  Histogram() { reset(); }
+
+  void reset() { ::mica::util::memset(this, 0, sizeof(Histogram)); }
+
+  void update(uint64_t v) {
+    bins_[index(v)]++;
+    count_++;
+    sum_ += v;
+    if (count_ == 1 || v < min_) min_ = v;
+    if (v > max_) max_ = v;
+  }
+
+  Histogram& operator+=(const Histogram& o) {
+    if (o.count_ == 0) return *this;
+    for (uint64_t i = 0; i < kBucketCount; i++) bins_[i] += o.bins_[i];
+    if (count_ == 0 || o.min_ < min_) min_ = o.min_;
+    if (o.max_ > max_) max_ = o.max_;
+    count_ += o.count_;
+    sum_ += o.sum_;
+    return *this;
+  }
+
+  uint64_t count() const { return count_; }
+  uint64_t sum() const { return sum_; }
+  uint64_t min() const { return min_; }
+  uint64_t max() const { return max_; }
+
+  uint64_t avg() const { return sum_ / std::max(uint64_t(1), count_); }
+
+  double avg_f() const {
+    return static_cast<double>(sum_) /
+           static_cast<double>(std::max(uint64_t(1), count_));
+  }
+
+  // Returns the upper bound of the bucket that contains the p-th quantile,
+  // clamped to the observed range.
+  uint64_t perc(double p) const {
+    if (count_ == 0) return 0;
+    int64_t thres = static_cast<int64_t>(p * static_cast<double>(count_));
+    for (uint64_t i = 0; i < kBucketCount; i++)
+      if ((thres -= static_cast<int64_t>(bins_[i])) < 0)
+        return std::max(min_, std::min(max_, upper_bound(i)));
+    return max_;
+  }
+
+  void print(FILE* fp) const {
+    for (uint64_t i = 0; i < kBucketCount; i++)
+      if (bins_[i] != 0)
+        fprintf(fp, "%10" PRIu64 " %10" PRIu64 "\n", lower_bound(i), bins_[i]);
+  }
+
+ private:
+  static uint64_t index(uint64_t v) {
+    if (v < kSubBucketCount) return v;
+    uint64_t shift =
+        static_cast<uint64_t>(63 - __builtin_clzll(v)) - kSubBucketBits;
+    // (v >> shift) is in [kSubBucketCount, 2 * kSubBucketCount).
+    return shift * kSubBucketCount + (v >> shift);
+  }
+
+  static uint64_t lower_bound(uint64_t i) {
+    if (i < 2 * kSubBucketCount) return i;
+    uint64_t shift = i / kSubBucketCount - 1;
+    return (kSubBucketCount + i % kSubBucketCount) << shift;
+  }
+
+  static uint64_t upper_bound(uint64_t i) {
+    if (i < 2 * kSubBucketCount) return i;
+    uint64_t shift = i / kSubBucketCount - 1;
+    return lower_bound(i) + ((uint64_t(1) << shift) - 1);
+  }
+
+  uint64_t bins_[kBucketCount];
+  uint64_t count_;
+  uint64_t sum_;
+  uint64_t min_;
+  uint64_t max_;
+};
+}
+}
+
+#endif